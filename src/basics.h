@@ -1,10 +1,15 @@
 /* basics.h
  *
- * Declaration of basic types.
+ * Declaration and inline definition of basic types.
  *
  *   - Vector3 is a three tuple vector of x, y, and z.
  *   - Ray is a vector plus a direction.
  *   - Color is a four tuple of red, green, blue, and alpha.
+ *   - AABB is an axis-aligned bounding box given by its minimum and maximum corners.
+ *
+ * These are used in every inner loop of the renderer, so everything short is defined here where the compiler can
+ * inline it. Building with CHARLES_SIMD_SSE defined (scons SIMD=sse or SIMD=avx) implements Vector3 and Color
+ * arithmetic with SSE4.1 intrinsics. Otherwise it's plain scalar code, which can be evaluated at compile time.
  *
  * Eryn Wells <eryn@erynwells.me>
  */
@@ -12,32 +17,45 @@
 #ifndef __BASICS_H__
 #define __BASICS_H__
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
+#if defined(CHARLES_SIMD_SSE)
+#include <smmintrin.h>
+#define BASICS_ALIGN alignas(16)
+#define BASICS_CONSTEXPR inline
+#else
+#define BASICS_ALIGN
+#define BASICS_CONSTEXPR constexpr
+#endif
+
 
-struct Vector3
+struct BASICS_ALIGN Vector3
 {
-    Vector3();
-    Vector3(float x, float y, float z);
+    constexpr Vector3();
+    constexpr Vector3(float x, float y, float z);
 
-    Vector3 &operator=(const Vector3 &v);
     Vector3 &operator*=(const float &rhs);
     Vector3 &operator/=(const float &rhs);
     Vector3 &operator+=(const Vector3 &rhs);
     Vector3 &operator-=(const Vector3 &rhs);
-    Vector3 operator*(const float &rhs) const;
-    Vector3 operator/(const float &rhs) const;
-    Vector3 operator+(const Vector3 &rhs) const;
-    Vector3 operator-(const Vector3 &rhs) const;
-    Vector3 operator-() const;
+    BASICS_CONSTEXPR Vector3 operator*(const float &rhs) const;
+    BASICS_CONSTEXPR Vector3 operator/(const float &rhs) const;
+    BASICS_CONSTEXPR Vector3 operator+(const Vector3 &rhs) const;
+    BASICS_CONSTEXPR Vector3 operator-(const Vector3 &rhs) const;
+    BASICS_CONSTEXPR Vector3 operator-() const;
 
-    bool operator==(const Vector3 &rhs) const;
-    bool operator!=(const Vector3 &rhs) const;
+    BASICS_CONSTEXPR bool operator==(const Vector3 &rhs) const;
+    BASICS_CONSTEXPR bool operator!=(const Vector3 &rhs) const;
 
-    float length2() const;
+    // Component access by axis index: 0 is x, 1 is y, 2 is z.
+    constexpr float operator[](const int &axis) const;
+
+    BASICS_CONSTEXPR float length2() const;
     float length() const;
-    float dot(const Vector3 &v) const;
-    Vector3 cross(const Vector3 &v) const;
+    BASICS_CONSTEXPR float dot(const Vector3 &v) const;
+    BASICS_CONSTEXPR Vector3 cross(const Vector3 &v) const;
 
     Vector3 &normalize();
 
@@ -46,18 +64,27 @@ struct Vector3
     static const Vector3 X, Y, Z;
 
     float x, y, z;
+
+#if defined(CHARLES_SIMD_SSE)
+    // Pads the vector out to a full SSE register. Its value is never looked at.
+    float w;
+
+    explicit Vector3(__m128 v);
+    __m128 to_m128() const;
+#endif
 };
 
-const Vector3 operator*(const float &lhs, const Vector3 &rhs);
+BASICS_CONSTEXPR Vector3 operator*(const float &lhs, const Vector3 &rhs);
 std::ostream &operator<<(std::ostream &os, const Vector3 &v);
 
 
 struct Ray
 {
-    Ray();
-    Ray(Vector3 o, Vector3 d);
+    constexpr Ray();
+    constexpr Ray(Vector3 o, Vector3 d);
 
-    Vector3 parameterize(const float t) const;
+    BASICS_CONSTEXPR Vector3 parameterize(const float t) const;
+    Vector3 compute_inverse_direction() const;
 
     Vector3 origin, direction;
 };
@@ -65,32 +92,30 @@ struct Ray
 std::ostream &operator<<(std::ostream &os, const Ray &r);
 
 
-struct Color
+struct BASICS_ALIGN Color
 {
-    Color();
-    Color(const float &r, const float &g, const float &b);
-    Color(const float &r, const float &g, const float &b, const float &a);
+    constexpr Color();
+    constexpr Color(const float &r, const float &g, const float &b);
+    constexpr Color(const float &r, const float &g, const float &b, const float &a);
 
     Color &operator*=(const float &rhs);
     Color &operator/=(const float &rhs);
     Color &operator+=(const float &rhs);
     Color &operator-=(const float &rhs);
-    Color operator*(const float &rhs) const;
-    Color operator/(const float &rhs) const;
-    Color operator+(const float &rhs) const;
-    Color operator-(const float &rhs) const;
-
-    Color &operator=(const Color &rhs);
+    BASICS_CONSTEXPR Color operator*(const float &rhs) const;
+    BASICS_CONSTEXPR Color operator/(const float &rhs) const;
+    BASICS_CONSTEXPR Color operator+(const float &rhs) const;
+    BASICS_CONSTEXPR Color operator-(const float &rhs) const;
 
     // These operators blend the two colors.
     Color &operator*=(const Color &rhs);
     Color &operator/=(const Color &rhs);
     Color &operator+=(const Color &rhs);
     Color &operator-=(const Color &rhs);
-    Color operator*(const Color &rhs) const;
-    Color operator/(const Color &rhs) const;
-    Color operator+(const Color &rhs) const;
-    Color operator-(const Color &rhs) const;
+    BASICS_CONSTEXPR Color operator*(const Color &rhs) const;
+    BASICS_CONSTEXPR Color operator/(const Color &rhs) const;
+    BASICS_CONSTEXPR Color operator+(const Color &rhs) const;
+    BASICS_CONSTEXPR Color operator-(const Color &rhs) const;
 
     static const Color Black;
     static const Color White;
@@ -99,9 +124,892 @@ struct Color
     static const Color Blue;
 
     float red, green, blue, alpha;
+
+#if defined(CHARLES_SIMD_SSE)
+    explicit Color(__m128 v);
+    __m128 to_m128() const;
+#endif
 };
 
-const Color operator*(const float &lhs, const Color &rhs);
+BASICS_CONSTEXPR Color operator*(const float &lhs, const Color &rhs);
 std::ostream &operator<<(std::ostream &os, const Color &c);
 
+
+struct AABB
+{
+    AABB();
+    constexpr AABB(const Vector3 &mn, const Vector3 &mx);
+
+    bool is_empty() const;
+    BASICS_CONSTEXPR Vector3 centroid() const;
+    BASICS_CONSTEXPR Vector3 extent() const;
+    float surface_area() const;
+    int longest_axis() const;
+
+    AABB &extend(const Vector3 &p);
+    AABB &extend(const AABB &b);
+
+    /*
+     * Slab test against a ray. inv_direction is the ray's Ray::compute_inverse_direction(); callers testing many boxes
+     * against the same ray should compute it once. Returns true if the box overlaps [tmin, tmax] along the ray, and
+     * stores the entry distance in tnear.
+     */
+    bool intersect(const Ray &ray, const Vector3 &inv_direction, float tmin, float tmax, float &tnear) const;
+
+    /*
+     * Slab distances are each off by at most 3 roundings, a relative error of gamma(3) = 3u / (1 - 3u) with u = 2^-24.
+     * Scaling exit distances by 1 + 2 gamma(3) covers the error in both ends of the interval, so rays grazing an edge
+     * or corner are never culled by a box that, exactly, they hit. Watertight primitives depend on that.
+     */
+    static constexpr float ExitScale = 1.00000036f;
+
+    Vector3 min, max;
+};
+
+std::ostream &operator<<(std::ostream &os, const AABB &b);
+
+#pragma mark - Vectors
+
+/*
+ * Vector3::Vector3 --
+ *
+ * Default constructor. Create a zero vector.
+ */
+constexpr
+Vector3::Vector3()
+    : Vector3(0.0, 0.0, 0.0)
+{ }
+
+
+/*
+ * Vector3::Vector3 --
+ *
+ * Constructor. Create a vector consisting of the given coordinates.
+ */
+constexpr
+Vector3::Vector3(float _x, float _y, float _z)
+#if defined(CHARLES_SIMD_SSE)
+    : x(_x), y(_y), z(_z), w(0.0)
+#else
+    : x(_x), y(_y), z(_z)
+#endif
+{ }
+
+
+/*
+ * Vector3::operator[] --
+ *
+ * Return the component of this vector along the given axis.
+ */
+constexpr float
+Vector3::operator[](const int &axis)
+    const
+{
+    return (axis == 0) ? x : ((axis == 1) ? y : z);
+}
+
+
+#if defined(CHARLES_SIMD_SSE)
+
+/*
+ * Vector3::Vector3 --
+ * Vector3::to_m128 --
+ *
+ * Convert between vectors and SSE registers. The fourth lane is the padding component.
+ */
+inline
+Vector3::Vector3(__m128 v)
+{
+    _mm_store_ps(&x, v);
+}
+
+inline __m128
+Vector3::to_m128()
+    const
+{
+    return _mm_load_ps(&x);
+}
+
+
+inline Vector3 &
+Vector3::operator*=(const float &rhs)
+{
+    return *this = Vector3(_mm_mul_ps(to_m128(), _mm_set1_ps(rhs)));
+}
+
+inline Vector3 &
+Vector3::operator/=(const float &rhs)
+{
+    return *this *= (1.0f / rhs);
+}
+
+inline Vector3 &
+Vector3::operator+=(const Vector3 &rhs)
+{
+    return *this = Vector3(_mm_add_ps(to_m128(), rhs.to_m128()));
+}
+
+inline Vector3 &
+Vector3::operator-=(const Vector3 &rhs)
+{
+    return *this = Vector3(_mm_sub_ps(to_m128(), rhs.to_m128()));
+}
+
+
+inline Vector3
+Vector3::operator-()
+    const
+{
+    return Vector3(_mm_xor_ps(to_m128(), _mm_set1_ps(-0.0f)));
+}
+
+
+inline bool
+Vector3::operator==(const Vector3 &rhs)
+    const
+{
+    // Only the low three lanes count.
+    return (_mm_movemask_ps(_mm_cmpeq_ps(to_m128(), rhs.to_m128())) & 0x7) == 0x7;
+}
+
+
+inline float
+Vector3::dot(const Vector3 &v)
+    const
+{
+    // Multiply lanes 0-2, sum them, and put the result in lane 0.
+    return _mm_cvtss_f32(_mm_dp_ps(to_m128(), v.to_m128(), 0x71));
+}
+
+
+inline Vector3
+Vector3::cross(const Vector3 &v)
+    const
+{
+    // (a.yzx * b.zxy) - (a.zxy * b.yzx)
+    const __m128 a = to_m128();
+    const __m128 b = v.to_m128();
+    const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+    const __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+    return Vector3(_mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx)));
+}
+
+#else
+
+/*
+ * Vector3::operator*= --
+ * Vector3::operator/= --
+ * Vector3::operator+= --
+ * Vector3::operator-= --
+ *
+ * Perform the corresponding arithmetic operation on this vector and the given vector. These methods are destructive and
+ * a reference to this vector is returned.
+ */
+inline Vector3 &
+Vector3::operator*=(const float &rhs)
+{
+    x *= rhs;
+    y *= rhs;
+    z *= rhs;
+    return *this;
+}
+
+inline Vector3 &
+Vector3::operator/=(const float &rhs)
+{
+    return *this *= (1.0f / rhs);
+}
+
+inline Vector3 &
+Vector3::operator+=(const Vector3 &rhs)
+{
+    x += rhs.x;
+    y += rhs.y;
+    z += rhs.z;
+    return *this;
+}
+
+inline Vector3 &
+Vector3::operator-=(const Vector3 &rhs)
+{
+    x -= rhs.x;
+    y -= rhs.y;
+    z -= rhs.z;
+    return *this;
+}
+
+
+/*
+ * Vector3::operator- --
+ *
+ * Negate this vector. Return a new vector.
+ */
+constexpr Vector3
+Vector3::operator-()
+    const
+{
+    return Vector3(-x, -y, -z);
+}
+
+
+/*
+ * Vector3::operator== --
+ *
+ * Compute boolean equality of this and the given vectors.
+ */
+constexpr bool
+Vector3::operator==(const Vector3 &rhs)
+    const
+{
+    return x == rhs.x && y == rhs.y && z == rhs.z;
+}
+
+
+/*
+ * Vector3::dot --
+ *
+ * Compute and return the dot product of this and the given vectors.
+ */
+constexpr float
+Vector3::dot(const Vector3 &v)
+    const
+{
+    return x*v.x + y*v.y + z*v.z;
+}
+
+
+/*
+ * Vector3::cross --
+ *
+ * Compute and return the cross product of this and the given vectors.
+ */
+constexpr Vector3
+Vector3::cross(const Vector3 &v)
+    const
+{
+    return Vector3(y*v.z - z*v.y, z*v.x - x*v.z, x*v.y - y*v.x);
+}
+
+#endif /* CHARLES_SIMD_SSE */
+
+
+/*
+ * Vector3::operator* --
+ * Vector3::operator/ --
+ * Vector3::operator+ --
+ * Vector3::operator- --
+ *
+ * Perform the corresponding operation on a copy of this vector. Return a new vector. Division multiplies by the
+ * reciprocal, same as operator/=.
+ */
+BASICS_CONSTEXPR Vector3
+Vector3::operator*(const float &rhs)
+    const
+{
+#if defined(CHARLES_SIMD_SSE)
+    return Vector3(*this) *= rhs;
+#else
+    return Vector3(x * rhs, y * rhs, z * rhs);
+#endif
+}
+
+BASICS_CONSTEXPR Vector3
+Vector3::operator/(const float &rhs)
+    const
+{
+    return *this * (1.0f / rhs);
+}
+
+BASICS_CONSTEXPR Vector3
+Vector3::operator+(const Vector3 &rhs)
+    const
+{
+#if defined(CHARLES_SIMD_SSE)
+    return Vector3(*this) += rhs;
+#else
+    return Vector3(x + rhs.x, y + rhs.y, z + rhs.z);
+#endif
+}
+
+BASICS_CONSTEXPR Vector3
+Vector3::operator-(const Vector3 &rhs)
+    const
+{
+#if defined(CHARLES_SIMD_SSE)
+    return Vector3(*this) -= rhs;
+#else
+    return Vector3(x - rhs.x, y - rhs.y, z - rhs.z);
+#endif
+}
+
+
+/*
+ * Vector3::operator!= --
+ *
+ * Compute boolean non-equality of this and the given vectors.
+ */
+BASICS_CONSTEXPR bool
+Vector3::operator!=(const Vector3 &rhs)
+    const
+{
+    return !(*this == rhs);
+}
+
+
+/*
+ * Vector3::length2 --
+ *
+ * Compute and return the length-squared of this vector.
+ */
+BASICS_CONSTEXPR float
+Vector3::length2()
+    const
+{
+    return dot(*this);
+}
+
+
+/*
+ * Vector3::length --
+ *
+ * Compute and return the length of this vector.
+ */
+inline float
+Vector3::length()
+    const
+{
+    return sqrtf(length2());
+}
+
+
+/*
+ * Vector3::normalize --
+ *
+ * Normalize this vector in place. That is, make this vector's magnitude (length) 1.0.
+ */
+inline Vector3 &
+Vector3::normalize()
+{
+    // Use the overloaded /= compound operator to do this.
+    return *this /= length();
+}
+
+
+/*
+ * operator* --
+ *
+ * Multiply the given float by the given vector. Return a new vector.
+ */
+BASICS_CONSTEXPR Vector3
+operator*(const float &lhs, const Vector3 &rhs)
+{
+    return rhs * lhs;
+}
+
+#pragma mark - Rays
+
+/*
+ * Ray::Ray --
+ *
+ * Default constructor. Create a ray at the origin (0, 0, 0) with direction (0, 0, 0).
+ */
+constexpr
+Ray::Ray()
+    : Ray(Vector3(), Vector3())
+{ }
+
+
+/*
+ * Ray::Ray --
+ *
+ * Constructor. Create a ray with the given origin and direction.
+ */
+constexpr
+Ray::Ray(Vector3 o, Vector3 d)
+    : origin(o), direction(d)
+{ }
+
+
+/*
+ * Ray::parameterize --
+ *
+ * Compute and return the point given by parameterizing this Ray by time t.
+ */
+BASICS_CONSTEXPR Vector3
+Ray::parameterize(const float t)
+    const
+{
+    return origin + t * direction;
+}
+
+
+/*
+ * Ray::compute_inverse_direction --
+ *
+ * Compute and return the componentwise reciprocal of this Ray's direction, for slab tests against boxes. Zero
+ * components become infinities; AABB::intersect is written to cope with them.
+ */
+inline Vector3
+Ray::compute_inverse_direction()
+    const
+{
+    return Vector3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+}
+
+#pragma mark - Colors
+
+/*
+ * Color::Color --
+ *
+ * Default constructor. Create a new Color with zeros for all components (black).
+ */
+constexpr
+Color::Color()
+    : Color(0.0, 0.0, 0.0, 0.0)
+{ }
+
+
+/*
+ * Color::Color --
+ *
+ * Constructor. Create a new Color with the given RGB components. Alpha is 1.0.
+ */
+constexpr
+Color::Color(const float &r, const float &g, const float &b)
+    : Color(r, g, b, 1.0)
+{ }
+
+
+/*
+ * Color::Color --
+ *
+ * Constructor. Create a new Color with the given components.
+ */
+constexpr
+Color::Color(const float &r, const float &g, const float &b, const float &a)
+    : red(r), green(g), blue(b), alpha(a)
+{ }
+
+
+#if defined(CHARLES_SIMD_SSE)
+
+/*
+ * Color::Color --
+ * Color::to_m128 --
+ *
+ * Convert between colors and SSE registers. Lanes are red, green, blue, alpha.
+ */
+inline
+Color::Color(__m128 v)
+{
+    _mm_store_ps(&red, v);
+}
+
+inline __m128
+Color::to_m128()
+    const
+{
+    return _mm_load_ps(&red);
+}
+
+
+inline Color &
+Color::operator*=(const float &rhs)
+{
+    return *this = Color(_mm_mul_ps(to_m128(), _mm_setr_ps(rhs, rhs, rhs, 1.0f)));
+}
+
+inline Color &
+Color::operator/=(const float &rhs)
+{
+    return *this *= (1.0 / rhs);
+}
+
+inline Color &
+Color::operator+=(const float &rhs)
+{
+    return *this = Color(_mm_add_ps(to_m128(), _mm_set1_ps(rhs)));
+}
+
+inline Color &
+Color::operator-=(const float &rhs)
+{
+    return *this += -rhs;
+}
+
+
+inline Color &
+Color::operator*=(const Color &rhs)
+{
+    // Take alpha from a 1.0 so it passes through unchanged.
+    return *this = Color(_mm_mul_ps(to_m128(), _mm_blend_ps(rhs.to_m128(), _mm_set1_ps(1.0f), 0x8)));
+}
+
+inline Color &
+Color::operator/=(const Color &rhs)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    return *this = Color(_mm_mul_ps(to_m128(), _mm_blend_ps(_mm_div_ps(one, rhs.to_m128()), one, 0x8)));
+}
+
+inline Color &
+Color::operator+=(const Color &rhs)
+{
+    return *this = Color(_mm_add_ps(to_m128(), rhs.to_m128()));
+}
+
+inline Color &
+Color::operator-=(const Color &rhs)
+{
+    return *this = Color(_mm_sub_ps(to_m128(), rhs.to_m128()));
+}
+
+#else
+
+/*
+ * Color::operator*= --
+ * Color::operator/= --
+ * Color::operator+= --
+ * Color::operator-= --
+ *
+ * Perform the corresponding arithmetic operation on this color and the given scalar. These methods are destructive and
+ * a reference to this color is returned. Multiplication and division leave alpha alone; addition and subtraction
+ * don't.
+ */
+inline Color &
+Color::operator*=(const float &rhs)
+{
+    red *= rhs;
+    green *= rhs;
+    blue *= rhs;
+    return *this;
+}
+
+inline Color &
+Color::operator/=(const float &rhs)
+{
+    return *this *= (1.0 / rhs);
+}
+
+inline Color &
+Color::operator+=(const float &rhs)
+{
+    red += rhs;
+    green += rhs;
+    blue += rhs;
+    alpha += rhs;
+    return *this;
+}
+
+inline Color &
+Color::operator-=(const float &rhs)
+{
+    return *this += -rhs;
+}
+
+
+/*
+ * Color::operator*= --
+ * Color::operator/= --
+ * Color::operator+= --
+ * Color::operator-= --
+ *
+ * Blend the given color into this one. As with scalars, multiplication and division leave alpha alone.
+ */
+inline Color &
+Color::operator*=(const Color &rhs)
+{
+    red *= rhs.red;
+    green *= rhs.green;
+    blue *= rhs.blue;
+    return *this;
+}
+
+inline Color &
+Color::operator/=(const Color &rhs)
+{
+    red *= (1.0 / rhs.red);
+    green *= (1.0 / rhs.green);
+    blue *= (1.0 / rhs.blue);
+    return *this;
+}
+
+inline Color &
+Color::operator+=(const Color &rhs)
+{
+    red += rhs.red;
+    green += rhs.green;
+    blue += rhs.blue;
+    alpha += rhs.alpha;
+    return *this;
+}
+
+inline Color &
+Color::operator-=(const Color &rhs)
+{
+    red -= rhs.red;
+    green -= rhs.green;
+    blue -= rhs.blue;
+    alpha -= rhs.alpha;
+    return *this;
+}
+
+#endif /* CHARLES_SIMD_SSE */
+
+
+/*
+ * Color::operator* --
+ * Color::operator/ --
+ * Color::operator+ --
+ * Color::operator- --
+ *
+ * Perform the corresponding operation on a copy of this color and the given scalar or color. Return a new color. The
+ * scalar versions round the same way as the compound operators above.
+ */
+BASICS_CONSTEXPR Color
+Color::operator*(const float &rhs)
+    const
+{
+#if defined(CHARLES_SIMD_SSE)
+    return Color(*this) *= rhs;
+#else
+    return Color(red * rhs, green * rhs, blue * rhs, alpha);
+#endif
+}
+
+BASICS_CONSTEXPR Color
+Color::operator/(const float &rhs)
+    const
+{
+    return *this * static_cast<float>(1.0 / rhs);
+}
+
+BASICS_CONSTEXPR Color
+Color::operator+(const float &rhs)
+    const
+{
+#if defined(CHARLES_SIMD_SSE)
+    return Color(*this) += rhs;
+#else
+    return Color(red + rhs, green + rhs, blue + rhs, alpha + rhs);
+#endif
+}
+
+BASICS_CONSTEXPR Color
+Color::operator-(const float &rhs)
+    const
+{
+    return *this + -rhs;
+}
+
+
+BASICS_CONSTEXPR Color
+Color::operator*(const Color &rhs)
+    const
+{
+#if defined(CHARLES_SIMD_SSE)
+    return Color(*this) *= rhs;
+#else
+    return Color(red * rhs.red, green * rhs.green, blue * rhs.blue, alpha);
+#endif
+}
+
+BASICS_CONSTEXPR Color
+Color::operator/(const Color &rhs)
+    const
+{
+#if defined(CHARLES_SIMD_SSE)
+    return Color(*this) /= rhs;
+#else
+    return Color(red * (1.0 / rhs.red), green * (1.0 / rhs.green), blue * (1.0 / rhs.blue), alpha);
+#endif
+}
+
+BASICS_CONSTEXPR Color
+Color::operator+(const Color &rhs)
+    const
+{
+#if defined(CHARLES_SIMD_SSE)
+    return Color(*this) += rhs;
+#else
+    return Color(red + rhs.red, green + rhs.green, blue + rhs.blue, alpha + rhs.alpha);
+#endif
+}
+
+BASICS_CONSTEXPR Color
+Color::operator-(const Color &rhs)
+    const
+{
+#if defined(CHARLES_SIMD_SSE)
+    return Color(*this) -= rhs;
+#else
+    return Color(red - rhs.red, green - rhs.green, blue - rhs.blue, alpha - rhs.alpha);
+#endif
+}
+
+
+BASICS_CONSTEXPR Color
+operator*(const float &lhs, const Color &rhs)
+{
+    return rhs * lhs;
+}
+
+#pragma mark - Bounding Boxes
+
+/*
+ * AABB::AABB --
+ *
+ * Default constructor. Create an empty box. The minimum corner is at +infinity and the maximum at -infinity, so
+ * extending an empty box by anything yields exactly that thing.
+ */
+inline
+AABB::AABB()
+    : min(INFINITY, INFINITY, INFINITY),
+      max(-INFINITY, -INFINITY, -INFINITY)
+{ }
+
+
+/*
+ * AABB::AABB --
+ *
+ * Constructor. Create a box with the given minimum and maximum corners.
+ */
+constexpr
+AABB::AABB(const Vector3 &mn, const Vector3 &mx)
+    : min(mn), max(mx)
+{ }
+
+
+/*
+ * AABB::is_empty --
+ *
+ * Return true if this box contains no points.
+ */
+inline bool
+AABB::is_empty()
+    const
+{
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+
+/*
+ * AABB::centroid --
+ * AABB::extent --
+ *
+ * Compute and return the center point and the size of this box along each axis.
+ */
+BASICS_CONSTEXPR Vector3
+AABB::centroid()
+    const
+{
+    return (min + max) * 0.5f;
+}
+
+BASICS_CONSTEXPR Vector3
+AABB::extent()
+    const
+{
+    return max - min;
+}
+
+
+/*
+ * AABB::surface_area --
+ *
+ * Compute and return the surface area of this box. Empty boxes have zero area.
+ */
+inline float
+AABB::surface_area()
+    const
+{
+    if (is_empty()) {
+        return 0.0;
+    }
+    Vector3 e = extent();
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+
+/*
+ * AABB::longest_axis --
+ *
+ * Return the index of the axis along which this box is largest.
+ */
+inline int
+AABB::longest_axis()
+    const
+{
+    Vector3 e = extent();
+    if (e.x >= e.y && e.x >= e.z) {
+        return 0;
+    }
+    return (e.y >= e.z) ? 1 : 2;
+}
+
+
+/*
+ * AABB::extend --
+ *
+ * Grow this box to enclose the given point or box. Return a reference to this box.
+ *
+ * std::min and std::max return their first argument, this box's, when the other is NaN, just as fminf and fmaxf
+ * ignore a NaN. They compile to single instructions, though, where fminf and fmaxf are library calls, and BVH builds
+ * extend boxes millions of times.
+ */
+inline AABB &
+AABB::extend(const Vector3 &p)
+{
+    min = Vector3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+    max = Vector3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+    return *this;
+}
+
+inline AABB &
+AABB::extend(const AABB &b)
+{
+    min = Vector3(std::min(min.x, b.min.x), std::min(min.y, b.min.y), std::min(min.z, b.min.z));
+    max = Vector3(std::max(max.x, b.max.x), std::max(max.y, b.max.y), std::max(max.z, b.max.z));
+    return *this;
+}
+
+
+/*
+ * AABB::intersect --
+ *
+ * Intersect the given ray with this box using the slab method. Each pair of parallel planes bounds an interval of t;
+ * the ray hits the box if the intersection of the three intervals and [tmin, tmax] is non-empty.
+ *
+ * A ray parallel to a slab has an infinite inverse direction. If the ray lies exactly in one of the slab's planes, the
+ * distance to that plane is 0 and 0 * inf is NaN. The comparisons below are arranged so that a NaN bound never
+ * narrows the interval, which counts those rays as inside the slab. Exit distances are scaled up by ExitScale so the
+ * test is conservative.
+ */
+inline bool
+AABB::intersect(const Ray &ray,
+                const Vector3 &inv_direction,
+                float tmin,
+                float tmax,
+                float &tnear)
+    const
+{
+    for (int axis = 0; axis < 3; axis++) {
+        float t0 = (min[axis] - ray.origin[axis]) * inv_direction[axis];
+        float t1 = (max[axis] - ray.origin[axis]) * inv_direction[axis];
+        if (inv_direction[axis] < 0.0f) {
+            float tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+        t1 *= ExitScale;
+        tmin = (t0 > tmin) ? t0 : tmin;
+        tmax = (t1 < tmax) ? t1 : tmax;
+    }
+
+    tnear = tmin;
+    return tmin <= tmax;
+}
+
 #endif
@@ -0,0 +1,784 @@
+/* bvh.cc
+ *
+ * Definition of the bounding volume hierarchy. Trees are built top down using the surface area heuristic (SAH),
+ * evaluated over a fixed number of bins along the longest axis of the primitive centroids, or as linear BVHs, from the
+ * Morton codes of the centroids.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <queue>
+
+#include "basics.h"
+#include "bvh.h"
+#include "morton.h"
+#include "parallel.h"
+#include "radix_sort.h"
+
+
+namespace {
+
+// Number of bins the SAH is evaluated over at each split.
+const int NumBins = 16;
+
+/*
+ * Relative cost of visiting an interior node, with the cost of intersecting one primitive as the unit. The SAH cost of
+ * a split is TraversalCost + (nl * area(l) + nr * area(r)) / area(parent).
+ */
+const float TraversalCost = 1.0f;
+
+/*
+ * Past this depth the builder stops looking for the best split and just cuts the primitives in half. That bounds the
+ * depth of the tree by ForceMedianDepth + log2(n), which has to fit in the traversal stack.
+ */
+const int ForceMedianDepth = 64;
+
+
+/*
+ * The linear builder hands subtrees of about this many primitives to each worker, or fewer, so there are at least
+ * TreeletsPerWorker of them to go around and the workers finish at about the same time.
+ */
+const unsigned int MinTreeletSize = 1 << 12;
+const unsigned int TreeletsPerWorker = 8;
+
+
+struct Bin
+{
+    Bin() : count(0) { }
+
+    AABB bounds;
+    unsigned int count;
+};
+
+} /* anonymous namespace */
+
+
+// Defined here too, since std::min and std::max take it by reference.
+const unsigned int BVH::MaxLeafSize;
+
+
+/*
+ * A subtree of a linear BVH over primitives [begin, end) in Morton order, built on its own by one worker. Its nodes
+ * refer to each other by their index in nodes; leaves refer to primitives by their index in the whole tree's indices.
+ */
+struct BVH::Treelet
+{
+    unsigned int begin, end;
+    std::vector<Node> nodes;
+};
+
+
+/*
+ * BVH::BVH --
+ *
+ * Default constructor. Create an empty tree.
+ */
+BVH::BVH()
+    : nodes(),
+      indices(),
+      node_data(NULL),
+      nnodes(0),
+      index_data(NULL),
+      nindices(0),
+      build_batch_size(1),
+      build_max_leaf_size(MaxLeafSize),
+      cost(0.0),
+      initial_cost(0.0),
+      initial_root_area(0.0f)
+{ }
+
+
+/*
+ * BVH::build --
+ *
+ * Build the tree over primitives with the given bounds. Any existing tree is thrown away.
+ *
+ * batch_size is the number of primitives the caller can test against a ray at once for the price of one, using SIMD
+ * for example. Leaves can hold that many primitives, if it's more than MaxLeafSize, and the SAH counts the cost of a
+ * leaf in batches rather than primitives.
+ */
+void
+BVH::build(const std::vector<AABB> &bounds,
+           unsigned int batch_size)
+{
+    clear();
+
+    build_batch_size = std::max(batch_size, 1u);
+    build_max_leaf_size = std::max(build_batch_size, MaxLeafSize);
+
+    unsigned int n = bounds.size();
+    if (n == 0) {
+        return;
+    }
+
+    std::vector<Vector3> centroids;
+    centroids.reserve(n);
+    indices.reserve(n);
+    for (unsigned int i = 0; i < n; i++) {
+        centroids.push_back(bounds[i].centroid());
+        indices.push_back(i);
+    }
+
+    // A binary tree with n leaves has 2n - 1 nodes, and there are never more leaves than primitives.
+    nodes.reserve(2 * n - 1);
+    build_node(bounds, centroids, 0, n, 0);
+
+    node_data = nodes.data();
+    nnodes = nodes.size();
+    index_data = indices.data();
+    nindices = indices.size();
+}
+
+
+/*
+ * BVH::build_linear --
+ *
+ * Build a linear BVH over primitives with the given bounds, using up to nworkers threads. Any existing tree is thrown
+ * away. batch_size means the same as it does to build(), but without a cost model to weigh it against, leaves simply
+ * hold up to that many primitives.
+ *
+ * The build goes in four steps, all but the last split across the workers:
+ *
+ *   1. Compute the Morton code of each primitive's centroid, over the bounds of all the centroids.
+ *   2. Radix sort the primitives by code. Sorted, the primitives under any node of the tree are a contiguous range.
+ *   3. Cut the top of the tree into treelets, and build the treelets. A range is split where the highest bit that
+ *      differs between its first and last codes turns on; the bit says which axis the split is along.
+ *   4. Build the few nodes above the treelets, copying each treelet into place under them.
+ */
+void
+BVH::build_linear(const std::vector<AABB> &bounds,
+                  unsigned int batch_size,
+                  unsigned int nworkers)
+{
+    clear();
+
+    build_batch_size = std::max(batch_size, 1u);
+    build_max_leaf_size = std::max(build_batch_size, MaxLeafSize);
+
+    unsigned int n = bounds.size();
+    if (n == 0) {
+        return;
+    }
+    nworkers = std::max(1u, std::min(nworkers, n / MinTreeletSize));
+
+    std::vector<AABB> worker_bounds(nworkers);
+    auto bound_centroids = [&](unsigned int worker) {
+        unsigned int begin, end;
+        split_range(n, worker, nworkers, begin, end);
+        AABB centroid_bounds;
+        for (unsigned int i = begin; i < end; i++) {
+            centroid_bounds.extend(bounds[i].centroid());
+        }
+        worker_bounds[worker] = centroid_bounds;
+    };
+    run_workers(nworkers, bound_centroids);
+
+    AABB centroid_bounds;
+    for (const AABB &b : worker_bounds) {
+        centroid_bounds.extend(b);
+    }
+
+    std::vector<SortItem> items(n), scratch(n);
+    auto compute_codes = [&](unsigned int worker) {
+        unsigned int begin, end;
+        split_range(n, worker, nworkers, begin, end);
+        for (unsigned int i = begin; i < end; i++) {
+            items[i].key = morton_code(bounds[i].centroid(), centroid_bounds);
+            items[i].value = i;
+        }
+    };
+    run_workers(nworkers, compute_codes);
+
+    radix_sort(items.data(), scratch.data(), n, 3 * MortonBits, nworkers);
+
+    // Keep the codes alongside the primitives, in sorted order.
+    std::vector<uint32_t> sorted_codes(n);
+    uint32_t *codes = sorted_codes.data();
+    indices.resize(n);
+    for (unsigned int i = 0; i < n; i++) {
+        indices[i] = items[i].value;
+        codes[i] = items[i].key;
+    }
+
+    unsigned int grain = std::max(MinTreeletSize, n / (nworkers * TreeletsPerWorker));
+    std::vector<Treelet> treelets;
+    collect_treelets(codes, 0, n, grain, treelets);
+
+    std::atomic<unsigned int> next(0);
+    auto build_treelets = [&](unsigned int worker) {
+        for (unsigned int t = next++; t < treelets.size(); t = next++) {
+            Treelet &treelet = treelets[t];
+            treelet.nodes.reserve(2 * (treelet.end - treelet.begin) - 1);
+            build_linear_node(bounds, codes, treelet.begin, treelet.end, treelet.nodes);
+        }
+    };
+    run_workers(nworkers, build_treelets);
+
+    if (treelets.size() == 1) {
+        nodes.swap(treelets[0].nodes);
+    }
+    else {
+        nodes.reserve(2 * n - 1);
+        unsigned int next_treelet = 0;
+        assemble_linear(codes, 0, n, grain, treelets, next_treelet);
+    }
+
+    node_data = nodes.data();
+    nnodes = nodes.size();
+    index_data = indices.data();
+    nindices = indices.size();
+}
+
+
+/*
+ * BVH::adopt --
+ *
+ * Use a tree built elsewhere, typically one read from a file, without copying it. The arrays must outlive this BVH or
+ * the next call to build(), adopt(), or clear(). The tree is checked for consistency first: every child and primitive
+ * reference has to be in range, children have to come after their parents, and no node can be StackSize or more levels
+ * down, so that traversal can't run off the end of either array or its stack, or loop. If the check fails, the tree is
+ * left empty and false is returned.
+ */
+bool
+BVH::adopt(const Node *new_nodes,
+           unsigned int new_nnodes,
+           const unsigned int *new_indices,
+           unsigned int new_nindices)
+{
+    clear();
+
+    /*
+     * Parents come before their children, so one pass in order sees every node's depth before its children's. A node
+     * that's never reached keeps depth 0, which is harmless since traversal never gets to it either.
+     */
+    std::vector<unsigned char> depths(new_nnodes, 0);
+    for (unsigned int i = 0; i < new_nnodes; i++) {
+        const Node &node = new_nodes[i];
+        if (node.nprims > 0) {
+            if (node.offset > new_nindices || node.nprims > new_nindices - node.offset) {
+                return false;
+            }
+        }
+        else if (node.offset <= i + 1 || node.offset >= new_nnodes || node.axis > 2) {
+            return false;
+        }
+        else {
+            const unsigned char depth = depths[i] + 1;
+            if (depth >= StackSize) {
+                return false;
+            }
+            depths[i + 1] = std::max(depths[i + 1], depth);
+            depths[node.offset] = std::max(depths[node.offset], depth);
+        }
+    }
+
+    node_data = new_nodes;
+    nnodes = new_nnodes;
+    index_data = new_indices;
+    nindices = new_nindices;
+    return true;
+}
+
+
+/*
+ * BVH::clear --
+ *
+ * Throw away the tree.
+ */
+void
+BVH::clear()
+{
+    nodes.clear();
+    indices.clear();
+    node_data = NULL;
+    nnodes = 0;
+    index_data = NULL;
+    nindices = 0;
+    parents.clear();
+    leaves.clear();
+    queued.clear();
+}
+
+
+/*
+ * BVH::refit --
+ *
+ * Update the tree after the primitives in prims have moved or changed size; bounds has the new bounds of every
+ * primitive. Only the leaves holding those primitives and the nodes above them are looked at, bottom up, and a node's
+ * parent only if the node's box changed. The nodes whose boxes changed are stored in changed, children before
+ * parents.
+ *
+ * Nodes always come after their parents, so taking the queued nodes highest index first refits every child before
+ * its parent. An adopted tree is copied first, since it can't be changed where it is.
+ */
+void
+BVH::refit(const std::vector<AABB> &bounds,
+           const std::vector<unsigned int> &prims,
+           std::vector<unsigned int> &changed)
+{
+    changed.clear();
+    if (nnodes == 0) {
+        return;
+    }
+
+    if (node_data != nodes.data()) {
+        nodes.assign(node_data, node_data + nnodes);
+        indices.assign(index_data, index_data + nindices);
+        node_data = nodes.data();
+        index_data = indices.data();
+    }
+    if (parents.empty()) {
+        prepare_refit();
+    }
+
+    std::priority_queue<unsigned int> queue;
+    for (unsigned int prim : prims) {
+        unsigned int leaf = leaves[prim];
+        if (!queued[leaf]) {
+            queued[leaf] = 1;
+            queue.push(leaf);
+        }
+    }
+
+    while (!queue.empty()) {
+        unsigned int index = queue.top();
+        queue.pop();
+        queued[index] = 0;
+
+        Node &node = nodes[index];
+        AABB node_bounds;
+        if (node.nprims > 0) {
+            for (unsigned int i = node.offset; i < node.offset + node.nprims; i++) {
+                node_bounds.extend(bounds[indices[i]]);
+            }
+        }
+        else {
+            node_bounds = nodes[index + 1].bounds;
+            node_bounds.extend(nodes[node.offset].bounds);
+        }
+        if (node_bounds.min == node.bounds.min && node_bounds.max == node.bounds.max) {
+            continue;
+        }
+
+        cost += compute_cost(index, node_bounds) - compute_cost(index, node.bounds);
+        node.bounds = node_bounds;
+        changed.push_back(index);
+
+        if (index > 0 && !queued[parents[index]]) {
+            queued[parents[index]] = 1;
+            queue.push(parents[index]);
+        }
+    }
+}
+
+
+/*
+ * BVH::get_degradation --
+ *
+ * Get how much worse the tree fits its primitives now than it did before it was first refit: the ratio of its SAH
+ * cost now to its cost then. Refitting keeps the tree correct, but as primitives wander away from where it was built
+ * for, boxes grow and overlap, and tracing gets slower. A tree that has never been refit has a degradation of 1.
+ *
+ * The SAH cost is relative to the area of the root, so moving or scaling everything together doesn't count.
+ */
+float
+BVH::get_degradation()
+    const
+{
+    if (parents.empty() || initial_cost <= 0.0) {
+        return 1.0f;
+    }
+    float root_area = node_data[0].bounds.surface_area();
+    if (root_area <= 0.0f || initial_root_area <= 0.0f) {
+        return 1.0f;
+    }
+    return (cost / root_area) / (initial_cost / initial_root_area);
+}
+
+
+/*
+ * BVH::prepare_refit --
+ *
+ * Work out the parents of the nodes, the leaf holding each primitive, and the tree's SAH cost as it stands.
+ */
+void
+BVH::prepare_refit()
+{
+    parents.assign(nnodes, 0);
+    leaves.assign(nindices, 0);
+    queued.assign(nnodes, 0);
+    cost = 0.0;
+    for (unsigned int i = 0; i < nnodes; i++) {
+        const Node &node = node_data[i];
+        if (node.nprims > 0) {
+            for (unsigned int j = node.offset; j < node.offset + node.nprims; j++) {
+                leaves[index_data[j]] = i;
+            }
+        }
+        else {
+            parents[i + 1] = i;
+            parents[node.offset] = i;
+        }
+        cost += compute_cost(i, node.bounds);
+    }
+    initial_cost = cost;
+    initial_root_area = node_data[0].bounds.surface_area();
+}
+
+
+/*
+ * BVH::compute_cost --
+ *
+ * Compute the contribution of node index to the tree's SAH cost if it had the given bounds: its area, times the cost
+ * of visiting it. Empty boxes cost nothing.
+ */
+float
+BVH::compute_cost(unsigned int index,
+                  const AABB &bounds)
+    const
+{
+    if (bounds.is_empty()) {
+        return 0.0f;
+    }
+    const Node &node = node_data[index];
+    return bounds.surface_area() * ((node.nprims > 0) ? batches(node.nprims) : TraversalCost);
+}
+
+
+/*
+ * BVH::is_empty --
+ * BVH::get_nodes --
+ * BVH::get_nnodes --
+ * BVH::get_indices --
+ * BVH::get_nindices --
+ *
+ * Accessors for the flattened tree.
+ */
+bool
+BVH::is_empty()
+    const
+{
+    return nnodes == 0;
+}
+
+const BVH::Node *
+BVH::get_nodes()
+    const
+{
+    return node_data;
+}
+
+unsigned int
+BVH::get_nnodes()
+    const
+{
+    return nnodes;
+}
+
+const unsigned int *
+BVH::get_indices()
+    const
+{
+    return index_data;
+}
+
+unsigned int
+BVH::get_nindices()
+    const
+{
+    return nindices;
+}
+
+
+/*
+ * BVH::batches --
+ *
+ * Get the number of batches it takes to test n primitives.
+ */
+unsigned int
+BVH::batches(unsigned int n)
+    const
+{
+    return (n + build_batch_size - 1) / build_batch_size;
+}
+
+
+/*
+ * BVH::build_node --
+ *
+ * Build the subtree over indices[begin, end) and return the index of its root node.
+ */
+unsigned int
+BVH::build_node(const std::vector<AABB> &bounds,
+                const std::vector<Vector3> &centroids,
+                unsigned int begin,
+                unsigned int end,
+                int depth)
+{
+    // Don't hold references into nodes across the recursive calls below; the vector may grow.
+    unsigned int index = nodes.size();
+    nodes.push_back(Node());
+
+    AABB node_bounds, centroid_bounds;
+    for (unsigned int i = begin; i < end; i++) {
+        node_bounds.extend(bounds[indices[i]]);
+        centroid_bounds.extend(centroids[indices[i]]);
+    }
+    nodes[index].bounds = node_bounds;
+
+    unsigned int count = end - begin;
+    int axis = centroid_bounds.longest_axis();
+    float cmin = centroid_bounds.min[axis];
+    float cmax = centroid_bounds.max[axis];
+    unsigned int mid = begin + count / 2;
+
+    if (count == 1 || (count <= build_max_leaf_size && cmax <= cmin)) {
+        nodes[index].offset = begin;
+        nodes[index].nprims = count;
+        nodes[index].axis = 0;
+        return index;
+    }
+
+    if (cmax <= cmin) {
+        /*
+         * All the centroids coincide, so no plane separates them. The leaf would be too big, so cut the range in half.
+         * The order doesn't matter.
+         */
+    }
+    else if (depth >= ForceMedianDepth) {
+        std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end,
+                         [&](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+    }
+    else {
+        // Drop each primitive into a bin by its centroid.
+        Bin bins[NumBins];
+        const float scale = NumBins / (cmax - cmin);
+        auto bin_index = [&](unsigned int prim) {
+            int b = (centroids[prim][axis] - cmin) * scale;
+            return std::min(b, NumBins - 1);
+        };
+        for (unsigned int i = begin; i < end; i++) {
+            Bin &bin = bins[bin_index(indices[i])];
+            bin.count++;
+            bin.bounds.extend(bounds[indices[i]]);
+        }
+
+        // Sweep from the right to get the area and count of everything right of each split plane.
+        float right_area[NumBins];
+        unsigned int right_count[NumBins];
+        AABB acc;
+        unsigned int acc_count = 0;
+        for (int b = NumBins - 1; b > 0; b--) {
+            acc.extend(bins[b].bounds);
+            acc_count += bins[b].count;
+            right_area[b] = acc.surface_area();
+            right_count[b] = acc_count;
+        }
+
+        // Then sweep from the left, evaluating the SAH at each plane. Plane b sits between bins b - 1 and b.
+        float parent_area = node_bounds.surface_area();
+        float best_cost = INFINITY;
+        int best_split = -1;
+        acc = AABB();
+        acc_count = 0;
+        for (int b = 1; b < NumBins; b++) {
+            acc.extend(bins[b - 1].bounds);
+            acc_count += bins[b - 1].count;
+            if (acc_count == 0 || right_count[b] == 0) {
+                continue;
+            }
+            float cost = batches(acc_count) * acc.surface_area() + batches(right_count[b]) * right_area[b];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_split = b;
+            }
+        }
+        float leaf_cost = batches(count);
+        best_cost = (parent_area > 0.0f) ? TraversalCost + best_cost / parent_area : TraversalCost + leaf_cost;
+
+        // Make a leaf if splitting doesn't pay for itself.
+        if (count <= build_max_leaf_size && best_cost >= leaf_cost) {
+            nodes[index].offset = begin;
+            nodes[index].nprims = count;
+            nodes[index].axis = 0;
+            return index;
+        }
+
+        if (best_split > 0) {
+            mid = std::partition(indices.begin() + begin, indices.begin() + end,
+                                 [&](unsigned int prim) { return bin_index(prim) < best_split; })
+                  - indices.begin();
+        }
+    }
+
+    build_node(bounds, centroids, begin, mid, depth + 1);
+    unsigned int right = build_node(bounds, centroids, mid, end, depth + 1);
+
+    nodes[index].offset = right;
+    nodes[index].nprims = 0;
+    nodes[index].axis = axis;
+    return index;
+}
+
+
+/*
+ * BVH::split_linear --
+ *
+ * Decide how to split the primitives in [begin, end) of a linear BVH, whose Morton codes are codes[begin, end). Return
+ * false if they should be a leaf. Otherwise return true, with the split in mid: [begin, mid) goes to the first child
+ * and [mid, end) to the second. axis is the axis the split is along, and the first child is the one toward -axis.
+ */
+bool
+BVH::split_linear(const uint32_t *codes,
+                  unsigned int begin,
+                  unsigned int end,
+                  unsigned int &mid,
+                  unsigned short &axis)
+    const
+{
+    unsigned int count = end - begin;
+    if (count <= build_max_leaf_size) {
+        return false;
+    }
+
+    uint32_t first = codes[begin];
+    uint32_t last = codes[end - 1];
+    if (first == last) {
+        // The codes are all the same, so nothing tells the primitives apart. The leaf would be too big, so cut the
+        // range in half.
+        mid = begin + count / 2;
+        axis = 0;
+        return true;
+    }
+
+    /*
+     * The codes are sorted, so they all share the bits above the highest one where the first and last differ, and that
+     * bit is off for a run of them and then on for the rest. Bits cycle through x, y and z from the bottom.
+     */
+    int bit = 3 * MortonBits - 1;
+    while (((first ^ last) >> bit) == 0) {
+        bit--;
+    }
+    mid = std::lower_bound(codes + begin, codes + end, (last >> bit) << bit) - codes;
+    axis = bit % 3;
+    return true;
+}
+
+
+/*
+ * BVH::collect_treelets --
+ *
+ * Cut the subtree over primitives [begin, end) into treelets of at most grain primitives, or leaves, and add them to
+ * treelets in depth-first order.
+ */
+void
+BVH::collect_treelets(const uint32_t *codes,
+                      unsigned int begin,
+                      unsigned int end,
+                      unsigned int grain,
+                      std::vector<Treelet> &treelets)
+    const
+{
+    unsigned int mid;
+    unsigned short axis;
+    if (end - begin <= grain || !split_linear(codes, begin, end, mid, axis)) {
+        treelets.push_back(Treelet());
+        treelets.back().begin = begin;
+        treelets.back().end = end;
+        return;
+    }
+    collect_treelets(codes, begin, mid, grain, treelets);
+    collect_treelets(codes, mid, end, grain, treelets);
+}
+
+
+/*
+ * BVH::build_linear_node --
+ *
+ * Build the subtree of a linear BVH over primitives [begin, end) into out, and return the index of its root node.
+ */
+unsigned int
+BVH::build_linear_node(const std::vector<AABB> &bounds,
+                       const uint32_t *codes,
+                       unsigned int begin,
+                       unsigned int end,
+                       std::vector<Node> &out)
+    const
+{
+    // As in build_node, don't hold references into out across the recursive calls.
+    unsigned int index = out.size();
+    out.push_back(Node());
+
+    unsigned int mid;
+    unsigned short axis;
+    if (!split_linear(codes, begin, end, mid, axis)) {
+        AABB leaf_bounds;
+        for (unsigned int i = begin; i < end; i++) {
+            leaf_bounds.extend(bounds[indices[i]]);
+        }
+        out[index].bounds = leaf_bounds;
+        out[index].offset = begin;
+        out[index].nprims = end - begin;
+        out[index].axis = 0;
+        return index;
+    }
+
+    unsigned int left = build_linear_node(bounds, codes, begin, mid, out);
+    unsigned int right = build_linear_node(bounds, codes, mid, end, out);
+
+    AABB node_bounds = out[left].bounds;
+    node_bounds.extend(out[right].bounds);
+    out[index].bounds = node_bounds;
+    out[index].offset = right;
+    out[index].nprims = 0;
+    out[index].axis = axis;
+    return index;
+}
+
+
+/*
+ * BVH::assemble_linear --
+ *
+ * Build the top of the linear BVH over primitives [begin, end), split the same way collect_treelets did, and copy the
+ * built treelets under it in the same order, moving their node references to where they land. Return the index of
+ * the root node.
+ */
+unsigned int
+BVH::assemble_linear(const uint32_t *codes,
+                     unsigned int begin,
+                     unsigned int end,
+                     unsigned int grain,
+                     std::vector<Treelet> &treelets,
+                     unsigned int &next_treelet)
+{
+    unsigned int index = nodes.size();
+
+    unsigned int mid;
+    unsigned short axis;
+    if (end - begin <= grain || !split_linear(codes, begin, end, mid, axis)) {
+        Treelet &treelet = treelets[next_treelet++];
+        for (Node node : treelet.nodes) {
+            if (node.nprims == 0) {
+                node.offset += index;
+            }
+            nodes.push_back(node);
+        }
+        std::vector<Node>().swap(treelet.nodes);
+        return index;
+    }
+
+    nodes.push_back(Node());
+    unsigned int left = assemble_linear(codes, begin, mid, grain, treelets, next_treelet);
+    unsigned int right = assemble_linear(codes, mid, end, grain, treelets, next_treelet);
+
+    AABB node_bounds = nodes[left].bounds;
+    node_bounds.extend(nodes[right].bounds);
+    nodes[index].bounds = node_bounds;
+    nodes[index].offset = right;
+    nodes[index].nprims = 0;
+    nodes[index].axis = axis;
+    return index;
+}
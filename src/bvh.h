@@ -0,0 +1,409 @@
+/* bvh.h
+ *
+ * Declaration of the bounding volume hierarchy. A BVH is a binary tree of axis-aligned boxes over a set of primitives.
+ * Finding the nearest primitive a ray hits only requires visiting the nodes whose boxes the ray passes through, so the
+ * cost is roughly logarithmic rather than linear in the number of primitives.
+ *
+ * There are two builders. build() uses the surface area heuristic, and makes trees that are fast to trace but slow to
+ * build. build_linear() makes a linear BVH (LBVH): it sorts the primitives along a Morton curve and splits them where
+ * their codes first differ, in parallel. Its trees take a little longer to trace, but build many times faster.
+ *
+ * When primitives move without being added or removed, a tree can also be refit: the boxes of the leaves holding the
+ * primitives that moved, and of the nodes above them, are recomputed, and the rest of the tree is left alone. The
+ * tree's shape doesn't change, so the more things move, the worse it fits; see get_degradation().
+ *
+ * The tree knows nothing about what its primitives are. It is built from a list of bounding boxes and stores indices
+ * into that list; callers supply a function that intersects a ray with the primitive at a given index.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "basics.h"
+#include "ray_packet.h"
+
+
+class BVH
+{
+public:
+    /*
+     * Nodes are stored depth-first in a flat array. An interior node's first child immediately follows it; offset is
+     * the index of its second child. For a leaf, offset is the index of its first primitive in the index array and
+     * nprims is the number of primitives. Interior nodes have nprims == 0.
+     */
+    struct Node
+    {
+        AABB bounds;
+        unsigned int offset;
+        unsigned short nprims;
+        unsigned short axis;
+    };
+
+    BVH();
+
+    void build(const std::vector<AABB> &bounds, unsigned int batch_size = 1);
+    void build_linear(const std::vector<AABB> &bounds, unsigned int batch_size = 1, unsigned int nworkers = 1);
+    bool adopt(const Node *nodes, unsigned int nnodes, const unsigned int *indices, unsigned int nindices);
+    void clear();
+
+    void refit(const std::vector<AABB> &bounds, const std::vector<unsigned int> &prims,
+               std::vector<unsigned int> &changed);
+    float get_degradation() const;
+
+    bool is_empty() const;
+    const Node *get_nodes() const;
+    unsigned int get_nnodes() const;
+    const unsigned int *get_indices() const;
+    unsigned int get_nindices() const;
+
+    /*
+     * Find the nearest primitive hit by ray in [tmin, tmax]. intersect_primitive is called as
+     *
+     *     bool intersect_primitive(unsigned int index, float tmin, float &tmax)
+     *
+     * for each primitive in each leaf the ray reaches. It should return true and shrink tmax to the hit distance if it
+     * finds a hit nearer than tmax. On return tmax holds the nearest hit distance. Returns true if anything was hit.
+     */
+    template<typename IntersectPrimitive>
+    bool intersect(const Ray &ray, float tmin, float &tmax, IntersectPrimitive intersect_primitive) const;
+
+    /*
+     * Determine whether any primitive is hit by ray in [tmin, tmax]. occluded_primitive is called as
+     *
+     *     bool occluded_primitive(unsigned int index, float tmin, float tmax)
+     *
+     * and should return true if the primitive at index is hit anywhere in the interval. Traversal stops at the first
+     * primitive that is.
+     */
+    template<typename OccludedPrimitive>
+    bool occluded(const Ray &ray, float tmin, float tmax, OccludedPrimitive occluded_primitive) const;
+
+    /*
+     * The same, but a leaf at a time, for callers that can test several primitives at once. The functions are called
+     * as
+     *
+     *     bool intersect_leaf(const unsigned int *prims, unsigned int n, float tmin, float &tmax)
+     *     bool occluded_leaf(const unsigned int *prims, unsigned int n, float tmin, float tmax)
+     *
+     * with the indices of the n primitives in each leaf the ray reaches.
+     */
+    template<typename IntersectLeaf>
+    bool intersect_leaves(const Ray &ray, float tmin, float &tmax, IntersectLeaf intersect_leaf) const;
+    template<typename OccludedLeaf>
+    bool occluded_leaves(const Ray &ray, float tmin, float tmax, OccludedLeaf occluded_leaf) const;
+
+    /*
+     * Find the nearest primitive hit by each ray in packet, which must be prepared. tmax holds one interval end per
+     * ray, and intersect_leaf is called as
+     *
+     *     bool intersect_leaf(unsigned int ray, const unsigned int *prims, unsigned int n, float tmin, float &tmax)
+     *
+     * with the index of the ray in the packet. Each ray sees the same leaves in the same order it would if it were
+     * traced on its own.
+     */
+    template<typename IntersectLeaf>
+    void intersect_packet(const RayPacket &packet, float tmin, float *tmax, IntersectLeaf intersect_leaf) const;
+
+    // Maximum number of primitives in a leaf before the builder is forced to split, unless batches are bigger.
+    static const unsigned int MaxLeafSize = 4;
+
+    // Depth of the traversal stack. The builder guarantees trees are never deeper than this.
+    static const int StackSize = 128;
+
+private:
+    struct Treelet;
+
+    unsigned int build_node(const std::vector<AABB> &bounds,
+                            const std::vector<Vector3> &centroids,
+                            unsigned int begin,
+                            unsigned int end,
+                            int depth);
+    bool split_linear(const uint32_t *codes, unsigned int begin, unsigned int end, unsigned int &mid,
+                      unsigned short &axis) const;
+    void collect_treelets(const uint32_t *codes, unsigned int begin, unsigned int end, unsigned int grain,
+                          std::vector<Treelet> &treelets) const;
+    unsigned int build_linear_node(const std::vector<AABB> &bounds, const uint32_t *codes, unsigned int begin,
+                                   unsigned int end, std::vector<Node> &out) const;
+    unsigned int assemble_linear(const uint32_t *codes, unsigned int begin, unsigned int end, unsigned int grain,
+                                 std::vector<Treelet> &treelets, unsigned int &next_treelet);
+    void prepare_refit();
+    float compute_cost(unsigned int index, const AABB &bounds) const;
+
+    // Storage for trees built here. Adopted trees live elsewhere and leave these empty.
+    std::vector<Node> nodes;
+    std::vector<unsigned int> indices;
+
+    // The tree in use, either in the vectors above or adopted.
+    const Node *node_data;
+    unsigned int nnodes;
+    const unsigned int *index_data;
+    unsigned int nindices;
+
+    // Parameters of the build in progress. See build().
+    unsigned int build_batch_size;
+    unsigned int build_max_leaf_size;
+    unsigned int batches(unsigned int n) const;
+
+    /*
+     * What refitting needs to know about the tree, worked out the first time it's refit: the parent of each node, the
+     * leaf holding each primitive, and the SAH cost of the tree before and since, as the sum over nodes of each one's
+     * surface area times the cost of visiting it. queued marks nodes waiting to be refit.
+     */
+    std::vector<unsigned int> parents;
+    std::vector<unsigned int> leaves;
+    std::vector<unsigned char> queued;
+    double cost, initial_cost;
+    float initial_root_area;
+};
+
+
+/*
+ * BVH::intersect --
+ * BVH::occluded --
+ *
+ * Per-primitive traversal, in terms of the per-leaf versions below.
+ */
+template<typename IntersectPrimitive>
+bool
+BVH::intersect(const Ray &ray,
+               float tmin,
+               float &tmax,
+               IntersectPrimitive intersect_primitive)
+    const
+{
+    return intersect_leaves(ray, tmin, tmax, [&](const unsigned int *prims, unsigned int n, float tmin, float &tmax) {
+        bool hit = false;
+        for (unsigned int i = 0; i < n; i++) {
+            if (intersect_primitive(prims[i], tmin, tmax)) {
+                hit = true;
+            }
+        }
+        return hit;
+    });
+}
+
+template<typename OccludedPrimitive>
+bool
+BVH::occluded(const Ray &ray,
+              float tmin,
+              float tmax,
+              OccludedPrimitive occluded_primitive)
+    const
+{
+    return occluded_leaves(ray, tmin, tmax, [&](const unsigned int *prims, unsigned int n, float tmin, float tmax) {
+        for (unsigned int i = 0; i < n; i++) {
+            if (occluded_primitive(prims[i], tmin, tmax)) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+
+/*
+ * BVH::intersect_leaves --
+ *
+ * Walk the tree front to back. At each interior node the child nearer the ray's origin along the node's split axis is
+ * visited first and the other is pushed on the stack, so tmax tends to shrink early and prune more of the tree.
+ */
+template<typename IntersectLeaf>
+bool
+BVH::intersect_leaves(const Ray &ray,
+                      float tmin,
+                      float &tmax,
+                      IntersectLeaf intersect_leaf)
+    const
+{
+    if (nnodes == 0) {
+        return false;
+    }
+
+    const Vector3 inv_direction = ray.compute_inverse_direction();
+    const bool negative[3] = { inv_direction.x < 0, inv_direction.y < 0, inv_direction.z < 0 };
+
+    unsigned int stack[StackSize];
+    int sp = 0;
+    unsigned int current = 0;
+    bool hit = false;
+    float tnear;
+
+    while (true) {
+        const Node &node = node_data[current];
+        if (node.bounds.intersect(ray, inv_direction, tmin, tmax, tnear)) {
+            if (node.nprims > 0) {
+                if (intersect_leaf(index_data + node.offset, node.nprims, tmin, tmax)) {
+                    hit = true;
+                }
+            }
+            else if (negative[node.axis]) {
+                stack[sp++] = current + 1;
+                current = node.offset;
+                continue;
+            }
+            else {
+                stack[sp++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (sp == 0) {
+            break;
+        }
+        current = stack[--sp];
+    }
+
+    return hit;
+}
+
+
+/*
+ * BVH::occluded_leaves --
+ *
+ * Walk the tree looking for any hit at all. Since the first one ends the search and the interval never shrinks, there
+ * is no point ordering the children.
+ */
+template<typename OccludedLeaf>
+bool
+BVH::occluded_leaves(const Ray &ray,
+                     float tmin,
+                     float tmax,
+                     OccludedLeaf occluded_leaf)
+    const
+{
+    if (nnodes == 0) {
+        return false;
+    }
+
+    const Vector3 inv_direction = ray.compute_inverse_direction();
+
+    unsigned int stack[StackSize];
+    int sp = 0;
+    unsigned int current = 0;
+    float tnear;
+
+    while (true) {
+        const Node &node = node_data[current];
+        if (node.bounds.intersect(ray, inv_direction, tmin, tmax, tnear)) {
+            if (node.nprims > 0) {
+                if (occluded_leaf(index_data + node.offset, node.nprims, tmin, tmax)) {
+                    return true;
+                }
+            }
+            else {
+                stack[sp++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (sp == 0) {
+            break;
+        }
+        current = stack[--sp];
+    }
+
+    return false;
+}
+
+
+/*
+ * BVH::intersect_packet --
+ *
+ * Walk the tree front to back with the whole packet. A node is skipped outright if the packet's frustum misses it.
+ * Otherwise the rays are tested against it in order until one hits; the rays before that one miss the node, so they
+ * miss everything under it too, and the node's subtree is walked with only the rest. Each entry on the stack carries
+ * the first ray still worth testing along with the node.
+ *
+ * A prepared packet's rays all agree on which child is nearer, so they are visited in the same order as
+ * intersect_leaves would for each ray alone, and a leaf is handed a ray exactly when that ray's own slab test passes.
+ */
+template<typename IntersectLeaf>
+void
+BVH::intersect_packet(const RayPacket &packet,
+                      float tmin,
+                      float *tmax,
+                      IntersectLeaf intersect_leaf)
+    const
+{
+    if (nnodes == 0) {
+        return;
+    }
+
+    // The frustum only needs to reach as far as the farthest ray still could.
+    float packet_tmax = tmin;
+    for (unsigned int i = 0; i < packet.size; i++) {
+        packet_tmax = fmaxf(packet_tmax, tmax[i]);
+    }
+
+    struct Entry
+    {
+        unsigned int node;
+        unsigned int first;
+    };
+    Entry stack[StackSize];
+    int sp = 0;
+    unsigned int current = 0;
+    unsigned int first = 0;
+    float tnear;
+
+    while (true) {
+        const Node &node = node_data[current];
+        if (packet.intersect_frustum(node.bounds, tmin, packet_tmax)) {
+            while (first < packet.size
+                   && !node.bounds.intersect(packet.rays[first], packet.inv_directions[first], tmin, tmax[first],
+                                             tnear)) {
+                first++;
+            }
+
+            if (first < packet.size) {
+                if (node.nprims > 0) {
+                    bool hit = false;
+                    for (unsigned int i = first; i < packet.size; i++) {
+                        if (i > first
+                            && !node.bounds.intersect(packet.rays[i], packet.inv_directions[i], tmin, tmax[i], tnear)) {
+                            continue;
+                        }
+                        if (intersect_leaf(i, index_data + node.offset, node.nprims, tmin, tmax[i])) {
+                            hit = true;
+                        }
+                    }
+                    // Rays skipped here may still be live further up the stack, so they all count.
+                    if (hit) {
+                        packet_tmax = tmin;
+                        for (unsigned int i = 0; i < packet.size; i++) {
+                            packet_tmax = fmaxf(packet_tmax, tmax[i]);
+                        }
+                    }
+                }
+                else if (packet.negative[node.axis]) {
+                    stack[sp].node = current + 1;
+                    stack[sp++].first = first;
+                    current = node.offset;
+                    continue;
+                }
+                else {
+                    stack[sp].node = node.offset;
+                    stack[sp++].first = first;
+                    current = current + 1;
+                    continue;
+                }
+            }
+        }
+
+        if (sp == 0) {
+            break;
+        }
+        sp--;
+        current = stack[sp].node;
+        first = stack[sp].first;
+    }
+}
+
+#endif
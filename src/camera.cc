@@ -1,4 +1,4 @@
-/* camera.h
+/* camera.cc
  *
  * The Camera is the eye into the scene. It defines several parameters and a single compute_primary_ray method
  * that generates rays with which the ray tracer draws the scene.
@@ -6,15 +6,20 @@
  * Eryn Wells <eryn@erynwells.me>
  */
 
+#include <cmath>
+
 #include "camera.h"
 
 
 #pragma mark - Generic Camera
 
 Camera::Camera()
-    : height(Vector3::Y),
+    : pwidth(640),
+      pheight(480),
+      height(Vector3::Y),
       width(4.0 / 3.0 * Vector3::X),
-      direction(Vector3::Z)
+      direction(Vector3::Z),
+      angle(60.0)
 { }
 
 
@@ -114,8 +119,9 @@ Camera::set_direction(const Vector3 &d)
 
 /*
  * Camera::get_angle --
+ * Camera::set_angle --
  *
- * Get the angle of view.
+ * Get and set the horizontal angle of view, in degrees.
  */
 float
 Camera::get_angle()
@@ -124,27 +130,97 @@ Camera::get_angle()
     return angle;
 }
 
+void
+Camera::set_angle(float a)
+{
+    angle = a;
+}
+
 #pragma mark - Orthographic Camera
 
+OrthographicCamera::OrthographicCamera()
+    : Camera(),
+      dx(),
+      dy()
+{ }
+
+
+/*
+ * OrthographicCamera::prepare --
+ *
+ * Divide the image plane into pixels. The width and height vectors span the whole image, so each pixel's share of them
+ * is the step from one pixel's ray to the next.
+ */
+void
+OrthographicCamera::prepare()
+{
+    dx = (get_pixel_width() > 0) ? get_width() / get_pixel_width() : Vector3::Zero;
+    dy = (get_pixel_height() > 0) ? get_height() / get_pixel_height() : Vector3::Zero;
+}
+
+
 /*
  * OrthographicCamera::compute_primary_ray --
  *
  * Compute a primary ray given an (x,y) coordinate pair. The orthographic camera projects rays parallel to the viewing
- * direction through the (x,y) coordinate given. Thus, the size of the orthographic camera should be set to the size of
- * the view into the scene.
+ * direction, from the corner of pixel (x,y) on the image plane. The camera's origin is the corner of pixel (0,0), so
+ * the width and height of the orthographic camera should be set to the size of the view into the scene.
  */
 Ray
 OrthographicCamera::compute_primary_ray(const int &x,
                                         const int &y)
     const
 {
-    // Calculate the point on the image plane that the given (x,y) coordinate pair corresponds to.
-    float dir_x = (x / get_pixel_width()) + 0.5;
-    float dir_y = (y / get_pixel_height()) + 0.5;
-    Vector3 ray_origin = (dir_x * get_width()) + (dir_y * get_height()) + get_direction();
+    return Ray(get_origin() + dx * x + dy * y, get_direction());
+}
+
+#pragma mark - Perspective Camera
+
+PerspectiveCamera::PerspectiveCamera()
+    : Camera(),
+      corner(),
+      dx(),
+      dy()
+{ }
+
+
+/*
+ * PerspectiveCamera::prepare --
+ *
+ * Lay out the image plane one unit in front of the eye, as wide as the angle of view. The direction, width and height
+ * vectors only give directions: the image's center, rows and columns. Their lengths don't matter, since the plane is
+ * always one unit out and pixels are square.
+ */
+void
+PerspectiveCamera::prepare()
+{
+    const int pw = get_pixel_width(), ph = get_pixel_height();
+    Vector3 forward = get_direction();
+    forward.normalize();
+    if (pw <= 0 || ph <= 0) {
+        corner = forward;
+        dx = dy = Vector3::Zero;
+        return;
+    }
+
+    const float pixel_size = 2.0 * tan(get_angle() * M_PI / 360.0) / pw;
+    Vector3 right = get_width(), down = get_height();
+    dx = right.normalize() * pixel_size;
+    dy = down.normalize() * pixel_size;
+    corner = forward - dx * (0.5f * (pw - 1)) - dy * (0.5f * (ph - 1));
+}
 
-    // Calculate the direction of the ray, given the camera's origin and normalize that vector.
-    Vector3 ray_direction = (ray_origin - get_origin()).normalize();
 
-    return Ray(get_origin(), ray_direction);
+/*
+ * PerspectiveCamera::compute_primary_ray --
+ *
+ * Compute the ray from the eye through the center of pixel (x,y).
+ */
+Ray
+PerspectiveCamera::compute_primary_ray(const int &x,
+                                       const int &y)
+    const
+{
+    Vector3 d = corner + dx * x + dy * y;
+    return Ray(get_origin(), d.normalize());
 }
@@ -3,6 +3,9 @@
  * The Camera is the eye into the scene. It defines several parameters and a single compute_primary_ray method
  * that generates rays with which the ray tracer draws the scene.
  *
+ * Cameras precompute what they can in prepare(), which has to be called after any of their parameters change and
+ * before any rays are computed, so that computing a ray costs no more than a few multiply-adds.
+ *
  * Eryn Wells <eryn@erynwells.me>
  */
 
@@ -18,7 +21,7 @@ class Camera
 {
 public:
     Camera();
-    ~Camera();
+    virtual ~Camera();
 
     int get_pixel_width() const;
     void set_pixel_width(const int &w);
@@ -31,7 +34,9 @@ public:
     const Vector3 &get_direction() const;
     void set_direction(const Vector3 &d);
     float get_angle() const;
+    void set_angle(float a);
 
+    virtual void prepare() = 0;
     virtual Ray compute_primary_ray(const int &x, const int &y) const = 0;
 
 private:
@@ -44,7 +49,7 @@ private:
     // Direction. A normalized vector defining where the camera is pointed.
     Vector3 direction;
 
-    // Horizontal viewing angle.
+    // Horizontal viewing angle, in degrees.
     float angle;
 };
 
@@ -53,7 +58,29 @@ class OrthographicCamera
     : public Camera
 {
 public:
+    OrthographicCamera();
+
+    void prepare();
+    Ray compute_primary_ray(const int &x, const int &y) const;
+
+private:
+    // How far apart neighboring pixels' ray origins are across and down the image.
+    Vector3 dx, dy;
+};
+
+
+class PerspectiveCamera
+    : public Camera
+{
+public:
+    PerspectiveCamera();
+
+    void prepare();
     Ray compute_primary_ray(const int &x, const int &y) const;
+
+private:
+    // The unnormalized direction through the center of pixel (0, 0), and the steps to the next pixel across and down.
+    Vector3 corner, dx, dy;
 };
 
 
@@ -6,6 +6,11 @@
  */
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <strings.h>
+#include <unistd.h>
 
 #include "basics.h"
 #include "light.h"
@@ -13,17 +18,339 @@
 #include "object_sphere.h"
 #include "object_plane.h"
 #include "scene.h"
+#include "tonemap.h"
+#include "writer_exr.h"
+#include "writer_pfm.h"
 #include "writer_png.h"
 
 const char *OUT_FILE = "charles_out.png";
 
 
+static void usage(const char *progname);
+static int parse_png_filter(const char *name);
+static int parse_exr_compression(const char *name);
+static int parse_tonemap_operator(const char *name);
+static bool has_extension(const char *filename, const char *extension);
+static void build_default_scene(Scene &scene);
+
+
 int
 main(int argc,
      const char *argv[])
 {
-    Scene scene = Scene();
+    Scene scene;
+
+    const char *out_file = OUT_FILE;
+    int nthreads = -1;
+    int max_depth = -1;
+    bool bake = false;
+    bool wavefront = false;
+    bool no_sort = false;
+    bool sort_stats = false;
+    bool lbvh = false;
+    int png_level = -1;
+    int png_filter = -1;
+    int exr_compression = -1;
+    bool tonemap = false;
+    float exposure = 0.0;
+    int tonemap_operator = ToneMapper::OperatorClamp;
+    bool dither = true;
+
+    const struct option long_options[] = {
+        { "bake", no_argument, NULL, 'b' },
+        { "help", no_argument, NULL, 'h' },
+        // Wavefront rendering is experimental, and slower than depth-first so far, so these are left out of the help.
+        { "wavefront", no_argument, NULL, 'w' },
+        { "no-sort", no_argument, NULL, 'n' },
+        { "sort-stats", no_argument, NULL, 's' },
+        { "lbvh", no_argument, NULL, 'l' },
+        { "png-level", required_argument, NULL, 'L' },
+        { "png-filter", required_argument, NULL, 'F' },
+        { "exr-compression", required_argument, NULL, 'C' },
+        { "exposure", required_argument, NULL, 'E' },
+        { "tonemap", required_argument, NULL, 'T' },
+        { "no-dither", no_argument, NULL, 'D' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, (char *const *)argv, "ho:j:d:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'b':
+                bake = true;
+                break;
+            case 'w':
+                wavefront = true;
+                break;
+            case 'n':
+                no_sort = true;
+                break;
+            case 's':
+                sort_stats = true;
+                break;
+            case 'l':
+                lbvh = true;
+                break;
+            case 'L':
+                png_level = atoi(optarg);
+                break;
+            case 'F':
+                png_filter = parse_png_filter(optarg);
+                if (png_filter < 0) {
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'C':
+                exr_compression = parse_exr_compression(optarg);
+                if (exr_compression < 0) {
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'E':
+                tonemap = true;
+                exposure = atof(optarg);
+                break;
+            case 'T':
+                tonemap = true;
+                tonemap_operator = parse_tonemap_operator(optarg);
+                if (tonemap_operator < 0) {
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'D':
+                dither = false;
+                break;
+            case 'o':
+                out_file = optarg;
+                break;
+            case 'j':
+                nthreads = atoi(optarg);
+                break;
+            case 'd':
+                max_depth = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? 0 : -1;
+        }
+    }
+
+    if (bake) {
+        if (optind >= argc) {
+            usage(argv[0]);
+            return -1;
+        }
+        return (scene.bake(argv[optind]) < 0) ? -1 : 0;
+    }
+
+    if (optind < argc) {
+        if (scene.read(argv[optind]) < 0) {
+            return -1;
+        }
+    }
+    else {
+        build_default_scene(scene);
+    }
+
+    // The command line overrides the scene file.
+    if (nthreads >= 0) {
+        scene.set_nthreads(nthreads);
+    }
+    if (max_depth >= 0) {
+        scene.set_max_depth(max_depth);
+    }
+    if (wavefront) {
+        scene.set_render_mode(Scene::RenderModeWavefront);
+    }
+    if (no_sort) {
+        scene.set_ray_sorting(false);
+    }
+    if (sort_stats) {
+        scene.set_ray_sort_stats(true);
+    }
+    if (lbvh) {
+        scene.set_bvh_builder(Scene::BVHBuilderLinear);
+    }
+
+    // The output file's extension picks its format.
+    Writer *writer;
+    if (has_extension(out_file, ".pfm")) {
+        writer = new PFMWriter();
+    }
+    else if (has_extension(out_file, ".exr")) {
+        EXRWriter *exr = new EXRWriter();
+        if (nthreads >= 0) {
+            exr->set_nthreads(nthreads);
+        }
+        if (exr_compression >= 0) {
+            exr->set_compression((EXRWriter::Compression)exr_compression);
+        }
+        writer = exr;
+    }
+    else {
+        PNGWriter *png = new PNGWriter();
+        if (nthreads >= 0) {
+            png->set_nthreads(nthreads);
+        }
+        if (png_level >= 0) {
+            png->set_level(png_level);
+        }
+        if (png_filter >= 0) {
+            png->set_filter((PNGWriter::Filter)png_filter);
+        }
+        writer = png;
+    }
+
+    // Tone mapping goes in front of the writer, and maps tiles on their way to it.
+    ToneMapper *mapper = NULL;
+    if (tonemap) {
+        mapper = new ToneMapper(*writer);
+        if (nthreads >= 0) {
+            mapper->set_nthreads(nthreads);
+        }
+        mapper->set_exposure(exposure);
+        mapper->set_operator((ToneMapper::Operator)tonemap_operator);
+        mapper->set_dither(dither);
+    }
+
+    // Render, streaming the image into the file as it's finished. The writer has reported any failure to write it.
+    int nbytes = scene.render(mapper ? *mapper : *writer, out_file);
+    delete mapper;
+    delete writer;
+
+    return (nbytes < 0) ? -1 : 0;
+}
+
+
+/*
+ * usage --
+ *
+ * Print a usage message.
+ */
+static void
+usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [-h] [-o outfile] [-j threads] [-d depth] [--lbvh]\n",
+            progname);
+    fprintf(stderr, "       %*s [--png-level level] [--png-filter filter] [--exr-compression method]\n",
+            (int)strlen(progname), "");
+    fprintf(stderr, "       %*s [--exposure stops] [--tonemap operator] [--no-dither] [scene]\n",
+            (int)strlen(progname), "");
+    fprintf(stderr, "       %s --bake scene\n", progname);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  -h          Show this help.\n");
+    fprintf(stderr, "  -o outfile  Write the rendered image to outfile, as a PNG, or as floats if it ends in\n");
+    fprintf(stderr, "              .pfm or .exr. (default: %s)\n", OUT_FILE);
+    fprintf(stderr, "  -j threads  Render with this many threads. 0 means one per CPU. (default: 0)\n");
+    fprintf(stderr, "  -d depth    Follow reflections at most this many bounces deep, counting the first hit.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  --lbvh      Build the BVH with the fast, parallel linear builder instead of the SAH builder.\n");
+    fprintf(stderr, "              Quicker to build, slower to trace.\n");
+    fprintf(stderr, "  --png-level level\n");
+    fprintf(stderr, "              Compress the image at this zlib level, from 0 (fastest) to 9 (smallest).\n");
+    fprintf(stderr, "              (default: 6)\n");
+    fprintf(stderr, "  --png-filter filter\n");
+    fprintf(stderr, "              Filter rows before compressing them with none, sub, up, average, paeth, or\n");
+    fprintf(stderr, "              adaptive, which picks one per row. (default: adaptive)\n");
+    fprintf(stderr, "  --exr-compression method\n");
+    fprintf(stderr, "              Compress EXR files with none, rle, zips, or zip. (default: zip)\n");
+    fprintf(stderr, "  --exposure stops\n");
+    fprintf(stderr, "              Brighten the image by this many stops, or darken it if negative, and tone map\n");
+    fprintf(stderr, "              it.\n");
+    fprintf(stderr, "  --tonemap operator\n");
+    fprintf(stderr, "              Map the image for display with clamp, reinhard, or aces, then encode it as\n");
+    fprintf(stderr, "              sRGB and dither it to 8 bits. (default: none)\n");
+    fprintf(stderr, "  --no-dither With --exposure or --tonemap, don't dither.\n");
+    fprintf(stderr, "  --bake      Don't render. Write a binary cache of the scene next to it, which later runs read\n");
+    fprintf(stderr, "              instead of the scene file for as long as the scene file doesn't change.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Renders the scene file, or a built-in test scene if none is given.\n");
+}
+
+
+/*
+ * parse_png_filter --
+ *
+ * Look up a PNG filter by name. Return -1 if there's no such filter.
+ */
+static int
+parse_png_filter(const char *name)
+{
+    static const char *names[] = { "none", "sub", "up", "average", "paeth", "adaptive" };
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return PNGWriter::FilterNone + i;
+        }
+    }
+    fprintf(stderr, "unknown PNG filter '%s'\n", name);
+    return -1;
+}
+
+
+/*
+ * parse_exr_compression --
+ *
+ * Look up an EXR compression method by name. Return -1 if there's no such method.
+ */
+static int
+parse_exr_compression(const char *name)
+{
+    static const char *names[] = { "none", "rle", "zips", "zip" };
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return EXRWriter::CompressionNone + i;
+        }
+    }
+    fprintf(stderr, "unknown EXR compression '%s'\n", name);
+    return -1;
+}
+
+
+/*
+ * parse_tonemap_operator --
+ *
+ * Look up a tone mapping operator by name. Return -1 if there's no such operator.
+ */
+static int
+parse_tonemap_operator(const char *name)
+{
+    static const char *names[] = { "clamp", "reinhard", "aces" };
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return ToneMapper::OperatorClamp + i;
+        }
+    }
+    fprintf(stderr, "unknown tone mapping operator '%s'\n", name);
+    return -1;
+}
+
 
+/*
+ * has_extension --
+ *
+ * Return true if filename ends in extension, ignoring case.
+ */
+static bool
+has_extension(const char *filename,
+              const char *extension)
+{
+    const size_t length = strlen(filename), extension_length = strlen(extension);
+    return length >= extension_length && strcasecmp(filename + length - extension_length, extension) == 0;
+}
+
+
+/*
+ * build_default_scene --
+ *
+ * Fill in the built-in test scene: three spheres and a little one, over a plane.
+ */
+static void
+build_default_scene(Scene &scene)
+{
     scene.get_ambient().set_intensity(1.0);
 
     Material *m1 = new Material();
@@ -34,6 +361,10 @@ main(int argc,
     m3->set_diffuse_color(Color::Blue);
     Material *m4 = new Material();
     m4->set_diffuse_color(Color(1.0, 0.0, 1.0));
+    scene.add_material(m1);
+    scene.add_material(m2);
+    scene.add_material(m3);
+    scene.add_material(m4);
 
     // Make some spheres.
     Sphere *s1 = new Sphere(Vector3(233, 290, 0), 80.0);
@@ -56,12 +387,4 @@ main(int argc,
 
     PointLight *l1 = new PointLight(Vector3(0.0, 240.0, 100.0), Color::White, 1.0);
     scene.add_light(l1);
-
-    // Render.
-    scene.render();
-
-    Writer *writer = new PNGWriter();
-    scene.write(*writer, OUT_FILE);
-
-    return 0;
 }
@@ -0,0 +1,605 @@
+/* framebuffer.cc
+ *
+ * Definition of the Framebuffer.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "framebuffer.h"
+#include "morton.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRAMEBUFFER_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+// A half float 1.0, for the alpha of pixels stored without one.
+const uint16_t HalfOne = 0x3c00;
+
+
+inline size_t
+get_format_size(Framebuffer::Format format)
+{
+    switch (format) {
+        case Framebuffer::FormatRGBA32F:
+            return 4 * sizeof(float);
+        case Framebuffer::FormatRGB32F:
+            return 3 * sizeof(float);
+        case Framebuffer::FormatRGBA16F:
+            return 4 * sizeof(uint16_t);
+        case Framebuffer::FormatRGB16F:
+            return 3 * sizeof(uint16_t);
+    }
+    return 0;
+}
+
+#pragma mark - Half Floats
+
+/*
+ * store_halves_scalar --
+ * load_halves_scalar --
+ *
+ * Convert n pixels to or from channels half floats each, three or four. Pixels loaded without alpha get an alpha of 1.
+ */
+void
+store_halves_scalar(const Color *in,
+                    int n,
+                    int channels,
+                    uint16_t *out)
+{
+    for (int i = 0; i < n; i++) {
+        out[0] = float_to_half(in[i].red);
+        out[1] = float_to_half(in[i].green);
+        out[2] = float_to_half(in[i].blue);
+        if (channels == 4) {
+            out[3] = float_to_half(in[i].alpha);
+        }
+        out += channels;
+    }
+}
+
+void
+load_halves_scalar(const uint16_t *in,
+                   int n,
+                   int channels,
+                   Color *out)
+{
+    for (int i = 0; i < n; i++) {
+        out[i] = Color(half_to_float(in[0]), half_to_float(in[1]), half_to_float(in[2]),
+                       half_to_float((channels == 4) ? in[3] : HalfOne));
+        in += channels;
+    }
+}
+
+
+#if FRAMEBUFFER_X86
+
+/*
+ * store_halves_f16c --
+ * load_halves_f16c --
+ *
+ * The same, with F16C instructions, a pixel at a time.
+ */
+__attribute__((target("f16c")))
+void
+store_halves_f16c(const Color *in,
+                  int n,
+                  int channels,
+                  uint16_t *out)
+{
+    for (int i = 0; i < n; i++) {
+        const __m128i h = _mm_cvtps_ph(_mm_loadu_ps(&in[i].red), _MM_FROUND_TO_NEAREST_INT);
+        if (channels == 4) {
+            _mm_storel_epi64((__m128i *)out, h);
+        }
+        else {
+            uint16_t pixel[8];
+            _mm_storeu_si128((__m128i *)pixel, h);
+            memcpy(out, pixel, 3 * sizeof(uint16_t));
+        }
+        out += channels;
+    }
+}
+
+__attribute__((target("f16c")))
+void
+load_halves_f16c(const uint16_t *in,
+                 int n,
+                 int channels,
+                 Color *out)
+{
+    uint16_t pixel[8] = { 0, 0, 0, HalfOne, 0, 0, 0, 0 };
+    for (int i = 0; i < n; i++) {
+        memcpy(pixel, in, channels * sizeof(uint16_t));
+        _mm_storeu_ps(&out[i].red, _mm_cvtph_ps(_mm_loadu_si128((const __m128i *)pixel)));
+        in += channels;
+    }
+}
+
+
+#endif /* FRAMEBUFFER_X86 */
+
+
+/*
+ * has_f16c --
+ *
+ * Determine whether the CPU can convert half floats itself. Checked once.
+ */
+bool
+has_f16c()
+{
+#if FRAMEBUFFER_X86
+    static const bool f16c = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("f16c");
+    }();
+    return f16c;
+#else
+    return false;
+#endif
+}
+
+
+inline void
+store_halves(const Color *in,
+             int n,
+             int channels,
+             uint16_t *out)
+{
+#if FRAMEBUFFER_X86
+    if (has_f16c()) {
+        store_halves_f16c(in, n, channels, out);
+        return;
+    }
+#endif
+    store_halves_scalar(in, n, channels, out);
+}
+
+
+inline void
+load_halves(const uint16_t *in,
+            int n,
+            int channels,
+            Color *out)
+{
+#if FRAMEBUFFER_X86
+    if (has_f16c()) {
+        load_halves_f16c(in, n, channels, out);
+        return;
+    }
+#endif
+    load_halves_scalar(in, n, channels, out);
+}
+
+#pragma mark - Spans
+
+/*
+ * store_span --
+ * load_span --
+ *
+ * Convert n pixels, which are next to each other in storage, to or from the given format.
+ */
+void
+store_span(Framebuffer::Format format,
+           const Color *in,
+           int n,
+           unsigned char *out)
+{
+    switch (format) {
+        case Framebuffer::FormatRGBA32F:
+            memcpy(out, in, n * sizeof(Color));
+            break;
+        case Framebuffer::FormatRGB32F:
+            for (int i = 0; i < n; i++) {
+                memcpy(out + i * 3 * sizeof(float), &in[i].red, 3 * sizeof(float));
+            }
+            break;
+        case Framebuffer::FormatRGBA16F:
+            store_halves(in, n, 4, (uint16_t *)out);
+            break;
+        case Framebuffer::FormatRGB16F:
+            store_halves(in, n, 3, (uint16_t *)out);
+            break;
+    }
+}
+
+void
+load_span(Framebuffer::Format format,
+          const unsigned char *in,
+          int n,
+          Color *out)
+{
+    switch (format) {
+        case Framebuffer::FormatRGBA32F:
+            memcpy(out, in, n * sizeof(Color));
+            break;
+        case Framebuffer::FormatRGB32F:
+            for (int i = 0; i < n; i++) {
+                float rgb[3];
+                memcpy(rgb, in + i * 3 * sizeof(float), 3 * sizeof(float));
+                out[i] = Color(rgb[0], rgb[1], rgb[2]);
+            }
+            break;
+        case Framebuffer::FormatRGBA16F:
+            load_halves((const uint16_t *)in, n, 4, out);
+            break;
+        case Framebuffer::FormatRGB16F:
+            load_halves((const uint16_t *)in, n, 3, out);
+            break;
+    }
+}
+
+} /* anonymous namespace */
+
+#pragma mark - Half Float Conversion
+
+/*
+ * float_to_half --
+ *
+ * Convert a float to the nearest half float, with ties going to the even one, as F16C does. Floats too big for a half
+ * become infinity, ones too small to be a normal half become subnormal halves or zero, and NaNs stay NaNs.
+ */
+uint16_t
+float_to_half(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    const uint16_t sign = (x >> 16) & 0x8000;
+    const uint32_t magnitude = x & 0x7fffffff;
+
+    if (magnitude >= 0x7f800000) {
+        // Infinity, or a NaN, made quiet, with the top of its payload.
+        return sign | 0x7c00 | ((magnitude > 0x7f800000) ? (0x200 | ((magnitude >> 13) & 0x3ff)) : 0);
+    }
+    if (magnitude >= 0x477ff000) {
+        // 65520, halfway between the largest half and the next power of two, and up.
+        return sign | 0x7c00;
+    }
+    if (magnitude < 0x38800000) {
+        // Below 2^-14, the smallest normal half. Anything up to half of 2^-24, the smallest subnormal, rounds to 0.
+        if (magnitude <= 0x33000000) {
+            return sign;
+        }
+        const uint32_t exponent = magnitude >> 23;
+        const uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+        const int shift = 126 - exponent;
+        uint32_t h = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (h & 1))) {
+            h++;
+        }
+        return sign | h;
+    }
+
+    // Rebias the exponent from 127 to 15 and round away the low 13 bits of the mantissa, which can carry into the
+    // exponent.
+    uint32_t h = (magnitude - 0x38000000) >> 13;
+    const uint32_t rest = magnitude & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+        h++;
+    }
+    return sign | h;
+}
+
+
+/*
+ * half_to_float --
+ *
+ * Convert a half float to a float, which is always exact.
+ */
+float
+half_to_float(uint16_t h)
+{
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    const uint32_t exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff;
+    uint32_t x;
+    if (exponent == 0x1f) {
+        x = sign | 0x7f800000 | (mantissa << 13) | (mantissa ? 0x400000 : 0);
+    }
+    else if (exponent == 0) {
+        // Zero or subnormal: mantissa * 2^-24, which a float holds exactly.
+        const float f = mantissa * (1.0f / 16777216.0f);
+        memcpy(&x, &f, sizeof(x));
+        x |= sign;
+    }
+    else {
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+#pragma mark - Framebuffer
+
+/*
+ * Framebuffer::Framebuffer --
+ *
+ * Default constructor. Create an empty framebuffer, which will hold Colors in row order.
+ */
+Framebuffer::Framebuffer()
+    : format(FormatRGBA32F),
+      order(OrderLinear),
+      current_format(FormatRGBA32F),
+      current_order(OrderLinear),
+      width(0),
+      height(0),
+      tile_size(1),
+      ntiles_x(0),
+      storage()
+{ }
+
+
+/*
+ * Framebuffer::get_format --
+ * Framebuffer::set_format --
+ * Framebuffer::get_order --
+ * Framebuffer::set_order --
+ *
+ * Get and set the format and order pixels are stored in. Changes take effect the next time the framebuffer is
+ * allocated; the pixels it holds now stay as they are.
+ */
+Framebuffer::Format
+Framebuffer::get_format()
+    const
+{
+    return format;
+}
+
+void
+Framebuffer::set_format(Format f)
+{
+    format = f;
+}
+
+Framebuffer::Order
+Framebuffer::get_order()
+    const
+{
+    return order;
+}
+
+void
+Framebuffer::set_order(Order o)
+{
+    order = o;
+}
+
+
+/*
+ * Framebuffer::allocate --
+ *
+ * Make room for a width x height image, cleared to black, in the current format and order. Tiled orders lay pixels out
+ * in square tiles tile_size on a side; Morton order rounds that up to a power of two. The image is padded out to whole
+ * tiles.
+ */
+void
+Framebuffer::allocate(int w,
+                      int h,
+                      int size)
+{
+    current_format = format;
+    current_order = order;
+    width = w;
+    height = h;
+    tile_size = std::max(1, size);
+    if (order == OrderMorton) {
+        int rounded = 1;
+        while (rounded < tile_size && rounded < (1 << 15)) {
+            rounded *= 2;
+        }
+        tile_size = rounded;
+    }
+
+    size_t npixels = (size_t)width * height;
+    ntiles_x = 0;
+    if (order != OrderLinear) {
+        ntiles_x = (width + tile_size - 1) / tile_size;
+        const int ntiles_y = (height + tile_size - 1) / tile_size;
+        npixels = (size_t)ntiles_x * ntiles_y * tile_size * tile_size;
+    }
+    const size_t nbytes = npixels * get_pixel_size();
+    storage.assign((nbytes + sizeof(Color) - 1) / sizeof(Color), Color());
+}
+
+
+/*
+ * Framebuffer::release --
+ *
+ * Let go of the image.
+ */
+void
+Framebuffer::release()
+{
+    std::vector<Color>().swap(storage);
+    width = height = 0;
+    ntiles_x = 0;
+}
+
+
+/*
+ * Framebuffer::get_width --
+ * Framebuffer::get_height --
+ * Framebuffer::get_tile_size --
+ * Framebuffer::get_pixel_size --
+ * Framebuffer::get_nbytes --
+ *
+ * Get the size of the image held now, the edge length of its tiles, the bytes each pixel takes, and the bytes the
+ * whole image takes, padding included.
+ */
+int
+Framebuffer::get_width()
+    const
+{
+    return width;
+}
+
+int
+Framebuffer::get_height()
+    const
+{
+    return height;
+}
+
+int
+Framebuffer::get_tile_size()
+    const
+{
+    return tile_size;
+}
+
+size_t
+Framebuffer::get_pixel_size()
+    const
+{
+    return get_format_size(current_format);
+}
+
+size_t
+Framebuffer::get_nbytes()
+    const
+{
+    return storage.size() * sizeof(Color);
+}
+
+
+/*
+ * Framebuffer::get_index --
+ *
+ * Get where pixel (x, y) is in storage, counting in pixels.
+ */
+size_t
+Framebuffer::get_index(int x,
+                       int y)
+    const
+{
+    if (current_order == OrderLinear) {
+        return (size_t)y * width + x;
+    }
+    const size_t tile = (size_t)(y / tile_size) * ntiles_x + x / tile_size;
+    const int tx = x % tile_size, ty = y % tile_size;
+    const size_t within = (current_order == OrderMorton) ? morton_code2(tx, ty) : ty * tile_size + tx;
+    return tile * tile_size * tile_size + within;
+}
+
+
+/*
+ * Framebuffer::get_pixels --
+ *
+ * Get the pixels, if they're Colors in row order, or NULL if they aren't.
+ */
+Color *
+Framebuffer::get_pixels()
+{
+    if (storage.empty() || current_format != FormatRGBA32F || current_order != OrderLinear) {
+        return NULL;
+    }
+    return storage.data();
+}
+
+const Color *
+Framebuffer::get_pixels()
+    const
+{
+    return const_cast<Framebuffer *>(this)->get_pixels();
+}
+
+
+/*
+ * Framebuffer::get_span --
+ *
+ * Get how many of the n pixels of a row starting at column x are next to each other in storage.
+ */
+int
+Framebuffer::get_span(int x,
+                      int n)
+    const
+{
+    switch (current_order) {
+        case OrderLinear:
+            return n;
+        case OrderTiled:
+            return std::min(n, tile_size - x % tile_size);
+        case OrderMorton:
+            // Only pairs: x is the lowest bit of a Morton code.
+            return std::min(n, 2 - x % 2);
+    }
+    return 1;
+}
+
+
+/*
+ * Framebuffer::store --
+ * Framebuffer::load --
+ *
+ * Store or load the width x height rectangle of pixels at (x, y). The rows of pixels are stride Colors apart. Safe to
+ * call from many threads at once, as long as the rectangles being stored don't overlap.
+ */
+void
+Framebuffer::store(int x,
+                   int y,
+                   int w,
+                   int h,
+                   const Color *pixels,
+                   int stride)
+{
+    unsigned char *data = (unsigned char *)storage.data();
+    const size_t pixel_size = get_pixel_size();
+    for (int r = 0; r < h; r++) {
+        const Color *row = pixels + (size_t)r * stride;
+        for (int i = 0; i < w;) {
+            const int n = get_span(x + i, w - i);
+            store_span(current_format, row + i, n, data + get_index(x + i, y + r) * pixel_size);
+            i += n;
+        }
+    }
+}
+
+void
+Framebuffer::load(int x,
+                  int y,
+                  int w,
+                  int h,
+                  Color *pixels,
+                  int stride)
+    const
+{
+    const unsigned char *data = (const unsigned char *)storage.data();
+    const size_t pixel_size = get_pixel_size();
+    for (int r = 0; r < h; r++) {
+        Color *row = pixels + (size_t)r * stride;
+        for (int i = 0; i < w;) {
+            const int n = get_span(x + i, w - i);
+            load_span(current_format, data + get_index(x + i, y + r) * pixel_size, n, row + i);
+            i += n;
+        }
+    }
+}
+
+
+/*
+ * Framebuffer::load_rows --
+ *
+ * Get nrows whole rows starting at row y, as Colors in row order. They're read in place if that's how they're stored,
+ * and loaded into buffer if not.
+ */
+const Color *
+Framebuffer::load_rows(int y,
+                       int nrows,
+                       std::vector<Color> &buffer)
+    const
+{
+    const Color *pixels = get_pixels();
+    if (pixels != NULL) {
+        return pixels + (size_t)y * width;
+    }
+    buffer.resize((size_t)nrows * width);
+    load(0, y, width, nrows, buffer.data(), width);
+    return buffer.data();
+}
@@ -0,0 +1,96 @@
+/* framebuffer.h
+ *
+ * Declaration of the Framebuffer, which holds the image a Scene renders.
+ *
+ * By default pixels are Colors in row order, which can be read in place. The image can be kept more compactly: RGB32F
+ * drops the alpha channel no writer uses, and RGBA16F and RGB16F store half floats, which keep about three
+ * significant digits over a range far wider than renders need, in a half or three eighths of the memory. Half floats
+ * are converted with F16C instructions if the CPU has them, and by the code below if not, with the same results.
+ *
+ * Pixels can also be laid out a tile at a time, in row order within each tile or in Morton order, which puts a small
+ * square of pixels in each cache line or two. Render threads working on tiles that match then write memory of their
+ * own, and nearby pixels stay close together. Morton tiles are rounded up to a power of two on a side.
+ *
+ * Colors go in a rectangle at a time with store, and come back out with load, in row order whatever the layout.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __FRAMEBUFFER_H__
+#define __FRAMEBUFFER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "basics.h"
+
+
+uint16_t float_to_half(float f);
+float half_to_float(uint16_t h);
+
+
+class Framebuffer
+{
+public:
+    enum Format {
+        FormatRGBA32F = 0,
+        FormatRGB32F,
+        FormatRGBA16F,
+        FormatRGB16F,
+    };
+
+    enum Order {
+        OrderLinear = 0,
+        OrderTiled,
+        OrderMorton,
+    };
+
+    Framebuffer();
+
+    Format get_format() const;
+    void set_format(Format f);
+    Order get_order() const;
+    void set_order(Order o);
+
+    void allocate(int width, int height, int tile_size);
+    void release();
+
+    int get_width() const;
+    int get_height() const;
+    int get_tile_size() const;
+    size_t get_pixel_size() const;
+    size_t get_nbytes() const;
+    size_t get_index(int x, int y) const;
+
+    Color *get_pixels();
+    const Color *get_pixels() const;
+
+    void store(int x, int y, int width, int height, const Color *pixels, int stride);
+    void load(int x, int y, int width, int height, Color *pixels, int stride) const;
+    const Color *load_rows(int y, int nrows, std::vector<Color> &buffer) const;
+
+private:
+    Framebuffer(const Framebuffer &other);
+    Framebuffer &operator=(const Framebuffer &other);
+
+    int get_span(int x, int n) const;
+
+    // Format and order of the next allocation.
+    Format format;
+    Order order;
+
+    // Format and order of the pixels held now.
+    Format current_format;
+    Order current_order;
+
+    int width, height;
+
+    // Edge length of a tile, and how many tiles there are across, in tiled orders.
+    int tile_size, ntiles_x;
+
+    // The pixels. They're held as Colors so they're aligned for Colors, whatever format they're in.
+    std::vector<Color> storage;
+};
+
+#endif
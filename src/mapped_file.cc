@@ -0,0 +1,111 @@
+/* mapped_file.cc
+ *
+ * Definition of memory-mapped files.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.h"
+
+
+MappedFile::MappedFile()
+    : _is_open(false),
+      data(NULL),
+      size(0)
+{ }
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+/*
+ * MappedFile::open --
+ *
+ * Map the named file into memory, replacing whatever was mapped before. Return false if it couldn't be opened; errno
+ * says why. Empty files can't be mapped, but they open successfully with no data.
+ */
+bool
+MappedFile::open(const std::string &filename)
+{
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        ::close(fd);
+        return false;
+    }
+
+    if (st.st_size > 0) {
+        void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        data = addr;
+        size = st.st_size;
+    }
+
+    // The mapping holds its own reference to the file.
+    ::close(fd);
+    _is_open = true;
+    return true;
+}
+
+
+/*
+ * MappedFile::close --
+ *
+ * Unmap the file. Pointers into it are no longer valid.
+ */
+void
+MappedFile::close()
+{
+    if (data != NULL) {
+        munmap(data, size);
+    }
+    data = NULL;
+    size = 0;
+    _is_open = false;
+}
+
+
+/*
+ * MappedFile::is_open --
+ * MappedFile::get_data --
+ * MappedFile::get_size --
+ *
+ * Accessors for the mapped file.
+ */
+bool
+MappedFile::is_open()
+    const
+{
+    return _is_open;
+}
+
+const char *
+MappedFile::get_data()
+    const
+{
+    return (const char *)data;
+}
+
+size_t
+MappedFile::get_size()
+    const
+{
+    return size;
+}
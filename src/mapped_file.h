@@ -0,0 +1,37 @@
+/* mapped_file.h
+ *
+ * A read-only view of a whole file, mapped into memory. The mapping stays valid for the life of the MappedFile.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <cstddef>
+#include <string>
+
+
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const std::string &filename);
+    void close();
+
+    bool is_open() const;
+    const char *get_data() const;
+    size_t get_size() const;
+
+private:
+    MappedFile(const MappedFile &other);
+    MappedFile &operator=(const MappedFile &other);
+
+    bool _is_open;
+    void *data;
+    size_t size;
+};
+
+#endif
@@ -0,0 +1,89 @@
+/* morton.h
+ *
+ * Morton codes. A Morton code interleaves the bits of a point's quantized coordinates, x in the lowest bit, then y,
+ * then z, then x again, and so on. Sorting points by their codes lays them out along a Z-order curve, which keeps
+ * points that are close in space mostly close in the sorted order too.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __MORTON_H__
+#define __MORTON_H__
+
+#include <cstdint>
+
+#include "basics.h"
+
+
+// Bits of each coordinate in a Morton code. Three of them fill 30 bits.
+static const unsigned int MortonBits = 10;
+
+
+/*
+ * morton_expand --
+ *
+ * Spread the low 10 bits of v out so there are two zero bits between each of them.
+ */
+inline uint32_t
+morton_expand(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+
+/*
+ * morton_expand2 --
+ *
+ * Spread the low 16 bits of v out so there's a zero bit between each of them.
+ */
+inline uint32_t
+morton_expand2(uint32_t v)
+{
+    v &= 0x0000FFFFu;
+    v = (v | (v << 8)) & 0x00FF00FFu;
+    v = (v | (v << 4)) & 0x0F0F0F0Fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+}
+
+
+/*
+ * morton_code2 --
+ *
+ * Compute the 32 bit Morton code of a point on a 2D grid, from the low 16 bits of each coordinate.
+ */
+inline uint32_t
+morton_code2(uint32_t x,
+             uint32_t y)
+{
+    return morton_expand2(x) | (morton_expand2(y) << 1);
+}
+
+
+/*
+ * morton_code --
+ *
+ * Compute the 30 bit Morton code of point p, quantized to a 1024^3 grid over the given box. Points outside the box are
+ * clamped to it.
+ */
+inline uint32_t
+morton_code(const Vector3 &p,
+            const AABB &box)
+{
+    const float scale = (1 << MortonBits) - 1;
+    const Vector3 extent = box.extent();
+    uint32_t q[3];
+    for (int axis = 0; axis < 3; axis++) {
+        float f = (extent[axis] > 0.0f) ? (p[axis] - box.min[axis]) / extent[axis] : 0.0f;
+        f = (f < 0.0f) ? 0.0f : ((f > 1.0f) ? 1.0f : f);
+        q[axis] = (uint32_t)(f * scale);
+    }
+    return morton_expand(q[0]) | (morton_expand(q[1]) << 1) | (morton_expand(q[2]) << 2);
+}
+
+#endif
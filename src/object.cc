@@ -13,6 +13,16 @@
 #include "material.h"
 #include "object.h"
 
+#pragma mark - Object Observers
+
+/*
+ * ObjectObserver::~ObjectObserver --
+ *
+ * Destructor.
+ */
+ObjectObserver::~ObjectObserver()
+{ }
+
 #pragma mark - Objects
 
 /*
@@ -31,7 +41,9 @@ Object::Object()
  * Constructor. Create a new Object with an origin at o.
  */
 Object::Object(Vector3 o)
-    : origin(o)
+    : origin(o),
+      observer(NULL),
+      observer_id(0)
 { }
 
 
@@ -52,6 +64,35 @@ void
 Object::set_origin(Vector3 v)
 {
     origin = v;
+    notify_changed();
+}
+
+
+/*
+ * Object::set_observer --
+ *
+ * Report changes to this Object to obs, as id. Pass NULL to stop reporting them.
+ */
+void
+Object::set_observer(ObjectObserver *obs,
+                     unsigned int id)
+{
+    observer = obs;
+    observer_id = id;
+}
+
+
+/*
+ * Object::notify_changed --
+ *
+ * Tell the observer, if there is one, that this Object has changed. Subclasses call this from their setters.
+ */
+void
+Object::notify_changed()
+{
+    if (observer != NULL) {
+        observer->object_changed(observer_id);
+    }
 }
 
 
@@ -63,6 +104,20 @@ operator<<(std::ostream &os, const Object &o)
     return os;
 }
 
+#pragma mark - Intersections
+
+/*
+ * Intersection::Intersection --
+ *
+ * Default constructor. Create an empty intersection record infinitely far away.
+ */
+Intersection::Intersection()
+    : t(INFINITY),
+      shape(NULL),
+      shape_id(0),
+      primitive_id(0)
+{ }
+
 #pragma mark - Shapes
 
 /*
@@ -112,3 +167,47 @@ Shape::set_material(Material *mat)
 {
     material = mat;
 }
+
+
+/*
+ * Shape::occluded --
+ *
+ * Determine whether ray hits this shape in [tmin, tmax]. By default, look for an intersection and throw it away.
+ */
+bool
+Shape::occluded(const Ray &ray,
+                float tmin,
+                float tmax)
+    const
+{
+    Intersection hit;
+    return intersect(ray, tmin, tmax, hit);
+}
+
+
+/*
+ * Shape::compute_bounds --
+ *
+ * Compute an axis-aligned box enclosing this shape and store it in bounds. Shapes that extend infinitely (planes, for
+ * example) cannot be bounded; they return false and leave bounds untouched. This is the default.
+ */
+bool
+Shape::compute_bounds(AABB &bounds)
+    const
+{
+    return false;
+}
+
+
+/*
+ * Shape::compute_hit_normal --
+ *
+ * Compute the surface normal at point p of hit. By default, the normal at p.
+ */
+Vector3
+Shape::compute_hit_normal(const Intersection &hit,
+                          const Vector3 &p)
+    const
+{
+    return compute_normal(p);
+}
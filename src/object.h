@@ -16,6 +16,19 @@
 #include "texture.h"
 
 
+/*
+ * Something that keeps derived data about Objects, like an acceleration structure over their bounds, and needs to know
+ * when they change. Each Object reports to at most one observer, under an ID the observer gave it.
+ */
+class ObjectObserver
+{
+public:
+    virtual ~ObjectObserver();
+
+    virtual void object_changed(unsigned int id) = 0;
+};
+
+
 class Object
 {
 public:
@@ -25,15 +38,43 @@ public:
     Vector3 get_origin() const;
     void set_origin(Vector3 v);
 
+    void set_observer(ObjectObserver *obs, unsigned int id);
+
     friend std::ostream &operator<<(std::ostream &os, const Object &o);
 
+protected:
+    void notify_changed();
+
 private:
     Vector3 origin;
+
+    ObjectObserver *observer;
+    unsigned int observer_id;
 };
 
 std::ostream &operator<<(std::ostream &os, const Object &o);
 
 
+class Shape;
+
+
+/*
+ * A ray-shape intersection. Shape::intersect fills in t, shape, and primitive_id; primitive_id picks out a piece of
+ * shapes that are made of several, and is 0 for shapes that aren't. shape_id is assigned by whoever owns the shapes
+ * being tested (the Scene, usually) and identifies the shape within that collection. Records are owned by the caller,
+ * so finding an intersection never allocates.
+ */
+struct Intersection
+{
+    Intersection();
+
+    float t;
+    const Shape *shape;
+    unsigned int shape_id;
+    unsigned int primitive_id;
+};
+
+
 class Shape
     : public Object
 {
@@ -45,9 +86,28 @@ public:
     Material &get_material() const;
     void set_material(Material *mat);
 
-    virtual int does_intersect(const Ray &ray, float **t) const = 0;
+    /*
+     * Find the nearest intersection of ray with this shape with t in [tmin, tmax]. If there is one, fill in hit and
+     * return true. Otherwise return false and leave hit alone, so a caller can keep the nearest hit so far in it and
+     * pass hit.t as tmax for the next shape.
+     */
+    virtual bool intersect(const Ray &ray, float tmin, float tmax, Intersection &hit) const = 0;
+
+    /*
+     * Determine whether ray hits this shape anywhere in [tmin, tmax]. This is all shadow rays need to know, and shapes
+     * can often answer it more cheaply than finding the intersection itself.
+     */
+    virtual bool occluded(const Ray &ray, float tmin, float tmax) const;
+
     virtual bool point_is_on_surface(const Vector3 &p) const = 0;
     virtual Vector3 compute_normal(const Vector3 &p) const = 0;
+    virtual bool compute_bounds(AABB &bounds) const;
+
+    /*
+     * Compute the surface normal at point p of an intersection this shape found. Shapes whose intersections need more
+     * than the point to work out the normal, like those made of pieces, or instances of other shapes, override this.
+     */
+    virtual Vector3 compute_hit_normal(const Intersection &hit, const Vector3 &p) const;
 
 private:
     Material *material;
@@ -0,0 +1,408 @@
+/* object_instance.cc
+ *
+ * Definition of instances and the groups of shapes they share.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <vector>
+
+#include "basics.h"
+#include "object.h"
+#include "object_instance.h"
+#include "object_sphere.h"
+#include "transform.h"
+
+#pragma mark - Instance Groups
+
+/*
+ * InstanceGroup::InstanceGroup --
+ *
+ * Default constructor. Create an empty group.
+ */
+InstanceGroup::InstanceGroup()
+    : shapes(),
+      bounds(),
+      spheres(),
+      other_shapes(),
+      bvh(),
+      wide_bvh(),
+      built(false)
+{ }
+
+
+/*
+ * InstanceGroup::~InstanceGroup --
+ *
+ * Destructor. Delete the group's shapes.
+ */
+InstanceGroup::~InstanceGroup()
+{
+    wide_bvh.clear();
+    for (Shape *s : shapes) {
+        delete s;
+    }
+}
+
+
+/*
+ * InstanceGroup::add_shape --
+ *
+ * Add a shape to the group, which takes ownership of it. Shapes without finite bounds, and Instances, can't be added;
+ * return false for those, and leave them with the caller.
+ */
+bool
+InstanceGroup::add_shape(Shape *shape)
+{
+    AABB b;
+    if (dynamic_cast<Instance *>(shape) != NULL || !shape->compute_bounds(b)) {
+        return false;
+    }
+    shapes.push_back(shape);
+    bounds.extend(b);
+    built = false;
+    return true;
+}
+
+
+/*
+ * InstanceGroup::build --
+ *
+ * Sort the group's shapes into its rendering arrays and build its BVH.
+ */
+void
+InstanceGroup::build()
+{
+    spheres.clear();
+    other_shapes.clear();
+    for (Shape *s : shapes) {
+        if (const Sphere *sphere = dynamic_cast<const Sphere *>(s)) {
+            spheres.add(*sphere);
+        }
+        else {
+            other_shapes.push_back(s);
+        }
+    }
+
+    std::vector<AABB> prim_bounds;
+    prim_bounds.reserve(shapes.size());
+    bounds = AABB();
+    for (unsigned int i = 0; i < spheres.size(); i++) {
+        prim_bounds.push_back(spheres.compute_bounds(i));
+        bounds.extend(prim_bounds.back());
+    }
+    AABB b;
+    for (Shape *s : other_shapes) {
+        s->compute_bounds(b);
+        prim_bounds.push_back(b);
+        bounds.extend(b);
+    }
+
+    bvh.build(prim_bounds, spheres.get_kernel().width);
+    wide_bvh.build(bvh);
+    built = true;
+}
+
+
+/*
+ * InstanceGroup::is_built --
+ * InstanceGroup::size --
+ * InstanceGroup::get_bounds --
+ *
+ * Accessors for the group: whether it's been built since it last changed, how many shapes it has, and a box around
+ * all of them.
+ */
+bool
+InstanceGroup::is_built()
+    const
+{
+    return built;
+}
+
+unsigned int
+InstanceGroup::size()
+    const
+{
+    return shapes.size();
+}
+
+const AABB &
+InstanceGroup::get_bounds()
+    const
+{
+    return bounds;
+}
+
+
+/*
+ * InstanceGroup::intersect --
+ *
+ * Find the nearest intersection of ray with the group's shapes in [tmin, tmax], just as Shape::intersect does. hit's
+ * shape is the group's shape that was hit. Runs of spheres in a leaf go to the sphere kernel together, as in the Scene.
+ */
+bool
+InstanceGroup::intersect(const Ray &ray,
+                         float tmin,
+                         float tmax,
+                         Intersection &hit)
+    const
+{
+    const unsigned int nspheres = spheres.size();
+    return wide_bvh.intersect_leaves(ray, tmin, tmax,
+                                     [&](const unsigned int *prims, unsigned int n, float tmin, float &tmax) {
+        bool found = false;
+        unsigned int i = 0;
+        while (i < n) {
+            unsigned int run = 0;
+            while (i + run < n && prims[i + run] < nspheres) {
+                run++;
+            }
+            if (run > 0) {
+                unsigned int index;
+                if (spheres.intersect(prims + i, run, ray, tmin, tmax, index)) {
+                    hit.t = tmax;
+                    hit.shape = spheres.get_shape(index);
+                    hit.primitive_id = 0;
+                    found = true;
+                }
+                i += run;
+            }
+            else {
+                if (other_shapes[prims[i] - nspheres]->intersect(ray, tmin, tmax, hit)) {
+                    tmax = hit.t;
+                    found = true;
+                }
+                i++;
+            }
+        }
+        return found;
+    });
+}
+
+
+/*
+ * InstanceGroup::occluded --
+ *
+ * Determine whether ray hits any of the group's shapes in [tmin, tmax].
+ */
+bool
+InstanceGroup::occluded(const Ray &ray,
+                        float tmin,
+                        float tmax)
+    const
+{
+    const unsigned int nspheres = spheres.size();
+    return wide_bvh.occluded_leaves(ray, tmin, tmax,
+                                    [&](const unsigned int *prims, unsigned int n, float tmin, float tmax) {
+        unsigned int i = 0;
+        while (i < n) {
+            unsigned int run = 0;
+            while (i + run < n && prims[i + run] < nspheres) {
+                run++;
+            }
+            if (run > 0) {
+                if (spheres.occluded(prims + i, run, ray, tmin, tmax)) {
+                    return true;
+                }
+                i += run;
+            }
+            else {
+                if (other_shapes[prims[i] - nspheres]->occluded(ray, tmin, tmax)) {
+                    return true;
+                }
+                i++;
+            }
+        }
+        return false;
+    });
+}
+
+
+/*
+ * InstanceGroup::find_surface --
+ *
+ * Find a shape in the group that p is on the surface of, or NULL if there isn't one.
+ */
+const Shape *
+InstanceGroup::find_surface(const Vector3 &p)
+    const
+{
+    for (const Shape *s : shapes) {
+        if (s->point_is_on_surface(p)) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+#pragma mark - Instances
+
+/*
+ * Instance::Instance --
+ *
+ * Constructor. Create an Instance of group, in the group's own space or placed by transform. A transform with no
+ * inverse can't place anything, so it's ignored, and the Instance is left at its translation.
+ */
+Instance::Instance(const InstanceGroup *g)
+    : Shape(),
+      group(g),
+      linear(),
+      inverse()
+{ }
+
+
+Instance::Instance(const InstanceGroup *g,
+                   const Transform &transform)
+    : Shape(transform.get_translation()),
+      group(g),
+      linear(),
+      inverse()
+{
+    Transform l = transform.get_linear();
+    if (l.invert(inverse)) {
+        linear = l;
+    }
+}
+
+
+/*
+ * Instance::get_group --
+ *
+ * Get the group this Instance places.
+ */
+const InstanceGroup *
+Instance::get_group()
+    const
+{
+    return group;
+}
+
+
+/*
+ * Instance::get_transform --
+ * Instance::set_transform --
+ *
+ * Get and set the transform from the group's space to the scene's. The translation is the Instance's origin. Setting
+ * a transform with no inverse fails, and returns false.
+ */
+Transform
+Instance::get_transform()
+    const
+{
+    return Transform::translate(get_origin()) * linear;
+}
+
+bool
+Instance::set_transform(const Transform &transform)
+{
+    Transform l = transform.get_linear();
+    Transform inv;
+    if (!l.invert(inv)) {
+        return false;
+    }
+    linear = l;
+    inverse = inv;
+    set_origin(transform.get_translation());
+    return true;
+}
+
+
+/*
+ * Instance::to_group --
+ *
+ * Take ray into the group's space.
+ */
+inline Ray
+Instance::to_group(const Ray &ray)
+    const
+{
+    return Ray(inverse.transform_vector(ray.origin - get_origin()), inverse.transform_vector(ray.direction));
+}
+
+
+/*
+ * Instance::intersect --
+ * Instance::occluded --
+ *
+ * Intersect a ray with the group, in its space.
+ */
+bool
+Instance::intersect(const Ray &ray,
+                    float tmin,
+                    float tmax,
+                    Intersection &hit)
+    const
+{
+    return group->intersect(to_group(ray), tmin, tmax, hit);
+}
+
+bool
+Instance::occluded(const Ray &ray,
+                   float tmin,
+                   float tmax)
+    const
+{
+    return group->occluded(to_group(ray), tmin, tmax);
+}
+
+
+/*
+ * Instance::point_is_on_surface --
+ *
+ * Determine whether p is on the surface of any of the group's shapes.
+ */
+bool
+Instance::point_is_on_surface(const Vector3 &p)
+    const
+{
+    return group->find_surface(inverse.transform_vector(p - get_origin())) != NULL;
+}
+
+
+/*
+ * Instance::compute_normal --
+ * Instance::compute_hit_normal --
+ *
+ * Compute the normal at p. With only a point to go on, the normal is that of whichever of the group's shapes p is on;
+ * with an intersection, it's that of the shape hit. Normals are taken back out of the group's space by the transpose
+ * of the inverse of the transform, which keeps them perpendicular to surfaces that have been scaled unevenly.
+ */
+Vector3
+Instance::compute_normal(const Vector3 &p)
+    const
+{
+    const Vector3 q = inverse.transform_vector(p - get_origin());
+    const Shape *s = group->find_surface(q);
+    if (s == NULL) {
+        return Vector3::Zero;
+    }
+    Vector3 normal = inverse.transform_transposed(s->compute_normal(q));
+    return normal.normalize();
+}
+
+Vector3
+Instance::compute_hit_normal(const Intersection &hit,
+                             const Vector3 &p)
+    const
+{
+    const Vector3 q = inverse.transform_vector(p - get_origin());
+    Vector3 normal = inverse.transform_transposed(hit.shape->compute_hit_normal(hit, q));
+    return normal.normalize();
+}
+
+
+/*
+ * Instance::compute_bounds --
+ *
+ * Compute a box around the group, where this Instance puts it. Instances of empty groups have no bounds.
+ */
+bool
+Instance::compute_bounds(AABB &bounds)
+    const
+{
+    if (group->get_bounds().is_empty()) {
+        return false;
+    }
+    bounds = (Transform::translate(get_origin()) * linear).transform_bounds(group->get_bounds());
+    return true;
+}
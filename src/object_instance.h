@@ -0,0 +1,103 @@
+/* object_instance.h
+ *
+ * Instances are Shapes that place a shared group of other shapes in the scene through an affine transform. The group
+ * has its own BVH, built once however many times it's placed, so a scene with thousands of copies of the same cluster
+ * of shapes costs one copy of the cluster plus a small Instance per placement. The Scene's BVH over the instances is
+ * the top level of a two level tree; each group's is the bottom level.
+ *
+ * Rays are taken into a group's space rather than the group into the ray's. The ray's direction isn't normalized
+ * afterwards, so distances along it are the same in both spaces.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __OBJECT_INSTANCE_H__
+#define __OBJECT_INSTANCE_H__
+
+#include <vector>
+
+#include "basics.h"
+#include "bvh.h"
+#include "object.h"
+#include "shape_arrays.h"
+#include "transform.h"
+#include "wide_bvh.h"
+
+
+/*
+ * A group of bounded shapes for Instances to share. The group owns its shapes, and their materials are the ones the
+ * instances are drawn with. Groups can't hold Instances.
+ *
+ * A group has to be built before it's rendered; the Scene builds the groups it owns. Its shapes shouldn't change after
+ * that, or it has to be built again.
+ */
+class InstanceGroup
+{
+public:
+    InstanceGroup();
+    ~InstanceGroup();
+
+    bool add_shape(Shape *shape);
+    void build();
+
+    bool is_built() const;
+    unsigned int size() const;
+    const AABB &get_bounds() const;
+
+    bool intersect(const Ray &ray, float tmin, float tmax, Intersection &hit) const;
+    bool occluded(const Ray &ray, float tmin, float tmax) const;
+    const Shape *find_surface(const Vector3 &p) const;
+
+private:
+    InstanceGroup(const InstanceGroup &other);
+    InstanceGroup &operator=(const InstanceGroup &other);
+
+    // Every shape in the group, in the order they were added.
+    std::vector<Shape *> shapes;
+    AABB bounds;
+
+    /*
+     * Rendering copies of the shapes, as in the Scene: spheres in a flat array, everything else by pointer after them.
+     * The BVH's primitive indices number them in that order.
+     */
+    SphereArray spheres;
+    std::vector<Shape *> other_shapes;
+    BVH bvh;
+    WideBVH wide_bvh;
+    bool built;
+};
+
+
+class Instance
+    : public Shape
+{
+public:
+    Instance(const InstanceGroup *group);
+    Instance(const InstanceGroup *group, const Transform &transform);
+
+    const InstanceGroup *get_group() const;
+    Transform get_transform() const;
+    bool set_transform(const Transform &transform);
+
+    bool intersect(const Ray &ray, float tmin, float tmax, Intersection &hit) const;
+    bool occluded(const Ray &ray, float tmin, float tmax) const;
+    bool point_is_on_surface(const Vector3 &p) const;
+    Vector3 compute_normal(const Vector3 &p) const;
+    Vector3 compute_hit_normal(const Intersection &hit, const Vector3 &p) const;
+    bool compute_bounds(AABB &bounds) const;
+
+private:
+    inline Ray to_group(const Ray &ray) const;
+
+    const InstanceGroup *group;
+
+    /*
+     * The transform from the group's space to the scene's is linear followed by a translation to the Instance's origin.
+     * Keeping the translation in the origin lets set_origin() move instances like any other shape. inverse is the
+     * inverse of linear.
+     */
+    Transform linear;
+    Transform inverse;
+};
+
+#endif
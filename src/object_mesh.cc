@@ -0,0 +1,433 @@
+/* object_mesh.cc
+ *
+ * Definition of triangle meshes.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "basics.h"
+#include "object.h"
+#include "object_mesh.h"
+
+
+namespace {
+
+/*
+ * A ray set up for the watertight triangle test. Axis kz is the one the ray's direction is longest along, and kx and
+ * ky are the other two, swapped if need be to keep the winding of triangles the same. The shear (sx, sy) and scale sz
+ * map the ray onto the +kz axis through the origin, and origin is the ray's origin.
+ */
+struct ShearedRay
+{
+    ShearedRay(const Ray &ray);
+
+    int kx, ky, kz;
+    float sx, sy, sz;
+    Vector3 origin;
+};
+
+
+ShearedRay::ShearedRay(const Ray &ray)
+    : origin(ray.origin)
+{
+    const Vector3 &d = ray.direction;
+    kz = (fabsf(d.x) > fabsf(d.y)) ? ((fabsf(d.x) > fabsf(d.z)) ? 0 : 2) : ((fabsf(d.y) > fabsf(d.z)) ? 1 : 2);
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+    if (d[kz] < 0.0f) {
+        std::swap(kx, ky);
+    }
+    sx = d[kx] / d[kz];
+    sy = d[ky] / d[kz];
+    sz = 1.0f / d[kz];
+}
+
+
+/*
+ * intersect_triangle --
+ *
+ * Find where ray hits the triangle (a, b, c), if it's in [tmin, tmax], and store it in t. The triangle's vertices are
+ * moved and sheared into the ray's space, where the ray runs along an axis, and the 2D edge functions U, V, and W say
+ * which side of each edge the ray passes on. It hits if they all have the same sign, either sign, since triangles are
+ * two-sided. If any is exactly zero, the ray passes through an edge or vertex; they're computed again in double
+ * precision then, where the products can't round, so every triangle sharing the edge agrees on which side it's on.
+ */
+inline bool
+intersect_triangle(const ShearedRay &ray,
+                   const Vector3 &a,
+                   const Vector3 &b,
+                   const Vector3 &c,
+                   float tmin,
+                   float tmax,
+                   float &t)
+{
+    const Vector3 A = a - ray.origin, B = b - ray.origin, C = c - ray.origin;
+    const float ax = A[ray.kx] - ray.sx * A[ray.kz], ay = A[ray.ky] - ray.sy * A[ray.kz];
+    const float bx = B[ray.kx] - ray.sx * B[ray.kz], by = B[ray.ky] - ray.sy * B[ray.kz];
+    const float cx = C[ray.kx] - ray.sx * C[ray.kz], cy = C[ray.ky] - ray.sy * C[ray.kz];
+
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+    if (u == 0.0f || v == 0.0f || w == 0.0f) {
+        u = (float)((double)cx * (double)by - (double)cy * (double)bx);
+        v = (float)((double)ax * (double)cy - (double)ay * (double)cx);
+        w = (float)((double)bx * (double)ay - (double)by * (double)ax);
+    }
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) {
+        return false;
+    }
+
+    const float det = u + v + w;
+    if (det == 0.0f) {
+        return false;
+    }
+    const float az = ray.sz * A[ray.kz], bz = ray.sz * B[ray.kz], cz = ray.sz * C[ray.kz];
+    const float hit_t = (u * az + v * bz + w * cz) / det;
+    if (!(hit_t >= tmin && hit_t <= tmax)) {
+        return false;
+    }
+    t = hit_t;
+    return true;
+}
+
+
+/*
+ * compute_barycentrics --
+ *
+ * Compute the barycentric coordinates of p, which should be in the plane of the triangle (a, b, c): the weights of
+ * a, b, and c that add up to p. Return false if the triangle is degenerate and has none.
+ */
+bool
+compute_barycentrics(const Vector3 &a,
+                     const Vector3 &b,
+                     const Vector3 &c,
+                     const Vector3 &p,
+                     float &wa,
+                     float &wb,
+                     float &wc)
+{
+    const Vector3 e1 = b - a, e2 = c - a, ep = p - a;
+    const float d11 = e1.dot(e1), d12 = e1.dot(e2), d22 = e2.dot(e2);
+    const float dp1 = ep.dot(e1), dp2 = ep.dot(e2);
+    const float denom = d11 * d22 - d12 * d12;
+    if (denom == 0.0f) {
+        return false;
+    }
+    wb = (d22 * dp1 - d12 * dp2) / denom;
+    wc = (d11 * dp2 - d12 * dp1) / denom;
+    wa = 1.0f - wb - wc;
+    return true;
+}
+
+} /* anonymous namespace */
+
+
+/*
+ * TriangleMesh::TriangleMesh --
+ *
+ * Constructors. Create an empty mesh, with its origin at o, or (0, 0, 0). Vertices are relative to the origin.
+ */
+TriangleMesh::TriangleMesh()
+    : TriangleMesh(Vector3::Zero)
+{ }
+
+
+TriangleMesh::TriangleMesh(Vector3 o)
+    : Shape(o),
+      vertices(),
+      indices(),
+      normals(),
+      bvh(),
+      wide_bvh(),
+      bounds()
+{ }
+
+
+/*
+ * TriangleMesh::~TriangleMesh --
+ *
+ * Destructor.
+ */
+TriangleMesh::~TriangleMesh()
+{
+    wide_bvh.clear();
+}
+
+
+/*
+ * TriangleMesh::set_geometry --
+ *
+ * Replace the mesh's triangles and build its BVH. The mesh takes the contents of vertices and indices, rather than
+ * copying them, and leaves them empty. Every index has to refer to a vertex, and there have to be three per triangle;
+ * if not, return false and leave everything alone. Any normals are thrown away.
+ */
+bool
+TriangleMesh::set_geometry(std::vector<Vector3> &new_vertices,
+                           std::vector<unsigned int> &new_indices)
+{
+    if (new_indices.size() % 3 != 0) {
+        return false;
+    }
+    for (unsigned int index : new_indices) {
+        if (index >= new_vertices.size()) {
+            return false;
+        }
+    }
+
+    vertices.swap(new_vertices);
+    indices.swap(new_indices);
+    new_vertices.clear();
+    new_indices.clear();
+    normals.clear();
+
+    const unsigned int ntriangles = get_ntriangles();
+    std::vector<AABB> triangle_bounds(ntriangles);
+    bounds = AABB();
+    for (unsigned int i = 0; i < ntriangles; i++) {
+        AABB &b = triangle_bounds[i];
+        b.extend(vertices[indices[3 * i]]);
+        b.extend(vertices[indices[3 * i + 1]]);
+        b.extend(vertices[indices[3 * i + 2]]);
+        bounds.extend(b);
+    }
+    bvh.build(triangle_bounds);
+    wide_bvh.build(bvh);
+    notify_changed();
+    return true;
+}
+
+
+/*
+ * TriangleMesh::set_normals --
+ *
+ * Give the mesh a normal at each vertex, to interpolate across its triangles. Like set_geometry, the mesh takes the
+ * contents of normals. There has to be one per vertex; if not, return false and leave things alone.
+ */
+bool
+TriangleMesh::set_normals(std::vector<Vector3> &new_normals)
+{
+    if (new_normals.size() != vertices.size()) {
+        return false;
+    }
+    normals.swap(new_normals);
+    new_normals.clear();
+    return true;
+}
+
+
+/*
+ * TriangleMesh::get_nvertices --
+ * TriangleMesh::get_ntriangles --
+ * TriangleMesh::get_vertices --
+ * TriangleMesh::get_indices --
+ *
+ * Accessors for the mesh's buffers.
+ */
+unsigned int
+TriangleMesh::get_nvertices()
+    const
+{
+    return vertices.size();
+}
+
+unsigned int
+TriangleMesh::get_ntriangles()
+    const
+{
+    return indices.size() / 3;
+}
+
+const Vector3 *
+TriangleMesh::get_vertices()
+    const
+{
+    return vertices.data();
+}
+
+const unsigned int *
+TriangleMesh::get_indices()
+    const
+{
+    return indices.data();
+}
+
+
+/*
+ * TriangleMesh::intersect --
+ *
+ * Find the nearest triangle ray hits in [tmin, tmax]. hit's primitive_id is the index of the triangle.
+ */
+bool
+TriangleMesh::intersect(const Ray &ray,
+                        float tmin,
+                        float tmax,
+                        Intersection &hit)
+    const
+{
+    const Ray local(ray.origin - get_origin(), ray.direction);
+    const ShearedRay sheared(local);
+    return wide_bvh.intersect_leaves(local, tmin, tmax,
+                                     [&](const unsigned int *prims, unsigned int n, float tmin, float &tmax) {
+        bool found = false;
+        for (unsigned int i = 0; i < n; i++) {
+            const unsigned int *triangle = &indices[3 * prims[i]];
+            if (intersect_triangle(sheared, vertices[triangle[0]], vertices[triangle[1]], vertices[triangle[2]], tmin,
+                                   tmax, tmax)) {
+                hit.t = tmax;
+                hit.shape = this;
+                hit.primitive_id = prims[i];
+                found = true;
+            }
+        }
+        return found;
+    });
+}
+
+
+/*
+ * TriangleMesh::occluded --
+ *
+ * Determine whether ray hits any triangle in [tmin, tmax].
+ */
+bool
+TriangleMesh::occluded(const Ray &ray,
+                       float tmin,
+                       float tmax)
+    const
+{
+    const Ray local(ray.origin - get_origin(), ray.direction);
+    const ShearedRay sheared(local);
+    return wide_bvh.occluded_leaves(local, tmin, tmax,
+                                    [&](const unsigned int *prims, unsigned int n, float tmin, float tmax) {
+        float t;
+        for (unsigned int i = 0; i < n; i++) {
+            const unsigned int *triangle = &indices[3 * prims[i]];
+            if (intersect_triangle(sheared, vertices[triangle[0]], vertices[triangle[1]], vertices[triangle[2]], tmin,
+                                   tmax, t)) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+
+/*
+ * TriangleMesh::point_is_on_surface --
+ *
+ * Determine whether p lies on one of the mesh's triangles.
+ */
+bool
+TriangleMesh::point_is_on_surface(const Vector3 &p)
+    const
+{
+    return find_triangle(p) >= 0;
+}
+
+
+/*
+ * TriangleMesh::compute_normal --
+ * TriangleMesh::compute_hit_normal --
+ *
+ * Compute the normal at p. An intersection says which triangle p is on; without one, the triangles are searched one by
+ * one, which is slow, and a zero vector is returned if p isn't on any of them.
+ */
+Vector3
+TriangleMesh::compute_normal(const Vector3 &p)
+    const
+{
+    int triangle = find_triangle(p);
+    if (triangle < 0) {
+        return Vector3::Zero;
+    }
+    return compute_triangle_normal(triangle, p - get_origin());
+}
+
+Vector3
+TriangleMesh::compute_hit_normal(const Intersection &hit,
+                                 const Vector3 &p)
+    const
+{
+    return compute_triangle_normal(hit.primitive_id, p - get_origin());
+}
+
+
+/*
+ * TriangleMesh::compute_bounds --
+ *
+ * Compute a box around the mesh. Empty meshes have no bounds.
+ */
+bool
+TriangleMesh::compute_bounds(AABB &b)
+    const
+{
+    if (bounds.is_empty()) {
+        return false;
+    }
+    b = AABB(bounds.min + get_origin(), bounds.max + get_origin());
+    return true;
+}
+
+
+/*
+ * TriangleMesh::find_triangle --
+ *
+ * Find a triangle that p is on, to within a little rounding, and return its index, or -1 if there isn't one.
+ */
+int
+TriangleMesh::find_triangle(const Vector3 &p)
+    const
+{
+    if (bounds.is_empty()) {
+        return -1;
+    }
+    const Vector3 q = p - get_origin();
+    const Vector3 extent = bounds.extent();
+    const float epsilon = 1e-5f * std::max(extent.x, std::max(extent.y, extent.z));
+    for (unsigned int i = 0; i < get_ntriangles(); i++) {
+        const Vector3 &a = vertices[indices[3 * i]];
+        const Vector3 &b = vertices[indices[3 * i + 1]];
+        const Vector3 &c = vertices[indices[3 * i + 2]];
+        Vector3 normal = (b - a).cross(c - a);
+        if (normal.length2() == 0.0f || fabsf(normal.normalize().dot(q - a)) > epsilon) {
+            continue;
+        }
+        float wa, wb, wc;
+        if (compute_barycentrics(a, b, c, q, wa, wb, wc) && wa >= -1e-5f && wb >= -1e-5f && wc >= -1e-5f) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * TriangleMesh::compute_triangle_normal --
+ *
+ * Compute the normal of triangle at p, relative to the mesh's origin. Without vertex normals, that's the normal of the
+ * triangle's plane, on the side its vertices run counterclockwise around. With them, it's the vertex normals weighted
+ * by how close p is to each vertex.
+ */
+Vector3
+TriangleMesh::compute_triangle_normal(unsigned int triangle,
+                                      const Vector3 &p)
+    const
+{
+    const unsigned int *t = &indices[3 * triangle];
+    const Vector3 &a = vertices[t[0]], &b = vertices[t[1]], &c = vertices[t[2]];
+
+    float wa, wb, wc;
+    if (!normals.empty() && compute_barycentrics(a, b, c, p, wa, wb, wc)) {
+        Vector3 normal = normals[t[0]] * wa + normals[t[1]] * wb + normals[t[2]] * wc;
+        if (normal.length2() > 0.0f) {
+            return normal.normalize();
+        }
+    }
+    Vector3 normal = (b - a).cross(c - a);
+    return normal.normalize();
+}
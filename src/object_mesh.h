@@ -0,0 +1,70 @@
+/* object_mesh.h
+ *
+ * Triangle meshes are Shapes made of many triangles sharing vertices. The vertices are stored once, in one contiguous
+ * buffer, and each triangle is three indices into it, in another. A mesh keeps its own BVH over its triangles, so a
+ * mesh with millions of them is still a single Shape to the Scene.
+ *
+ * Rays are tested against triangles with the watertight algorithm of Woop, Benthin and Wald, "Watertight Ray/Triangle
+ * Intersection" (JCGT 2013): a ray that hits an edge or vertex shared by several triangles hits at least one of them,
+ * so nothing leaks through the seams.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __OBJECT_MESH_H__
+#define __OBJECT_MESH_H__
+
+#include <vector>
+
+#include "basics.h"
+#include "bvh.h"
+#include "object.h"
+#include "wide_bvh.h"
+
+
+class TriangleMesh
+    : public Shape
+{
+public:
+    TriangleMesh();
+    TriangleMesh(Vector3 o);
+    ~TriangleMesh();
+
+    bool set_geometry(std::vector<Vector3> &vertices, std::vector<unsigned int> &indices);
+    bool set_normals(std::vector<Vector3> &normals);
+
+    unsigned int get_nvertices() const;
+    unsigned int get_ntriangles() const;
+    const Vector3 *get_vertices() const;
+    const unsigned int *get_indices() const;
+
+    bool intersect(const Ray &ray, float tmin, float tmax, Intersection &hit) const;
+    bool occluded(const Ray &ray, float tmin, float tmax) const;
+    bool point_is_on_surface(const Vector3 &p) const;
+    Vector3 compute_normal(const Vector3 &p) const;
+    Vector3 compute_hit_normal(const Intersection &hit, const Vector3 &p) const;
+    bool compute_bounds(AABB &bounds) const;
+
+private:
+    TriangleMesh(const TriangleMesh &other);
+    TriangleMesh &operator=(const TriangleMesh &other);
+
+    int find_triangle(const Vector3 &p) const;
+    Vector3 compute_triangle_normal(unsigned int triangle, const Vector3 &p) const;
+
+    /*
+     * Vertex positions, relative to the mesh's origin, and three indices into them per triangle, counterclockwise
+     * around the side the triangle faces. normals, if there are any, has one per vertex, and they're interpolated
+     * across each triangle; otherwise triangles are flat.
+     */
+    std::vector<Vector3> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<Vector3> normals;
+
+    // The BVH over the triangles, and a box around all of them.
+    BVH bvh;
+    WideBVH wide_bvh;
+    AABB bounds;
+};
+
+#endif
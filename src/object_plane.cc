@@ -47,14 +47,28 @@ Plane::Plane(Vector3 o, Vector3 n)
 
 
 /*
- * Plane::does_intersect --
+ * Plane::get_normal --
  *
- * Compute the intersection of a ray with this Plane. All intersection t values are returned in the **t argument. The
- * number of values returned therein is indicated by the return value. Memory is allocated at *t. It is the caller's
- * responsibility to free it when it is no longer needed. If 0 is returned, no memory needs to be freed.
+ * Get the unit normal of this Plane.
  */
-int
-Plane::does_intersect(const Ray &ray, float **t)
+const Vector3 &
+Plane::get_normal()
+    const
+{
+    return normal;
+}
+
+
+/*
+ * Plane::intersect --
+ *
+ * Compute the intersection of a ray with this Plane, if it lies in [tmin, tmax].
+ */
+bool
+Plane::intersect(const Ray &ray,
+                 float tmin,
+                 float tmax,
+                 Intersection &hit)
     const
 {
     /*
@@ -73,42 +87,50 @@ Plane::does_intersect(const Ray &ray, float **t)
      *     t = ((p0 - ro) . n) / (ld . n)
      *
      * Note that if the denominator is 0, the ray runs parallel to the plane and there are no intersections. If both the
-     * numerator and denominator are 0, the ray is in the plane and intersects everywhere.
+     * numerator and denominator are 0, the ray is in the plane and intersects everywhere; there's no single nearest
+     * point to report, so that counts as a miss too.
      *
      * See: http://en.wikipedia.org/wiki/Line-plane_intersection
      */
-    Vector3 o = get_origin();
-    int nints = 1;
-    float numer = (o - ray.origin).dot(normal);
     float denom = ray.direction.dot(normal);
-
     if (denom == 0.0) {
-        nints = 0;
-        if (numer == 0.0) {
-            // Ray is in plane.
-            nints = 1;
-        }
+        return false;
     }
 
-    // No intersections.
-    if (nints == 0) {
-        return nints;
+    float numer = (get_origin() - ray.origin).dot(normal);
+    float t = numer / denom;
+
+    // Negative t values are "behind" the origin of the ray, which tmin will generally exclude.
+    if (t < tmin || t > tmax) {
+        return false;
     }
 
-    // TODO: denom could still be 0 here!
-    float t0 = numer / denom;
+    hit.t = t;
+    hit.shape = this;
+    hit.primitive_id = 0;
+    return true;
+}
 
-    // If the t value is negative, it's "behind" the origin of the ray, which we don't care about.
-    if (t0 < 0.0) {
-        return 0;
-    }
 
-    // Allocate memory, at most one float.
-    if (t != NULL) {
-        *t = new float(t0);
+/*
+ * Plane::occluded --
+ *
+ * Determine whether a ray hits this Plane anywhere in [tmin, tmax]. Planes have at most one intersection, so this
+ * finds it but doesn't record it.
+ */
+bool
+Plane::occluded(const Ray &ray,
+                float tmin,
+                float tmax)
+    const
+{
+    float denom = ray.direction.dot(normal);
+    if (denom == 0.0) {
+        return false;
     }
 
-    return nints;
+    float t = (get_origin() - ray.origin).dot(normal) / denom;
+    return t >= tmin && t <= tmax;
 }
 
 
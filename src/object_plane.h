@@ -20,7 +20,10 @@ public:
     Plane(Vector3 normal);
     Plane(Vector3 o, Vector3 normal);
 
-    int does_intersect(const Ray &ray, float **t) const;
+    const Vector3 &get_normal() const;
+
+    bool intersect(const Ray &ray, float tmin, float tmax, Intersection &hit) const;
+    bool occluded(const Ray &ray, float tmin, float tmax) const;
     bool point_is_on_surface(const Vector3 &p) const;
     Vector3 compute_normal(const Vector3 &p) const;
 
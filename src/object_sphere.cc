@@ -13,6 +13,7 @@
 #include "basics.h"
 #include "object.h"
 #include "object_sphere.h"
+#include "sphere_kernels.h"
 
 
 /*
@@ -45,10 +46,11 @@ Sphere::Sphere(Vector3 o, float r)
  * Sphere::get_radius --
  * Sphere::set_radius --
  *
- * Get and set the radius of this Sphere.
+ * Get and set the radius of this Sphere. Negative radii are taken as positive.
  */
 float
 Sphere::get_radius()
+    const
 {
     return radius;
 }
@@ -56,74 +58,54 @@ Sphere::get_radius()
 void
 Sphere::set_radius(float r)
 {
-    radius = (radius >= 0.0) ? r : -r;
+    radius = (r >= 0.0) ? r : -r;
+    notify_changed();
 }
 
 
 /*
- * Sphere::does_intersect --
+ * Sphere::intersect --
  *
- * Compute the intersection of a ray with this Sphere. All intersection t values are returned in the **t argument. The
- * number of values returned therein is indicated by the return value. Memory is allocated at *t. It is the caller's
- * responsibility to free it when it is no longer needed. If 0 is returned, no memory needs to be freed.
+ * Compute the nearest intersection of a ray with this Sphere in [tmin, tmax]. Rays can hit a sphere at most twice;
+ * the nearer root is used unless it falls before tmin, as it does for rays starting inside the sphere. The math is
+ * shared with the sphere kernels; see intersect_sphere.
  */
-int
-Sphere::does_intersect(const Ray &ray, float **t)
+bool
+Sphere::intersect(const Ray &ray,
+                  float tmin,
+                  float tmax,
+                  Intersection &hit)
     const
 {
-    // Origin of the vector in object space.
-    Vector3 ray_origin_obj = ray.origin - get_origin();
-
-    // Coefficients for quadratic equation.
-    float a = ray.direction.dot(ray.direction);
-    float b = ray.direction.dot(ray_origin_obj) * 2.0;
-    float c = ray_origin_obj.dot(ray_origin_obj) - (radius * radius);
-
-    // Discriminant for the quadratic equation.
-    float discrim = (b * b) - (4.0 * a * c);
-
-    // If the discriminant is less than zero, there are no real (as in not imaginary) solutions to this intersection.
-    if (discrim < 0) {
-        return 0;
-    }
-
-    // Compute the intersections, the roots of the quadratic equation. Spheres have at most two intersections.
-    float sqrt_discrim = sqrtf(discrim);
-    float t0 = (-b - sqrt_discrim) / (2.0 * a);
-    float t1 = (-b + sqrt_discrim) / (2.0 * a);
+    Vector3 center = get_origin();
+    SphereData data = { &center.x, &center.y, &center.z, &radius };
 
-    // If t[1] is less than t[0], swap them (t[0] will always be the first intersection).
-    if (t1 < t0) {
-        float tmp = t0;
-        t0 = t1;
-        t1 = tmp;
+    float t;
+    if (!intersect_sphere(data, 0, ray, tmin, tmax, t)) {
+        return false;
     }
 
-    /*
-     * If the farther intersection of the two is in the negative direction, the sphere is in the ray's negative
-     * direction.
-     */
-    if (t1 < 0) {
-        return 0;
-    }
+    hit.t = t;
+    hit.shape = this;
+    hit.primitive_id = 0;
+    return true;
+}
 
-    /*
-     * Allocate the memory and store the values. It's possible the two values are equal. Only allocate enough memory to
-     * store the required number of values.
-     */
-    int nints = (t0 != t1) ? 2 : 1;
-    if (t != NULL) {
-        *t = new float[nints];
-        if (*t == NULL) {
-            return 0;
-        }
-        (*t)[0] = t0;
-        if (nints > 1) {
-            (*t)[1] = t1;
-        }
-    }
 
-    return nints;
+/*
+ * Sphere::occluded --
+ *
+ * Determine whether a ray hits this Sphere anywhere in [tmin, tmax], without solving for where. See occluded_sphere.
+ */
+bool
+Sphere::occluded(const Ray &ray,
+                 float tmin,
+                 float tmax)
+    const
+{
+    Vector3 center = get_origin();
+    SphereData data = { &center.x, &center.y, &center.z, &radius };
+    return occluded_sphere(data, 0, ray, tmin, tmax);
 }
 
 
@@ -160,3 +142,18 @@ Sphere::compute_normal(const Vector3 &p)
     normal.normalize();
     return normal;
 }
+
+
+/*
+ * Sphere::compute_bounds --
+ *
+ * Compute the box enclosing this Sphere: a cube of side 2r centered on the origin.
+ */
+bool
+Sphere::compute_bounds(AABB &bounds)
+    const
+{
+    Vector3 r(radius, radius, radius);
+    bounds = AABB(get_origin() - r, get_origin() + r);
+    return true;
+}
@@ -20,12 +20,14 @@ public:
     Sphere(float r);
     Sphere(Vector3 o, float r);
 
-    float get_radius();
+    float get_radius() const;
     void set_radius(float r);
 
-    int does_intersect(const Ray &ray, float **t) const;
+    bool intersect(const Ray &ray, float tmin, float tmax, Intersection &hit) const;
+    bool occluded(const Ray &ray, float tmin, float tmax) const;
     bool point_is_on_surface(const Vector3 &p) const;
     Vector3 compute_normal(const Vector3 &p) const;
+    bool compute_bounds(AABB &bounds) const;
 private:
     float radius;
 };
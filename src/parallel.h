@@ -0,0 +1,55 @@
+/* parallel.h
+ *
+ * A small helper for splitting work across threads outside of rendering, which has its own schedulers.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <functional>
+#include <thread>
+#include <vector>
+
+
+/*
+ * run_workers --
+ *
+ * Call body(worker) once for each worker in [0, nworkers), each on its own thread, and wait for them all. Worker 0 runs
+ * on the calling thread, so a single worker costs nothing extra.
+ */
+template<typename Body>
+void
+run_workers(unsigned int nworkers,
+            Body body)
+{
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < nworkers; i++) {
+        threads.push_back(std::thread(body, i));
+    }
+    body(0);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+
+/*
+ * split_range --
+ *
+ * Get the part of [0, n) that worker out of nworkers is responsible for. The parts are contiguous, in worker order, and
+ * differ in size by at most one.
+ */
+inline void
+split_range(unsigned int n,
+            unsigned int worker,
+            unsigned int nworkers,
+            unsigned int &begin,
+            unsigned int &end)
+{
+    begin = (unsigned int)((unsigned long long)n * worker / nworkers);
+    end = (unsigned int)((unsigned long long)n * (worker + 1) / nworkers);
+}
+
+#endif
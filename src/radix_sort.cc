@@ -0,0 +1,92 @@
+/* radix_sort.cc
+ *
+ * Definition of the radix sort.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "parallel.h"
+#include "radix_sort.h"
+
+
+namespace {
+
+// Bits of the key sorted on per pass, and the number of values they can have. 30 bit Morton codes take three passes.
+const unsigned int DigitBits = 11;
+const unsigned int NumDigits = 1 << DigitBits;
+
+// Below this many items per worker, threads cost more than they save.
+const unsigned int MinItemsPerWorker = 1 << 14;
+
+} /* anonymous namespace */
+
+
+/*
+ * radix_sort --
+ *
+ * Each pass counts how many items have each value of one digit of the key, turns the counts into the offset where each
+ * value's items start, and scatters the items into place in order. Passes alternate between items and scratch; if
+ * there's an odd number, the result is copied back at the end.
+ *
+ * With more than one worker, each counts and scatters its own contiguous chunk of the items. A value's items from
+ * worker w go after the same value's items from every worker before it, so the sort stays stable.
+ */
+void
+radix_sort(SortItem *items,
+           SortItem *scratch,
+           unsigned int n,
+           unsigned int key_bits,
+           unsigned int nworkers)
+{
+    nworkers = std::max(1u, std::min(nworkers, n / MinItemsPerWorker));
+    std::vector<unsigned int> offsets(NumDigits * nworkers);
+
+    SortItem *from = items, *to = scratch;
+    for (unsigned int shift = 0; shift < key_bits; shift += DigitBits) {
+        auto count = [&](unsigned int worker) {
+            unsigned int *counts = &offsets[NumDigits * worker];
+            unsigned int begin, end;
+            split_range(n, worker, nworkers, begin, end);
+            memset(counts, 0, NumDigits * sizeof(unsigned int));
+            for (unsigned int i = begin; i < end; i++) {
+                counts[(from[i].key >> shift) & (NumDigits - 1)]++;
+            }
+        };
+        run_workers(nworkers, count);
+
+        bool uniform = false;
+        unsigned int total = 0;
+        for (unsigned int d = 0; d < NumDigits && !uniform; d++) {
+            unsigned int start = total;
+            for (unsigned int w = 0; w < nworkers; w++) {
+                unsigned int c = offsets[NumDigits * w + d];
+                offsets[NumDigits * w + d] = total;
+                total += c;
+            }
+            uniform = (total - start == n);
+        }
+        // Every item has the same digit here, so this pass wouldn't move anything.
+        if (uniform) {
+            continue;
+        }
+
+        auto scatter = [&](unsigned int worker) {
+            unsigned int *next = &offsets[NumDigits * worker];
+            unsigned int begin, end;
+            split_range(n, worker, nworkers, begin, end);
+            for (unsigned int i = begin; i < end; i++) {
+                to[next[(from[i].key >> shift) & (NumDigits - 1)]++] = from[i];
+            }
+        };
+        run_workers(nworkers, scatter);
+        std::swap(from, to);
+    }
+
+    if (from != items) {
+        std::copy(from, from + n, items);
+    }
+}
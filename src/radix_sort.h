@@ -0,0 +1,29 @@
+/* radix_sort.h
+ *
+ * Declaration of a radix sort for integer keys, each carrying a value along with it. It's a least significant digit
+ * first sort, 11 bits per pass, so it's stable, takes time linear in the number of items, and only does as many passes
+ * as the keys have digits in use.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __RADIX_SORT_H__
+#define __RADIX_SORT_H__
+
+#include <cstdint>
+
+
+struct SortItem
+{
+    uint64_t key;
+    unsigned int value;
+};
+
+
+/*
+ * Sort the n items by key, split across up to nworkers threads. Only the low key_bits bits of the keys are looked at.
+ * scratch must have room for n items; the sorted items end up in items.
+ */
+void radix_sort(SortItem *items, SortItem *scratch, unsigned int n, unsigned int key_bits, unsigned int nworkers = 1);
+
+#endif
@@ -0,0 +1,93 @@
+/* ray_packet.cc
+ *
+ * Definition of ray packets.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "basics.h"
+#include "ray_packet.h"
+
+
+/*
+ * RayPacket::RayPacket --
+ *
+ * Default constructor. Create an empty packet.
+ */
+RayPacket::RayPacket()
+    : size(0)
+{ }
+
+
+/*
+ * RayPacket::clear --
+ *
+ * Empty the packet.
+ */
+void
+RayPacket::clear()
+{
+    size = 0;
+}
+
+
+/*
+ * RayPacket::add --
+ *
+ * Add a ray to the packet. There must be room for it.
+ */
+void
+RayPacket::add(const Ray &ray)
+{
+    rays[size] = ray;
+    inv_directions[size] = ray.compute_inverse_direction();
+    size++;
+}
+
+
+/*
+ * RayPacket::prepare --
+ *
+ * Compute the packet's frustum. Return false if the packet can't be traced as one, because its rays don't all travel
+ * the same way along every axis. Those have to be traced one at a time.
+ *
+ * None of the values here are NaN, so std::min and std::max do, and unlike fminf and fmaxf, they compile to single
+ * instructions rather than library calls.
+ */
+bool
+RayPacket::prepare()
+{
+    if (size == 0) {
+        return false;
+    }
+
+    unsigned int nparallel[3] = { 0, 0, 0 };
+    for (int axis = 0; axis < 3; axis++) {
+        negative[axis] = inv_directions[0][axis] < 0.0f;
+        origin_min[axis] = origin_max[axis] = rays[0].origin[axis];
+        inv_min[axis] = inv_max[axis] = inv_directions[0][axis];
+    }
+
+    for (unsigned int i = 0; i < size; i++) {
+        const float origin[3] = { rays[i].origin.x, rays[i].origin.y, rays[i].origin.z };
+        const float inv[3] = { inv_directions[i].x, inv_directions[i].y, inv_directions[i].z };
+        for (int axis = 0; axis < 3; axis++) {
+            if ((inv[axis] < 0.0f) != negative[axis]) {
+                return false;
+            }
+            nparallel[axis] += std::isinf(inv[axis]);
+            origin_min[axis] = std::min(origin_min[axis], origin[axis]);
+            origin_max[axis] = std::max(origin_max[axis], origin[axis]);
+            inv_min[axis] = std::min(inv_min[axis], inv[axis]);
+            inv_max[axis] = std::max(inv_max[axis], inv[axis]);
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        culls[axis] = (nparallel[axis] == 0 || nparallel[axis] == size);
+    }
+    return true;
+}
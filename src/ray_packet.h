@@ -0,0 +1,97 @@
+/* ray_packet.h
+ *
+ * Declaration of ray packets. A packet is a small group of coherent rays, such as the primary rays through a square
+ * block of neighboring pixels, that are traced through the BVH together. Rays that start close together and point the
+ * same way visit mostly the same nodes, so the packet can decide once for all of them whether a node is worth looking
+ * at, instead of each ray deciding for itself.
+ *
+ * That decision is made with a frustum: a conservative bound on every ray in the packet, built from the ranges their
+ * origins and inverse directions span. A box the frustum misses is missed by every ray in the packet.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __RAY_PACKET_H__
+#define __RAY_PACKET_H__
+
+#include <algorithm>
+
+#include "basics.h"
+
+
+struct RayPacket
+{
+    // An 8x8 block of pixels.
+    static const unsigned int MaxSize = 64;
+
+    RayPacket();
+
+    void clear();
+    void add(const Ray &ray);
+    bool prepare();
+
+    bool intersect_frustum(const AABB &box, float tmin, float tmax) const;
+
+    unsigned int size;
+    Ray rays[MaxSize];
+    Vector3 inv_directions[MaxSize];
+
+    /*
+     * The frustum, computed by prepare(). Along each axis the rays' origins lie in [origin_min, origin_max] and their
+     * inverse directions in [inv_min, inv_max]. negative[axis] is whether the rays travel toward -axis; it's the same
+     * for every ray in a prepared packet. Axes along which some but not all of the rays are parallel can't be bounded
+     * this way, and don't cull.
+     */
+    float origin_min[3], origin_max[3];
+    float inv_min[3], inv_max[3];
+    bool negative[3];
+    bool culls[3];
+};
+
+
+/*
+ * RayPacket::intersect_frustum --
+ *
+ * Determine whether any ray in the packet could hit box in [tmin, tmax]. This is the slab test of AABB::intersect done
+ * in interval arithmetic: each ray's entry distance into a slab is (plane - origin) * inv_direction, so the lowest any
+ * of them can be is the least of that product over the corners of the origin and inverse direction ranges, and
+ * likewise for the highest exit distance, scaled up as in AABB::intersect. If those don't overlap, no ray hits the box.
+ * The test may pass for boxes that no ray hits, but never fails for one that some ray does.
+ *
+ * Axes the rays are all parallel to have no slab distances at all. There, a ray is in the slab for its whole length
+ * or not at all, so the box is missed only if the origins all lie outside it.
+ */
+inline bool
+RayPacket::intersect_frustum(const AABB &box,
+                             float tmin,
+                             float tmax)
+    const
+{
+    for (int axis = 0; axis < 3; axis++) {
+        if (!culls[axis]) {
+            continue;
+        }
+        if (std::isinf(inv_min[axis])) {
+            if (origin_max[axis] < box.min[axis] || origin_min[axis] > box.max[axis]) {
+                return false;
+            }
+            continue;
+        }
+
+        float entry = negative[axis] ? box.max[axis] : box.min[axis];
+        float exit = negative[axis] ? box.min[axis] : box.max[axis];
+
+        float e0 = entry - origin_min[axis], e1 = entry - origin_max[axis];
+        float t0 = std::min(std::min(e0 * inv_min[axis], e0 * inv_max[axis]),
+                            std::min(e1 * inv_min[axis], e1 * inv_max[axis]));
+        float x0 = exit - origin_min[axis], x1 = exit - origin_max[axis];
+        float t1 = std::max(std::max(x0 * inv_min[axis], x0 * inv_max[axis]),
+                            std::max(x1 * inv_min[axis], x1 * inv_max[axis])) * AABB::ExitScale;
+
+        tmin = (t0 > tmin) ? t0 : tmin;
+        tmax = (t1 < tmax) ? t1 : tmax;
+    }
+    return tmin <= tmax;
+}
+
+#endif
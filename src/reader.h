@@ -0,0 +1,31 @@
+/* reader.h
+ *
+ * Readers load scene descriptions from files into Scenes. They're the counterpart of Writers.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __READER_H__
+#define __READER_H__
+
+#include <string>
+
+
+class Scene;
+
+
+class Reader
+{
+public:
+    virtual
+    ~Reader()
+    { }
+
+    /*
+     * Read the scene description in the named file into the given Scene. Returns the number of statements read, or a
+     * negative number if the file couldn't be read.
+     */
+    virtual int read_scene(Scene &scene, const std::string &filename) = 0;
+};
+
+#endif
@@ -0,0 +1,1034 @@
+/* reader_mesh.cc
+ *
+ * Definition of the mesh reader.
+ *
+ * OBJ files are read for their vertex positions (v) and faces (f); everything else, including texture coordinates and
+ * normals, is skipped. Faces with more than three vertices are split into fans of triangles. Indices may be negative,
+ * counting back from the last vertex defined before the face.
+ *
+ * PLY files are read for the x, y, and z properties of their vertex element, nx, ny, and nz if they're all there, and
+ * the vertex_indices list of their face element. Either byte order is fine; ASCII PLY files aren't supported. Faces
+ * are variable length, so each face's vertex count has to be read before the next one can be found. That much is done
+ * in one pass over the faces, which notes where each chunk starts; the rest is parsed in parallel.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "basics.h"
+#include "mapped_file.h"
+#include "object_mesh.h"
+#include "parallel.h"
+#include "reader_mesh.h"
+
+
+namespace {
+
+// Below this many bytes per worker, threads cost more than they save, so files smaller than this are read by one.
+const size_t MinBytesPerWorker = 1 << 18;
+
+// Powers of ten a double holds exactly, for the float parser.
+const double PowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+    1e20, 1e21, 1e22
+};
+const int MaxExactPower = 22;
+
+// Significant digits that fit in a 64 bit mantissa.
+const int MaxMantissaDigits = 19;
+
+
+/*
+ * A parse error: where in the file it happened, and what went wrong. where is NULL if nothing has.
+ */
+struct ParseError
+{
+    ParseError();
+
+    const char *where;
+    const char *message;
+};
+
+
+ParseError::ParseError()
+    : where(NULL),
+      message(NULL)
+{ }
+
+
+inline bool
+is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+inline bool
+is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+
+inline const char *
+skip_spaces(const char *p,
+            const char *end)
+{
+    while (p < end && is_space(*p)) {
+        p++;
+    }
+    return p;
+}
+
+
+inline const char *
+find_line_end(const char *p,
+              const char *end)
+{
+    const char *newline = (const char *)memchr(p, '\n', end - p);
+    return (newline != NULL) ? newline : end;
+}
+
+
+/*
+ * parse_float --
+ *
+ * Parse a decimal number, [+-]digits[.digits][(e|E)[+-]digits], from p, and advance p past it. Up to 19 significant
+ * digits are gathered into an integer, which is scaled by a power of ten. When the integer and the power are both
+ * exactly representable as doubles, which covers nearly every number a mesh file has, the result is correctly rounded
+ * to double and then to float; otherwise it may be off by a unit in the last place. Return false if there's no number
+ * at p.
+ */
+bool
+parse_float(const char *&p,
+            const char *end,
+            float &f)
+{
+    const char *s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+        negative = (*s == '-');
+        s++;
+    }
+
+    uint64_t mantissa = 0;
+    int ndigits = 0, exponent = 0;
+    bool any_digits = false;
+    for (; s < end && is_digit(*s); s++) {
+        any_digits = true;
+        if (ndigits < MaxMantissaDigits) {
+            mantissa = mantissa * 10 + (*s - '0');
+            ndigits += (mantissa != 0);
+        }
+        else {
+            exponent++;
+        }
+    }
+    if (s < end && *s == '.') {
+        for (s++; s < end && is_digit(*s); s++) {
+            any_digits = true;
+            if (ndigits < MaxMantissaDigits) {
+                mantissa = mantissa * 10 + (*s - '0');
+                ndigits += (mantissa != 0);
+                exponent--;
+            }
+        }
+    }
+    if (!any_digits) {
+        return false;
+    }
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char *e = s + 1;
+        bool negative_exponent = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            negative_exponent = (*e == '-');
+            e++;
+        }
+        if (e >= end || !is_digit(*e)) {
+            return false;
+        }
+        int value = 0;
+        for (; e < end && is_digit(*e); e++) {
+            if (value < 10000) {
+                value = value * 10 + (*e - '0');
+            }
+        }
+        exponent += negative_exponent ? -value : value;
+        s = e;
+    }
+
+    double d = (double)mantissa;
+    if (mantissa != 0) {
+        if (exponent >= 0 && exponent <= MaxExactPower) {
+            d *= PowersOfTen[exponent];
+        }
+        else if (exponent < 0 && exponent >= -MaxExactPower) {
+            d /= PowersOfTen[-exponent];
+        }
+        else {
+            d *= pow(10.0, exponent);
+        }
+    }
+    f = (float)(negative ? -d : d);
+    p = s;
+    return true;
+}
+
+
+/*
+ * parse_int --
+ *
+ * Parse a decimal integer, [+-]digits, from p, and advance p past it. Return false if there's no integer at p, or it
+ * doesn't fit in a long long.
+ */
+bool
+parse_int(const char *&p,
+          const char *end,
+          long long &i)
+{
+    const char *s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+        negative = (*s == '-');
+        s++;
+    }
+    if (s >= end || !is_digit(*s)) {
+        return false;
+    }
+    long long value = 0;
+    for (; s < end && is_digit(*s); s++) {
+        if (value > (INT64_MAX - 9) / 10) {
+            return false;
+        }
+        value = value * 10 + (*s - '0');
+    }
+    i = negative ? -value : value;
+    p = s;
+    return true;
+}
+
+
+/*
+ * count_line_number --
+ *
+ * Get the line number of the character at p in the file starting at data.
+ */
+int
+count_line_number(const char *data,
+                  const char *p)
+{
+    int line = 1;
+    for (const char *c = data; c < p; c++) {
+        line += (*c == '\n');
+    }
+    return line;
+}
+
+#pragma mark - OBJ
+
+/*
+ * A piece of an OBJ file, a whole number of lines, and where its vertices and triangles go in the mesh's buffers.
+ */
+struct ObjChunk
+{
+    const char *begin, *end;
+    size_t nvertices, ntriangles;
+    size_t first_vertex, first_triangle;
+    ParseError error;
+};
+
+
+/*
+ * obj_keyword --
+ *
+ * Determine whether the line starting at p (after any spaces) begins with the one-letter keyword c.
+ */
+inline bool
+obj_keyword(const char *p,
+            const char *line_end,
+            char c)
+{
+    return p + 1 < line_end && p[0] == c && is_space(p[1]);
+}
+
+
+/*
+ * count_obj_chunk --
+ *
+ * Count the vertices and triangles in chunk, without parsing any numbers. A face of n vertices makes n - 2 triangles.
+ */
+void
+count_obj_chunk(ObjChunk &chunk)
+{
+    chunk.nvertices = chunk.ntriangles = 0;
+    for (const char *p = chunk.begin; p < chunk.end; ) {
+        const char *line_end = find_line_end(p, chunk.end);
+        const char *q = skip_spaces(p, line_end);
+        if (obj_keyword(q, line_end, 'v')) {
+            chunk.nvertices++;
+        }
+        else if (obj_keyword(q, line_end, 'f')) {
+            size_t n = 0;
+            for (q = skip_spaces(q + 1, line_end); q < line_end; q = skip_spaces(q, line_end)) {
+                while (q < line_end && !is_space(*q)) {
+                    q++;
+                }
+                n++;
+            }
+            if (n >= 3) {
+                chunk.ntriangles += n - 2;
+            }
+        }
+        p = line_end + 1;
+    }
+}
+
+
+/*
+ * parse_obj_chunk --
+ *
+ * Parse the vertices and faces in chunk into their places in vertices and indices. Vertex indices in the file start
+ * at 1; negative ones count back from the last vertex before them, which is why each chunk needs to know how many
+ * vertices come before it. Stop at the first error, and record it in the chunk.
+ */
+void
+parse_obj_chunk(ObjChunk &chunk,
+                Vector3 *vertices,
+                unsigned int *indices)
+{
+    Vector3 *vertex = vertices + chunk.first_vertex;
+    unsigned int *index = indices + 3 * chunk.first_triangle;
+
+    for (const char *p = chunk.begin; p < chunk.end; ) {
+        const char *line_end = find_line_end(p, chunk.end);
+        const char *q = skip_spaces(p, line_end);
+        if (obj_keyword(q, line_end, 'v')) {
+            float xyz[3];
+            for (int axis = 0; axis < 3; axis++) {
+                q = skip_spaces(q + (axis == 0), line_end);
+                if (!parse_float(q, line_end, xyz[axis]) || (q < line_end && !is_space(*q))) {
+                    chunk.error.where = p;
+                    chunk.error.message = "expected three numbers after v";
+                    return;
+                }
+            }
+            *vertex++ = Vector3(xyz[0], xyz[1], xyz[2]);
+        }
+        else if (obj_keyword(q, line_end, 'f')) {
+            const long long nbefore = vertex - vertices;
+            unsigned int first = 0, previous = 0;
+            int n = 0;
+            for (q = skip_spaces(q + 1, line_end); q < line_end; q = skip_spaces(q, line_end), n++) {
+                long long i;
+                if (!parse_int(q, line_end, i) || i == 0) {
+                    chunk.error.where = p;
+                    chunk.error.message = "bad vertex index";
+                    return;
+                }
+                // Skip any texture coordinate and normal indices.
+                while (q < line_end && !is_space(*q)) {
+                    q++;
+                }
+
+                long long resolved = (i > 0) ? i - 1 : nbefore + i;
+                if (resolved < 0 || resolved > UINT32_MAX) {
+                    chunk.error.where = p;
+                    chunk.error.message = "vertex index out of range";
+                    return;
+                }
+                unsigned int current = (unsigned int)resolved;
+                if (n == 0) {
+                    first = current;
+                }
+                else if (n >= 2) {
+                    *index++ = first;
+                    *index++ = previous;
+                    *index++ = current;
+                }
+                previous = current;
+            }
+            if (n < 3) {
+                chunk.error.where = p;
+                chunk.error.message = "faces need at least three vertices";
+                return;
+            }
+        }
+        p = line_end + 1;
+    }
+}
+
+
+/*
+ * read_obj --
+ *
+ * Read the OBJ file in data into vertices and indices. Split it into a chunk per worker, breaking at the line ends
+ * after even splits; count what's in each chunk in parallel; work out where each chunk's vertices and triangles start;
+ * and parse them in parallel. Return false, after reporting the first error, if there is one.
+ */
+bool
+read_obj(const std::string &filename,
+         const char *data,
+         size_t size,
+         unsigned int nworkers,
+         std::vector<Vector3> &vertices,
+         std::vector<unsigned int> &indices)
+{
+    const char *end = data + size;
+    std::vector<ObjChunk> chunks(nworkers);
+    for (unsigned int w = 0; w < nworkers; w++) {
+        const char *begin = data + (size_t)((unsigned long long)size * w / nworkers);
+        if (w > 0 && begin[-1] != '\n') {
+            begin = find_line_end(begin, end);
+            begin += (begin < end);
+        }
+        chunks[w].begin = begin;
+        if (w > 0) {
+            chunks[w - 1].end = begin;
+        }
+    }
+    chunks[nworkers - 1].end = end;
+
+    run_workers(nworkers, [&](unsigned int w) {
+        count_obj_chunk(chunks[w]);
+    });
+
+    size_t nvertices = 0, ntriangles = 0;
+    for (ObjChunk &chunk : chunks) {
+        chunk.first_vertex = nvertices;
+        chunk.first_triangle = ntriangles;
+        nvertices += chunk.nvertices;
+        ntriangles += chunk.ntriangles;
+    }
+    vertices.resize(nvertices);
+    indices.resize(3 * ntriangles);
+
+    run_workers(nworkers, [&](unsigned int w) {
+        parse_obj_chunk(chunks[w], vertices.data(), indices.data());
+    });
+
+    for (const ObjChunk &chunk : chunks) {
+        if (chunk.error.where != NULL) {
+            fprintf(stderr, "%s:%d: %s\n", filename.c_str(), count_line_number(data, chunk.error.where),
+                    chunk.error.message);
+            return false;
+        }
+    }
+    return true;
+}
+
+#pragma mark - PLY
+
+enum PlyType {
+    PlyInt8 = 0,
+    PlyUInt8,
+    PlyInt16,
+    PlyUInt16,
+    PlyInt32,
+    PlyUInt32,
+    PlyFloat32,
+    PlyFloat64,
+    PlyInvalid,
+};
+
+const unsigned int PlyTypeSizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type;
+
+    // For lists, type is the type of the items, and count_type the type of the count before them.
+    bool is_list;
+    PlyType count_type;
+};
+
+
+struct PlyElement
+{
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> properties;
+};
+
+
+/*
+ * A run of faces, and where its triangles go in the index buffer.
+ */
+struct PlyChunk
+{
+    const unsigned char *begin;
+    size_t nfaces;
+    size_t first_triangle;
+    ParseError error;
+};
+
+
+/*
+ * get_ply_type --
+ *
+ * Look up a PLY type by either of its names.
+ */
+PlyType
+get_ply_type(const std::string &name)
+{
+    static const char *names[][2] = {
+        { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+        { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" },
+    };
+    for (int i = 0; i < PlyInvalid; i++) {
+        if (name == names[i][0] || name == names[i][1]) {
+            return (PlyType)i;
+        }
+    }
+    return PlyInvalid;
+}
+
+
+/*
+ * read_ply_value --
+ *
+ * Read a value of the given type at p, swapping its bytes first if the file's byte order isn't this machine's.
+ */
+inline double
+read_ply_value(const unsigned char *p,
+               PlyType type,
+               bool swap)
+{
+    unsigned char bytes[8] = { 0 };
+    const unsigned int size = PlyTypeSizes[type];
+    if (swap) {
+        for (unsigned int i = 0; i < size; i++) {
+            bytes[i] = p[size - 1 - i];
+        }
+    }
+    else {
+        memcpy(bytes, p, size);
+    }
+
+    switch (type) {
+        case PlyInt8: { int8_t v; memcpy(&v, bytes, 1); return v; }
+        case PlyUInt8: { uint8_t v; memcpy(&v, bytes, 1); return v; }
+        case PlyInt16: { int16_t v; memcpy(&v, bytes, 2); return v; }
+        case PlyUInt16: { uint16_t v; memcpy(&v, bytes, 2); return v; }
+        case PlyInt32: { int32_t v; memcpy(&v, bytes, 4); return v; }
+        case PlyUInt32: { uint32_t v; memcpy(&v, bytes, 4); return v; }
+        case PlyFloat32: { float v; memcpy(&v, bytes, 4); return v; }
+        case PlyFloat64: { double v; memcpy(&v, bytes, 8); return v; }
+        default: return 0.0;
+    }
+}
+
+
+/*
+ * parse_ply_header --
+ *
+ * Parse the header of the PLY file in data into its elements, and find out its byte order and where the body starts.
+ * Return false with a message in error if it isn't a binary PLY file that makes sense.
+ */
+bool
+parse_ply_header(const char *data,
+                 size_t size,
+                 std::vector<PlyElement> &elements,
+                 bool &little_endian,
+                 size_t &body,
+                 ParseError &error)
+{
+    const char *end = data + size;
+    bool have_format = false;
+    const char *p = find_line_end(data, end) + 1;
+    while (p < end) {
+        const char *line_end = find_line_end(p, end);
+        std::vector<std::string> words;
+        for (const char *q = skip_spaces(p, line_end); q < line_end; q = skip_spaces(q, line_end)) {
+            const char *word = q;
+            while (q < line_end && !is_space(*q)) {
+                q++;
+            }
+            words.push_back(std::string(word, q));
+        }
+        error.where = p;
+        p = line_end + 1;
+
+        if (words.empty() || words[0] == "comment" || words[0] == "obj_info") {
+            continue;
+        }
+        if (words[0] == "end_header") {
+            if (!have_format) {
+                error.message = "no format line";
+                return false;
+            }
+            body = std::min((size_t)(p - data), size);
+            error.where = NULL;
+            return true;
+        }
+        if (words[0] == "format" && words.size() == 3) {
+            if (words[1] == "binary_little_endian" || words[1] == "binary_big_endian") {
+                little_endian = (words[1] == "binary_little_endian");
+                have_format = true;
+                continue;
+            }
+            error.message = (words[1] == "ascii") ? "ASCII PLY files aren't supported" : "unknown format";
+            return false;
+        }
+        if (words[0] == "element" && words.size() == 3) {
+            char *count_end;
+            PlyElement element;
+            element.name = words[1];
+            element.count = strtoull(words[2].c_str(), &count_end, 10);
+            if (*count_end != '\0') {
+                error.message = "bad element count";
+                return false;
+            }
+            elements.push_back(element);
+            continue;
+        }
+        if (words[0] == "property" && !elements.empty()) {
+            PlyProperty property;
+            if (words.size() == 3) {
+                property.type = get_ply_type(words[1]);
+                property.is_list = false;
+                property.count_type = PlyInvalid;
+                property.name = words[2];
+            }
+            else if (words.size() == 5 && words[1] == "list") {
+                property.count_type = get_ply_type(words[2]);
+                property.type = get_ply_type(words[3]);
+                property.is_list = true;
+                property.name = words[4];
+            }
+            else {
+                property.type = PlyInvalid;
+            }
+            if (property.type == PlyInvalid || (property.is_list && property.count_type == PlyInvalid)) {
+                error.message = "bad property";
+                return false;
+            }
+            elements.back().properties.push_back(property);
+            continue;
+        }
+        error.message = "unknown header line";
+        return false;
+    }
+    error.where = data;
+    error.message = "no end_header";
+    return false;
+}
+
+
+/*
+ * skip_ply_record --
+ *
+ * Find the end of the record of element starting at p. Return NULL if it runs past end.
+ */
+const unsigned char *
+skip_ply_record(const PlyElement &element,
+                const unsigned char *p,
+                const unsigned char *end,
+                bool swap)
+{
+    for (const PlyProperty &property : element.properties) {
+        if (property.is_list) {
+            if ((size_t)(end - p) < PlyTypeSizes[property.count_type]) {
+                return NULL;
+            }
+            double count = read_ply_value(p, property.count_type, swap);
+            p += PlyTypeSizes[property.count_type];
+            if (count < 0 || count * PlyTypeSizes[property.type] > (double)(end - p)) {
+                return NULL;
+            }
+            p += (size_t)count * PlyTypeSizes[property.type];
+        }
+        else {
+            if ((size_t)(end - p) < PlyTypeSizes[property.type]) {
+                return NULL;
+            }
+            p += PlyTypeSizes[property.type];
+        }
+    }
+    return p;
+}
+
+
+/*
+ * read_ply_vertices --
+ *
+ * Read the positions, and normals if there are any, of the vertex element starting at p. Vertex records are all the
+ * same size, so the workers just take a share of them each.
+ */
+bool
+read_ply_vertices(const PlyElement &element,
+                  const unsigned char *p,
+                  bool swap,
+                  unsigned int nworkers,
+                  std::vector<Vector3> &vertices,
+                  std::vector<Vector3> &normals,
+                  ParseError &error)
+{
+    static const char *names[] = { "x", "y", "z", "nx", "ny", "nz" };
+    int offsets[6];
+    PlyType types[6];
+    size_t stride = 0;
+    for (int i = 0; i < 6; i++) {
+        offsets[i] = -1;
+    }
+    for (const PlyProperty &property : element.properties) {
+        for (int i = 0; i < 6; i++) {
+            if (property.name == names[i] && !property.is_list) {
+                offsets[i] = stride;
+                types[i] = property.type;
+            }
+        }
+        stride += PlyTypeSizes[property.type];
+    }
+    if (offsets[0] < 0 || offsets[1] < 0 || offsets[2] < 0) {
+        error.message = "vertices need x, y, and z";
+        return false;
+    }
+    const bool have_normals = offsets[3] >= 0 && offsets[4] >= 0 && offsets[5] >= 0;
+
+    vertices.resize(element.count);
+    if (have_normals) {
+        normals.resize(element.count);
+    }
+    run_workers(nworkers, [&](unsigned int w) {
+        unsigned int begin, end;
+        split_range(element.count, w, nworkers, begin, end);
+        for (unsigned int i = begin; i < end; i++) {
+            const unsigned char *record = p + i * stride;
+            vertices[i] = Vector3(read_ply_value(record + offsets[0], types[0], swap),
+                                  read_ply_value(record + offsets[1], types[1], swap),
+                                  read_ply_value(record + offsets[2], types[2], swap));
+            if (have_normals) {
+                normals[i] = Vector3(read_ply_value(record + offsets[3], types[3], swap),
+                                     read_ply_value(record + offsets[4], types[4], swap),
+                                     read_ply_value(record + offsets[5], types[5], swap));
+            }
+        }
+    });
+    return true;
+}
+
+
+/*
+ * parse_ply_faces --
+ *
+ * Parse the faces in chunk into their places in indices, splitting each into a fan of triangles.
+ */
+void
+parse_ply_faces(const PlyElement &element,
+                const PlyProperty *vertex_indices,
+                PlyChunk &chunk,
+                bool swap,
+                unsigned int *indices)
+{
+    unsigned int *index = indices + 3 * chunk.first_triangle;
+    const unsigned char *p = chunk.begin;
+    for (size_t f = 0; f < chunk.nfaces; f++) {
+        for (const PlyProperty &property : element.properties) {
+            if (!property.is_list) {
+                p += PlyTypeSizes[property.type];
+                continue;
+            }
+            const size_t count = (size_t)read_ply_value(p, property.count_type, swap);
+            p += PlyTypeSizes[property.count_type];
+            if (&property == vertex_indices) {
+                unsigned int first = 0, previous = 0;
+                for (size_t i = 0; i < count; i++) {
+                    double value = read_ply_value(p + i * PlyTypeSizes[property.type], property.type, swap);
+                    if (value < 0 || value > UINT32_MAX) {
+                        chunk.error.where = (const char *)p;
+                        chunk.error.message = "vertex index out of range";
+                        return;
+                    }
+                    unsigned int current = (unsigned int)value;
+                    if (i == 0) {
+                        first = current;
+                    }
+                    else if (i >= 2) {
+                        *index++ = first;
+                        *index++ = previous;
+                        *index++ = current;
+                    }
+                    previous = current;
+                }
+            }
+            p += count * PlyTypeSizes[property.type];
+        }
+    }
+}
+
+
+/*
+ * read_ply_faces --
+ *
+ * Read the face element starting at p, which ends before end. One pass walks the faces to find where each worker's
+ * share starts and count its triangles; then the workers parse their shares in parallel. Store the end of the element
+ * in p.
+ */
+bool
+read_ply_faces(const PlyElement &element,
+               const unsigned char *&p,
+               const unsigned char *end,
+               bool swap,
+               unsigned int nworkers,
+               std::vector<unsigned int> &indices,
+               ParseError &error)
+{
+    const PlyProperty *vertex_indices = NULL;
+    for (const PlyProperty &property : element.properties) {
+        if (property.is_list && (property.name == "vertex_indices" || property.name == "vertex_index")) {
+            vertex_indices = &property;
+        }
+    }
+    if (vertex_indices == NULL) {
+        error.where = (const char *)p;
+        error.message = "faces need a vertex_indices list";
+        return false;
+    }
+
+    std::vector<PlyChunk> chunks(nworkers);
+    size_t ntriangles = 0;
+    for (unsigned int w = 0; w < nworkers; w++) {
+        unsigned int begin, stop;
+        split_range(element.count, w, nworkers, begin, stop);
+        chunks[w].begin = p;
+        chunks[w].nfaces = stop - begin;
+        chunks[w].first_triangle = ntriangles;
+        for (unsigned int f = begin; f < stop; f++) {
+            const unsigned char *record = p;
+            p = skip_ply_record(element, p, end, swap);
+            if (p == NULL) {
+                error.where = (const char *)end;
+                error.message = "file is truncated";
+                return false;
+            }
+            // The record is all there, so its counts can be read without checking.
+            for (const PlyProperty &property : element.properties) {
+                if (!property.is_list) {
+                    record += PlyTypeSizes[property.type];
+                    continue;
+                }
+                const size_t count = (size_t)read_ply_value(record, property.count_type, swap);
+                if (&property == vertex_indices) {
+                    ntriangles += (count >= 3) ? count - 2 : 0;
+                    break;
+                }
+                record += PlyTypeSizes[property.count_type] + count * PlyTypeSizes[property.type];
+            }
+        }
+    }
+
+    indices.resize(3 * ntriangles);
+    run_workers(nworkers, [&](unsigned int w) {
+        parse_ply_faces(element, vertex_indices, chunks[w], swap, indices.data());
+    });
+    for (const PlyChunk &chunk : chunks) {
+        if (chunk.error.where != NULL) {
+            error = chunk.error;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*
+ * read_ply --
+ *
+ * Read the binary PLY file in data into vertices, normals, and indices. Elements other than vertex and face are
+ * skipped.
+ */
+bool
+read_ply(const std::string &filename,
+         const char *data,
+         size_t size,
+         unsigned int nworkers,
+         std::vector<Vector3> &vertices,
+         std::vector<Vector3> &normals,
+         std::vector<unsigned int> &indices)
+{
+    std::vector<PlyElement> elements;
+    bool little_endian = true;
+    size_t body = 0;
+    ParseError error;
+    if (!parse_ply_header(data, size, elements, little_endian, body, error)) {
+        fprintf(stderr, "%s:%d: %s\n", filename.c_str(), count_line_number(data, error.where), error.message);
+        return false;
+    }
+
+    const uint16_t one = 1;
+    const bool swap = (*(const unsigned char *)&one == 1) != little_endian;
+
+    const unsigned char *p = (const unsigned char *)data + body;
+    const unsigned char *end = (const unsigned char *)data + size;
+    for (const PlyElement &element : elements) {
+        bool fixed_size = true;
+        size_t stride = 0;
+        for (const PlyProperty &property : element.properties) {
+            fixed_size = fixed_size && !property.is_list;
+            stride += PlyTypeSizes[property.type];
+        }
+
+        if (fixed_size) {
+            if (stride > 0 && element.count > (size_t)(end - p) / stride) {
+                fprintf(stderr, "%s: file is truncated\n", filename.c_str());
+                return false;
+            }
+            if (element.name == "vertex"
+                    && !read_ply_vertices(element, p, swap, nworkers, vertices, normals, error)) {
+                fprintf(stderr, "%s: %s\n", filename.c_str(), error.message);
+                return false;
+            }
+            p += element.count * stride;
+        }
+        else if (element.name == "face") {
+            if (!read_ply_faces(element, p, end, swap, nworkers, indices, error)) {
+                fprintf(stderr, "%s: byte %lu: %s\n", filename.c_str(), (unsigned long)(error.where - data),
+                        error.message);
+                return false;
+            }
+        }
+        else {
+            for (size_t i = 0; i < element.count && p != NULL; i++) {
+                p = skip_ply_record(element, p, end, swap);
+            }
+            if (p == NULL) {
+                fprintf(stderr, "%s: file is truncated\n", filename.c_str());
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} /* anonymous namespace */
+
+
+/*
+ * MeshReader::MeshReader --
+ *
+ * Default constructor. Create a reader that parses with one thread per hardware thread.
+ */
+MeshReader::MeshReader()
+    : nthreads(0),
+      nbytes(0),
+      seconds(0.0)
+{ }
+
+
+/*
+ * MeshReader::get_nthreads --
+ * MeshReader::set_nthreads --
+ *
+ * Get and set the number of threads to parse with. 0 means one per hardware thread, or fewer for small files.
+ */
+unsigned int
+MeshReader::get_nthreads()
+    const
+{
+    return nthreads;
+}
+
+void
+MeshReader::set_nthreads(unsigned int n)
+{
+    nthreads = n;
+}
+
+
+/*
+ * MeshReader::read_mesh --
+ *
+ * Read the named OBJ or PLY file into mesh, replacing whatever it held. PLY files are recognized by the magic word at
+ * their start, and anything else is read as OBJ. Return the number of triangles read, or a negative number if the
+ * file couldn't be read; the reason is printed.
+ */
+int
+MeshReader::read_mesh(TriangleMesh &mesh,
+                      const std::string &filename)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    MappedFile file;
+    if (!file.open(filename)) {
+        fprintf(stderr, "%s: %s\n", filename.c_str(), strerror(errno));
+        return -1;
+    }
+    const char *data = file.get_data();
+    const size_t size = file.get_size();
+
+    unsigned int nworkers = nthreads;
+    if (nworkers == 0) {
+        nworkers = std::min(std::thread::hardware_concurrency(), (unsigned int)(size / MinBytesPerWorker));
+    }
+    nworkers = std::max(1u, nworkers);
+
+    std::vector<Vector3> vertices, normals;
+    std::vector<unsigned int> indices;
+    bool ok;
+    if (size >= 4 && memcmp(data, "ply", 3) == 0 && (data[3] == '\n' || data[3] == '\r')) {
+        ok = read_ply(filename, data, size, nworkers, vertices, normals, indices);
+    }
+    else {
+        ok = read_obj(filename, data, size, nworkers, vertices, indices);
+    }
+    if (!ok) {
+        return -1;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    nbytes = size;
+    seconds = elapsed.count();
+
+    if (!mesh.set_geometry(vertices, indices)) {
+        fprintf(stderr, "%s: a face refers to a vertex that doesn't exist\n", filename.c_str());
+        return -1;
+    }
+    if (!normals.empty()) {
+        mesh.set_normals(normals);
+    }
+    return mesh.get_ntriangles();
+}
+
+
+/*
+ * MeshReader::get_nbytes --
+ * MeshReader::get_seconds --
+ * MeshReader::get_throughput --
+ *
+ * Get the size of the last file read, how long reading it took, not counting building the mesh's BVH, and the rate it
+ * was read at in megabytes (10^6 bytes) per second.
+ */
+size_t
+MeshReader::get_nbytes()
+    const
+{
+    return nbytes;
+}
+
+double
+MeshReader::get_seconds()
+    const
+{
+    return seconds;
+}
+
+double
+MeshReader::get_throughput()
+    const
+{
+    return (seconds > 0.0) ? nbytes / 1e6 / seconds : 0.0;
+}
@@ -0,0 +1,45 @@
+/* reader_mesh.h
+ *
+ * Declaration of the mesh reader, which loads Wavefront OBJ and binary PLY files into TriangleMeshes.
+ *
+ * Files are mapped into memory and split into chunks, at line boundaries for OBJ and element boundaries for PLY, which
+ * are parsed in parallel. A first pass over each chunk counts its vertices and triangles, so the vertex and index
+ * buffers can be allocated once, at their final size; a second pass parses each chunk straight into its part of them.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __READER_MESH_H__
+#define __READER_MESH_H__
+
+#include <cstddef>
+#include <string>
+
+
+class TriangleMesh;
+
+
+class MeshReader
+{
+public:
+    MeshReader();
+
+    unsigned int get_nthreads() const;
+    void set_nthreads(unsigned int n);
+
+    int read_mesh(TriangleMesh &mesh, const std::string &filename);
+
+    size_t get_nbytes() const;
+    double get_seconds() const;
+    double get_throughput() const;
+
+private:
+    // Threads to parse with, or 0 for one per hardware thread, or fewer for small files.
+    unsigned int nthreads;
+
+    // Size of the last file read, and how long it took to read it, not counting building the mesh's BVH.
+    size_t nbytes;
+    double seconds;
+};
+
+#endif
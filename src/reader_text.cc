@@ -0,0 +1,912 @@
+/* reader_text.cc
+ *
+ * Definition of the text scene reader. Scene files are plain text, one statement per line:
+ *
+ *     # Comments run from a hash to the end of the line.
+ *     render width 640 height 480 max-depth 5 min-weight 0.0001 threads 0 tile-size 32
+ *     camera orthographic origin 0 0 -1000 direction 0 0 1 width 640 0 0 height 0 480 0
+ *     ambient color 1 1 1 intensity 1
+ *     material red diffuse-color 1 0 0 diffuse-level 0.8 specular-color 1 1 1 specular-level 0.5
+ *     sphere center 233 290 0 radius 80 material red
+ *     plane origin 0 460 400 normal 0 1 0.01 material red
+ *     mesh file bunny.obj origin 320 240 0 material red
+ *     light origin 0 240 100 color 1 1 1 intensity 1
+ *
+ * Each statement is a keyword, then a name for materials or a type for cameras, then any number of parameters in any
+ * order. Parameters that aren't given take the same defaults as the corresponding constructors. Vectors and colors
+ * are three numbers. Materials have to be defined before shapes can use them; shapes without one get a default. Mesh
+ * files are OBJ or binary PLY, and relative paths are taken from the directory the scene file is in.
+ *
+ * Files are read in a single pass through a fixed-size buffer, and each object goes into the Scene as soon as its
+ * statement has been parsed. Apart from the scene itself, memory use doesn't grow with the size of the file.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cerrno>
+#include <climits>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "basics.h"
+#include "camera.h"
+#include "light.h"
+#include "material.h"
+#include "object_mesh.h"
+#include "object_plane.h"
+#include "object_sphere.h"
+#include "reader_mesh.h"
+#include "reader_text.h"
+#include "scene.h"
+
+
+namespace {
+
+const size_t BufferSize = 1 << 16;
+const size_t MaxTokenLength = 255;
+
+
+/*
+ * Splits a file into lines of whitespace-separated tokens, skipping comments and blank lines.
+ */
+class Tokenizer
+{
+public:
+    Tokenizer(FILE *file);
+
+    bool next_statement();
+    bool next_token();
+
+    const char *get_token() const;
+    int get_line() const;
+    bool is_token_too_long() const;
+
+private:
+    int peek();
+    int get();
+
+    FILE *file;
+    std::vector<char> buffer;
+    size_t pos, len;
+
+    char token[MaxTokenLength + 1];
+    bool token_too_long;
+    bool in_statement;
+    int line;
+};
+
+
+/*
+ * Turns statements into scene objects.
+ */
+class Parser
+{
+public:
+    Parser(Scene &scene, FILE *file, const std::string &filename);
+
+    int parse();
+
+private:
+    bool parse_render();
+    bool parse_camera();
+    bool parse_ambient();
+    bool parse_material();
+    bool parse_sphere();
+    bool parse_plane();
+    bool parse_mesh();
+    bool parse_light();
+
+    bool is(const char *keyword) const;
+    bool read_int(int &i);
+    bool read_float(float &f);
+    bool read_vector(Vector3 &v);
+    bool read_color(Color &c);
+    bool read_material(Material *&material);
+    Material *get_default_material();
+
+    bool finish_statement();
+    bool unknown_parameter(const char *statement);
+    bool error(const char *format, ...);
+
+    Scene &scene;
+    Tokenizer tokens;
+    const std::string &filename;
+
+    std::map<std::string, Material *> materials;
+    Material *default_material;
+};
+
+#pragma mark - Tokenizer
+
+Tokenizer::Tokenizer(FILE *f)
+    : file(f),
+      buffer(BufferSize),
+      pos(0), len(0),
+      token_too_long(false),
+      in_statement(false),
+      line(1)
+{
+    token[0] = '\0';
+}
+
+
+/*
+ * Tokenizer::peek --
+ * Tokenizer::get --
+ *
+ * Look at or consume the next character in the file, refilling the buffer as needed. Return EOF at the end.
+ */
+int
+Tokenizer::peek()
+{
+    if (pos == len) {
+        len = fread(buffer.data(), 1, buffer.size(), file);
+        pos = 0;
+        if (len == 0) {
+            return EOF;
+        }
+    }
+    return (unsigned char)buffer[pos];
+}
+
+int
+Tokenizer::get()
+{
+    int c = peek();
+    if (c != EOF) {
+        pos++;
+        if (c == '\n') {
+            line++;
+        }
+    }
+    return c;
+}
+
+
+/*
+ * Tokenizer::next_statement --
+ *
+ * Skip the rest of the current statement, and any blank or comment lines after it. Return false at the end of the
+ * file, or true if there's another statement to read.
+ */
+bool
+Tokenizer::next_statement()
+{
+    int c;
+    if (in_statement) {
+        while ((c = get()) != EOF && c != '\n') { }
+        in_statement = false;
+    }
+
+    while (true) {
+        while ((c = peek()) == ' ' || c == '\t' || c == '\r') {
+            get();
+        }
+        if (c == EOF) {
+            return false;
+        }
+        if (c == '#') {
+            while ((c = peek()) != EOF && c != '\n') {
+                get();
+            }
+            continue;
+        }
+        if (c == '\n') {
+            get();
+            continue;
+        }
+        in_statement = true;
+        return true;
+    }
+}
+
+
+/*
+ * Tokenizer::next_token --
+ *
+ * Read the next token in the current statement. Return false if there isn't one, or if it's too long to hold; in that
+ * case is_token_too_long() is true.
+ */
+bool
+Tokenizer::next_token()
+{
+    int c;
+    while ((c = peek()) == ' ' || c == '\t' || c == '\r') {
+        get();
+    }
+    if (c == EOF || c == '\n' || c == '#') {
+        return false;
+    }
+
+    size_t n = 0;
+    while ((c = peek()) != EOF && c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != '#') {
+        if (n == MaxTokenLength) {
+            token[n] = '\0';
+            token_too_long = true;
+            return false;
+        }
+        token[n++] = get();
+    }
+    token[n] = '\0';
+    return true;
+}
+
+
+const char *
+Tokenizer::get_token()
+    const
+{
+    return token;
+}
+
+int
+Tokenizer::get_line()
+    const
+{
+    return line;
+}
+
+bool
+Tokenizer::is_token_too_long()
+    const
+{
+    return token_too_long;
+}
+
+#pragma mark - Parser
+
+Parser::Parser(Scene &s,
+               FILE *file,
+               const std::string &fn)
+    : scene(s),
+      tokens(file),
+      filename(fn),
+      materials(),
+      default_material(NULL)
+{ }
+
+
+/*
+ * Parser::parse --
+ *
+ * Read statements until the end of the file. Return the number read, or -1 on the first error.
+ */
+int
+Parser::parse()
+{
+    int nstatements = 0;
+    while (tokens.next_statement()) {
+        bool ok;
+        if (!tokens.next_token()) {
+            // There's always a token at the start of a statement unless it's too long to read, which error() reports.
+            ok = error("");
+        }
+        else if (is("render")) {
+            ok = parse_render();
+        }
+        else if (is("camera")) {
+            ok = parse_camera();
+        }
+        else if (is("ambient")) {
+            ok = parse_ambient();
+        }
+        else if (is("material")) {
+            ok = parse_material();
+        }
+        else if (is("sphere")) {
+            ok = parse_sphere();
+        }
+        else if (is("plane")) {
+            ok = parse_plane();
+        }
+        else if (is("mesh")) {
+            ok = parse_mesh();
+        }
+        else if (is("light")) {
+            ok = parse_light();
+        }
+        else {
+            ok = error("unknown statement '%s'", tokens.get_token());
+        }
+
+        if (!ok) {
+            return -1;
+        }
+        nstatements++;
+    }
+    return nstatements;
+}
+
+
+/*
+ * Parser::parse_render --
+ *
+ * render [width W] [height H] [max-depth D] [min-weight W] [threads N] [tile-size S]
+ */
+bool
+Parser::parse_render()
+{
+    int i;
+    float f;
+    while (tokens.next_token()) {
+        if (is("width")) {
+            if (!read_int(i)) {
+                return false;
+            }
+            scene.set_width(i);
+        }
+        else if (is("height")) {
+            if (!read_int(i)) {
+                return false;
+            }
+            scene.set_height(i);
+        }
+        else if (is("max-depth")) {
+            if (!read_int(i)) {
+                return false;
+            }
+            scene.set_max_depth(i);
+        }
+        else if (is("min-weight")) {
+            if (!read_float(f)) {
+                return false;
+            }
+            scene.set_min_weight(f);
+        }
+        else if (is("threads")) {
+            if (!read_int(i)) {
+                return false;
+            }
+            if (i < 0 || (unsigned int)i > Scene::MaxThreads) {
+                return error("threads must be from 0 to %u", Scene::MaxThreads);
+            }
+            scene.set_nthreads(i);
+        }
+        else if (is("tile-size")) {
+            if (!read_int(i)) {
+                return false;
+            }
+            if (i <= 0) {
+                return error("tile size must be positive");
+            }
+            scene.set_tile_size(i);
+        }
+        else {
+            return unknown_parameter("render");
+        }
+    }
+    if (scene.get_width() <= 0 || scene.get_height() <= 0) {
+        return error("image dimensions must be positive");
+    }
+    return finish_statement();
+}
+
+
+/*
+ * Parser::parse_camera --
+ *
+ * camera orthographic [origin V] [direction V] [width V] [height V]
+ * camera perspective [origin V] [direction V] [width V] [height V] [angle DEGREES]
+ */
+bool
+Parser::parse_camera()
+{
+    if (!tokens.next_token()) {
+        return error("expected a camera type");
+    }
+
+    Camera *camera;
+    if (is("orthographic")) {
+        camera = new OrthographicCamera();
+    }
+    else if (is("perspective")) {
+        camera = new PerspectiveCamera();
+    }
+    else {
+        return error("unknown camera type '%s'", tokens.get_token());
+    }
+
+    Vector3 v;
+    while (tokens.next_token()) {
+        bool ok = true;
+        if (is("origin")) {
+            if ((ok = read_vector(v))) {
+                camera->set_origin(v);
+            }
+        }
+        else if (is("direction")) {
+            if ((ok = read_vector(v))) {
+                camera->set_direction(v.normalize());
+            }
+        }
+        else if (is("width")) {
+            if ((ok = read_vector(v))) {
+                camera->set_width(v);
+            }
+        }
+        else if (is("height")) {
+            if ((ok = read_vector(v))) {
+                camera->set_height(v);
+            }
+        }
+        else if (is("angle")) {
+            float angle;
+            if ((ok = read_float(angle))) {
+                if (angle <= 0.0 || angle >= 180.0) {
+                    ok = error("camera angle must be between 0 and 180 degrees");
+                }
+                camera->set_angle(angle);
+            }
+        }
+        else {
+            ok = unknown_parameter("camera");
+        }
+        if (!ok) {
+            delete camera;
+            return false;
+        }
+    }
+
+    scene.set_camera(camera);
+    return finish_statement();
+}
+
+
+/*
+ * Parser::parse_ambient --
+ *
+ * ambient [color C] [intensity I]
+ */
+bool
+Parser::parse_ambient()
+{
+    Color color = scene.get_ambient().get_color();
+    float intensity = scene.get_ambient().get_intensity();
+    while (tokens.next_token()) {
+        if (is("color")) {
+            if (!read_color(color)) {
+                return false;
+            }
+        }
+        else if (is("intensity")) {
+            if (!read_float(intensity)) {
+                return false;
+            }
+        }
+        else {
+            return unknown_parameter("ambient");
+        }
+    }
+    scene.get_ambient() = AmbientLight(color, intensity);
+    return finish_statement();
+}
+
+
+/*
+ * Parser::parse_material --
+ *
+ * material NAME [diffuse-color C] [diffuse-level L] [specular-color C] [specular-level L]
+ */
+bool
+Parser::parse_material()
+{
+    if (!tokens.next_token()) {
+        return error("expected a material name");
+    }
+    std::string name = tokens.get_token();
+    if (materials.count(name) > 0) {
+        return error("material '%s' is already defined", name.c_str());
+    }
+
+    Material *material = new Material();
+    scene.add_material(material);
+    materials[name] = material;
+
+    Color c;
+    float f;
+    while (tokens.next_token()) {
+        if (is("diffuse-color")) {
+            if (!read_color(c)) {
+                return false;
+            }
+            material->set_diffuse_color(c);
+        }
+        else if (is("diffuse-level")) {
+            if (!read_float(f)) {
+                return false;
+            }
+            material->set_diffuse_level(f);
+        }
+        else if (is("specular-color")) {
+            if (!read_color(c)) {
+                return false;
+            }
+            material->set_specular_color(c);
+        }
+        else if (is("specular-level")) {
+            if (!read_float(f)) {
+                return false;
+            }
+            material->set_specular_level(f);
+        }
+        else {
+            return unknown_parameter("material");
+        }
+    }
+    return finish_statement();
+}
+
+
+/*
+ * Parser::parse_sphere --
+ *
+ * sphere [center V] [radius R] [material NAME]
+ */
+bool
+Parser::parse_sphere()
+{
+    Vector3 center;
+    float radius = 1.0;
+    Material *material = NULL;
+    while (tokens.next_token()) {
+        if (is("center")) {
+            if (!read_vector(center)) {
+                return false;
+            }
+        }
+        else if (is("radius")) {
+            if (!read_float(radius)) {
+                return false;
+            }
+        }
+        else if (is("material")) {
+            if (!read_material(material)) {
+                return false;
+            }
+        }
+        else {
+            return unknown_parameter("sphere");
+        }
+    }
+    if (!finish_statement()) {
+        return false;
+    }
+    if (radius <= 0.0) {
+        return error("sphere radius must be positive");
+    }
+
+    Sphere *sphere = new Sphere(center, radius);
+    sphere->set_material((material != NULL) ? material : get_default_material());
+    scene.add_shape(sphere);
+    return true;
+}
+
+
+/*
+ * Parser::parse_plane --
+ *
+ * plane [origin V] [normal V] [material NAME]
+ */
+bool
+Parser::parse_plane()
+{
+    Vector3 origin;
+    Vector3 normal = Vector3::Y;
+    Material *material = NULL;
+    while (tokens.next_token()) {
+        if (is("origin")) {
+            if (!read_vector(origin)) {
+                return false;
+            }
+        }
+        else if (is("normal")) {
+            if (!read_vector(normal)) {
+                return false;
+            }
+        }
+        else if (is("material")) {
+            if (!read_material(material)) {
+                return false;
+            }
+        }
+        else {
+            return unknown_parameter("plane");
+        }
+    }
+    if (!finish_statement()) {
+        return false;
+    }
+    if (normal == Vector3::Zero) {
+        return error("plane normal must not be zero");
+    }
+
+    Plane *plane = new Plane(origin, normal);
+    plane->set_material((material != NULL) ? material : get_default_material());
+    scene.add_shape(plane);
+    return true;
+}
+
+
+/*
+ * Parser::parse_mesh --
+ *
+ * mesh file PATH [origin V] [material NAME]
+ */
+bool
+Parser::parse_mesh()
+{
+    std::string path;
+    Vector3 origin;
+    Material *material = NULL;
+    while (tokens.next_token()) {
+        if (is("file")) {
+            if (!tokens.next_token()) {
+                return error("expected a file name");
+            }
+            path = tokens.get_token();
+        }
+        else if (is("origin")) {
+            if (!read_vector(origin)) {
+                return false;
+            }
+        }
+        else if (is("material")) {
+            if (!read_material(material)) {
+                return false;
+            }
+        }
+        else {
+            return unknown_parameter("mesh");
+        }
+    }
+    if (!finish_statement()) {
+        return false;
+    }
+    if (path.empty()) {
+        return error("mesh needs a file");
+    }
+    if (path[0] != '/') {
+        std::string::size_type slash = filename.rfind('/');
+        if (slash != std::string::npos) {
+            path = filename.substr(0, slash + 1) + path;
+        }
+    }
+
+    TriangleMesh *mesh = new TriangleMesh(origin);
+    MeshReader reader;
+    if (reader.read_mesh(*mesh, path) < 0) {
+        delete mesh;
+        return error("couldn't read mesh '%s'", path.c_str());
+    }
+    printf("%s: %u triangles, %.1f MB read in %f seconds (%.1f MB/s)\n", path.c_str(), mesh->get_ntriangles(),
+           reader.get_nbytes() / 1e6, reader.get_seconds(), reader.get_throughput());
+    mesh->set_material((material != NULL) ? material : get_default_material());
+    scene.add_shape(mesh);
+    return true;
+}
+
+
+/*
+ * Parser::parse_light --
+ *
+ * light [origin V] [color C] [intensity I]
+ */
+bool
+Parser::parse_light()
+{
+    Vector3 origin;
+    Color color = Color::White;
+    float intensity = 1.0;
+    while (tokens.next_token()) {
+        if (is("origin")) {
+            if (!read_vector(origin)) {
+                return false;
+            }
+        }
+        else if (is("color")) {
+            if (!read_color(color)) {
+                return false;
+            }
+        }
+        else if (is("intensity")) {
+            if (!read_float(intensity)) {
+                return false;
+            }
+        }
+        else {
+            return unknown_parameter("light");
+        }
+    }
+    if (!finish_statement()) {
+        return false;
+    }
+
+    scene.add_light(new PointLight(origin, color, intensity));
+    return true;
+}
+
+
+/*
+ * Parser::is --
+ *
+ * Return true if the current token is the given keyword.
+ */
+bool
+Parser::is(const char *keyword)
+    const
+{
+    return strcmp(tokens.get_token(), keyword) == 0;
+}
+
+
+/*
+ * Parser::read_int --
+ * Parser::read_float --
+ * Parser::read_vector --
+ * Parser::read_color --
+ *
+ * Read a parameter value from the next one or three tokens. On failure, report an error and return false.
+ */
+bool
+Parser::read_int(int &i)
+{
+    if (!tokens.next_token()) {
+        return error("expected an integer");
+    }
+
+    char *end;
+    errno = 0;
+    long value = strtol(tokens.get_token(), &end, 10);
+    if (*end != '\0' || (errno != 0 && errno != ERANGE)) {
+        return error("'%s' is not an integer", tokens.get_token());
+    }
+    if (errno == ERANGE || value < INT_MIN || value > INT_MAX) {
+        return error("'%s' is out of range", tokens.get_token());
+    }
+    i = value;
+    return true;
+}
+
+bool
+Parser::read_float(float &f)
+{
+    if (!tokens.next_token()) {
+        return error("expected a number");
+    }
+
+    char *end;
+    errno = 0;
+    f = strtof(tokens.get_token(), &end);
+    if (*end != '\0' || errno != 0) {
+        return error("'%s' is not a number", tokens.get_token());
+    }
+    return true;
+}
+
+bool
+Parser::read_vector(Vector3 &v)
+{
+    return read_float(v.x) && read_float(v.y) && read_float(v.z);
+}
+
+bool
+Parser::read_color(Color &c)
+{
+    c.alpha = 1.0;
+    return read_float(c.red) && read_float(c.green) && read_float(c.blue);
+}
+
+
+/*
+ * Parser::read_material --
+ *
+ * Read a material name and look it up.
+ */
+bool
+Parser::read_material(Material *&material)
+{
+    if (!tokens.next_token()) {
+        return error("expected a material name");
+    }
+
+    std::map<std::string, Material *>::iterator it = materials.find(tokens.get_token());
+    if (it == materials.end()) {
+        return error("undefined material '%s'", tokens.get_token());
+    }
+    material = it->second;
+    return true;
+}
+
+
+/*
+ * Parser::get_default_material --
+ *
+ * Get the material for shapes that don't name one, creating it the first time it's needed.
+ */
+Material *
+Parser::get_default_material()
+{
+    if (default_material == NULL) {
+        default_material = new Material();
+        scene.add_material(default_material);
+    }
+    return default_material;
+}
+
+
+/*
+ * Parser::finish_statement --
+ *
+ * Check that a statement ended because its line did, rather than because of a token too long to read.
+ */
+bool
+Parser::finish_statement()
+{
+    return tokens.is_token_too_long() ? error("") : true;
+}
+
+
+/*
+ * Parser::unknown_parameter --
+ * Parser::error --
+ *
+ * Report an error at the current line and return false. A token too long to read is the root cause of whatever went
+ * wrong after it, so that's reported instead of the given message.
+ */
+bool
+Parser::unknown_parameter(const char *statement)
+{
+    return error("unknown %s parameter '%s'", statement, tokens.get_token());
+}
+
+bool
+Parser::error(const char *format, ...)
+{
+    fprintf(stderr, "%s:%d: ", filename.c_str(), tokens.get_line());
+    if (tokens.is_token_too_long()) {
+        fprintf(stderr, "token longer than %lu characters\n", (unsigned long)MaxTokenLength);
+        return false;
+    }
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+    return false;
+}
+
+} /* anonymous namespace */
+
+#pragma mark - Text Reader
+
+/*
+ * TextReader::read_scene --
+ *
+ * Read the text scene description in the named file into the given Scene.
+ */
+int
+TextReader::read_scene(Scene &scene,
+                       const std::string &filename)
+{
+    FILE *file = fopen(filename.c_str(), "r");
+    if (!file) {
+        perror(filename.c_str());
+        return -1;
+    }
+
+    Parser parser(scene, file, filename);
+    int nstatements = parser.parse();
+
+    if (ferror(file)) {
+        perror(filename.c_str());
+        nstatements = -1;
+    }
+    fclose(file);
+    return nstatements;
+}
@@ -0,0 +1,21 @@
+/* reader_text.h
+ *
+ * Declaration of the text scene reader.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __READER_TEXT_H__
+#define __READER_TEXT_H__
+
+#include "reader.h"
+
+
+class TextReader
+    : public Reader
+{
+public:
+    int read_scene(Scene &scene, const std::string &filename);
+};
+
+#endif
@@ -5,26 +5,82 @@
  * Eryn Wells <eryn@erynwells.me>
  */
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <cstdio>
+#include <thread>
+#include <vector>
 
 #include "basics.h"
+#include "camera.h"
 #include "light.h"
+#include "mapped_file.h"
+#include "material.h"
 #include "object.h"
+#include "object_instance.h"
+#include "object_plane.h"
+#include "object_sphere.h"
+#include "reader_text.h"
 #include "scene.h"
+#include "scene_cache.h"
+#include "scheduler.h"
+#include "wavefront.h"
 #include "writer.h"
 
 
+/*
+ * Secondary rays start on the surface they leave from. Intersections nearer than this to a ray's origin are ignored so
+ * that rounding error doesn't make surfaces shadow or reflect themselves.
+ */
+const float Scene::RayEpsilon = 1e-2;
+
+// Defined here too, since std::min takes it by reference.
+const int Scene::MaxPacketSize;
+
+/*
+ * Reflection and other secondary rays waiting to be traced. Every surface spawns at most one, so this is deeper than
+ * it ever needs to be; rays that don't fit are dropped.
+ */
+static const int RayStackSize = 16;
+
+
 Scene::Scene()
     : width(640), height(480),
       max_depth(5),
       min_weight(1e-4),
+      nthreads(0),
+      tile_size(32),
+      packet_size(0),
+      render_mode(RenderModeDepthFirst),
+      ray_sorting(true),
+      ray_sort_stats(false),
       ambient(new AmbientLight()),
+      camera(NULL),
       shapes(),
       lights(),
+      materials(),
+      groups(),
+      default_camera(NULL),
+      render_camera(NULL),
+      spheres(),
+      bounded_shapes(),
+      planes(),
+      unbounded_shapes(),
+      bvh(),
+      wide_bvh(),
+      bvh_builder(BVHBuilderSAH),
+      is_acceleration_current(false),
+      shape_ids(),
+      prim_bounds(),
+      changed_shapes(),
+      is_shape_changed(),
+      refit_limit(1.5),
+      cache_file(NULL),
       nrays(0),
-      pixels(NULL)
+      nshadow_rays(0),
+      _is_rendered(false),
+      framebuffer()
 { }
 
 
@@ -34,6 +90,13 @@ Scene::~Scene()
         delete ambient;
     }
 
+    if (camera != NULL) {
+        delete camera;
+    }
+    if (default_camera != NULL) {
+        delete default_camera;
+    }
+
     for (Shape *s : shapes) {
         delete s;
     }
@@ -44,10 +107,22 @@ Scene::~Scene()
     }
     lights.clear();
 
-    if (pixels != NULL) {
-        delete[] pixels;
-        _is_rendered = false;
+    for (Material *m : materials) {
+        delete m;
+    }
+    materials.clear();
+
+    for (InstanceGroup *g : groups) {
+        delete g;
     }
+    groups.clear();
+
+    _is_rendered = false;
+
+    // The BVHs may point into the cache, so they have to go first.
+    wide_bvh.clear();
+    bvh.clear();
+    set_cache_file(NULL);
 }
 
 
@@ -59,6 +134,14 @@ Scene::is_rendered()
 }
 
 
+/*
+ * Scene::get_width --
+ * Scene::set_width --
+ * Scene::get_height --
+ * Scene::set_height --
+ *
+ * Get and set the pixel dimensions of the image.
+ */
 int
 Scene::get_width()
     const
@@ -66,6 +149,11 @@ Scene::get_width()
     return width;
 }
 
+void
+Scene::set_width(int w)
+{
+    width = w;
+}
 
 int
 Scene::get_height()
@@ -74,6 +162,47 @@ Scene::get_height()
     return height;
 }
 
+void
+Scene::set_height(int h)
+{
+    height = h;
+}
+
+
+/*
+ * Scene::get_max_depth --
+ * Scene::set_max_depth --
+ * Scene::get_min_weight --
+ * Scene::set_min_weight --
+ *
+ * Get and set the ray tracing parameters that bound the depth of the ray tree.
+ */
+int
+Scene::get_max_depth()
+    const
+{
+    return max_depth;
+}
+
+void
+Scene::set_max_depth(int depth)
+{
+    max_depth = depth;
+}
+
+float
+Scene::get_min_weight()
+    const
+{
+    return min_weight;
+}
+
+void
+Scene::set_min_weight(float weight)
+{
+    min_weight = weight;
+}
+
 
 AmbientLight &
 Scene::get_ambient()
@@ -83,208 +212,1274 @@ Scene::get_ambient()
 }
 
 
+/*
+ * Scene::get_camera --
+ * Scene::set_camera --
+ *
+ * Get and set the Scene's camera. The Scene takes ownership of the camera, and deletes the old one if there was one.
+ */
+Camera *
+Scene::get_camera()
+    const
+{
+    return camera;
+}
+
+void
+Scene::set_camera(Camera *cam)
+{
+    if (camera != NULL && camera != cam) {
+        delete camera;
+    }
+    camera = cam;
+}
+
+
+/*
+ * Scene::get_pixels --
+ * Scene::get_framebuffer --
+ *
+ * Get the rendered image. The pixels are only there as Colors in row order if the framebuffer keeps them that way, as
+ * it does by default, and are NULL otherwise; the framebuffer can load them in row order whatever its layout. Set the
+ * framebuffer's format and order before rendering.
+ */
 const Color *
 Scene::get_pixels()
     const
 {
-    return pixels;
+    return framebuffer.get_pixels();
+}
+
+Framebuffer &
+Scene::get_framebuffer()
+{
+    return framebuffer;
+}
+
+const Framebuffer &
+Scene::get_framebuffer()
+    const
+{
+    return framebuffer;
 }
 
 
 /*
- * scene_load --
+ * Scene::get_nthreads --
+ * Scene::set_nthreads --
  *
- * Load scene objects into this Scene from the given file.
+ * Get and set the number of threads to render with. 0 means one per hardware thread.
  */
+unsigned int
+Scene::get_nthreads()
+    const
+{
+    return nthreads;
+}
+
 void
-Scene::read(const std::string &filename)
-{ }
+Scene::set_nthreads(unsigned int n)
+{
+    nthreads = n;
+}
 
 
 /*
- * scene_save --
+ * Scene::get_tile_size --
+ * Scene::set_tile_size --
  *
- * Write a rendered scene to the given file.
+ * Get and set the edge length, in pixels, of the tiles the image is split into for rendering.
  */
+int
+Scene::get_tile_size()
+    const
+{
+    return tile_size;
+}
+
 void
-Scene::write(Writer &writer, const std::string &filename)
+Scene::set_tile_size(int size)
 {
-    writer.write_scene(*this, filename);
+    tile_size = (size > 0) ? size : 1;
 }
 
 
 /*
- * Scene::render --
+ * Scene::get_packet_size --
+ * Scene::set_packet_size --
  *
- * Render the given Scene.
+ * Get and set the edge length, in pixels, of the square packets primary rays are traced in. 1 traces every ray on its
+ * own. 0, the default, picks a size to suit the sphere kernel: 8 if it tests 8 or more spheres at a time, 4 otherwise.
  */
+int
+Scene::get_packet_size()
+    const
+{
+    return packet_size;
+}
+
 void
-Scene::render()
+Scene::set_packet_size(int size)
 {
-    std::chrono::time_point<std::chrono::system_clock> start, end;
-    start = std::chrono::system_clock::now();
+    packet_size = std::max(0, std::min(size, MaxPacketSize));
+}
 
-    pixels = new Color[width * height];
-
-    Ray primary_ray;
-    Vector3 o, d;
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            // Assemble a ray and trace it.
-            o = Vector3(x, y, -1000);
-            d = Vector3(0, 0, 1);
-            d.normalize();
-            primary_ray = Ray(o, d);
-            Color c = trace_ray(primary_ray);
-            pixels[y * width + x] = c;
-        }
+
+/*
+ * Scene::get_effective_packet_size --
+ *
+ * Return the packet size to render with, resolving the automatic choice.
+ */
+int
+Scene::get_effective_packet_size()
+    const
+{
+    if (packet_size > 0) {
+        return packet_size;
     }
+    return (spheres.get_kernel().width >= 8) ? 8 : 4;
+}
 
-    end = std::chrono::system_clock::now();
-    std::chrono::duration<float> seconds = end - start;
 
-    _is_rendered = true;
-    printf("Scene rendered. %d rays traced in %f seconds.\n", nrays, seconds.count());
+/*
+ * Scene::get_render_mode --
+ * Scene::set_render_mode --
+ *
+ * Get and set how the Scene is rendered. See RenderMode.
+ */
+Scene::RenderMode
+Scene::get_render_mode()
+    const
+{
+    return render_mode;
+}
+
+void
+Scene::set_render_mode(RenderMode mode)
+{
+    render_mode = mode;
 }
 
 
 /*
- * Scene::add_shape --
+ * Scene::get_ray_sorting --
+ * Scene::set_ray_sorting --
+ * Scene::get_ray_sort_stats --
+ * Scene::set_ray_sort_stats --
  *
- * Add a shape to the scene.
+ * Get and set whether wavefront rendering sorts reflection rays for coherence before tracing them, and whether it
+ * reports statistics on the sort when it's done. Depth-first rendering traces reflection rays as it makes them, so
+ * there is nothing to sort.
  */
+bool
+Scene::get_ray_sorting()
+    const
+{
+    return ray_sorting;
+}
+
 void
-Scene::add_shape(Shape *shape)
+Scene::set_ray_sorting(bool sort)
 {
-    shapes.push_back(shape);
+    ray_sorting = sort;
+}
+
+bool
+Scene::get_ray_sort_stats()
+    const
+{
+    return ray_sort_stats;
+}
+
+void
+Scene::set_ray_sort_stats(bool report)
+{
+    ray_sort_stats = report;
 }
 
 
 /*
- * Scene::add_light --
+ * Scene::get_bvh_builder --
+ * Scene::set_bvh_builder --
  *
- * Add a light to the scene.
+ * Get and set which builder makes the BVH. Changing it rebuilds the BVH at the next render.
  */
+Scene::BVHBuilder
+Scene::get_bvh_builder()
+    const
+{
+    return bvh_builder;
+}
+
 void
-Scene::add_light(PointLight *light)
+Scene::set_bvh_builder(BVHBuilder builder)
 {
-    lights.push_back(light);
+    if (builder != bvh_builder) {
+        bvh_builder = builder;
+        is_acceleration_current = false;
+    }
 }
 
 
 /*
- * Scene::trace_ray --
+ * Scene::get_refit_limit --
+ * Scene::set_refit_limit --
  *
- * Trace the given ray through the scene, recursing until depth has been reached.
+ * Get and set how much worse a refit BVH may get, as a ratio of its SAH cost to its cost when it was built, before it's
+ * rebuilt instead. 1 rebuilds it whenever it gets any worse at all.
  */
-Color
-Scene::trace_ray(const Ray &ray,
-                 const int depth,
-                 const float weight)
+float
+Scene::get_refit_limit()
+    const
 {
-    if (depth >= max_depth || weight <= min_weight) {
-        return Color::Black;
-    }
+    return refit_limit;
+}
 
-    Color out_color = Color::Black;
-    Shape *intersected_shape = NULL;
-    float *t = NULL;
-    float nearest_t = INFINITY;
-    int nints;
+void
+Scene::set_refit_limit(float limit)
+{
+    refit_limit = limit;
+}
 
-    // Keep stats.
-    nrays++;
 
-    // Find intersections of this ray with objects in the scene.
-    for (Shape *s : shapes) {
-        nints = s->does_intersect(ray, &t);
-        if (nints > 0) {
-            for (int i = 0; i < nints; i++) {
-                if (t[i] < 1e-2) {
-                    break;
-                }
-                if (t[i] < nearest_t) {
-                    intersected_shape = s;
-                    nearest_t = t[i];
-                }
-            }
-            delete[] t;
-        }
+/*
+ * Scene::read --
+ *
+ * Load scene objects into this Scene from the given text scene file. If the file has an up to date cache, that's read
+ * instead. Return the number of statements or cached objects read, or a negative number on error.
+ */
+int
+Scene::read(const std::string &filename)
+{
+    SceneCache cache;
+    int nobjects = cache.read_scene(*this, filename);
+    if (nobjects >= 0) {
+        return nobjects;
     }
 
-    // If there was no intersection, return black.
-    if (intersected_shape == NULL) {
-        return out_color;
+    TextReader reader;
+    return reader.read_scene(*this, filename);
+}
+
+
+/*
+ * Scene::bake --
+ *
+ * Read the given text scene file into this Scene, build its acceleration structure, and write it all out to the
+ * file's cache so later reads are quick. Return 0 on success, or a negative number on error.
+ */
+int
+Scene::bake(const std::string &filename)
+{
+    TextReader reader;
+    if (reader.read_scene(*this, filename) < 0) {
+        return -1;
     }
+    build_acceleration();
 
-    Material shape_material = intersected_shape->get_material();
-    Color shape_color = shape_material.get_diffuse_color();
+    SceneCache cache;
+    return cache.write_cache(*this, filename);
+}
 
-    Vector3 intersection = ray.parameterize(nearest_t);
-    Vector3 normal = intersected_shape->compute_normal(intersection);
 
-    /*
-     * Diffuse lighting. (Shading, etc.)
-     */
+/*
+ * scene_save --
+ *
+ * Write a rendered scene to the given file.
+ */
+void
+Scene::write(Writer &writer, const std::string &filename)
+{
+    writer.write_scene(*this, filename);
+}
 
-    Vector3 light_direction;
-    float ldotn, diffuse_level, ambient_level;
-    Ray shadow_ray;
 
-    for (PointLight *l : lights) {
-        light_direction = (intersection - l->get_origin()).normalize();
-        ldotn = light_direction.dot(normal);
+/*
+ * Scene::render --
+ *
+ * Render the given Scene. In the default depth-first mode, the image is split into tiles which a pool of threads
+ * renders in parallel; this thread is one of them. In wavefront mode, the WavefrontRenderer takes over.
+ *
+ * Given a Writer, render straight into the named file, and return what the Writer does. Writers that can stream are
+ * handed each tile as it's finished, and the Scene keeps no image of its own; others are given the whole image at the
+ * end.
+ */
+void
+Scene::render()
+{
+    render_image(NULL);
+}
 
-        if (ldotn < 0) {
-            ldotn = 0.0;
-        }
+int
+Scene::render(Writer &writer,
+              const std::string &filename)
+{
+    if (!writer.can_stream()) {
+        render();
+        return writer.write_scene(*this, filename);
+    }
+    if (!writer.begin_image(filename, width, height)) {
+        return -1;
+    }
+    render_image(&writer);
+    return writer.end_image();
+}
 
-        diffuse_level = shape_material.get_diffuse_level();
-        ambient_level = 1.0 - diffuse_level;
 
-        shadow_ray = Ray(intersection, light_direction);
-        for (Shape *s : shapes) {
-            // Skip the intersected shape.
-            if (s == intersected_shape) {
-                continue;
-            }
+/*
+ * Scene::render_image --
+ *
+ * Render the image into the framebuffer, or, if stream isn't NULL, a tile or wave at a time into stream.
+ */
+void
+Scene::render_image(Writer *stream)
+{
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    start = std::chrono::system_clock::now();
 
-            // Figure out if we're in shadow.
-            if (s->does_intersect(shadow_ray, NULL) > 0) {
-                diffuse_level = 0.0;
-                break;
+    build_acceleration();
+    prepare_camera();
+
+    if (stream == NULL) {
+        framebuffer.allocate(width, height, tile_size);
+    }
+    else {
+        framebuffer.release();
+    }
+    _is_rendered = false;
+
+    unsigned int nworkers = get_nworkers();
+
+    RenderStats total;
+    if (render_mode == RenderModeWavefront) {
+        WavefrontRenderer renderer(*this, nworkers);
+        renderer.render(total, stream);
+    }
+    else {
+        // Streamed tiles are dealt out so that they finish in about the order the writer needs them.
+        TileScheduler scheduler(width, height, tile_size, nworkers, stream != NULL);
+        std::vector<RenderStats> stats(nworkers);
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < nworkers; i++) {
+            threads.push_back(std::thread(&Scene::render_tiles, this, std::ref(scheduler), i, stream,
+                                          std::ref(stats[i])));
+        }
+        render_tiles(scheduler, 0, stream, stats[0]);
+
+        for (unsigned int i = 0; i < nworkers; i++) {
+            if (i > 0) {
+                threads[i - 1].join();
             }
+            total += stats[i];
         }
+    }
+    nrays = total.nrays;
+    nshadow_rays = total.nshadow_rays;
 
-        /*
-         * Compute basic Lambert diffuse shading for this object.
-         */
-        out_color += shape_color * (  ambient_level * ambient->compute_color_contribution()
-                                    + diffuse_level * ldotn);
+    end = std::chrono::system_clock::now();
+    std::chrono::duration<float> seconds = end - start;
+
+    _is_rendered = (stream == NULL);
+    printf("Scene rendered. %lu rays (%lu shadow rays) traced in %f seconds on %u threads.\n",
+           nrays + nshadow_rays, nshadow_rays, seconds.count(), nworkers);
+}
+
+
+/*
+ * Scene::render_tiles --
+ *
+ * Body of a render thread. Render tiles until the scheduler runs out of them, straight into the framebuffer if it
+ * holds Colors in row order, or else into a buffer the size of a tile, which is stored into the framebuffer or handed
+ * to stream as each tile is finished. Statistics are kept on this thread's stack and only written to stats at the end.
+ */
+void
+Scene::render_tiles(TileScheduler &scheduler,
+                    unsigned int worker,
+                    Writer *stream,
+                    RenderStats &stats)
+{
+    RenderStats local;
+    Tile tile;
+    std::vector<Color> buffer;
+    Color *pixels = (stream == NULL) ? framebuffer.get_pixels() : NULL;
+    while (scheduler.next_tile(worker, tile)) {
+        if (pixels != NULL) {
+            render_tile(tile, pixels + tile.y * width + tile.x, width, local);
+            continue;
+        }
+        buffer.resize(tile.width * tile.height);
+        render_tile(tile, buffer.data(), tile.width, local);
+        if (stream != NULL) {
+            stream->write_tile(tile.x, tile.y, tile.width, tile.height, buffer.data());
+        }
+        else {
+            framebuffer.store(tile.x, tile.y, tile.width, tile.height, buffer.data(), tile.width);
+        }
     }
+    stats = local;
+}
+
 
-    /*
-     * Specular lighting. (Reflections, etc.)
-     */
+/*
+ * Scene::render_tile --
+ *
+ * Trace a primary ray for each pixel in the given tile, and store its color in out, whose rows are stride pixels
+ * apart. The pixels are gathered into square packets, packet_size on a side, and each packet is traced together.
+ */
+void
+Scene::render_tile(const Tile &tile,
+                   Color *out,
+                   int stride,
+                   RenderStats &stats)
+{
+    const int size = get_effective_packet_size();
+
+    RayPacket packet;
+    Color colors[RayPacket::MaxSize];
+    for (int py = tile.y; py < tile.y + tile.height; py += size) {
+        for (int px = tile.x; px < tile.x + tile.width; px += size) {
+            const int xend = std::min(px + size, tile.x + tile.width);
+            const int yend = std::min(py + size, tile.y + tile.height);
 
-    float specular_level = shape_material.get_specular_level();
-    const Color &specular_color = shape_material.get_specular_color();
+            // Assemble the packet's rays and trace them.
+            packet.clear();
+            for (int y = py; y < yend; y++) {
+                for (int x = px; x < xend; x++) {
+                    packet.add(compute_primary_ray(x, y));
+                }
+            }
+            trace_packet(packet, colors, stats);
 
-    /*
-     * Compute the reflection ray. Computing the direction of the reflection ray is done by the following formula:
-     *
-     *     d = dr - 2n(dr . n)
-     *
-     * where d is the direction, dr is the direction of the incoming ray, and n is the normal vector. Period (.)
-     * indicates the dot product.
-     *
-     * The origin of the reflection ray is the point on the surface where the incoming ray intersected with it.
-     */
-    Ray reflection_ray = Ray(intersection, ray.direction - 2.0 * normal * ray.direction.dot(normal));
-    Color reflection_color = trace_ray(reflection_ray, depth + 1, weight * specular_level);
+            unsigned int i = 0;
+            for (int y = py; y < yend; y++) {
+                for (int x = px; x < xend; x++) {
+                    out[(y - tile.y) * stride + (x - tile.x)] = colors[i++];
+                }
+            }
+        }
+    }
+}
 
-    // TODO: Mix in specular_color of material.
-    out_color += specular_level * specular_color * reflection_color;
 
-    return out_color;
+/*
+ * Scene::prepare_camera --
+ *
+ * Size the camera to the image and let it precompute what it needs to make primary rays. A Scene without a camera gets
+ * an orthographic one looking along +Z from z = -1000, one unit per pixel, with pixel (0, 0) at the origin.
+ */
+void
+Scene::prepare_camera()
+{
+    render_camera = camera;
+    if (render_camera == NULL) {
+        if (default_camera == NULL) {
+            default_camera = new OrthographicCamera();
+            default_camera->set_origin(Vector3(0, 0, -1000));
+        }
+        default_camera->set_width(Vector3(width, 0, 0));
+        default_camera->set_height(Vector3(0, height, 0));
+        render_camera = default_camera;
+    }
+    render_camera->set_pixel_width(width);
+    render_camera->set_pixel_height(height);
+    render_camera->prepare();
+}
+
+
+/*
+ * Scene::compute_primary_ray --
+ *
+ * Compute the ray from the eye through pixel (x, y). The camera must have been prepared.
+ */
+Ray
+Scene::compute_primary_ray(int x,
+                           int y)
+    const
+{
+    return render_camera->compute_primary_ray(x, y);
+}
+
+
+/*
+ * Scene::add_shape --
+ *
+ * Add a shape to the scene. The Scene watches it for changes from then on.
+ */
+void
+Scene::add_shape(Shape *shape)
+{
+    shape->set_observer(this, shapes.size());
+    shapes.push_back(shape);
+    is_acceleration_current = false;
+}
+
+
+/*
+ * Scene::add_light --
+ *
+ * Add a light to the scene.
+ */
+void
+Scene::add_light(PointLight *light)
+{
+    lights.push_back(light);
+}
+
+
+/*
+ * Scene::add_material --
+ *
+ * Add a material to the scene. Shapes don't own their materials, so the Scene keeps them alive on their behalf.
+ */
+void
+Scene::add_material(Material *material)
+{
+    materials.push_back(material);
+}
+
+
+/*
+ * Scene::add_group --
+ *
+ * Add a group of shapes for Instances to share. Instances don't own their groups, so the Scene keeps them alive on
+ * their behalf, and builds them before rendering.
+ */
+void
+Scene::add_group(InstanceGroup *group)
+{
+    groups.push_back(group);
+    is_acceleration_current = false;
+}
+
+
+/*
+ * Scene::set_cache_file --
+ *
+ * Hold on to the mapped scene cache this Scene was read from, and let go of the last one. The Scene owns the file.
+ */
+void
+Scene::set_cache_file(MappedFile *file)
+{
+    if (cache_file != NULL && cache_file != file) {
+        delete cache_file;
+    }
+    cache_file = file;
+}
+
+
+/*
+ * Scene::build_shape_arrays --
+ *
+ * Sort the scene's shapes into the rendering arrays by type. The type of each shape is looked up once here so it never
+ * has to be during a render. Also work out the ID of each shape, and the bounds of the bounded ones, and forget any
+ * changes to them, since the arrays are up to date now.
+ *
+ * Instance groups are built first, since instances' bounds depend on them.
+ */
+void
+Scene::build_shape_arrays()
+{
+    AABB b;
+
+    for (InstanceGroup *g : groups) {
+        if (!g->is_built()) {
+            g->build();
+        }
+    }
+
+    spheres.clear();
+    bounded_shapes.clear();
+    planes.clear();
+    unbounded_shapes.clear();
+
+    // Each shape's index in its own array for now, tagged with which array, until the sizes of all of them are known.
+    enum { KindSphere, KindBounded, KindPlane, KindUnbounded };
+    std::vector<unsigned char> kinds(shapes.size());
+    shape_ids.resize(shapes.size());
+    for (unsigned int i = 0; i < shapes.size(); i++) {
+        Shape *s = shapes[i];
+        if (const Sphere *sphere = dynamic_cast<const Sphere *>(s)) {
+            kinds[i] = KindSphere;
+            shape_ids[i] = spheres.size();
+            spheres.add(*sphere);
+        }
+        else if (const Plane *plane = dynamic_cast<const Plane *>(s)) {
+            kinds[i] = KindPlane;
+            shape_ids[i] = planes.size();
+            planes.add(*plane);
+        }
+        else if (s->compute_bounds(b)) {
+            kinds[i] = KindBounded;
+            shape_ids[i] = bounded_shapes.size();
+            bounded_shapes.push_back(s);
+        }
+        else {
+            kinds[i] = KindUnbounded;
+            shape_ids[i] = unbounded_shapes.size();
+            unbounded_shapes.push_back(s);
+        }
+    }
+
+    const unsigned int firsts[] = { 0, spheres.size(), spheres.size() + (unsigned int)bounded_shapes.size(),
+                                    spheres.size() + (unsigned int)bounded_shapes.size() + planes.size() };
+    for (unsigned int i = 0; i < shapes.size(); i++) {
+        shape_ids[i] += firsts[kinds[i]];
+    }
+
+    prim_bounds.clear();
+    prim_bounds.reserve(spheres.size() + bounded_shapes.size());
+    for (unsigned int i = 0; i < spheres.size(); i++) {
+        prim_bounds.push_back(spheres.compute_bounds(i));
+    }
+    for (Shape *s : bounded_shapes) {
+        s->compute_bounds(b);
+        prim_bounds.push_back(b);
+    }
+
+    changed_shapes.clear();
+    is_shape_changed.assign(shapes.size(), 0);
+}
+
+
+/*
+ * Scene::build_acceleration --
+ *
+ * Rebuild the shape arrays and the BVH over all bounded shapes in the scene, unless they're already up to date. If
+ * shapes have only changed since the last build, and none have been added, update them instead.
+ */
+void
+Scene::build_acceleration()
+{
+    if (is_acceleration_current) {
+        if (!changed_shapes.empty()) {
+            update_acceleration();
+        }
+        return;
+    }
+
+    build_shape_arrays();
+    build_bvh();
+    is_acceleration_current = true;
+
+    // The new tree doesn't need the cache anymore.
+    set_cache_file(NULL);
+}
+
+
+/*
+ * Scene::build_bvh --
+ *
+ * Build the BVH, and its wide copy, over prim_bounds with the chosen builder.
+ */
+void
+Scene::build_bvh()
+{
+    // Spheres are tested a kernel's width at a time, so leaves that size cost no more than leaves of one.
+    if (bvh_builder == BVHBuilderLinear) {
+        bvh.build_linear(prim_bounds, spheres.get_kernel().width, get_nworkers());
+    }
+    else {
+        bvh.build(prim_bounds, spheres.get_kernel().width);
+    }
+    wide_bvh.build(bvh);
+}
+
+
+/*
+ * Scene::update_acceleration --
+ *
+ * Bring the shape arrays and the BVH up to date with the shapes that have changed since they were built: copy those
+ * shapes into the arrays again, and refit the BVH around their new bounds. If refitting has made the tree too much
+ * worse, rebuild it from scratch.
+ */
+void
+Scene::update_acceleration()
+{
+    const unsigned int nbounded = prim_bounds.size();
+    const unsigned int first_plane = nbounded;
+    std::vector<unsigned int> prims;
+    for (unsigned int index : changed_shapes) {
+        unsigned int id = shape_ids[index];
+        if (id < spheres.size()) {
+            spheres.update(id);
+            prim_bounds[id] = spheres.compute_bounds(id);
+            prims.push_back(id);
+        }
+        else if (id < nbounded) {
+            shapes[index]->compute_bounds(prim_bounds[id]);
+            prims.push_back(id);
+        }
+        else if (id - first_plane < planes.size()) {
+            planes.update(id - first_plane);
+        }
+        is_shape_changed[index] = 0;
+    }
+    changed_shapes.clear();
+
+    if (prims.empty()) {
+        return;
+    }
+
+    std::vector<unsigned int> changed;
+    bvh.refit(prim_bounds, prims, changed);
+    if (bvh.get_degradation() > refit_limit) {
+        build_bvh();
+    }
+    else {
+        wide_bvh.refit(bvh, changed);
+    }
+
+    // Refitting copies the tree out of the cache.
+    set_cache_file(NULL);
+}
+
+
+/*
+ * Scene::object_changed --
+ *
+ * Note that the shape at index in shapes has changed, so it can be updated before the next render.
+ */
+void
+Scene::object_changed(unsigned int id)
+{
+    if (id < is_shape_changed.size() && !is_shape_changed[id]) {
+        is_shape_changed[id] = 1;
+        changed_shapes.push_back(id);
+    }
+}
+
+
+/*
+ * Scene::get_nworkers --
+ *
+ * Get the number of threads to work with: nthreads, or one per hardware thread if that's 0.
+ */
+unsigned int
+Scene::get_nworkers()
+    const
+{
+    unsigned int nworkers = (nthreads > 0) ? nthreads : std::thread::hardware_concurrency();
+    return (nworkers > 0) ? nworkers : 1;
+}
+
+
+/*
+ * Scene::intersect --
+ *
+ * Find the nearest intersection of the given ray with a shape in the scene, with t in [tmin, tmax]. If there is one,
+ * store it in hit and return true. Shape IDs are numbered as described in scene.h. Spheres and planes only record
+ * their t and ID while the search is on; their Shape is looked up once at the end.
+ */
+bool
+Scene::intersect(const Ray &ray,
+                 float tmin,
+                 float tmax,
+                 Intersection &hit)
+    const
+{
+    auto intersect_leaf = [&](const unsigned int *prims, unsigned int n, float tmin, float &tmax) {
+        return intersect_bounded(ray, prims, n, tmin, tmax, hit);
+    };
+    bool found = wide_bvh.intersect_leaves(ray, tmin, tmax, intersect_leaf);
+
+    if (intersect_unbounded(ray, tmin, tmax, hit)) {
+        found = true;
+    }
+    if (found) {
+        resolve_hit(hit);
+    }
+    return found;
+}
+
+
+/*
+ * Scene::intersect_packet --
+ *
+ * Find the nearest intersection of each ray in the given prepared packet, as Scene::intersect does for one ray. The
+ * rays go through the BVH together; the unbounded shapes are tested one ray at a time, as there's nothing to cull.
+ */
+void
+Scene::intersect_packet(const RayPacket &packet,
+                        float tmin,
+                        Intersection *hits,
+                        bool *found)
+    const
+{
+    float tmax[RayPacket::MaxSize];
+    for (unsigned int i = 0; i < packet.size; i++) {
+        tmax[i] = INFINITY;
+        found[i] = false;
+    }
+
+    auto intersect_leaf = [&](unsigned int r, const unsigned int *prims, unsigned int n, float tmin, float &tmax) {
+        if (intersect_bounded(packet.rays[r], prims, n, tmin, tmax, hits[r])) {
+            found[r] = true;
+            return true;
+        }
+        return false;
+    };
+    bvh.intersect_packet(packet, tmin, tmax, intersect_leaf);
+
+    for (unsigned int i = 0; i < packet.size; i++) {
+        if (intersect_unbounded(packet.rays[i], tmin, tmax[i], hits[i])) {
+            found[i] = true;
+        }
+        if (found[i]) {
+            resolve_hit(hits[i]);
+        }
+    }
+}
+
+
+/*
+ * Scene::intersect_bounded --
+ *
+ * Find the nearest intersection of the given ray with the n shapes in prims, all of which are in the BVH, in
+ * [tmin, tmax]. If there is one, shrink tmax to it, record it in hit, and return true. Runs of spheres are handed to
+ * the sphere kernel together; BVH leaves usually hold nothing else.
+ */
+bool
+Scene::intersect_bounded(const Ray &ray,
+                         const unsigned int *prims,
+                         unsigned int n,
+                         float tmin,
+                         float &tmax,
+                         Intersection &hit)
+    const
+{
+    const unsigned int nspheres = spheres.size();
+
+    bool found = false;
+    unsigned int i = 0;
+    while (i < n) {
+        unsigned int run = 0;
+        while (i + run < n && prims[i + run] < nspheres) {
+            run++;
+        }
+        if (run > 0) {
+            if (spheres.intersect(prims + i, run, ray, tmin, tmax, hit.shape_id)) {
+                hit.t = tmax;
+                found = true;
+            }
+            i += run;
+        }
+        else {
+            if (bounded_shapes[prims[i] - nspheres]->intersect(ray, tmin, tmax, hit)) {
+                hit.shape_id = prims[i];
+                tmax = hit.t;
+                found = true;
+            }
+            i++;
+        }
+    }
+    return found;
+}
+
+
+/*
+ * Scene::intersect_unbounded --
+ *
+ * Find the nearest intersection of the given ray with the shapes outside the BVH, in [tmin, tmax]. If there is one,
+ * record it in hit and return true.
+ */
+bool
+Scene::intersect_unbounded(const Ray &ray,
+                           float tmin,
+                           float tmax,
+                           Intersection &hit)
+    const
+{
+    const unsigned int nbounded = spheres.size() + bounded_shapes.size();
+
+    bool found = false;
+    unsigned int plane;
+    if (planes.intersect(ray, tmin, tmax, plane)) {
+        hit.t = tmax;
+        hit.shape_id = nbounded + plane;
+        found = true;
+    }
+
+    for (unsigned int i = 0; i < unbounded_shapes.size(); i++) {
+        if (unbounded_shapes[i]->intersect(ray, tmin, tmax, hit)) {
+            hit.shape_id = nbounded + planes.size() + i;
+            tmax = hit.t;
+            found = true;
+        }
+    }
+    return found;
+}
+
+
+/*
+ * Scene::resolve_hit --
+ *
+ * Fill in the Shape of a finished intersection found in one of the shape arrays, which only record the shape's ID.
+ */
+void
+Scene::resolve_hit(Intersection &hit)
+    const
+{
+    const unsigned int nspheres = spheres.size();
+    const unsigned int nbounded = nspheres + bounded_shapes.size();
+
+    if (hit.shape_id < nspheres) {
+        hit.shape = spheres.get_shape(hit.shape_id);
+        hit.primitive_id = 0;
+    }
+    else if (hit.shape_id >= nbounded && hit.shape_id < nbounded + planes.size()) {
+        hit.shape = planes.get_shape(hit.shape_id - nbounded);
+        hit.primitive_id = 0;
+    }
+}
+
+
+/*
+ * Scene::occluded --
+ *
+ * Determine whether anything in the scene blocks the given ray before it has gone tmax along its direction. This is
+ * an any-hit query: it stops at the first blocker it finds, which needn't be the nearest one, and never works out
+ * where along the ray the blocker is.
+ */
+bool
+Scene::occluded(const Ray &ray,
+                float tmax)
+    const
+{
+    const unsigned int nspheres = spheres.size();
+
+    auto occluded_leaf = [&](const unsigned int *prims, unsigned int n, float tmin, float tmax) {
+        unsigned int i = 0;
+        while (i < n) {
+            unsigned int run = 0;
+            while (i + run < n && prims[i + run] < nspheres) {
+                run++;
+            }
+            if (run > 0) {
+                if (spheres.occluded(prims + i, run, ray, tmin, tmax)) {
+                    return true;
+                }
+                i += run;
+            }
+            else {
+                if (bounded_shapes[prims[i] - nspheres]->occluded(ray, tmin, tmax)) {
+                    return true;
+                }
+                i++;
+            }
+        }
+        return false;
+    };
+    bool blocked = wide_bvh.occluded_leaves(ray, RayEpsilon, tmax, occluded_leaf);
+    if (blocked || planes.occluded(ray, RayEpsilon, tmax)) {
+        return true;
+    }
+
+    for (Shape *s : unbounded_shapes) {
+        if (s->occluded(ray, RayEpsilon, tmax)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/*
+ * Scene::compute_normal --
+ *
+ * Compute the surface normal at point p of the shape hit refers to. Shapes outside the arrays are asked by their shape
+ * ID rather than through hit.shape, which for instances is the piece of their group that was hit.
+ */
+Vector3
+Scene::compute_normal(const Intersection &hit,
+                      const Vector3 &p)
+    const
+{
+    const unsigned int nspheres = spheres.size();
+    const unsigned int nbounded = nspheres + bounded_shapes.size();
+
+    if (hit.shape_id < nspheres) {
+        return spheres.compute_normal(hit.shape_id, p);
+    }
+    if (hit.shape_id < nbounded) {
+        return bounded_shapes[hit.shape_id - nspheres]->compute_hit_normal(hit, p);
+    }
+    if (hit.shape_id < nbounded + planes.size()) {
+        return planes.compute_normal(hit.shape_id - nbounded, p);
+    }
+    return unbounded_shapes[hit.shape_id - nbounded - planes.size()]->compute_hit_normal(hit, p);
+}
+
+
+/*
+ * Scene::trace_ray --
+ *
+ * Trace the given ray through the scene and return the color it sees.
+ */
+Color
+Scene::trace_ray(const Ray &ray,
+                 RenderStats &stats)
+    const
+{
+    if (max_depth <= 0 || min_weight >= 1.0) {
+        return Color::Black;
+    }
+
+    Intersection hit;
+
+    // Keep stats.
+    stats.nrays++;
+
+    // Find the nearest intersection of this ray with objects in the scene. If there isn't one, return black.
+    if (!intersect(ray, RayEpsilon, INFINITY, hit)) {
+        return Color::Black;
+    }
+
+    return shade(ray, hit, stats);
+}
+
+
+/*
+ * Scene::trace_packet --
+ *
+ * Trace the primary rays in the given packet through the scene and store their colors. The rays are intersected with
+ * the scene together, but everything after the first hit, shadow and reflection rays included, goes one ray at a
+ * time: those rays head off in all directions and make poor packets. Packets whose rays don't travel the same way are
+ * traced one ray at a time from the start.
+ */
+void
+Scene::trace_packet(RayPacket &packet,
+                    Color *colors,
+                    RenderStats &stats)
+    const
+{
+    if (!packet.prepare()) {
+        for (unsigned int i = 0; i < packet.size; i++) {
+            colors[i] = trace_ray(packet.rays[i], stats);
+        }
+        return;
+    }
+
+    if (max_depth <= 0 || min_weight >= 1.0) {
+        for (unsigned int i = 0; i < packet.size; i++) {
+            colors[i] = Color::Black;
+        }
+        return;
+    }
+
+    stats.nrays += packet.size;
+
+    Intersection hits[RayPacket::MaxSize];
+    bool found[RayPacket::MaxSize];
+    intersect_packet(packet, RayEpsilon, hits, found);
+    for (unsigned int i = 0; i < packet.size; i++) {
+        colors[i] = found[i] ? shade(packet.rays[i], hits[i], stats) : Color::Black;
+    }
+}
+
+
+/*
+ * Scene::shade --
+ *
+ * Compute the color the given ray sees at its nearest intersection, hit: direct light at the hit, plus whatever the
+ * surface reflects.
+ *
+ * Reflections are followed in a loop rather than by recursion. Rays still to be traced wait on a small stack, each
+ * with its throughput: the fraction of the light it finds that makes it back to the eye, which is the product of the
+ * specular colors of every surface it bounced off on the way. Each surface a ray hits adds its direct light, scaled by
+ * the ray's throughput, and pushes the rays that leave it. Nothing here grows with depth, so max_depth can be as large
+ * as a scene needs.
+ *
+ * A ray is only traced if it's within max_depth bounces of the eye and its weight, the product of the specular levels
+ * along the way, is above min_weight.
+ */
+Color
+Scene::shade(const Ray &ray,
+             const Intersection &hit,
+             RenderStats &stats)
+    const
+{
+    struct PendingRay
+    {
+        Ray ray;
+        Color throughput;
+        float weight;
+        int depth;
+    };
+    PendingRay stack[RayStackSize];
+    int sp = 0;
+
+    Color out_color = Color::Black;
+    Ray current = ray;
+    Intersection current_hit = hit;
+    Color throughput = Color::White;
+    float weight = 1.0;
+    int depth = 0;
+
+    while (true) {
+        const Material &material = current_hit.shape->get_material();
+        Vector3 intersection = current.parameterize(current_hit.t);
+        Vector3 normal = compute_normal(current_hit, intersection);
+
+        out_color += throughput * shade_direct(material, intersection, normal, stats);
+
+        // Specular lighting. (Reflections, etc.)
+        float specular_level = material.get_specular_level();
+        if (depth + 1 < max_depth && weight * specular_level > min_weight && sp < RayStackSize) {
+            PendingRay &reflection = stack[sp++];
+            reflection.ray = compute_reflection_ray(current, intersection, normal);
+            reflection.throughput = throughput * (specular_level * material.get_specular_color());
+            reflection.weight = weight * specular_level;
+            reflection.depth = depth + 1;
+        }
+
+        // Move on to the next pending ray that hits something.
+        bool found = false;
+        while (!found && sp > 0) {
+            const PendingRay &next = stack[--sp];
+            stats.nrays++;
+            current_hit = Intersection();
+            found = intersect(next.ray, RayEpsilon, INFINITY, current_hit);
+            current = next.ray;
+            throughput = next.throughput;
+            weight = next.weight;
+            depth = next.depth;
+        }
+        if (!found) {
+            break;
+        }
+    }
+
+    return out_color;
+}
+
+
+/*
+ * Scene::shade_direct --
+ *
+ * Compute the light reaching the eye directly from each light in the scene, off the surface with the given material
+ * at point intersection, where its normal is normal. Shadow rays are traced here, unless shadowed is given. Then
+ * shadowed[i] says whether the ith light is blocked, as found by tracing the shadow ray from compute_light_ray.
+ */
+Color
+Scene::shade_direct(const Material &material,
+                    const Vector3 &intersection,
+                    const Vector3 &normal,
+                    RenderStats &stats,
+                    const bool *shadowed)
+    const
+{
+    Color out_color = Color::Black;
+    Color shape_color = material.get_diffuse_color();
+
+    Ray light_ray;
+    float light_distance, ldotn, diffuse_level, ambient_level;
+
+    unsigned int i = 0;
+    for (PointLight *l : lights) {
+        ldotn = compute_light_ray(*l, intersection, normal, light_ray, light_distance);
+
+        diffuse_level = material.get_diffuse_level();
+        ambient_level = 1.0 - diffuse_level;
+
+        /*
+         * Figure out if we're in shadow. Only things between here and the light can block it. Surfaces facing away from
+         * the light get no diffuse light anyway, so don't bother asking.
+         */
+        if (ldotn > 0) {
+            bool blocked;
+            if (shadowed != NULL) {
+                blocked = shadowed[i];
+            }
+            else {
+                stats.nshadow_rays++;
+                blocked = occluded(light_ray, light_distance);
+            }
+            if (blocked) {
+                diffuse_level = 0.0;
+            }
+        }
+
+        /*
+         * Compute basic Lambert diffuse shading for this object.
+         */
+        out_color += shape_color * (  ambient_level * ambient->compute_color_contribution()
+                                    + diffuse_level * ldotn);
+        i++;
+    }
+
+    return out_color;
+}
+
+
+/*
+ * Scene::compute_light_ray --
+ *
+ * Compute the ray from point p on a surface toward the given light, and the distance to the light. Return the cosine
+ * of the angle between the ray and the surface normal, or 0 if the light is behind the surface. Only if it's positive
+ * can anything shadow the light.
+ */
+float
+Scene::compute_light_ray(const PointLight &light,
+                         const Vector3 &p,
+                         const Vector3 &normal,
+                         Ray &ray,
+                         float &distance)
+    const
+{
+    Vector3 direction = light.get_origin() - p;
+    distance = direction.length();
+    direction /= distance;
+    ray = Ray(p, direction);
+
+    float ldotn = direction.dot(normal);
+    return (ldotn < 0) ? 0.0 : ldotn;
+}
+
+
+/*
+ * Scene::compute_reflection_ray --
+ *
+ * Compute the ray reflected off a surface at point p, where its normal is normal, by the incoming ray. Computing the
+ * direction of the reflection ray is done by the following formula:
+ *
+ *     d = dr - 2n(dr . n)
+ *
+ * where d is the direction, dr is the direction of the incoming ray, and n is the normal vector. Period (.) indicates
+ * the dot product.
+ *
+ * The origin of the reflection ray is the point on the surface where the incoming ray intersected with it.
+ */
+Ray
+Scene::compute_reflection_ray(const Ray &ray,
+                              const Vector3 &p,
+                              const Vector3 &normal)
+{
+    return Ray(p, ray.direction - 2.0 * normal * ray.direction.dot(normal));
+}
+
+#pragma mark - Render Stats
+
+/*
+ * Scene::RenderStats::RenderStats --
+ *
+ * Default constructor. Create a zeroed set of stats.
+ */
+Scene::RenderStats::RenderStats()
+    : nrays(0),
+      nshadow_rays(0)
+{ }
+
+
+/*
+ * Scene::RenderStats::operator+= --
+ *
+ * Merge the given stats into these.
+ */
+Scene::RenderStats &
+Scene::RenderStats::operator+=(const RenderStats &rhs)
+{
+    nrays += rhs.nrays;
+    nshadow_rays += rhs.nshadow_rays;
+    return *this;
 }
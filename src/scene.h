@@ -13,36 +13,149 @@
 
 #include <list>
 #include <string>
+#include <vector>
 #include "basics.h"
+#include "bvh.h"
+#include "framebuffer.h"
+#include "object.h"
+#include "shape_arrays.h"
+#include "wide_bvh.h"
 
 
 class AmbientLight;
+class Camera;
+class InstanceGroup;
+struct Intersection;
+class MappedFile;
+class Material;
 class PointLight;
+struct RayPacket;
 class Shape;
+struct Tile;
+class TileScheduler;
 class Writer;
 
 
 class Scene
+    : private ObjectObserver
 {
+    friend class SceneCache;
+    friend class WavefrontRenderer;
+
 public:
+    /*
+     * How the image is rendered. Depth-first rendering follows each pixel's path to the end before starting the next
+     * pixel. Wavefront rendering takes a big batch of pixels a bounce at a time, tracing all their rays together in
+     * stages (see wavefront.h); it's experimental, and so far the slower of the two. Both produce the same image.
+     */
+    enum RenderMode {
+        RenderModeDepthFirst = 0,
+        RenderModeWavefront,
+    };
+
+    /*
+     * How the BVH is built. The SAH builder makes the fastest trees to trace. The linear builder makes trees that trace
+     * a little slower, but it's parallel and builds them many times faster, for scenes that change every frame.
+     */
+    enum BVHBuilder {
+        BVHBuilderSAH = 0,
+        BVHBuilderLinear,
+    };
+
+    // Most threads a Scene will render with. Scene files asking for more are rejected.
+    static const unsigned int MaxThreads = 1024;
+
     Scene();
     ~Scene();
 
     bool is_rendered() const;
     int get_width() const;
+    void set_width(int w);
     int get_height() const;
+    void set_height(int h);
+    int get_max_depth() const;
+    void set_max_depth(int depth);
+    float get_min_weight() const;
+    void set_min_weight(float weight);
     AmbientLight &get_ambient() const;
+    Camera *get_camera() const;
+    void set_camera(Camera *cam);
     const Color *get_pixels() const;
-
-    void read(const std::string &filename);
+    Framebuffer &get_framebuffer();
+    const Framebuffer &get_framebuffer() const;
+    unsigned int get_nthreads() const;
+    void set_nthreads(unsigned int n);
+    int get_tile_size() const;
+    void set_tile_size(int size);
+    int get_packet_size() const;
+    void set_packet_size(int size);
+    RenderMode get_render_mode() const;
+    void set_render_mode(RenderMode mode);
+    bool get_ray_sorting() const;
+    void set_ray_sorting(bool sort);
+    bool get_ray_sort_stats() const;
+    void set_ray_sort_stats(bool report);
+    BVHBuilder get_bvh_builder() const;
+    void set_bvh_builder(BVHBuilder builder);
+    float get_refit_limit() const;
+    void set_refit_limit(float limit);
+
+    int read(const std::string &filename);
+    int bake(const std::string &filename);
     void write(Writer &writer, const std::string &filename);
     void render();
+    int render(Writer &writer, const std::string &filename);
 
     void add_shape(Shape *obj);
     void add_light(PointLight *light);
+    void add_material(Material *material);
+    void add_group(InstanceGroup *group);
 
 private:
-    Color trace_ray(const Ray &ray, const int depth = 0, const float weight = 1.0);
+    /*
+     * Per-thread rendering statistics. Each render thread counts into its own copy; they're merged when the render is
+     * done, so the inner loop never writes to memory another thread touches.
+     */
+    struct RenderStats
+    {
+        RenderStats();
+        RenderStats &operator+=(const RenderStats &rhs);
+
+        unsigned long nrays;
+        unsigned long nshadow_rays;
+    };
+
+    static const float RayEpsilon;
+
+    void set_cache_file(MappedFile *file);
+    void build_shape_arrays();
+    void build_acceleration();
+    void build_bvh();
+    void update_acceleration();
+    void object_changed(unsigned int id);
+    unsigned int get_nworkers() const;
+    void render_image(Writer *stream);
+    void render_tiles(TileScheduler &scheduler, unsigned int worker, Writer *stream, RenderStats &stats);
+    void render_tile(const Tile &tile, Color *out, int stride, RenderStats &stats);
+    int get_effective_packet_size() const;
+    void prepare_camera();
+    Ray compute_primary_ray(int x, int y) const;
+    bool intersect(const Ray &ray, float tmin, float tmax, Intersection &hit) const;
+    void intersect_packet(const RayPacket &packet, float tmin, Intersection *hits, bool *found) const;
+    bool intersect_bounded(const Ray &ray, const unsigned int *prims, unsigned int n, float tmin, float &tmax,
+                           Intersection &hit) const;
+    bool intersect_unbounded(const Ray &ray, float tmin, float tmax, Intersection &hit) const;
+    void resolve_hit(Intersection &hit) const;
+    bool occluded(const Ray &ray, float tmax) const;
+    Vector3 compute_normal(const Intersection &hit, const Vector3 &p) const;
+    Color trace_ray(const Ray &ray, RenderStats &stats) const;
+    void trace_packet(RayPacket &packet, Color *colors, RenderStats &stats) const;
+    Color shade(const Ray &ray, const Intersection &hit, RenderStats &stats) const;
+    Color shade_direct(const Material &material, const Vector3 &intersection, const Vector3 &normal,
+                       RenderStats &stats, const bool *shadowed = NULL) const;
+    float compute_light_ray(const PointLight &light, const Vector3 &p, const Vector3 &normal, Ray &ray,
+                            float &distance) const;
+    static Ray compute_reflection_ray(const Ray &ray, const Vector3 &p, const Vector3 &normal);
 
     // Pixel dimensions of the image.
     int width, height;
@@ -54,17 +167,87 @@ private:
     int max_depth;
     float min_weight;
 
-    // Scene objects.
+    /*
+     * Parallelism. Rendering is split across nthreads threads, or one per hardware thread if nthreads is 0. The image
+     * is handed out to them in square tiles tile_size pixels on a side.
+     */
+    unsigned int nthreads;
+    int tile_size;
+
+    /*
+     * Primary rays are traced in square packets packet_size pixels on a side, up to MaxPacketSize, which fills a
+     * RayPacket. 0 means pick a size automatically.
+     */
+    static const int MaxPacketSize = 8;
+    int packet_size;
+
+    RenderMode render_mode;
+
+    /*
+     * In wavefront mode, whether reflection rays are sorted before they're traced, and whether to print how much that
+     * helped.
+     */
+    bool ray_sorting;
+    bool ray_sort_stats;
+
+    // Scene objects. The Scene owns all of these and deletes them when it's destroyed.
     AmbientLight *ambient;
-    std::list<Shape *> shapes;
+    Camera *camera;
+    std::vector<Shape *> shapes;
     std::list<PointLight *> lights;
+    std::list<Material *> materials;
+    std::list<InstanceGroup *> groups;
+
+    /*
+     * The camera primary rays come from: camera if the Scene has one, otherwise default_camera, which is made to fit
+     * the image at the start of each render.
+     */
+    Camera *default_camera;
+    Camera *render_camera;
+
+    /*
+     * Rendering copies of the shapes, rebuilt from shapes at the start of a render if shapes have been added since the
+     * last build. Spheres and planes are kept in flat arrays by type and tested without going through Shape at all.
+     * Shapes of other types are kept by pointer, split by whether they have finite bounds.
+     *
+     * Shape IDs, and the BVH's primitive indices, number the spheres first, then the other bounded shapes. The BVH
+     * holds all of those. The unbounded shapes come after them, planes first, and are tested against every ray.
+     *
+     * Single rays are traced through a wide copy of the BVH; packets use the binary tree.
+     */
+    SphereArray spheres;
+    std::vector<Shape *> bounded_shapes;
+    PlaneArray planes;
+    std::vector<Shape *> unbounded_shapes;
+    BVH bvh;
+    WideBVH wide_bvh;
+    BVHBuilder bvh_builder;
+    bool is_acceleration_current;
+
+    /*
+     * For updating the above when shapes change without any being added. shape_ids maps each shape's index in shapes
+     * to its shape ID, and prim_bounds holds the bounds of each of the BVH's primitives. changed_shapes lists the
+     * indices of the shapes that have changed since the last build, and is_shape_changed marks them.
+     *
+     * Changed shapes are copied again, and the BVH is refit around them, unless the refit tree's SAH cost has grown
+     * past refit_limit times what it was when it was built; then it's rebuilt.
+     */
+    std::vector<unsigned int> shape_ids;
+    std::vector<AABB> prim_bounds;
+    std::vector<unsigned int> changed_shapes;
+    std::vector<unsigned char> is_shape_changed;
+    float refit_limit;
+
+    // The scene cache this Scene was read from, if it was. The BVH's nodes live in it.
+    MappedFile *cache_file;
 
-    // Rendering stats
-    unsigned int nrays;
+    // Rendering stats, merged from all render threads. nrays doesn't include shadow rays.
+    unsigned long nrays;
+    unsigned long nshadow_rays;
 
     // Rendering output.
     bool _is_rendered;
-    Color *pixels;
+    Framebuffer framebuffer;
 };
 
 #endif
@@ -0,0 +1,622 @@
+/* scene_cache.cc
+ *
+ * Definition of the binary scene cache. A cache file is a header followed by sections, each a flat array of
+ * fixed-size records:
+ *
+ *     Header       magic, version, layout checks, the source file's size and hash, settings, camera, section table
+ *     materials    CacheMaterial[]
+ *     spheres      CacheSphere[], in the order of the BVH's primitive indices
+ *     planes       CachePlane[]
+ *     lights       CacheLight[]
+ *     nodes        BVH::Node[]
+ *     indices      unsigned int[]
+ *
+ * Every section starts on a SectionAlignment boundary. Numbers are stored in the byte order of the machine that baked
+ * the cache and BVH nodes are stored exactly as they are in memory, so a cache is only good on machines (and builds)
+ * like the one that wrote it. The header records enough to tell, and caches from anywhere else are ignored.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "basics.h"
+#include "bvh.h"
+#include "camera.h"
+#include "light.h"
+#include "mapped_file.h"
+#include "material.h"
+#include "object_plane.h"
+#include "object_sphere.h"
+#include "scene.h"
+#include "scene_cache.h"
+#include "wide_bvh.h"
+
+
+namespace {
+
+const char CacheMagic[8] = { 'C', 'H', 'A', 'R', 'L', 'E', 'S', 'C' };
+const uint32_t CacheVersion = 2;
+const uint32_t ByteOrderMark = 0x01020304;
+const uint64_t SectionAlignment = 64;
+
+enum {
+    CameraTypeNone = 0,
+    CameraTypeOrthographic = 1,
+    CameraTypePerspective = 2,
+};
+
+enum {
+    SectionMaterials = 0,
+    SectionSpheres,
+    SectionPlanes,
+    SectionLights,
+    SectionNodes,
+    SectionIndices,
+    NumSections
+};
+
+// Materials, shapes and lights refer to materials by their index in the materials section.
+struct CacheMaterial
+{
+    float diffuse_color[3];
+    float diffuse_level;
+    float specular_color[3];
+    float specular_level;
+};
+
+struct CacheSphere
+{
+    float center[3];
+    float radius;
+    uint32_t material;
+};
+
+struct CachePlane
+{
+    float origin[3];
+    float normal[3];
+    uint32_t material;
+};
+
+struct CacheLight
+{
+    float origin[3];
+    float color[3];
+    float intensity;
+};
+
+struct CacheSection
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t node_size;
+    uint32_t index_size;
+
+    // The text file this cache was baked from.
+    uint64_t source_size;
+    uint64_t source_hash;
+
+    // Render settings.
+    int32_t width, height;
+    int32_t max_depth;
+    float min_weight;
+    uint32_t nthreads;
+    int32_t tile_size;
+
+    float ambient_color[3];
+    float ambient_intensity;
+
+    uint32_t camera_type;
+    float camera_origin[3];
+    float camera_direction[3];
+    float camera_width[3];
+    float camera_height[3];
+    float camera_angle;
+
+    CacheSection sections[NumSections];
+};
+
+
+/*
+ * hash_bytes --
+ *
+ * Hash a block of memory. This is FNV-1a taken a word at a time instead of a byte at a time, so that hashing a big
+ * scene file is cheap next to parsing it. Multiplication only carries upward, so each round folds the high bits back
+ * down before the next word goes in.
+ */
+uint64_t
+hash_bytes(const char *data,
+           size_t size)
+{
+    const uint64_t FNVOffsetBasis = 0xcbf29ce484222325ULL;
+    const uint64_t FNVPrime = 0x100000001b3ULL;
+
+    uint64_t hash = FNVOffsetBasis;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * FNVPrime;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * FNVPrime;
+    }
+    return hash;
+}
+
+
+/*
+ * hash_file --
+ *
+ * Get the size and hash of the named file. Returns false if it can't be read.
+ */
+bool
+hash_file(const std::string &filename,
+          uint64_t &size,
+          uint64_t &hash)
+{
+    MappedFile file;
+    if (!file.open(filename)) {
+        return false;
+    }
+    size = file.get_size();
+    hash = hash_bytes(file.get_data(), file.get_size());
+    return true;
+}
+
+
+void
+put_vector(float out[3],
+           const Vector3 &v)
+{
+    out[0] = v.x;
+    out[1] = v.y;
+    out[2] = v.z;
+}
+
+void
+put_color(float out[3],
+          const Color &c)
+{
+    out[0] = c.red;
+    out[1] = c.green;
+    out[2] = c.blue;
+}
+
+Vector3
+get_vector(const float in[3])
+{
+    return Vector3(in[0], in[1], in[2]);
+}
+
+Color
+get_color(const float in[3])
+{
+    return Color(in[0], in[1], in[2]);
+}
+
+
+/*
+ * align_offset --
+ *
+ * Round offset up to the next section boundary.
+ */
+uint64_t
+align_offset(uint64_t offset)
+{
+    return (offset + SectionAlignment - 1) & ~(SectionAlignment - 1);
+}
+
+
+/*
+ * get_section --
+ *
+ * Find a section of count records of the given size in a mapped cache. Returns NULL if the section doesn't fit in the
+ * file or isn't aligned. Empty sections are always fine, and come back as a pointer that mustn't be dereferenced.
+ */
+const void *
+get_section(const MappedFile &file,
+            const CacheSection &section,
+            size_t record_size)
+{
+    if (section.count == 0) {
+        return file.get_data();
+    }
+    if (section.offset % SectionAlignment != 0 || section.offset > file.get_size()) {
+        return NULL;
+    }
+    if (section.count > (file.get_size() - section.offset) / record_size) {
+        return NULL;
+    }
+    return file.get_data() + section.offset;
+}
+
+
+/*
+ * write_section --
+ *
+ * Write count records of the given size at the next section boundary, recording where they went. Returns false on a
+ * write error.
+ */
+bool
+write_section(FILE *f,
+              uint64_t &offset,
+              CacheSection &section,
+              const void *records,
+              size_t record_size,
+              size_t count)
+{
+    static const char zeros[SectionAlignment] = { 0 };
+
+    uint64_t start = align_offset(offset);
+    if (fwrite(zeros, 1, start - offset, f) != start - offset) {
+        return false;
+    }
+    if (count > 0 && fwrite(records, record_size, count, f) != count) {
+        return false;
+    }
+
+    section.offset = start;
+    section.count = count;
+    offset = start + record_size * count;
+    return true;
+}
+
+} /* anonymous namespace */
+
+
+/*
+ * SceneCache::get_cache_filename --
+ *
+ * Get the name of the cache file for the named text scene file.
+ */
+std::string
+SceneCache::get_cache_filename(const std::string &filename)
+{
+    return filename + ".cache";
+}
+
+
+/*
+ * SceneCache::read_scene --
+ *
+ * Map the cache for the named scene file and load it into scene. Everything in the cache is checked before any of it
+ * goes into the Scene, so a failed read leaves the Scene as it was. On success the Scene keeps the mapping, and its
+ * BVH points into it.
+ */
+int
+SceneCache::read_scene(Scene &scene,
+                       const std::string &filename)
+{
+    const std::string cache_filename = get_cache_filename(filename);
+
+    MappedFile *file = new MappedFile();
+    if (!file->open(cache_filename)) {
+        delete file;
+        return -1;
+    }
+
+    auto fail = [&](const char *reason) {
+        fprintf(stderr, "%s: %s; reading %s instead\n", cache_filename.c_str(), reason, filename.c_str());
+        delete file;
+        return -1;
+    };
+
+    if (file->get_size() < sizeof(CacheHeader)) {
+        return fail("not a scene cache");
+    }
+    CacheHeader header;
+    memcpy(&header, file->get_data(), sizeof(header));
+    if (memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0) {
+        return fail("not a scene cache");
+    }
+    if (header.version != CacheVersion || header.byte_order != ByteOrderMark
+            || header.node_size != sizeof(BVH::Node) || header.index_size != sizeof(unsigned int)) {
+        return fail("baked by a different build of charles");
+    }
+
+    uint64_t source_size, source_hash;
+    if (!hash_file(filename, source_size, source_hash)) {
+        return fail(strerror(errno));
+    }
+    if (source_size != header.source_size || source_hash != header.source_hash) {
+        return fail("out of date");
+    }
+
+    const CacheSection *sections = header.sections;
+    auto materials = (const CacheMaterial *)get_section(*file, sections[SectionMaterials], sizeof(CacheMaterial));
+    auto spheres = (const CacheSphere *)get_section(*file, sections[SectionSpheres], sizeof(CacheSphere));
+    auto planes = (const CachePlane *)get_section(*file, sections[SectionPlanes], sizeof(CachePlane));
+    auto lights = (const CacheLight *)get_section(*file, sections[SectionLights], sizeof(CacheLight));
+    auto nodes = (const BVH::Node *)get_section(*file, sections[SectionNodes], sizeof(BVH::Node));
+    auto indices = (const unsigned int *)get_section(*file, sections[SectionIndices], sizeof(unsigned int));
+    if (materials == NULL || spheres == NULL || planes == NULL || lights == NULL || nodes == NULL || indices == NULL) {
+        return fail("truncated");
+    }
+
+    const uint64_t nmaterials = sections[SectionMaterials].count;
+    const uint64_t nspheres = sections[SectionSpheres].count;
+    const uint64_t nplanes = sections[SectionPlanes].count;
+    const uint64_t nlights = sections[SectionLights].count;
+    const uint64_t nnodes = sections[SectionNodes].count;
+    const uint64_t nindices = sections[SectionIndices].count;
+
+    if (header.width <= 0 || header.height <= 0 || header.nthreads > Scene::MaxThreads || header.tile_size <= 0
+            || header.camera_type > CameraTypePerspective) {
+        return fail("bad settings");
+    }
+    for (uint64_t i = 0; i < nspheres; i++) {
+        if (spheres[i].material >= nmaterials || !(spheres[i].radius > 0.0)) {
+            return fail("bad sphere");
+        }
+    }
+    for (uint64_t i = 0; i < nplanes; i++) {
+        if (planes[i].material >= nmaterials) {
+            return fail("bad plane");
+        }
+    }
+    /*
+     * The BVH's primitives are the spheres, so its indices have to name every sphere exactly once. Anything else leaves
+     * spheres out of the tree, or refits the tree around stale bounds, or out of bounds.
+     */
+    if (nindices != nspheres) {
+        return fail("bad BVH");
+    }
+    std::vector<bool> seen(nspheres, false);
+    for (uint64_t i = 0; i < nindices; i++) {
+        if (indices[i] >= nspheres || seen[indices[i]]) {
+            return fail("bad BVH");
+        }
+        seen[indices[i]] = true;
+    }
+    if ((nspheres > 0) != (nnodes > 0) || nnodes > UINT32_MAX || nindices > UINT32_MAX) {
+        return fail("bad BVH");
+    }
+
+    // The BVH does its own checking. Adopt into a scratch tree first so a bad one doesn't clobber the Scene's.
+    BVH check;
+    if (!check.adopt(nodes, nnodes, indices, nindices)) {
+        return fail("bad BVH");
+    }
+
+    // The cache is good. Load it.
+    scene.set_width(header.width);
+    scene.set_height(header.height);
+    scene.set_max_depth(header.max_depth);
+    scene.set_min_weight(header.min_weight);
+    scene.set_nthreads(header.nthreads);
+    scene.set_tile_size(header.tile_size);
+    scene.get_ambient() = AmbientLight(get_color(header.ambient_color), header.ambient_intensity);
+
+    if (header.camera_type != CameraTypeNone) {
+        Camera *camera;
+        if (header.camera_type == CameraTypeOrthographic) {
+            camera = new OrthographicCamera();
+        }
+        else {
+            camera = new PerspectiveCamera();
+        }
+        camera->set_origin(get_vector(header.camera_origin));
+        camera->set_direction(get_vector(header.camera_direction));
+        camera->set_width(get_vector(header.camera_width));
+        camera->set_height(get_vector(header.camera_height));
+        camera->set_angle(header.camera_angle);
+        scene.set_camera(camera);
+    }
+
+    std::vector<Material *> material_table;
+    material_table.reserve(nmaterials);
+    for (uint64_t i = 0; i < nmaterials; i++) {
+        Material *m = new Material();
+        m->set_diffuse_color(get_color(materials[i].diffuse_color));
+        m->set_diffuse_level(materials[i].diffuse_level);
+        m->set_specular_color(get_color(materials[i].specular_color));
+        m->set_specular_level(materials[i].specular_level);
+        scene.add_material(m);
+        material_table.push_back(m);
+    }
+
+    /*
+     * Shapes are still objects, so they have to be made from their records. Spheres were written in the order the BVH
+     * refers to them, which is the order they'll have in the Scene's sphere array, so the stored tree can be used as
+     * is. That only works if these are the only shapes; otherwise the Scene builds a new tree over everything when it
+     * renders.
+     */
+    const bool use_bvh = scene.shapes.empty();
+    scene.shapes.reserve(scene.shapes.size() + nspheres + nplanes);
+    for (uint64_t i = 0; i < nspheres; i++) {
+        Sphere *s = new Sphere(get_vector(spheres[i].center), spheres[i].radius);
+        s->set_material(material_table[spheres[i].material]);
+        scene.add_shape(s);
+    }
+    for (uint64_t i = 0; i < nplanes; i++) {
+        Plane *p = new Plane(get_vector(planes[i].origin), get_vector(planes[i].normal));
+        p->set_material(material_table[planes[i].material]);
+        scene.add_shape(p);
+    }
+
+    for (uint64_t i = 0; i < nlights; i++) {
+        scene.add_light(new PointLight(get_vector(lights[i].origin), get_color(lights[i].color),
+                                       lights[i].intensity));
+    }
+
+    if (use_bvh) {
+        scene.build_shape_arrays();
+        scene.bvh.adopt(nodes, nnodes, indices, nindices);
+        scene.wide_bvh.build(scene.bvh);
+        scene.set_cache_file(file);
+        scene.is_acceleration_current = true;
+    }
+    else {
+        delete file;
+    }
+
+    return nmaterials + nspheres + nplanes + nlights;
+}
+
+
+/*
+ * SceneCache::write_cache --
+ *
+ * Bake scene into the cache file for the named scene file. The cache is written to a temporary file and renamed into
+ * place, so a reader never sees half of one.
+ */
+int
+SceneCache::write_cache(const Scene &scene,
+                        const std::string &filename)
+{
+    const std::string cache_filename = get_cache_filename(filename);
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+    header.version = CacheVersion;
+    header.byte_order = ByteOrderMark;
+    header.node_size = sizeof(BVH::Node);
+    header.index_size = sizeof(unsigned int);
+
+    if (!hash_file(filename, header.source_size, header.source_hash)) {
+        fprintf(stderr, "%s: %s\n", filename.c_str(), strerror(errno));
+        return -1;
+    }
+
+    header.width = scene.get_width();
+    header.height = scene.get_height();
+    header.max_depth = scene.get_max_depth();
+    header.min_weight = scene.get_min_weight();
+    header.nthreads = scene.get_nthreads();
+    header.tile_size = scene.get_tile_size();
+    put_color(header.ambient_color, scene.get_ambient().get_color());
+    header.ambient_intensity = scene.get_ambient().get_intensity();
+
+    Camera *camera = scene.get_camera();
+    if (camera == NULL) {
+        header.camera_type = CameraTypeNone;
+    }
+    else if (dynamic_cast<OrthographicCamera *>(camera) != NULL) {
+        header.camera_type = CameraTypeOrthographic;
+    }
+    else if (dynamic_cast<PerspectiveCamera *>(camera) != NULL) {
+        header.camera_type = CameraTypePerspective;
+    }
+    else {
+        fprintf(stderr, "%s: can't cache this kind of camera\n", filename.c_str());
+        return -1;
+    }
+    if (camera != NULL) {
+        put_vector(header.camera_origin, camera->get_origin());
+        put_vector(header.camera_direction, camera->get_direction());
+        put_vector(header.camera_width, camera->get_width());
+        put_vector(header.camera_height, camera->get_height());
+        header.camera_angle = camera->get_angle();
+    }
+
+    std::vector<CacheMaterial> materials;
+    std::vector<const Material *> material_table;
+    for (const Material *m : scene.materials) {
+        CacheMaterial record;
+        put_color(record.diffuse_color, m->get_diffuse_color());
+        record.diffuse_level = m->get_diffuse_level();
+        put_color(record.specular_color, m->get_specular_color());
+        record.specular_level = m->get_specular_level();
+        materials.push_back(record);
+        material_table.push_back(m);
+    }
+
+    auto material_index = [&](const Shape *s, uint32_t &index) {
+        for (index = 0; index < material_table.size(); index++) {
+            if (material_table[index] == &s->get_material()) {
+                return true;
+            }
+        }
+        fprintf(stderr, "%s: a shape's material isn't in the scene\n", filename.c_str());
+        return false;
+    };
+
+    if (!scene.bounded_shapes.empty() || !scene.unbounded_shapes.empty()) {
+        fprintf(stderr, "%s: can't cache this kind of shape\n", filename.c_str());
+        return -1;
+    }
+
+    // Spheres go out in the order of the Scene's sphere array, which is how the BVH refers to them.
+    std::vector<CacheSphere> spheres;
+    for (unsigned int i = 0; i < scene.spheres.size(); i++) {
+        const Shape *s = scene.spheres.get_shape(i);
+        const Sphere *sphere = static_cast<const Sphere *>(s);
+        CacheSphere record;
+        put_vector(record.center, sphere->get_origin());
+        record.radius = sphere->get_radius();
+        if (!material_index(s, record.material)) {
+            return -1;
+        }
+        spheres.push_back(record);
+    }
+
+    std::vector<CachePlane> planes;
+    for (unsigned int i = 0; i < scene.planes.size(); i++) {
+        const Shape *s = scene.planes.get_shape(i);
+        const Plane *plane = static_cast<const Plane *>(s);
+        CachePlane record;
+        put_vector(record.origin, plane->get_origin());
+        put_vector(record.normal, plane->get_normal());
+        if (!material_index(s, record.material)) {
+            return -1;
+        }
+        planes.push_back(record);
+    }
+
+    std::vector<CacheLight> lights;
+    for (const PointLight *l : scene.lights) {
+        CacheLight record;
+        put_vector(record.origin, l->get_origin());
+        put_color(record.color, l->get_color());
+        record.intensity = l->get_intensity();
+        lights.push_back(record);
+    }
+
+    const std::string temp_filename = cache_filename + ".tmp";
+    FILE *f = fopen(temp_filename.c_str(), "wb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: %s\n", temp_filename.c_str(), strerror(errno));
+        return -1;
+    }
+
+    // Write a placeholder header, then the sections, then go back and fill in the header with where they went.
+    uint64_t offset = sizeof(header);
+    CacheSection *sections = header.sections;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+        && write_section(f, offset, sections[SectionMaterials], materials.data(), sizeof(CacheMaterial),
+                         materials.size())
+        && write_section(f, offset, sections[SectionSpheres], spheres.data(), sizeof(CacheSphere), spheres.size())
+        && write_section(f, offset, sections[SectionPlanes], planes.data(), sizeof(CachePlane), planes.size())
+        && write_section(f, offset, sections[SectionLights], lights.data(), sizeof(CacheLight), lights.size())
+        && write_section(f, offset, sections[SectionNodes], scene.bvh.get_nodes(), sizeof(BVH::Node),
+                         scene.bvh.get_nnodes())
+        && write_section(f, offset, sections[SectionIndices], scene.bvh.get_indices(), sizeof(unsigned int),
+                         scene.bvh.get_nindices())
+        && fseek(f, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(temp_filename.c_str(), cache_filename.c_str()) != 0) {
+        fprintf(stderr, "%s: %s\n", cache_filename.c_str(), strerror(errno));
+        unlink(temp_filename.c_str());
+        return -1;
+    }
+    return 0;
+}
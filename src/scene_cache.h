@@ -0,0 +1,42 @@
+/* scene_cache.h
+ *
+ * Declaration of the binary scene cache. A cache is a baked copy of a text scene file: the settings, the material
+ * table, and the shape and light parameters stored as flat arrays, plus the BVH built over the shapes. It's mapped into
+ * memory rather than parsed, and the BVH is used in place, so loading a large scene costs little more than reading it
+ * off the disk.
+ *
+ * The cache for scene.scene lives next to it in scene.scene.cache. It records a hash of the text file it was baked
+ * from, and is ignored if the text file has changed since.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __SCENE_CACHE_H__
+#define __SCENE_CACHE_H__
+
+#include <string>
+
+#include "reader.h"
+
+
+class SceneCache
+    : public Reader
+{
+public:
+    static std::string get_cache_filename(const std::string &filename);
+
+    /*
+     * Read the cache for the named text scene file into the given Scene. Returns the number of objects read, or a
+     * negative number if there's no cache, it's out of date, or it's damaged. In that case the Scene is untouched and
+     * the text file should be read instead.
+     */
+    int read_scene(Scene &scene, const std::string &filename);
+
+    /*
+     * Write a cache for the named text scene file from the given Scene, which must have been read from that file and
+     * had its acceleration structure built. Returns 0 on success, or a negative number on error.
+     */
+    int write_cache(const Scene &scene, const std::string &filename);
+};
+
+#endif
@@ -0,0 +1,126 @@
+/* scheduler.cc
+ *
+ * Definition of the tile scheduler.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+
+#include "scheduler.h"
+
+
+/*
+ * TileScheduler::TileScheduler --
+ *
+ * Constructor. Cut a width x height image into tiles of at most tile_size x tile_size pixels and deal them out to
+ * nworkers queues. Tiles are generated in scanline order and each worker gets a contiguous run of them, so the tiles a
+ * worker renders on its own are near each other in the image. Interleaved, they're dealt out one at a time instead,
+ * so the workers move down the image together, and tiles finish in close to scanline order.
+ */
+TileScheduler::TileScheduler(int width,
+                             int height,
+                             int tile_size,
+                             unsigned int nworkers,
+                             bool interleaved)
+    : ntiles(0),
+      queues(std::max(nworkers, 1u))
+{
+    tile_size = std::max(tile_size, 1);
+
+    std::vector<Tile> tiles;
+    for (int y = 0; y < height; y += tile_size) {
+        for (int x = 0; x < width; x += tile_size) {
+            Tile t;
+            t.x = x;
+            t.y = y;
+            t.width = std::min(tile_size, width - x);
+            t.height = std::min(tile_size, height - y);
+            tiles.push_back(t);
+        }
+    }
+
+    ntiles = tiles.size();
+    for (unsigned int i = 0; i < ntiles; i++) {
+        const unsigned int queue = interleaved ? i % queues.size() : (unsigned long)i * queues.size() / ntiles;
+        queues[queue].tiles.push_back(tiles[i]);
+    }
+}
+
+
+/*
+ * TileScheduler::get_nworkers --
+ * TileScheduler::get_ntiles --
+ *
+ * Get the number of worker queues and the total number of tiles.
+ */
+unsigned int
+TileScheduler::get_nworkers()
+    const
+{
+    return queues.size();
+}
+
+unsigned int
+TileScheduler::get_ntiles()
+    const
+{
+    return ntiles;
+}
+
+
+/*
+ * TileScheduler::next_tile --
+ *
+ * Get the next tile for the given worker to render. Workers take from the front of their own queue first. If it's
+ * empty, they go around the other queues in order and steal from the back, which is the work farthest from what that
+ * queue's owner is doing now. Returns false when every queue is empty and the image is done.
+ */
+bool
+TileScheduler::next_tile(unsigned int worker,
+                         Tile &tile)
+{
+    unsigned int n = queues.size();
+    if (pop_front(queues[worker % n], tile)) {
+        return true;
+    }
+    for (unsigned int i = 1; i < n; i++) {
+        if (pop_back(queues[(worker + i) % n], tile)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*
+ * TileScheduler::pop_front --
+ * TileScheduler::pop_back --
+ *
+ * Take a tile off one end of the given queue. Returns false if the queue is empty.
+ */
+bool
+TileScheduler::pop_front(Queue &queue,
+                         Tile &tile)
+{
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tiles.empty()) {
+        return false;
+    }
+    tile = queue.tiles.front();
+    queue.tiles.pop_front();
+    return true;
+}
+
+bool
+TileScheduler::pop_back(Queue &queue,
+                        Tile &tile)
+{
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tiles.empty()) {
+        return false;
+    }
+    tile = queue.tiles.back();
+    queue.tiles.pop_back();
+    return true;
+}
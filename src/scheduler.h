@@ -0,0 +1,49 @@
+/* scheduler.h
+ *
+ * Declaration of the tile scheduler. The image is cut into rectangular tiles which are handed out to render threads.
+ * Each thread starts with a contiguous run of tiles in its own queue. When it runs out it steals from the back of
+ * another thread's queue, so threads that land on cheap tiles pick up the slack of threads stuck on expensive ones.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+
+struct Tile
+{
+    int x, y;
+    int width, height;
+};
+
+
+class TileScheduler
+{
+public:
+    TileScheduler(int width, int height, int tile_size, unsigned int nworkers, bool interleaved = false);
+
+    unsigned int get_nworkers() const;
+    unsigned int get_ntiles() const;
+
+    bool next_tile(unsigned int worker, Tile &tile);
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Tile> tiles;
+    };
+
+    bool pop_front(Queue &queue, Tile &tile);
+    bool pop_back(Queue &queue, Tile &tile);
+
+    unsigned int ntiles;
+    std::vector<Queue> queues;
+};
+
+#endif
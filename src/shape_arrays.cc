@@ -0,0 +1,268 @@
+/* shape_arrays.cc
+ *
+ * Definition of flat, per-type shape storage. The intersection kernels are in the header.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include "object_plane.h"
+#include "object_sphere.h"
+#include "shape_arrays.h"
+
+#pragma mark - Spheres
+
+/*
+ * SphereArray::SphereArray --
+ *
+ * Default constructor. Create an empty array that tests batches of spheres with the best kernel for this CPU.
+ */
+SphereArray::SphereArray()
+    : kernel(&get_best_sphere_kernel())
+{ }
+
+
+/*
+ * SphereArray::clear --
+ * SphereArray::reserve --
+ *
+ * Empty the array, or make room in it for n spheres.
+ */
+void
+SphereArray::clear()
+{
+    cx.clear();
+    cy.clear();
+    cz.clear();
+    radius.clear();
+    shapes.clear();
+}
+
+void
+SphereArray::reserve(unsigned int n)
+{
+    cx.reserve(n);
+    cy.reserve(n);
+    cz.reserve(n);
+    radius.reserve(n);
+    shapes.reserve(n);
+}
+
+
+/*
+ * SphereArray::add --
+ *
+ * Copy a sphere into the end of the array.
+ */
+void
+SphereArray::add(const Sphere &sphere)
+{
+    Vector3 center = sphere.get_origin();
+    cx.push_back(center.x);
+    cy.push_back(center.y);
+    cz.push_back(center.z);
+    radius.push_back(sphere.get_radius());
+    shapes.push_back(&sphere);
+}
+
+
+/*
+ * SphereArray::update --
+ *
+ * Copy sphere i from its Sphere again, after the Sphere has changed.
+ */
+void
+SphereArray::update(unsigned int i)
+{
+    const Sphere &sphere = *static_cast<const Sphere *>(shapes[i]);
+    Vector3 center = sphere.get_origin();
+    cx[i] = center.x;
+    cy[i] = center.y;
+    cz[i] = center.z;
+    radius[i] = sphere.get_radius();
+}
+
+
+/*
+ * SphereArray::size --
+ * SphereArray::get_shape --
+ *
+ * Get the number of spheres, and the Sphere object sphere i came from.
+ */
+unsigned int
+SphereArray::size()
+    const
+{
+    return radius.size();
+}
+
+const Shape *
+SphereArray::get_shape(unsigned int i)
+    const
+{
+    return shapes[i];
+}
+
+
+/*
+ * SphereArray::get_kernel --
+ * SphereArray::set_kernel --
+ *
+ * Get and set the kernel used to test batches of spheres.
+ */
+const SphereKernel &
+SphereArray::get_kernel()
+    const
+{
+    return *kernel;
+}
+
+void
+SphereArray::set_kernel(const SphereKernel &k)
+{
+    kernel = &k;
+}
+
+
+/*
+ * SphereArray::compute_bounds --
+ *
+ * Compute the box enclosing sphere i. See Sphere::compute_bounds.
+ */
+AABB
+SphereArray::compute_bounds(unsigned int i)
+    const
+{
+    Vector3 center(cx[i], cy[i], cz[i]);
+    Vector3 r(radius[i], radius[i], radius[i]);
+    return AABB(center - r, center + r);
+}
+
+
+/*
+ * SphereArray::compute_normal --
+ *
+ * Compute the normal of sphere i at point p, which should be on its surface. See Sphere::compute_normal.
+ */
+Vector3
+SphereArray::compute_normal(unsigned int i,
+                            const Vector3 &p)
+    const
+{
+    Vector3 normal = p - Vector3(cx[i], cy[i], cz[i]);
+    normal.normalize();
+    return normal;
+}
+
+#pragma mark - Planes
+
+/*
+ * PlaneArray::clear --
+ * PlaneArray::reserve --
+ *
+ * Empty the array, or make room in it for n planes.
+ */
+void
+PlaneArray::clear()
+{
+    px.clear();
+    py.clear();
+    pz.clear();
+    nx.clear();
+    ny.clear();
+    nz.clear();
+    shapes.clear();
+}
+
+void
+PlaneArray::reserve(unsigned int n)
+{
+    px.reserve(n);
+    py.reserve(n);
+    pz.reserve(n);
+    nx.reserve(n);
+    ny.reserve(n);
+    nz.reserve(n);
+    shapes.reserve(n);
+}
+
+
+/*
+ * PlaneArray::add --
+ *
+ * Copy a plane into the end of the array.
+ */
+void
+PlaneArray::add(const Plane &plane)
+{
+    Vector3 origin = plane.get_origin();
+    const Vector3 &normal = plane.get_normal();
+    px.push_back(origin.x);
+    py.push_back(origin.y);
+    pz.push_back(origin.z);
+    nx.push_back(normal.x);
+    ny.push_back(normal.y);
+    nz.push_back(normal.z);
+    shapes.push_back(&plane);
+}
+
+
+/*
+ * PlaneArray::update --
+ *
+ * Copy plane i from its Plane again, after the Plane has changed.
+ */
+void
+PlaneArray::update(unsigned int i)
+{
+    const Plane &plane = *static_cast<const Plane *>(shapes[i]);
+    Vector3 origin = plane.get_origin();
+    const Vector3 &normal = plane.get_normal();
+    px[i] = origin.x;
+    py[i] = origin.y;
+    pz[i] = origin.z;
+    nx[i] = normal.x;
+    ny[i] = normal.y;
+    nz[i] = normal.z;
+}
+
+
+/*
+ * PlaneArray::size --
+ * PlaneArray::get_shape --
+ *
+ * Get the number of planes, and the Plane object plane i came from.
+ */
+unsigned int
+PlaneArray::size()
+    const
+{
+    return nx.size();
+}
+
+const Shape *
+PlaneArray::get_shape(unsigned int i)
+    const
+{
+    return shapes[i];
+}
+
+
+
+/*
+ * PlaneArray::compute_normal --
+ *
+ * Compute the normal of plane i at point p. Like Plane::compute_normal, this is zero unless p is exactly on the plane.
+ */
+Vector3
+PlaneArray::compute_normal(unsigned int i,
+                           const Vector3 &p)
+    const
+{
+    float x = nx[i] * (p.x - px[i]);
+    float y = ny[i] * (p.y - py[i]);
+    float z = nz[i] * (p.z - pz[i]);
+    if ((x + y + z) != 0.0) {
+        return Vector3::Zero;
+    }
+    return Vector3(nx[i], ny[i], nz[i]);
+}
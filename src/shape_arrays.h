@@ -0,0 +1,222 @@
+/* shape_arrays.h
+ *
+ * Declaration of flat, per-type shape storage. Shapes are built as Shape objects, but rendering doesn't go through
+ * them: the Scene copies the parameters of every shape of a given type into one of these arrays, and the intersection
+ * kernels here run over them directly. Each parameter is its own contiguous array (structure of arrays), so a loop over
+ * many shapes touches only the memory it needs, never makes a virtual call, and is easy for the compiler to vectorize.
+ *
+ * The kernels do the same arithmetic as the corresponding Shape methods, so a shape gives the same answers whichever
+ * way it's tested. Spheres can also be tested several at a time with the SIMD kernels in sphere_kernels.h.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __SHAPE_ARRAYS_H__
+#define __SHAPE_ARRAYS_H__
+
+#include <cmath>
+#include <vector>
+
+#include "basics.h"
+#include "sphere_kernels.h"
+
+
+class Plane;
+class Shape;
+class Sphere;
+
+
+class SphereArray
+{
+public:
+    SphereArray();
+
+    void clear();
+    void reserve(unsigned int n);
+    void add(const Sphere &sphere);
+    void update(unsigned int i);
+
+    unsigned int size() const;
+    const Shape *get_shape(unsigned int i) const;
+    AABB compute_bounds(unsigned int i) const;
+    Vector3 compute_normal(unsigned int i, const Vector3 &p) const;
+
+    const SphereKernel &get_kernel() const;
+    void set_kernel(const SphereKernel &k);
+
+    inline bool intersect(unsigned int i, const Ray &ray, float tmin, float tmax, float &t) const;
+    inline bool occluded(unsigned int i, const Ray &ray, float tmin, float tmax) const;
+    inline bool intersect(const unsigned int *prims, unsigned int n, const Ray &ray, float tmin, float &tmax,
+                          unsigned int &index) const;
+    inline bool occluded(const unsigned int *prims, unsigned int n, const Ray &ray, float tmin, float tmax) const;
+
+private:
+    inline SphereData get_data() const;
+
+    // The kernel for testing batches of spheres. By default, the best one the CPU can run.
+    const SphereKernel *kernel;
+
+    std::vector<float> cx, cy, cz;
+    std::vector<float> radius;
+
+    // The shapes these came from. Only needed once a hit has been found, for its material.
+    std::vector<const Shape *> shapes;
+};
+
+
+class PlaneArray
+{
+public:
+    void clear();
+    void reserve(unsigned int n);
+    void add(const Plane &plane);
+    void update(unsigned int i);
+
+    unsigned int size() const;
+    const Shape *get_shape(unsigned int i) const;
+    Vector3 compute_normal(unsigned int i, const Vector3 &p) const;
+
+    inline bool intersect(const Ray &ray, float tmin, float &tmax, unsigned int &index) const;
+    inline bool occluded(const Ray &ray, float tmin, float tmax) const;
+
+private:
+    // A point on each plane, and its unit normal.
+    std::vector<float> px, py, pz;
+    std::vector<float> nx, ny, nz;
+
+    std::vector<const Shape *> shapes;
+};
+
+#pragma mark - Sphere Kernels
+
+/*
+ * SphereArray::intersect --
+ * SphereArray::occluded --
+ *
+ * Test a ray against sphere i. See intersect_sphere and occluded_sphere.
+ */
+inline bool
+SphereArray::intersect(unsigned int i,
+                       const Ray &ray,
+                       float tmin,
+                       float tmax,
+                       float &t)
+    const
+{
+    return intersect_sphere(get_data(), i, ray, tmin, tmax, t);
+}
+
+inline bool
+SphereArray::occluded(unsigned int i,
+                      const Ray &ray,
+                      float tmin,
+                      float tmax)
+    const
+{
+    return occluded_sphere(get_data(), i, ray, tmin, tmax);
+}
+
+
+/*
+ * SphereArray::intersect --
+ * SphereArray::occluded --
+ *
+ * Test a ray against the n spheres whose indexes are in prims, with the batched kernel. See SphereKernel.
+ */
+inline bool
+SphereArray::intersect(const unsigned int *prims,
+                       unsigned int n,
+                       const Ray &ray,
+                       float tmin,
+                       float &tmax,
+                       unsigned int &index)
+    const
+{
+    return kernel->intersect(get_data(), prims, n, ray, tmin, tmax, index);
+}
+
+inline bool
+SphereArray::occluded(const unsigned int *prims,
+                      unsigned int n,
+                      const Ray &ray,
+                      float tmin,
+                      float tmax)
+    const
+{
+    return kernel->occluded(get_data(), prims, n, ray, tmin, tmax);
+}
+
+
+/*
+ * SphereArray::get_data --
+ *
+ * Get pointers to the arrays, for the kernels.
+ */
+inline SphereData
+SphereArray::get_data()
+    const
+{
+    SphereData data = { cx.data(), cy.data(), cz.data(), radius.data() };
+    return data;
+}
+
+#pragma mark - Plane Kernels
+
+/*
+ * PlaneArray::intersect --
+ *
+ * Find the nearest intersection of ray with any of the planes in [tmin, tmax]. If there is one, shrink tmax to it,
+ * store which plane it was in index, and return true. See Plane::intersect.
+ */
+inline bool
+PlaneArray::intersect(const Ray &ray,
+                      float tmin,
+                      float &tmax,
+                      unsigned int &index)
+    const
+{
+    const float ox = ray.origin.x, oy = ray.origin.y, oz = ray.origin.z;
+    const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+
+    bool found = false;
+    const unsigned int n = nx.size();
+    for (unsigned int i = 0; i < n; i++) {
+        float denom = dx*nx[i] + dy*ny[i] + dz*nz[i];
+        float t = ((px[i] - ox)*nx[i] + (py[i] - oy)*ny[i] + (pz[i] - oz)*nz[i]) / denom;
+        // Rays parallel to a plane miss it.
+        if (denom != 0.0 && t >= tmin && t <= tmax) {
+            tmax = t;
+            index = i;
+            found = true;
+        }
+    }
+    return found;
+}
+
+
+/*
+ * PlaneArray::occluded --
+ *
+ * Determine whether ray hits any of the planes anywhere in [tmin, tmax].
+ */
+inline bool
+PlaneArray::occluded(const Ray &ray,
+                     float tmin,
+                     float tmax)
+    const
+{
+    const float ox = ray.origin.x, oy = ray.origin.y, oz = ray.origin.z;
+    const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+
+    const unsigned int n = nx.size();
+    for (unsigned int i = 0; i < n; i++) {
+        float denom = dx*nx[i] + dy*ny[i] + dz*nz[i];
+        float t = ((px[i] - ox)*nx[i] + (py[i] - oy)*ny[i] + (pz[i] - oz)*nz[i]) / denom;
+        if (denom != 0.0 && t >= tmin && t <= tmax) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
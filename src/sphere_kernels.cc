@@ -0,0 +1,552 @@
+/* sphere_kernels.cc
+ *
+ * Definition of the batched sphere intersection kernels. Each SIMD kernel follows the scalar code in sphere_kernels.h
+ * step for step, with one sphere per lane. Branches become lane masks: a lane that would have returned false early
+ * just has its hit bit cleared. Batches that don't fill the last vector are padded, and the padding lanes are masked
+ * off the same way.
+ *
+ * The SIMD kernels are compiled for their instruction sets with function attributes rather than compiler flags, so
+ * the rest of the program doesn't need those instructions and can run on CPUs without them.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+#include <vector>
+
+#include "basics.h"
+#include "sphere_kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPHERE_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * AVX-512 implies FMA, and both GCC and clang will happily fuse a separate multiply and add into one instruction, which
+ * rounds once instead of twice and gives slightly different answers than the other kernels. Keep them separate. GCC
+ * takes that as a function attribute, NO_FP_CONTRACT; clang takes it as a pragma at the top of the function body,
+ * BEGIN_NO_FP_CONTRACT.
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#define NO_FP_CONTRACT optimize("fp-contract=off")
+#else
+#define NO_FP_CONTRACT
+#endif
+
+#if defined(__clang__)
+#define BEGIN_NO_FP_CONTRACT _Pragma("clang fp contract(off)")
+#else
+#define BEGIN_NO_FP_CONTRACT
+#endif
+
+
+namespace {
+
+#pragma mark - Scalar
+
+bool
+intersect_scalar(const SphereData &spheres,
+                 const unsigned int *prims,
+                 unsigned int n,
+                 const Ray &ray,
+                 float tmin,
+                 float &tmax,
+                 unsigned int &index)
+{
+    bool found = false;
+    float t;
+    for (unsigned int i = 0; i < n; i++) {
+        if (intersect_sphere(spheres, prims[i], ray, tmin, tmax, t)) {
+            tmax = t;
+            index = prims[i];
+            found = true;
+        }
+    }
+    return found;
+}
+
+
+bool
+occluded_scalar(const SphereData &spheres,
+                const unsigned int *prims,
+                unsigned int n,
+                const Ray &ray,
+                float tmin,
+                float tmax)
+{
+    for (unsigned int i = 0; i < n; i++) {
+        if (occluded_sphere(spheres, prims[i], ray, tmin, tmax)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+#if SPHERE_KERNELS_X86
+
+/*
+ * nearest_lane --
+ *
+ * Given a bit mask of lanes with hits and their roots, pick the lane with the nearest root. Ties go to the highest
+ * lane, the one a scalar loop would have found last.
+ */
+inline unsigned int
+nearest_lane(unsigned int hits,
+             const float *roots)
+{
+    unsigned int lane = __builtin_ctz(hits);
+    float nearest = INFINITY;
+    for (unsigned int i = 0; hits != 0; i++, hits >>= 1) {
+        if ((hits & 1) && roots[i] <= nearest) {
+            nearest = roots[i];
+            lane = i;
+        }
+    }
+    return lane;
+}
+
+#pragma mark - SSE4.1
+
+__attribute__((target("sse4.1")))
+bool
+intersect_sse(const SphereData &spheres,
+              const unsigned int *prims,
+              unsigned int n,
+              const Ray &ray,
+              float tmin,
+              float &tmax,
+              unsigned int &index)
+{
+    const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+    const float a = dx*dx + dy*dy + dz*dz;
+
+    const __m128 vdx = _mm_set1_ps(dx), vdy = _mm_set1_ps(dy), vdz = _mm_set1_ps(dz);
+    const __m128 vox = _mm_set1_ps(ray.origin.x), voy = _mm_set1_ps(ray.origin.y), voz = _mm_set1_ps(ray.origin.z);
+    const __m128 four_a = _mm_set1_ps(4.0f * a), two_a = _mm_set1_ps(2.0f * a);
+    const __m128 two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps(), sign = _mm_set1_ps(-0.0f);
+    const __m128 vtmin = _mm_set1_ps(tmin);
+
+    bool found = false;
+    alignas(16) float cx[4], cy[4], cz[4], r[4], roots[4];
+    for (unsigned int base = 0; base < n; base += 4) {
+        const unsigned int count = (n - base < 4) ? n - base : 4;
+        for (unsigned int l = 0; l < 4; l++) {
+            unsigned int p = prims[base + ((l < count) ? l : count - 1)];
+            cx[l] = spheres.cx[p];
+            cy[l] = spheres.cy[p];
+            cz[l] = spheres.cz[p];
+            r[l] = spheres.radius[p];
+        }
+
+        __m128 ox = _mm_sub_ps(vox, _mm_load_ps(cx));
+        __m128 oy = _mm_sub_ps(voy, _mm_load_ps(cy));
+        __m128 oz = _mm_sub_ps(voz, _mm_load_ps(cz));
+        __m128 vr = _mm_load_ps(r);
+
+        __m128 b = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vdx, ox), _mm_mul_ps(vdy, oy)), _mm_mul_ps(vdz, oz)),
+                              two);
+        __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)),
+                              _mm_mul_ps(vr, vr));
+        __m128 discrim = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(four_a, c));
+
+        __m128 sqrt_discrim = _mm_sqrt_ps(discrim);
+        __m128 neg_b = _mm_xor_ps(b, sign);
+        __m128 t0 = _mm_div_ps(_mm_sub_ps(neg_b, sqrt_discrim), two_a);
+        __m128 t1 = _mm_div_ps(_mm_add_ps(neg_b, sqrt_discrim), two_a);
+        __m128 swap = _mm_cmplt_ps(t1, t0);
+        __m128 near = _mm_blendv_ps(t0, t1, swap);
+        __m128 far = _mm_blendv_ps(t1, t0, swap);
+        __m128 root = _mm_blendv_ps(far, near, _mm_cmpge_ps(near, vtmin));
+
+        __m128 hit = _mm_and_ps(_mm_cmpnlt_ps(discrim, zero),
+                                _mm_and_ps(_mm_cmpnlt_ps(root, vtmin), _mm_cmpngt_ps(root, _mm_set1_ps(tmax))));
+        unsigned int hits = _mm_movemask_ps(hit) & ((1u << count) - 1);
+        if (hits == 0) {
+            continue;
+        }
+
+        _mm_store_ps(roots, root);
+        unsigned int lane = nearest_lane(hits, roots);
+        tmax = roots[lane];
+        index = prims[base + lane];
+        found = true;
+    }
+    return found;
+}
+
+
+__attribute__((target("sse4.1")))
+bool
+occluded_sse(const SphereData &spheres,
+             const unsigned int *prims,
+             unsigned int n,
+             const Ray &ray,
+             float tmin,
+             float tmax)
+{
+    const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+    const float a = dx*dx + dy*dy + dz*dz;
+
+    const __m128 vdx = _mm_set1_ps(dx), vdy = _mm_set1_ps(dy), vdz = _mm_set1_ps(dz);
+    const __m128 vox = _mm_set1_ps(ray.origin.x), voy = _mm_set1_ps(ray.origin.y), voz = _mm_set1_ps(ray.origin.z);
+    const __m128 va = _mm_set1_ps(a), four_a = _mm_set1_ps(4.0f * a), two_a = _mm_set1_ps(2.0f * a);
+    const __m128 two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps(), sign = _mm_set1_ps(-0.0f);
+    const __m128 vtmin = _mm_set1_ps(tmin), vtmax = _mm_set1_ps(tmax);
+
+    alignas(16) float cx[4], cy[4], cz[4], r[4];
+    for (unsigned int base = 0; base < n; base += 4) {
+        const unsigned int count = (n - base < 4) ? n - base : 4;
+        for (unsigned int l = 0; l < 4; l++) {
+            unsigned int p = prims[base + ((l < count) ? l : count - 1)];
+            cx[l] = spheres.cx[p];
+            cy[l] = spheres.cy[p];
+            cz[l] = spheres.cz[p];
+            r[l] = spheres.radius[p];
+        }
+
+        __m128 ox = _mm_sub_ps(vox, _mm_load_ps(cx));
+        __m128 oy = _mm_sub_ps(voy, _mm_load_ps(cy));
+        __m128 oz = _mm_sub_ps(voz, _mm_load_ps(cz));
+        __m128 vr = _mm_load_ps(r);
+
+        __m128 b = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vdx, ox), _mm_mul_ps(vdy, oy)), _mm_mul_ps(vdz, oz)),
+                              two);
+        __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)),
+                              _mm_mul_ps(vr, vr));
+
+        __m128 f_tmin = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(va, vtmin), b), vtmin), c);
+        __m128 f_tmax = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(va, vtmax), b), vtmax), c);
+        __m128 crosses = _mm_xor_ps(_mm_cmple_ps(f_tmin, zero), _mm_cmple_ps(f_tmax, zero));
+
+        __m128 t_vertex = _mm_div_ps(_mm_xor_ps(b, sign), two_a);
+        __m128 discrim = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(four_a, c));
+        __m128 dips = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(t_vertex, vtmin), _mm_cmplt_ps(t_vertex, vtmax)),
+                                 _mm_cmpge_ps(discrim, zero));
+        dips = _mm_andnot_ps(_mm_cmplt_ps(f_tmin, zero), dips);
+
+        if (_mm_movemask_ps(_mm_or_ps(crosses, dips)) & ((1u << count) - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#pragma mark - AVX2
+
+__attribute__((target("avx2")))
+bool
+intersect_avx2(const SphereData &spheres,
+               const unsigned int *prims,
+               unsigned int n,
+               const Ray &ray,
+               float tmin,
+               float &tmax,
+               unsigned int &index)
+{
+    const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+    const float a = dx*dx + dy*dy + dz*dz;
+
+    const __m256 vdx = _mm256_set1_ps(dx), vdy = _mm256_set1_ps(dy), vdz = _mm256_set1_ps(dz);
+    const __m256 vox = _mm256_set1_ps(ray.origin.x);
+    const __m256 voy = _mm256_set1_ps(ray.origin.y);
+    const __m256 voz = _mm256_set1_ps(ray.origin.z);
+    const __m256 four_a = _mm256_set1_ps(4.0f * a), two_a = _mm256_set1_ps(2.0f * a);
+    const __m256 two = _mm256_set1_ps(2.0f), zero = _mm256_setzero_ps(), sign = _mm256_set1_ps(-0.0f);
+    const __m256 vtmin = _mm256_set1_ps(tmin);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    bool found = false;
+    alignas(32) float roots[8];
+    for (unsigned int base = 0; base < n; base += 8) {
+        const unsigned int count = (n - base < 8) ? n - base : 8;
+
+        // Padding lanes gather sphere prims[base], which is always there.
+        __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(count), lanes);
+        __m256i p = _mm256_maskload_epi32((const int *)prims + base, valid);
+        p = _mm256_blendv_epi8(_mm256_set1_epi32(prims[base]), p, valid);
+
+        __m256 ox = _mm256_sub_ps(vox, _mm256_i32gather_ps(spheres.cx, p, 4));
+        __m256 oy = _mm256_sub_ps(voy, _mm256_i32gather_ps(spheres.cy, p, 4));
+        __m256 oz = _mm256_sub_ps(voz, _mm256_i32gather_ps(spheres.cz, p, 4));
+        __m256 vr = _mm256_i32gather_ps(spheres.radius, p, 4);
+
+        __m256 b = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vdx, ox), _mm256_mul_ps(vdy, oy)),
+                                               _mm256_mul_ps(vdz, oz)),
+                                 two);
+        __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy)),
+                                               _mm256_mul_ps(oz, oz)),
+                                 _mm256_mul_ps(vr, vr));
+        __m256 discrim = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(four_a, c));
+
+        __m256 sqrt_discrim = _mm256_sqrt_ps(discrim);
+        __m256 neg_b = _mm256_xor_ps(b, sign);
+        __m256 t0 = _mm256_div_ps(_mm256_sub_ps(neg_b, sqrt_discrim), two_a);
+        __m256 t1 = _mm256_div_ps(_mm256_add_ps(neg_b, sqrt_discrim), two_a);
+        __m256 swap = _mm256_cmp_ps(t1, t0, _CMP_LT_OQ);
+        __m256 near = _mm256_blendv_ps(t0, t1, swap);
+        __m256 far = _mm256_blendv_ps(t1, t0, swap);
+        __m256 root = _mm256_blendv_ps(far, near, _mm256_cmp_ps(near, vtmin, _CMP_GE_OQ));
+
+        __m256 hit = _mm256_and_ps(_mm256_cmp_ps(discrim, zero, _CMP_NLT_UQ),
+                                   _mm256_and_ps(_mm256_cmp_ps(root, vtmin, _CMP_NLT_UQ),
+                                                 _mm256_cmp_ps(root, _mm256_set1_ps(tmax), _CMP_NGT_UQ)));
+        unsigned int hits = _mm256_movemask_ps(hit) & ((1u << count) - 1);
+        if (hits == 0) {
+            continue;
+        }
+
+        _mm256_store_ps(roots, root);
+        unsigned int lane = nearest_lane(hits, roots);
+        tmax = roots[lane];
+        index = prims[base + lane];
+        found = true;
+    }
+    return found;
+}
+
+
+__attribute__((target("avx2")))
+bool
+occluded_avx2(const SphereData &spheres,
+              const unsigned int *prims,
+              unsigned int n,
+              const Ray &ray,
+              float tmin,
+              float tmax)
+{
+    const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+    const float a = dx*dx + dy*dy + dz*dz;
+
+    const __m256 vdx = _mm256_set1_ps(dx), vdy = _mm256_set1_ps(dy), vdz = _mm256_set1_ps(dz);
+    const __m256 vox = _mm256_set1_ps(ray.origin.x);
+    const __m256 voy = _mm256_set1_ps(ray.origin.y);
+    const __m256 voz = _mm256_set1_ps(ray.origin.z);
+    const __m256 va = _mm256_set1_ps(a), four_a = _mm256_set1_ps(4.0f * a), two_a = _mm256_set1_ps(2.0f * a);
+    const __m256 two = _mm256_set1_ps(2.0f), zero = _mm256_setzero_ps(), sign = _mm256_set1_ps(-0.0f);
+    const __m256 vtmin = _mm256_set1_ps(tmin), vtmax = _mm256_set1_ps(tmax);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    for (unsigned int base = 0; base < n; base += 8) {
+        const unsigned int count = (n - base < 8) ? n - base : 8;
+
+        __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(count), lanes);
+        __m256i p = _mm256_maskload_epi32((const int *)prims + base, valid);
+        p = _mm256_blendv_epi8(_mm256_set1_epi32(prims[base]), p, valid);
+
+        __m256 ox = _mm256_sub_ps(vox, _mm256_i32gather_ps(spheres.cx, p, 4));
+        __m256 oy = _mm256_sub_ps(voy, _mm256_i32gather_ps(spheres.cy, p, 4));
+        __m256 oz = _mm256_sub_ps(voz, _mm256_i32gather_ps(spheres.cz, p, 4));
+        __m256 vr = _mm256_i32gather_ps(spheres.radius, p, 4);
+
+        __m256 b = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vdx, ox), _mm256_mul_ps(vdy, oy)),
+                                               _mm256_mul_ps(vdz, oz)),
+                                 two);
+        __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy)),
+                                               _mm256_mul_ps(oz, oz)),
+                                 _mm256_mul_ps(vr, vr));
+
+        __m256 f_tmin = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(va, vtmin), b), vtmin), c);
+        __m256 f_tmax = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(va, vtmax), b), vtmax), c);
+        __m256 crosses = _mm256_xor_ps(_mm256_cmp_ps(f_tmin, zero, _CMP_LE_OQ), _mm256_cmp_ps(f_tmax, zero, _CMP_LE_OQ));
+
+        __m256 t_vertex = _mm256_div_ps(_mm256_xor_ps(b, sign), two_a);
+        __m256 discrim = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(four_a, c));
+        __m256 dips = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(t_vertex, vtmin, _CMP_GT_OQ),
+                                                  _mm256_cmp_ps(t_vertex, vtmax, _CMP_LT_OQ)),
+                                    _mm256_cmp_ps(discrim, zero, _CMP_GE_OQ));
+        dips = _mm256_andnot_ps(_mm256_cmp_ps(f_tmin, zero, _CMP_LT_OQ), dips);
+
+        if (_mm256_movemask_ps(_mm256_or_ps(crosses, dips)) & ((1u << count) - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#pragma mark - AVX-512
+
+__attribute__((target("avx512f"), NO_FP_CONTRACT))
+bool
+intersect_avx512(const SphereData &spheres,
+                 const unsigned int *prims,
+                 unsigned int n,
+                 const Ray &ray,
+                 float tmin,
+                 float &tmax,
+                 unsigned int &index)
+{
+    BEGIN_NO_FP_CONTRACT
+
+    const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+    const float a = dx*dx + dy*dy + dz*dz;
+
+    const __m512 vdx = _mm512_set1_ps(dx), vdy = _mm512_set1_ps(dy), vdz = _mm512_set1_ps(dz);
+    const __m512 vox = _mm512_set1_ps(ray.origin.x);
+    const __m512 voy = _mm512_set1_ps(ray.origin.y);
+    const __m512 voz = _mm512_set1_ps(ray.origin.z);
+    const __m512 four_a = _mm512_set1_ps(4.0f * a), two_a = _mm512_set1_ps(2.0f * a);
+    const __m512 two = _mm512_set1_ps(2.0f), zero = _mm512_setzero_ps();
+    const __m512i sign = _mm512_set1_epi32(0x80000000);
+    const __m512 vtmin = _mm512_set1_ps(tmin);
+
+    bool found = false;
+    alignas(64) float roots[16];
+    for (unsigned int base = 0; base < n; base += 16) {
+        const unsigned int count = (n - base < 16) ? n - base : 16;
+        const __mmask16 valid = (__mmask16)((1u << count) - 1);
+
+        // Padding lanes gather sphere prims[base], which is always there.
+        __m512i p = _mm512_mask_loadu_epi32(_mm512_set1_epi32(prims[base]), valid, prims + base);
+
+        __m512 ox = _mm512_sub_ps(vox, _mm512_mask_i32gather_ps(zero, 0xFFFF, p, spheres.cx, 4));
+        __m512 oy = _mm512_sub_ps(voy, _mm512_mask_i32gather_ps(zero, 0xFFFF, p, spheres.cy, 4));
+        __m512 oz = _mm512_sub_ps(voz, _mm512_mask_i32gather_ps(zero, 0xFFFF, p, spheres.cz, 4));
+        __m512 vr = _mm512_mask_i32gather_ps(zero, 0xFFFF, p, spheres.radius, 4);
+
+        __m512 b = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(vdx, ox), _mm512_mul_ps(vdy, oy)),
+                                               _mm512_mul_ps(vdz, oz)),
+                                 two);
+        __m512 c = _mm512_sub_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ox, ox), _mm512_mul_ps(oy, oy)),
+                                               _mm512_mul_ps(oz, oz)),
+                                 _mm512_mul_ps(vr, vr));
+        __m512 discrim = _mm512_sub_ps(_mm512_mul_ps(b, b), _mm512_mul_ps(four_a, c));
+
+        __m512 sqrt_discrim = _mm512_maskz_sqrt_ps(0xFFFF, discrim);
+        __m512 neg_b = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(b), sign));
+        __m512 t0 = _mm512_div_ps(_mm512_sub_ps(neg_b, sqrt_discrim), two_a);
+        __m512 t1 = _mm512_div_ps(_mm512_add_ps(neg_b, sqrt_discrim), two_a);
+        __mmask16 swap = _mm512_cmp_ps_mask(t1, t0, _CMP_LT_OQ);
+        __m512 near = _mm512_mask_blend_ps(swap, t0, t1);
+        __m512 far = _mm512_mask_blend_ps(swap, t1, t0);
+        __m512 root = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(near, vtmin, _CMP_GE_OQ), far, near);
+
+        __mmask16 hit = _mm512_cmp_ps_mask(discrim, zero, _CMP_NLT_UQ)
+                      & _mm512_cmp_ps_mask(root, vtmin, _CMP_NLT_UQ)
+                      & _mm512_cmp_ps_mask(root, _mm512_set1_ps(tmax), _CMP_NGT_UQ)
+                      & valid;
+        if (hit == 0) {
+            continue;
+        }
+
+        _mm512_store_ps(roots, root);
+        unsigned int lane = nearest_lane(hit, roots);
+        tmax = roots[lane];
+        index = prims[base + lane];
+        found = true;
+    }
+    return found;
+}
+
+
+__attribute__((target("avx512f"), NO_FP_CONTRACT))
+bool
+occluded_avx512(const SphereData &spheres,
+                const unsigned int *prims,
+                unsigned int n,
+                const Ray &ray,
+                float tmin,
+                float tmax)
+{
+    BEGIN_NO_FP_CONTRACT
+
+    const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+    const float a = dx*dx + dy*dy + dz*dz;
+
+    const __m512 vdx = _mm512_set1_ps(dx), vdy = _mm512_set1_ps(dy), vdz = _mm512_set1_ps(dz);
+    const __m512 vox = _mm512_set1_ps(ray.origin.x);
+    const __m512 voy = _mm512_set1_ps(ray.origin.y);
+    const __m512 voz = _mm512_set1_ps(ray.origin.z);
+    const __m512 va = _mm512_set1_ps(a), four_a = _mm512_set1_ps(4.0f * a), two_a = _mm512_set1_ps(2.0f * a);
+    const __m512 two = _mm512_set1_ps(2.0f), zero = _mm512_setzero_ps();
+    const __m512i sign = _mm512_set1_epi32(0x80000000);
+    const __m512 vtmin = _mm512_set1_ps(tmin), vtmax = _mm512_set1_ps(tmax);
+
+    for (unsigned int base = 0; base < n; base += 16) {
+        const unsigned int count = (n - base < 16) ? n - base : 16;
+        const __mmask16 valid = (__mmask16)((1u << count) - 1);
+
+        __m512i p = _mm512_mask_loadu_epi32(_mm512_set1_epi32(prims[base]), valid, prims + base);
+
+        __m512 ox = _mm512_sub_ps(vox, _mm512_mask_i32gather_ps(zero, 0xFFFF, p, spheres.cx, 4));
+        __m512 oy = _mm512_sub_ps(voy, _mm512_mask_i32gather_ps(zero, 0xFFFF, p, spheres.cy, 4));
+        __m512 oz = _mm512_sub_ps(voz, _mm512_mask_i32gather_ps(zero, 0xFFFF, p, spheres.cz, 4));
+        __m512 vr = _mm512_mask_i32gather_ps(zero, 0xFFFF, p, spheres.radius, 4);
+
+        __m512 b = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(vdx, ox), _mm512_mul_ps(vdy, oy)),
+                                               _mm512_mul_ps(vdz, oz)),
+                                 two);
+        __m512 c = _mm512_sub_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ox, ox), _mm512_mul_ps(oy, oy)),
+                                               _mm512_mul_ps(oz, oz)),
+                                 _mm512_mul_ps(vr, vr));
+
+        __m512 f_tmin = _mm512_add_ps(_mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(va, vtmin), b), vtmin), c);
+        __m512 f_tmax = _mm512_add_ps(_mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(va, vtmax), b), vtmax), c);
+        __mmask16 crosses = _mm512_cmp_ps_mask(f_tmin, zero, _CMP_LE_OQ) ^ _mm512_cmp_ps_mask(f_tmax, zero, _CMP_LE_OQ);
+
+        __m512 neg_b = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(b), sign));
+        __m512 t_vertex = _mm512_div_ps(neg_b, two_a);
+        __m512 discrim = _mm512_sub_ps(_mm512_mul_ps(b, b), _mm512_mul_ps(four_a, c));
+        __mmask16 dips = _mm512_cmp_ps_mask(t_vertex, vtmin, _CMP_GT_OQ)
+                       & _mm512_cmp_ps_mask(t_vertex, vtmax, _CMP_LT_OQ)
+                       & _mm512_cmp_ps_mask(discrim, zero, _CMP_GE_OQ)
+                       & ~_mm512_cmp_ps_mask(f_tmin, zero, _CMP_LT_OQ);
+
+        if ((crosses | dips) & valid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif /* SPHERE_KERNELS_X86 */
+
+
+const SphereKernel ScalarKernel = { "scalar", 1, intersect_scalar, occluded_scalar };
+#if SPHERE_KERNELS_X86
+const SphereKernel SSEKernel = { "SSE4.1", 4, intersect_sse, occluded_sse };
+const SphereKernel AVX2Kernel = { "AVX2", 8, intersect_avx2, occluded_avx2 };
+const SphereKernel AVX512Kernel = { "AVX-512", 16, intersect_avx512, occluded_avx512 };
+#endif
+
+} /* anonymous namespace */
+
+
+/*
+ * get_sphere_kernels --
+ *
+ * Get all the kernels this CPU can run, narrowest first.
+ */
+std::vector<const SphereKernel *>
+get_sphere_kernels()
+{
+    std::vector<const SphereKernel *> kernels;
+    kernels.push_back(&ScalarKernel);
+#if SPHERE_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) {
+        kernels.push_back(&SSEKernel);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back(&AVX2Kernel);
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        kernels.push_back(&AVX512Kernel);
+    }
+#endif
+    return kernels;
+}
+
+
+/*
+ * get_best_sphere_kernel --
+ *
+ * Get the widest kernel this CPU can run. The CPU is only checked the first time.
+ */
+const SphereKernel &
+get_best_sphere_kernel()
+{
+    static const SphereKernel *best = get_sphere_kernels().back();
+    return *best;
+}
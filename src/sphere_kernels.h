@@ -0,0 +1,149 @@
+/* sphere_kernels.h
+ *
+ * Declaration of the batched sphere intersection kernels. A kernel tests one ray against a batch of spheres from a
+ * SphereArray at once, using SIMD instructions to work on several spheres per instruction: 4 with SSE4.1, 8 with AVX2,
+ * or 16 with AVX-512. Which of those the CPU has is checked at run time, so one build runs everywhere and uses the
+ * widest kernel it can. There's also a scalar kernel, one sphere at a time, for everything else.
+ *
+ * All the kernels do the same arithmetic in the same order as the scalar code below, so they find exactly the same
+ * hits, and in the case of ties, the same sphere.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __SPHERE_KERNELS_H__
+#define __SPHERE_KERNELS_H__
+
+#include <cmath>
+#include <vector>
+
+#include "basics.h"
+
+
+/*
+ * Spheres in structure of arrays form: the center of sphere i is (cx[i], cy[i], cz[i]) and its radius is radius[i].
+ */
+struct SphereData
+{
+    const float *cx, *cy, *cz;
+    const float *radius;
+};
+
+
+struct SphereKernel
+{
+    // Name of the instruction set, for messages.
+    const char *name;
+
+    // Number of spheres tested per instruction. Batches of any size work, but batches this big waste no work.
+    unsigned int width;
+
+    /*
+     * Find the nearest intersection of ray with the n spheres whose indexes are in prims, in [tmin, tmax]. If there is
+     * one, shrink tmax to it, store the index of its sphere in index, and return true. When two spheres are hit at the
+     * same distance, the one later in prims wins, just as if they'd been tested one at a time.
+     */
+    bool (*intersect)(const SphereData &spheres, const unsigned int *prims, unsigned int n, const Ray &ray,
+                      float tmin, float &tmax, unsigned int &index);
+
+    // Determine whether ray hits any of the n spheres whose indexes are in prims anywhere in [tmin, tmax].
+    bool (*occluded)(const SphereData &spheres, const unsigned int *prims, unsigned int n, const Ray &ray,
+                     float tmin, float tmax);
+};
+
+
+const SphereKernel &get_best_sphere_kernel();
+std::vector<const SphereKernel *> get_sphere_kernels();
+
+#pragma mark - Scalar Kernels
+
+/*
+ * intersect_sphere --
+ *
+ * Find the nearest intersection of ray with sphere i in [tmin, tmax] and store its t. The ray hits the sphere where
+ *
+ *     |o + td - c|^2 = r^2
+ *
+ * which is the quadratic at^2 + bt + c = 0 with a = d . d, b = 2 d . (o - c), c = (o - c) . (o - c) - r^2. The nearer
+ * root is used unless it falls before tmin, as it does for rays starting inside the sphere.
+ */
+inline bool
+intersect_sphere(const SphereData &spheres,
+                 unsigned int i,
+                 const Ray &ray,
+                 float tmin,
+                 float tmax,
+                 float &t)
+{
+    const float ox = ray.origin.x - spheres.cx[i];
+    const float oy = ray.origin.y - spheres.cy[i];
+    const float oz = ray.origin.z - spheres.cz[i];
+    const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+
+    float a = dx*dx + dy*dy + dz*dz;
+    float b = (dx*ox + dy*oy + dz*oz) * 2.0f;
+    float c = (ox*ox + oy*oy + oz*oz) - (spheres.radius[i] * spheres.radius[i]);
+
+    // No real roots means no intersections.
+    float discrim = (b * b) - (4.0f * a * c);
+    if (discrim < 0) {
+        return false;
+    }
+
+    float sqrt_discrim = sqrtf(discrim);
+    float t0 = (-b - sqrt_discrim) / (2.0f * a);
+    float t1 = (-b + sqrt_discrim) / (2.0f * a);
+    if (t1 < t0) {
+        float tmp = t0;
+        t0 = t1;
+        t1 = tmp;
+    }
+
+    float root = (t0 >= tmin) ? t0 : t1;
+    if (root < tmin || root > tmax) {
+        return false;
+    }
+    t = root;
+    return true;
+}
+
+
+/*
+ * occluded_sphere --
+ *
+ * Determine whether ray hits sphere i anywhere in [tmin, tmax], without solving for where. Along the ray, the squared
+ * distance from the surface is the quadratic f(t) = at^2 + bt + c, negative inside the sphere and positive outside. If
+ * f changes sign between tmin and tmax, exactly one root lies between them. If f is positive at both ends, the ray can
+ * still pass through the sphere in between, when the bottom of the parabola dips below zero inside the interval. If
+ * it's negative at both ends, the whole interval is inside and the ray never crosses the surface.
+ */
+inline bool
+occluded_sphere(const SphereData &spheres,
+                unsigned int i,
+                const Ray &ray,
+                float tmin,
+                float tmax)
+{
+    const float ox = ray.origin.x - spheres.cx[i];
+    const float oy = ray.origin.y - spheres.cy[i];
+    const float oz = ray.origin.z - spheres.cz[i];
+    const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+
+    float a = dx*dx + dy*dy + dz*dz;
+    float b = (dx*ox + dy*oy + dz*oz) * 2.0f;
+    float c = (ox*ox + oy*oy + oz*oz) - (spheres.radius[i] * spheres.radius[i]);
+
+    float f_tmin = (a * tmin + b) * tmin + c;
+    float f_tmax = (a * tmax + b) * tmax + c;
+    if ((f_tmin <= 0) != (f_tmax <= 0)) {
+        return true;
+    }
+    if (f_tmin < 0) {
+        return false;
+    }
+
+    float t_vertex = -b / (2.0f * a);
+    return t_vertex > tmin && t_vertex < tmax && (b * b) - (4.0f * a * c) >= 0;
+}
+
+#endif
@@ -0,0 +1,620 @@
+/* tonemap.cc
+ *
+ * Definition of the tone mapper and its kernels. The SIMD kernels follow the scalar one step for step, with one pixel
+ * per lane. They lean on SSE's min and max returning their second operand when the first is a NaN, which is what the
+ * scalar clamp does too. Like the sphere kernels, they're compiled for their instruction sets with function
+ * attributes, so the rest of the program can run on CPUs without them.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "basics.h"
+#include "parallel.h"
+#include "scene.h"
+#include "tonemap.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TONEMAP_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+// Steps in the sRGB table. Interpolating between them is off by less than a hundredth of an 8 bit level.
+const int SRGBTableSize = 4096;
+
+// Rows mapped at a time by write_scene's threads.
+const int BandHeight = 16;
+
+// An 8x8 Bayer matrix. Each pixel in a block is rounded up at a different threshold, so a block averages out to the
+// true color to within a 64th of a level.
+const unsigned char Bayer[8][8] = {
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+
+inline float
+get_threshold(int x,
+              int y)
+{
+    return (Bayer[y & 7][x & 7] + 0.5f) / 64.0f;
+}
+
+
+/*
+ * get_srgb_table --
+ *
+ * Get the sRGB encodings of SRGBTableSize + 1 evenly spaced values from 0 to 1, and a copy of the last, so that
+ * interpolating at exactly 1 needn't be a special case.
+ */
+const float *
+get_srgb_table()
+{
+    static const std::vector<float> table = [] {
+        std::vector<float> t(SRGBTableSize + 2);
+        for (int i = 0; i <= SRGBTableSize; i++) {
+            const double v = (double)i / SRGBTableSize;
+            t[i] = (v <= 0.0031308) ? 12.92 * v : 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+        }
+        t[SRGBTableSize + 1] = t[SRGBTableSize];
+        return t;
+    }();
+    return table.data();
+}
+
+
+/*
+ * get_row_thresholds --
+ *
+ * Get the dither thresholds of 16 pixels of row y, starting at column x. The pattern repeats every 8 pixels, so the
+ * thresholds of any 4 pixels starting at x + i, for i a multiple of 4, are at i % 8.
+ */
+inline void
+get_row_thresholds(int x,
+                   int y,
+                   float thresholds[16])
+{
+    for (int i = 0; i < 16; i++) {
+        thresholds[i] = get_threshold(x + i, y);
+    }
+}
+
+#pragma mark - Scalar
+
+void
+map_row_scalar(float scale,
+               ToneMapper::Operator op,
+               bool srgb,
+               bool dither,
+               int x,
+               int y,
+               int width,
+               const Color *in,
+               Color *out)
+{
+    const float *table = get_srgb_table();
+    for (int i = 0; i < width; i++) {
+        float c[3] = { in[i].red * scale, in[i].green * scale, in[i].blue * scale };
+        const float threshold = get_threshold(x + i, y);
+        for (float &v : c) {
+            if (op == ToneMapper::OperatorReinhard) {
+                v = v / (v + 1.0f);
+            }
+            else if (op == ToneMapper::OperatorACES) {
+                v = (v * (v * 2.51f + 0.03f)) / (v * (v * 2.43f + 0.59f) + 0.14f);
+            }
+            v = (v > 0.0f) ? v : 0.0f;
+            v = (v < 1.0f) ? v : 1.0f;
+
+            if (srgb) {
+                const float t = v * SRGBTableSize;
+                const int j = (int)t;
+                v = table[j] + (table[j + 1] - table[j]) * (t - (float)j);
+            }
+            if (dither) {
+                v = (float)(int)(v * 255.0f + threshold) / 255.0f;
+            }
+        }
+        out[i] = Color(c[0], c[1], c[2], in[i].alpha);
+    }
+}
+
+#if TONEMAP_X86
+
+#pragma mark - SSE2
+
+/*
+ * map_plane_sse --
+ *
+ * Map one channel of 4 pixels. The sRGB table is looked up one lane at a time, since SSE has no gathers.
+ */
+__attribute__((target("sse2")))
+inline __m128
+map_plane_sse(__m128 v,
+              __m128 scale,
+              ToneMapper::Operator op,
+              bool srgb,
+              bool dither,
+              __m128 threshold,
+              const float *table)
+{
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), levels = _mm_set1_ps(255.0f);
+    v = _mm_mul_ps(v, scale);
+    if (op == ToneMapper::OperatorReinhard) {
+        v = _mm_div_ps(v, _mm_add_ps(v, one));
+    }
+    else if (op == ToneMapper::OperatorACES) {
+        const __m128 n = _mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(2.51f)), _mm_set1_ps(0.03f)));
+        const __m128 d = _mm_add_ps(_mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(2.43f)), _mm_set1_ps(0.59f))),
+                                    _mm_set1_ps(0.14f));
+        v = _mm_div_ps(n, d);
+    }
+    v = _mm_min_ps(_mm_max_ps(v, zero), one);
+
+    if (srgb) {
+        const __m128 t = _mm_mul_ps(v, _mm_set1_ps((float)SRGBTableSize));
+        const __m128i index = _mm_cvttps_epi32(t);
+        alignas(16) int j[4];
+        _mm_store_si128((__m128i *)j, index);
+        const __m128 lo = _mm_setr_ps(table[j[0]], table[j[1]], table[j[2]], table[j[3]]);
+        const __m128 hi = _mm_setr_ps(table[j[0] + 1], table[j[1] + 1], table[j[2] + 1], table[j[3] + 1]);
+        v = _mm_add_ps(lo, _mm_mul_ps(_mm_sub_ps(hi, lo), _mm_sub_ps(t, _mm_cvtepi32_ps(index))));
+    }
+    if (dither) {
+        const __m128i level = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, levels), threshold));
+        v = _mm_div_ps(_mm_cvtepi32_ps(level), levels);
+    }
+    return v;
+}
+
+
+/*
+ * map_row_sse --
+ *
+ * Map 4 pixels at a time: transpose them into planes of reds, greens, blues and alphas, map the first three, and
+ * transpose them back.
+ */
+__attribute__((target("sse2")))
+void
+map_row_sse(float scale,
+            ToneMapper::Operator op,
+            bool srgb,
+            bool dither,
+            int x,
+            int y,
+            int width,
+            const Color *in,
+            Color *out)
+{
+    const float *table = get_srgb_table();
+    const __m128 vscale = _mm_set1_ps(scale);
+    float thresholds[16];
+    get_row_thresholds(x, y, thresholds);
+
+    int i = 0;
+    for (; i + 4 <= width; i += 4) {
+        __m128 r = _mm_loadu_ps(&in[i].red);
+        __m128 g = _mm_loadu_ps(&in[i + 1].red);
+        __m128 b = _mm_loadu_ps(&in[i + 2].red);
+        __m128 a = _mm_loadu_ps(&in[i + 3].red);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+
+        const __m128 threshold = _mm_loadu_ps(thresholds + (i & 7));
+        r = map_plane_sse(r, vscale, op, srgb, dither, threshold, table);
+        g = map_plane_sse(g, vscale, op, srgb, dither, threshold, table);
+        b = map_plane_sse(b, vscale, op, srgb, dither, threshold, table);
+
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        _mm_storeu_ps(&out[i].red, r);
+        _mm_storeu_ps(&out[i + 1].red, g);
+        _mm_storeu_ps(&out[i + 2].red, b);
+        _mm_storeu_ps(&out[i + 3].red, a);
+    }
+    map_row_scalar(scale, op, srgb, dither, x + i, y, width - i, in + i, out + i);
+}
+
+#pragma mark - AVX2
+
+/*
+ * map_plane_avx2 --
+ *
+ * Map one channel of 8 pixels, looking the sRGB table up with gathers.
+ */
+__attribute__((target("avx2")))
+inline __m256
+map_plane_avx2(__m256 v,
+               __m256 scale,
+               ToneMapper::Operator op,
+               bool srgb,
+               bool dither,
+               __m256 threshold,
+               const float *table)
+{
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), levels = _mm256_set1_ps(255.0f);
+    v = _mm256_mul_ps(v, scale);
+    if (op == ToneMapper::OperatorReinhard) {
+        v = _mm256_div_ps(v, _mm256_add_ps(v, one));
+    }
+    else if (op == ToneMapper::OperatorACES) {
+        const __m256 n = _mm256_mul_ps(v, _mm256_add_ps(_mm256_mul_ps(v, _mm256_set1_ps(2.51f)),
+                                                        _mm256_set1_ps(0.03f)));
+        const __m256 d = _mm256_add_ps(_mm256_mul_ps(v, _mm256_add_ps(_mm256_mul_ps(v, _mm256_set1_ps(2.43f)),
+                                                                      _mm256_set1_ps(0.59f))),
+                                       _mm256_set1_ps(0.14f));
+        v = _mm256_div_ps(n, d);
+    }
+    v = _mm256_min_ps(_mm256_max_ps(v, zero), one);
+
+    if (srgb) {
+        const __m256 t = _mm256_mul_ps(v, _mm256_set1_ps((float)SRGBTableSize));
+        const __m256i index = _mm256_cvttps_epi32(t);
+        const __m256 lo = _mm256_i32gather_ps(table, index, 4);
+        const __m256 hi = _mm256_i32gather_ps(table + 1, index, 4);
+        v = _mm256_add_ps(lo, _mm256_mul_ps(_mm256_sub_ps(hi, lo), _mm256_sub_ps(t, _mm256_cvtepi32_ps(index))));
+    }
+    if (dither) {
+        const __m256i level = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, levels), threshold));
+        v = _mm256_div_ps(_mm256_cvtepi32_ps(level), levels);
+    }
+    return v;
+}
+
+
+/*
+ * transpose_avx2 --
+ *
+ * Transpose the 4x4 block in each half of a, b, c and d, as _MM_TRANSPOSE4_PS does. Loading pixels 0 and 1 into a, 2
+ * and 3 into b, and so on gives planes holding pixels 0, 2, 4, 6, 1, 3, 5, 7 in that order, and transposing again
+ * puts them back.
+ */
+__attribute__((target("avx2")))
+inline void
+transpose_avx2(__m256 &a,
+               __m256 &b,
+               __m256 &c,
+               __m256 &d)
+{
+    const __m256 t0 = _mm256_unpacklo_ps(a, b), t1 = _mm256_unpacklo_ps(c, d);
+    const __m256 t2 = _mm256_unpackhi_ps(a, b), t3 = _mm256_unpackhi_ps(c, d);
+    a = _mm256_castpd_ps(_mm256_unpacklo_pd(_mm256_castps_pd(t0), _mm256_castps_pd(t1)));
+    b = _mm256_castpd_ps(_mm256_unpackhi_pd(_mm256_castps_pd(t0), _mm256_castps_pd(t1)));
+    c = _mm256_castpd_ps(_mm256_unpacklo_pd(_mm256_castps_pd(t2), _mm256_castps_pd(t3)));
+    d = _mm256_castpd_ps(_mm256_unpackhi_pd(_mm256_castps_pd(t2), _mm256_castps_pd(t3)));
+}
+
+
+/*
+ * map_row_avx2 --
+ *
+ * Map 8 pixels at a time, the same way as map_row_sse.
+ */
+__attribute__((target("avx2")))
+void
+map_row_avx2(float scale,
+             ToneMapper::Operator op,
+             bool srgb,
+             bool dither,
+             int x,
+             int y,
+             int width,
+             const Color *in,
+             Color *out)
+{
+    const float *table = get_srgb_table();
+    const __m256 vscale = _mm256_set1_ps(scale);
+    float t[16];
+    get_row_thresholds(x, y, t);
+    // In the order transpose_avx2 leaves the pixels in. Every group of 8 starts at a multiple of 8 from x.
+    const __m256 threshold = _mm256_setr_ps(t[0], t[2], t[4], t[6], t[1], t[3], t[5], t[7]);
+
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        __m256 r = _mm256_loadu_ps(&in[i].red);
+        __m256 g = _mm256_loadu_ps(&in[i + 2].red);
+        __m256 b = _mm256_loadu_ps(&in[i + 4].red);
+        __m256 a = _mm256_loadu_ps(&in[i + 6].red);
+        transpose_avx2(r, g, b, a);
+
+        r = map_plane_avx2(r, vscale, op, srgb, dither, threshold, table);
+        g = map_plane_avx2(g, vscale, op, srgb, dither, threshold, table);
+        b = map_plane_avx2(b, vscale, op, srgb, dither, threshold, table);
+
+        transpose_avx2(r, g, b, a);
+        _mm256_storeu_ps(&out[i].red, r);
+        _mm256_storeu_ps(&out[i + 2].red, g);
+        _mm256_storeu_ps(&out[i + 4].red, b);
+        _mm256_storeu_ps(&out[i + 6].red, a);
+    }
+    map_row_scalar(scale, op, srgb, dither, x + i, y, width - i, in + i, out + i);
+}
+
+#endif /* TONEMAP_X86 */
+
+
+const ToneMapKernel ScalarKernel = { "scalar", 1, map_row_scalar };
+#if TONEMAP_X86
+const ToneMapKernel SSEKernel = { "SSE2", 4, map_row_sse };
+const ToneMapKernel AVX2Kernel = { "AVX2", 8, map_row_avx2 };
+#endif
+
+} /* anonymous namespace */
+
+
+/*
+ * get_tone_map_kernels --
+ *
+ * Get all the kernels this CPU can run, narrowest first.
+ */
+std::vector<const ToneMapKernel *>
+get_tone_map_kernels()
+{
+    std::vector<const ToneMapKernel *> kernels;
+    kernels.push_back(&ScalarKernel);
+#if TONEMAP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        kernels.push_back(&SSEKernel);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back(&AVX2Kernel);
+    }
+#endif
+    return kernels;
+}
+
+
+/*
+ * get_best_tone_map_kernel --
+ *
+ * Get the widest kernel this CPU can run. The CPU is only checked the first time.
+ */
+const ToneMapKernel &
+get_best_tone_map_kernel()
+{
+    static const ToneMapKernel *best = get_tone_map_kernels().back();
+    return *best;
+}
+
+
+/*
+ * ToneMapper::ToneMapper --
+ *
+ * Constructor. Map colors for the given writer: clamped, at the exposure they were rendered at, encoded as sRGB, and
+ * dithered.
+ */
+ToneMapper::ToneMapper(Writer &w)
+    : writer(w),
+      exposure(0.0),
+      scale(1.0),
+      op(OperatorClamp),
+      srgb(true),
+      dither(true),
+      nthreads(0),
+      kernel(&get_best_tone_map_kernel())
+{ }
+
+
+/*
+ * ToneMapper::get_exposure --
+ * ToneMapper::set_exposure --
+ * ToneMapper::get_operator --
+ * ToneMapper::set_operator --
+ * ToneMapper::get_srgb --
+ * ToneMapper::set_srgb --
+ * ToneMapper::get_dither --
+ * ToneMapper::set_dither --
+ * ToneMapper::get_nthreads --
+ * ToneMapper::set_nthreads --
+ *
+ * Get and set the exposure, in stops brighter than the render; the tone mapping operator; whether to encode as sRGB;
+ * whether to dither to 8 bits; and the number of threads write_scene maps with, where 0 means one per hardware
+ * thread.
+ */
+float
+ToneMapper::get_exposure()
+    const
+{
+    return exposure;
+}
+
+void
+ToneMapper::set_exposure(float stops)
+{
+    exposure = stops;
+    scale = exp2f(stops);
+}
+
+ToneMapper::Operator
+ToneMapper::get_operator()
+    const
+{
+    return op;
+}
+
+void
+ToneMapper::set_operator(Operator o)
+{
+    op = o;
+}
+
+bool
+ToneMapper::get_srgb()
+    const
+{
+    return srgb;
+}
+
+void
+ToneMapper::set_srgb(bool s)
+{
+    srgb = s;
+}
+
+bool
+ToneMapper::get_dither()
+    const
+{
+    return dither;
+}
+
+void
+ToneMapper::set_dither(bool d)
+{
+    dither = d;
+}
+
+unsigned int
+ToneMapper::get_nthreads()
+    const
+{
+    return nthreads;
+}
+
+void
+ToneMapper::set_nthreads(unsigned int n)
+{
+    nthreads = n;
+}
+
+
+/*
+ * ToneMapper::get_kernel --
+ * ToneMapper::set_kernel --
+ *
+ * Get and set the kernel that maps rows.
+ */
+const ToneMapKernel &
+ToneMapper::get_kernel()
+    const
+{
+    return *kernel;
+}
+
+void
+ToneMapper::set_kernel(const ToneMapKernel &k)
+{
+    kernel = &k;
+}
+
+
+/*
+ * ToneMapper::map_row --
+ *
+ * Map width pixels of row y, starting at column x, from in to out, which may be the same. Dithered colors come out as
+ * exact multiples of 1/255, which writers that round to 8 bits keep as they are. Alpha is passed through.
+ *
+ * Anything the operator leaves outside [0, 1] is clamped, and NaNs come out black.
+ */
+void
+ToneMapper::map_row(int x,
+                    int y,
+                    int width,
+                    const Color *in,
+                    Color *out)
+    const
+{
+    kernel->map_row(scale, op, srgb, dither, x, y, width, in, out);
+}
+
+
+/*
+ * ToneMapper::write_scene --
+ *
+ * Map the given scene and write it to a file with the writer. The image is cut into bands of rows, which a pool of
+ * threads take turns mapping and streaming to the writer. Return what the writer does, or -1 if it can't stream.
+ */
+int
+ToneMapper::write_scene(const Scene &scene, const std::string &filename)
+{
+    if (!scene.is_rendered()) {
+        return -1;
+    }
+    if (!writer.can_stream()) {
+        fprintf(stderr, "%s: can't tone map for a writer that doesn't stream\n", filename.c_str());
+        return -1;
+    }
+
+    const int width = scene.get_width(), height = scene.get_height();
+    if (!begin_image(filename, width, height)) {
+        return -1;
+    }
+
+    const Framebuffer &framebuffer = scene.get_framebuffer();
+    const unsigned int nbands = (height + BandHeight - 1) / BandHeight;
+    unsigned int nworkers = (nthreads > 0) ? nthreads : std::thread::hardware_concurrency();
+    nworkers = std::max(1u, std::min(nworkers, nbands));
+    std::atomic<unsigned int> next_band(0);
+    run_workers(nworkers, [&](unsigned int) {
+        std::vector<Color> buffer;
+        for (unsigned int b = next_band++; b < nbands; b = next_band++) {
+            const int y = b * BandHeight, nrows = std::min(BandHeight, height - y);
+            write_tile(0, y, width, nrows, framebuffer.load_rows(y, nrows, buffer));
+        }
+    });
+    return end_image();
+}
+
+
+/*
+ * ToneMapper::can_stream --
+ * ToneMapper::begin_image --
+ * ToneMapper::end_image --
+ *
+ * Stream if the writer does, straight through to it.
+ */
+bool
+ToneMapper::can_stream()
+    const
+{
+    return writer.can_stream();
+}
+
+bool
+ToneMapper::begin_image(const std::string &filename,
+                        int width,
+                        int height)
+{
+    return writer.begin_image(filename, width, height);
+}
+
+int
+ToneMapper::end_image()
+{
+    return writer.end_image();
+}
+
+
+/*
+ * ToneMapper::write_tile --
+ *
+ * Map a finished tile and pass it on to the writer. Safe to call from many threads at once, if the writer's
+ * write_tile is.
+ */
+void
+ToneMapper::write_tile(int x,
+                       int y,
+                       int width,
+                       int height,
+                       const Color *pixels)
+{
+    std::vector<Color> mapped(width * height);
+    for (int r = 0; r < height; r++) {
+        map_row(x, y + r, width, pixels + r * width, mapped.data() + r * width);
+    }
+    writer.write_tile(x, y, width, height, mapped.data());
+}
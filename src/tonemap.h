@@ -0,0 +1,111 @@
+/* tonemap.h
+ *
+ * Declaration of the tone mapper, which turns the renderer's linear, unbounded colors into display colors on their way
+ * to a Writer.
+ *
+ * Each pixel is scaled by the exposure, brought into [0, 1] by a tone mapping operator, encoded as sRGB, and, if
+ * dithering is on, quantized to 8 bits through an ordered dither so that smooth gradients don't band. sRGB encoding
+ * interpolates in a table rather than calling powf.
+ *
+ * Rows are mapped by a kernel. Besides the scalar one, there are SIMD kernels that split pixels into planes of reds,
+ * greens and blues and map 4 pixels per instruction with SSE2, or 8 with AVX2, which also looks up the sRGB table with
+ * gathers. Which of those the CPU has is checked at run time, as for the sphere kernels, so every build uses the widest
+ * it can. They all do the same arithmetic in the same order, and give exactly the same results.
+ *
+ * A ToneMapper is itself a Writer, which passes the image on to another, so it goes in front of any of them. Streamed
+ * tiles are mapped by the render threads that finished them on their way through; whole scenes are cut into bands
+ * which a pool of threads maps and streams through the same way.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __TONEMAP_H__
+#define __TONEMAP_H__
+
+#include <vector>
+
+#include "writer.h"
+
+
+struct ToneMapKernel;
+
+
+class ToneMapper
+    : public Writer
+{
+public:
+    enum Operator {
+        // Clip anything outside [0, 1].
+        OperatorClamp = 0,
+        // c / (1 + c), which rolls off highlights gently and never quite reaches white.
+        OperatorReinhard,
+        // Narkowicz's fit of the ACES filmic curve, with a toe in the shadows and a shoulder that reaches white.
+        OperatorACES,
+    };
+
+    ToneMapper(Writer &writer);
+
+    float get_exposure() const;
+    void set_exposure(float stops);
+    Operator get_operator() const;
+    void set_operator(Operator op);
+    bool get_srgb() const;
+    void set_srgb(bool s);
+    bool get_dither() const;
+    void set_dither(bool d);
+    unsigned int get_nthreads() const;
+    void set_nthreads(unsigned int n);
+
+    const ToneMapKernel &get_kernel() const;
+    void set_kernel(const ToneMapKernel &k);
+
+    void map_row(int x, int y, int width, const Color *in, Color *out) const;
+
+    int write_scene(const Scene &scene, const std::string &filename);
+
+    bool can_stream() const;
+    bool begin_image(const std::string &filename, int width, int height);
+    void write_tile(int x, int y, int width, int height, const Color *pixels);
+    int end_image();
+
+private:
+    ToneMapper(const ToneMapper &other);
+    ToneMapper &operator=(const ToneMapper &other);
+
+    // The writer that gets the mapped image.
+    Writer &writer;
+
+    // Exposure in stops, and the factor it scales colors by.
+    float exposure;
+    float scale;
+
+    Operator op;
+    bool srgb;
+    bool dither;
+
+    // Threads write_scene maps with, or 0 for one per hardware thread.
+    unsigned int nthreads;
+
+    // The kernel that maps rows. By default, the best one the CPU can run.
+    const ToneMapKernel *kernel;
+};
+
+
+struct ToneMapKernel
+{
+    // Name of the instruction set, for messages.
+    const char *name;
+
+    // Number of pixels mapped per instruction. Rows of any width work; the pixels left over are mapped one at a time.
+    unsigned int width;
+
+    // Map width pixels of row y, starting at column x, from in to out, which may be the same. See ToneMapper::map_row.
+    void (*map_row)(float scale, ToneMapper::Operator op, bool srgb, bool dither, int x, int y, int width,
+                    const Color *in, Color *out);
+};
+
+
+const ToneMapKernel &get_best_tone_map_kernel();
+std::vector<const ToneMapKernel *> get_tone_map_kernels();
+
+#endif
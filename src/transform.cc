@@ -0,0 +1,198 @@
+/* transform.cc
+ *
+ * Definition of affine transforms.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+
+#include "basics.h"
+#include "transform.h"
+
+
+/*
+ * Transform::Transform --
+ *
+ * Default constructor. Create the identity transform.
+ */
+Transform::Transform()
+{
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            m[i][j] = (i == j) ? 1.0f : 0.0f;
+        }
+    }
+}
+
+
+/*
+ * Transform::translate --
+ * Transform::scale --
+ * Transform::rotate --
+ *
+ * Make transforms that translate by v; scale by s along every axis, or by each component of s along its own axis; and
+ * rotate by angle radians about axis, counterclockwise looking down the axis toward the origin.
+ */
+Transform
+Transform::translate(const Vector3 &v)
+{
+    Transform t;
+    t.m[0][3] = v.x;
+    t.m[1][3] = v.y;
+    t.m[2][3] = v.z;
+    return t;
+}
+
+Transform
+Transform::scale(float s)
+{
+    return scale(Vector3(s, s, s));
+}
+
+Transform
+Transform::scale(const Vector3 &s)
+{
+    Transform t;
+    t.m[0][0] = s.x;
+    t.m[1][1] = s.y;
+    t.m[2][2] = s.z;
+    return t;
+}
+
+Transform
+Transform::rotate(const Vector3 &axis,
+                  float angle)
+{
+    Vector3 a = axis;
+    a.normalize();
+    const float c = cosf(angle), s = sinf(angle), k = 1.0f - c;
+
+    // Rodrigues' rotation formula.
+    Transform t;
+    t.m[0][0] = c + a.x * a.x * k;
+    t.m[0][1] = a.x * a.y * k - a.z * s;
+    t.m[0][2] = a.x * a.z * k + a.y * s;
+    t.m[1][0] = a.y * a.x * k + a.z * s;
+    t.m[1][1] = c + a.y * a.y * k;
+    t.m[1][2] = a.y * a.z * k - a.x * s;
+    t.m[2][0] = a.z * a.x * k - a.y * s;
+    t.m[2][1] = a.z * a.y * k + a.x * s;
+    t.m[2][2] = c + a.z * a.z * k;
+    return t;
+}
+
+
+/*
+ * Transform::operator* --
+ *
+ * Compose two transforms. The result applies rhs first, then this one.
+ */
+Transform
+Transform::operator*(const Transform &rhs)
+    const
+{
+    Transform t;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            t.m[i][j] = m[i][0] * rhs.m[0][j] + m[i][1] * rhs.m[1][j] + m[i][2] * rhs.m[2][j];
+        }
+        t.m[i][3] += m[i][3];
+    }
+    return t;
+}
+
+
+/*
+ * Transform::invert --
+ *
+ * Compute the inverse of this transform and store it in inverse. Return false, and leave inverse alone, if there isn't
+ * one because the linear part flattens space onto a plane or less.
+ *
+ * The linear part is inverted by its adjugate over its determinant. The translation of the inverse undoes this one's:
+ * it's the inverse linear part applied to the negated translation.
+ */
+bool
+Transform::invert(Transform &inverse)
+    const
+{
+    const float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    const float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    const float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    const float det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+    if (det == 0.0f || !std::isfinite(det)) {
+        return false;
+    }
+    const float inv_det = 1.0f / det;
+
+    Transform t;
+    t.m[0][0] = c00 * inv_det;
+    t.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+    t.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+    t.m[1][0] = c01 * inv_det;
+    t.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+    t.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+    t.m[2][0] = c02 * inv_det;
+    t.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+    t.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+    const Vector3 translation = t.transform_vector(-get_translation());
+    t.m[0][3] = translation.x;
+    t.m[1][3] = translation.y;
+    t.m[2][3] = translation.z;
+
+    inverse = t;
+    return true;
+}
+
+
+/*
+ * Transform::get_translation --
+ * Transform::get_linear --
+ *
+ * Get the translation of this transform, and the transform without it.
+ */
+Vector3
+Transform::get_translation()
+    const
+{
+    return Vector3(m[0][3], m[1][3], m[2][3]);
+}
+
+Transform
+Transform::get_linear()
+    const
+{
+    Transform t = *this;
+    t.m[0][3] = t.m[1][3] = t.m[2][3] = 0.0f;
+    return t;
+}
+
+
+/*
+ * Transform::transform_bounds --
+ *
+ * Compute a box around the given box, transformed. Each coordinate of the new box's corners is the translation plus,
+ * for each axis, whichever end of the old box makes the term smaller (or bigger), so the 8 corners never have to be
+ * transformed one by one. Empty boxes stay empty.
+ */
+AABB
+Transform::transform_bounds(const AABB &bounds)
+    const
+{
+    if (bounds.is_empty()) {
+        return bounds;
+    }
+
+    float lo[3], hi[3];
+    for (int i = 0; i < 3; i++) {
+        lo[i] = hi[i] = m[i][3];
+        for (int j = 0; j < 3; j++) {
+            const float a = m[i][j] * bounds.min[j];
+            const float b = m[i][j] * bounds.max[j];
+            lo[i] += std::min(a, b);
+            hi[i] += std::max(a, b);
+        }
+    }
+    return AABB(Vector3(lo[0], lo[1], lo[2]), Vector3(hi[0], hi[1], hi[2]));
+}
@@ -0,0 +1,85 @@
+/* transform.h
+ *
+ * Declaration of affine transforms. A Transform is a 3x4 matrix: a linear part (rotation, scale, shear) in the first
+ * three columns and a translation in the fourth. Points get the translation; vectors, like ray directions, don't.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __TRANSFORM_H__
+#define __TRANSFORM_H__
+
+#include "basics.h"
+
+
+struct Transform
+{
+    Transform();
+
+    static Transform translate(const Vector3 &v);
+    static Transform scale(float s);
+    static Transform scale(const Vector3 &s);
+    static Transform rotate(const Vector3 &axis, float angle);
+
+    Transform operator*(const Transform &rhs) const;
+
+    bool invert(Transform &inverse) const;
+    Vector3 get_translation() const;
+    Transform get_linear() const;
+
+    inline Vector3 transform_point(const Vector3 &p) const;
+    inline Vector3 transform_vector(const Vector3 &v) const;
+    inline Vector3 transform_transposed(const Vector3 &v) const;
+    AABB transform_bounds(const AABB &bounds) const;
+
+    // Row i of the matrix is m[i]; m[i][3] is the translation along axis i.
+    float m[3][4];
+};
+
+
+/*
+ * Transform::transform_point --
+ *
+ * Transform the point p.
+ */
+inline Vector3
+Transform::transform_point(const Vector3 &p)
+    const
+{
+    return Vector3(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                   m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                   m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+}
+
+
+/*
+ * Transform::transform_vector --
+ *
+ * Transform the vector v by the linear part alone.
+ */
+inline Vector3
+Transform::transform_vector(const Vector3 &v)
+    const
+{
+    return Vector3(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                   m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                   m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+}
+
+
+/*
+ * Transform::transform_transposed --
+ *
+ * Transform the vector v by the transpose of the linear part. Normals are transformed by the transpose of the inverse,
+ * so this, called on the inverse, transforms normals; they need normalizing again after.
+ */
+inline Vector3
+Transform::transform_transposed(const Vector3 &v)
+    const
+{
+    return Vector3(m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+                   m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+                   m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z);
+}
+
+#endif
@@ -0,0 +1,620 @@
+/* wavefront.cc
+ *
+ * Definition of the wavefront renderer.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "basics.h"
+#include "light.h"
+#include "material.h"
+#include "morton.h"
+#include "object.h"
+#include "radix_sort.h"
+#include "ray_packet.h"
+#include "scene.h"
+#include "wavefront.h"
+#include "writer.h"
+
+
+/*
+ * Fewest items of work worth handing a thread of its own in a stage. Smaller stages, like the last few bounces of a
+ * wave, aren't worth the cost of starting threads.
+ */
+static const unsigned int MinItemsPerWorker = 4096;
+
+// Defined here too, since std::max takes it by reference.
+const unsigned int WavefrontRenderer::WaveSize;
+
+
+/*
+ * WavefrontRenderer::WavefrontRenderer --
+ *
+ * Constructor. Create a renderer for the given scene that splits each stage across nworkers threads.
+ */
+WavefrontRenderer::WavefrontRenderer(Scene &s,
+                                     unsigned int n)
+    : scene(s),
+      nworkers((n > 0) ? n : 1),
+      stats(nworkers),
+      lights(scene.lights.begin(), scene.lights.end()),
+      wave(NULL),
+      wave_pixels(),
+      shadowed(NULL),
+      nshadowed(0)
+{ }
+
+
+WavefrontRenderer::~WavefrontRenderer()
+{
+    if (shadowed != NULL) {
+        delete[] shadowed;
+    }
+}
+
+
+/*
+ * WavefrontRenderer::render --
+ *
+ * Render the scene into its framebuffer, or into stream if it isn't NULL, one wave at a time, and add up the rays
+ * traced into stats. Each wave runs bounce by bounce until none of its rays are left.
+ */
+void
+WavefrontRenderer::render(Scene::RenderStats &total,
+                          Writer *stream)
+{
+    const unsigned int npixels = scene.width * scene.height;
+    const unsigned int wave_size = std::min(npixels, std::max(WaveSize, (unsigned int)scene.width));
+    rays.resize(wave_size);
+    next.resize(wave_size);
+    spawned.resize(wave_size);
+    hits.resize(wave_size);
+    found.resize(wave_size);
+    order.resize(wave_size);
+    px.resize(wave_size);
+    py.resize(wave_size);
+    pz.resize(wave_size);
+    nx.resize(wave_size);
+    ny.resize(wave_size);
+    nz.resize(wave_size);
+    materials.resize(wave_size);
+    sort_items.resize(wave_size);
+    sort_scratch.resize(wave_size);
+
+    const unsigned int nslots = wave_size * lights.size();
+    sdx.resize(nslots);
+    sdy.resize(nslots);
+    sdz.resize(nslots);
+    sdistance.resize(nslots);
+    pending.resize(nslots);
+    if (nslots > nshadowed) {
+        if (shadowed != NULL) {
+            delete[] shadowed;
+        }
+        shadowed = new bool[nslots];
+        nshadowed = nslots;
+    }
+
+    // Waves are bands of whole rows, a multiple of the packet size tall where they can be.
+    const int packet_size = scene.get_effective_packet_size();
+    int rows = std::max(1U, wave_size / scene.width);
+    if (rows > packet_size) {
+        rows -= rows % packet_size;
+    }
+
+    // Waves accumulate straight into the framebuffer if it holds Colors in row order, and into a buffer otherwise.
+    Color *pixels = (stream == NULL) ? scene.framebuffer.get_pixels() : NULL;
+    if (pixels == NULL) {
+        wave_pixels.resize(rows * scene.width);
+    }
+    for (int y = 0; y < scene.height; y += rows) {
+        const int yend = std::min(y + rows, scene.height);
+        wave = (pixels != NULL) ? pixels + y * scene.width : wave_pixels.data();
+        unsigned int n = generate(y, yend, packet_size);
+        bool primary = true;
+        while (n > 0) {
+            extend(n, primary);
+            n = compact(n);
+            shade(n);
+            trace_shadows(n);
+            n = accumulate(n);
+            primary = false;
+        }
+        if (stream != NULL) {
+            stream->write_tile(0, y, scene.width, yend - y, wave);
+        }
+        else if (pixels == NULL) {
+            scene.framebuffer.store(0, y, scene.width, yend - y, wave, scene.width);
+        }
+    }
+
+    if (scene.ray_sort_stats) {
+        print_sort_stats();
+    }
+
+    for (unsigned int i = 0; i < nworkers; i++) {
+        total += stats[i];
+    }
+}
+
+
+/*
+ * WavefrontRenderer::generate --
+ *
+ * Start a wave with the primary rays for the pixels in rows [y0, y1), and clear those pixels. The rays are laid out in
+ * square blocks packet_size pixels on a side, so runs of them can be traced as packets. Their pixel indexes count from
+ * the start of row y0. Return the number of rays to trace, which is none if the scene's limits rule out even primary
+ * rays.
+ */
+unsigned int
+WavefrontRenderer::generate(int y0,
+                            int y1,
+                            int packet_size)
+{
+    const int width = scene.width;
+    for (int p = 0; p < (y1 - y0) * width; p++) {
+        wave[p] = Color::Black;
+    }
+    if (scene.max_depth <= 0 || scene.min_weight >= 1.0) {
+        return 0;
+    }
+
+    unsigned int i = 0;
+    for (int by = y0; by < y1; by += packet_size) {
+        for (int bx = 0; bx < width; bx += packet_size) {
+            const int xend = std::min(bx + packet_size, width);
+            const int yend = std::min(by + packet_size, y1);
+            for (int y = by; y < yend; y++) {
+                for (int x = bx; x < xend; x++) {
+                    rays.set(i++, scene.compute_primary_ray(x, y), Color::White, 1.0, 0, (y - y0) * width + x);
+                }
+            }
+        }
+    }
+    return i;
+}
+
+
+/*
+ * WavefrontRenderer::extend --
+ *
+ * Find the nearest hit of each of the n rays. Primary rays are coherent, and are traced as packets of
+ * RayPacket::MaxSize at a time; the rest go one at a time.
+ *
+ * Sorted reflection rays are nearly all in one octant per packet, but their origins are still spread far enough apart
+ * that packet frusta hardly cull anything, and tracing them as packets is slower than tracing them alone.
+ */
+void
+WavefrontRenderer::extend(unsigned int n,
+                          bool primary)
+{
+    const unsigned int packet_size = primary ? RayPacket::MaxSize : 1;
+    const unsigned int npackets = (n + packet_size - 1) / packet_size;
+    auto extend_packets = [&](unsigned int first, unsigned int last, Scene::RenderStats &stats) {
+        RayPacket packet;
+        bool packet_found[RayPacket::MaxSize];
+        for (unsigned int p = first; p < last; p++) {
+            const unsigned int begin = p * packet_size;
+            const unsigned int end = std::min(begin + packet_size, n);
+            stats.nrays += end - begin;
+
+            packet.clear();
+            for (unsigned int i = begin; i < end; i++) {
+                hits[i] = Intersection();
+                packet.add(rays.get_ray(i));
+            }
+            if (packet.size > 1 && packet.prepare()) {
+                scene.intersect_packet(packet, Scene::RayEpsilon, &hits[begin], packet_found);
+                for (unsigned int i = begin; i < end; i++) {
+                    found[i] = packet_found[i - begin];
+                }
+            }
+            else {
+                for (unsigned int i = begin; i < end; i++) {
+                    found[i] = scene.intersect(packet.rays[i - begin], Scene::RayEpsilon, INFINITY, hits[i]);
+                }
+            }
+        }
+    };
+    run_stage(npackets, MinItemsPerWorker / packet_size, extend_packets);
+}
+
+
+/*
+ * WavefrontRenderer::compact --
+ *
+ * Gather the indexes of the rays that hit something into order, and return how many there are. The rays stay in the
+ * order they were in, which keeps rays from neighboring pixels next to each other through every bounce.
+ */
+unsigned int
+WavefrontRenderer::compact(unsigned int n)
+{
+    unsigned int m = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        if (found[i]) {
+            order[m++] = i;
+        }
+    }
+    return m;
+}
+
+
+/*
+ * WavefrontRenderer::shade --
+ *
+ * Work out where each of the n hits is and the surface normal there, and set up its shadow rays: one toward each light
+ * in front of the surface.
+ */
+void
+WavefrontRenderer::shade(unsigned int n)
+{
+    const unsigned int nlights = lights.size();
+    auto shade_hits = [&](unsigned int first, unsigned int last, Scene::RenderStats &stats) {
+        Ray light_ray;
+        float light_distance;
+        for (unsigned int k = first; k < last; k++) {
+            const unsigned int i = order[k];
+            const Intersection &hit = hits[i];
+
+            Vector3 intersection = rays.get_ray(i).parameterize(hit.t);
+            Vector3 normal = scene.compute_normal(hit, intersection);
+            px[k] = intersection.x;
+            py[k] = intersection.y;
+            pz[k] = intersection.z;
+            nx[k] = normal.x;
+            ny[k] = normal.y;
+            nz[k] = normal.z;
+            materials[k] = &hit.shape->get_material();
+
+            for (unsigned int l = 0; l < nlights; l++) {
+                const unsigned int slot = k * nlights + l;
+                float ldotn = scene.compute_light_ray(*lights[l], intersection, normal, light_ray, light_distance);
+                pending[slot] = (ldotn > 0);
+                sdx[slot] = light_ray.direction.x;
+                sdy[slot] = light_ray.direction.y;
+                sdz[slot] = light_ray.direction.z;
+                sdistance[slot] = light_distance;
+            }
+        }
+    };
+    run_stage(n, MinItemsPerWorker, shade_hits);
+}
+
+
+/*
+ * WavefrontRenderer::trace_shadows --
+ *
+ * Trace the pending shadow rays of the n hits, and record which lights are blocked.
+ */
+void
+WavefrontRenderer::trace_shadows(unsigned int n)
+{
+    const unsigned int nlights = lights.size();
+    auto trace_slots = [&](unsigned int first, unsigned int last, Scene::RenderStats &stats) {
+        for (unsigned int slot = first; slot < last; slot++) {
+            shadowed[slot] = false;
+            if (!pending[slot]) {
+                continue;
+            }
+            const unsigned int k = slot / nlights;
+            Ray ray(Vector3(px[k], py[k], pz[k]), Vector3(sdx[slot], sdy[slot], sdz[slot]));
+            stats.nshadow_rays++;
+            shadowed[slot] = scene.occluded(ray, sdistance[slot]);
+        }
+    };
+    run_stage(n * nlights, MinItemsPerWorker, trace_slots);
+}
+
+
+/*
+ * WavefrontRenderer::accumulate --
+ *
+ * Add the direct light at each of the n hits to its pixel, and spawn its reflection ray if the path is to go on. The
+ * new rays are packed into the ray buffer for the next bounce. Return how many there are.
+ */
+unsigned int
+WavefrontRenderer::accumulate(unsigned int n)
+{
+    const unsigned int nlights = lights.size();
+    auto accumulate_hits = [&](unsigned int first, unsigned int last, Scene::RenderStats &stats) {
+        for (unsigned int k = first; k < last; k++) {
+            const unsigned int i = order[k];
+            const Material &material = *materials[k];
+            const Vector3 intersection(px[k], py[k], pz[k]);
+            const Vector3 normal(nx[k], ny[k], nz[k]);
+            const Color &throughput = rays.throughput[i];
+
+            Color direct = scene.shade_direct(material, intersection, normal, stats, shadowed + k * nlights);
+            wave[rays.pixel[i]] += throughput * direct;
+
+            // The same test as Scene::shade.
+            const float weight = rays.weight[i];
+            const int depth = rays.depth[i];
+            float specular_level = material.get_specular_level();
+            spawned[k] = (depth + 1 < scene.max_depth && weight * specular_level > scene.min_weight);
+            if (spawned[k]) {
+                next.set(k,
+                         Scene::compute_reflection_ray(rays.get_ray(i), intersection, normal),
+                         throughput * (specular_level * material.get_specular_color()),
+                         weight * specular_level,
+                         depth + 1,
+                         rays.pixel[i]);
+            }
+        }
+    };
+    run_stage(n, MinItemsPerWorker, accumulate_hits);
+
+    unsigned int m = 0;
+    for (unsigned int k = 0; k < n; k++) {
+        if (spawned[k]) {
+            order[m++] = k;
+        }
+    }
+    if (scene.ray_sorting) {
+        sort(m);
+    }
+    for (unsigned int j = 0; j < m; j++) {
+        rays.copy(j, next, order[j]);
+    }
+    return m;
+}
+
+
+/*
+ * WavefrontRenderer::sort --
+ *
+ * Reorder the m reflection rays whose slots in next are in order so that rays likely to visit the same parts of the
+ * scene are traced together. Rays are binned by octant, the signs of their direction, so that every ray in a bin
+ * visits the children of a BVH node in the same order, and a run of them can be traced as a packet. Within a bin they
+ * are sorted by the Morton code of their origin, so rays that start near each other end up near each other.
+ */
+void
+WavefrontRenderer::sort(unsigned int m)
+{
+    if (m == 0) {
+        return;
+    }
+
+    AABB box(next.get_ray(order[0]).origin, next.get_ray(order[0]).origin);
+    for (unsigned int j = 1; j < m; j++) {
+        const unsigned int k = order[j];
+        box.min = Vector3(std::min(box.min.x, next.ox[k]), std::min(box.min.y, next.oy[k]),
+                          std::min(box.min.z, next.oz[k]));
+        box.max = Vector3(std::max(box.max.x, next.ox[k]), std::max(box.max.y, next.oy[k]),
+                          std::max(box.max.z, next.oz[k]));
+    }
+
+    for (unsigned int j = 0; j < m; j++) {
+        const unsigned int k = order[j];
+        sort_items[j].key = ((uint64_t)get_octant(k) << (3 * MortonBits))
+                          | morton_code(Vector3(next.ox[k], next.oy[k], next.oz[k]), box);
+        sort_items[j].value = k;
+    }
+    radix_sort(sort_items.data(), sort_scratch.data(), m, 3 * MortonBits + 3, nworkers);
+
+    if (scene.ray_sort_stats) {
+        measure_coherence(m, 0);
+    }
+    for (unsigned int j = 0; j < m; j++) {
+        order[j] = sort_items[j].value;
+    }
+    if (scene.ray_sort_stats) {
+        measure_coherence(m, 1);
+        sort_stats.nrays += m;
+    }
+}
+
+
+/*
+ * WavefrontRenderer::get_octant --
+ *
+ * Return the octant of the ray in slot k of next: a bit for each axis along which its direction is negative. Zero
+ * components count by their sign, as they do for RayPacket.
+ */
+unsigned int
+WavefrontRenderer::get_octant(unsigned int k)
+    const
+{
+    return std::signbit(next.dx[k]) | (std::signbit(next.dy[k]) << 1) | (std::signbit(next.dz[k]) << 2);
+}
+
+
+/*
+ * WavefrontRenderer::measure_coherence --
+ *
+ * Add up how coherent the m rays in next are, taken in the order given by order, into the before (when = 0) or after
+ * (when = 1) column of the sort statistics. Coherence is measured three ways: how often neighboring rays are in
+ * different octants, how many runs of RayPacket::MaxSize rays are all in one octant and can be traced as a packet,
+ * and how far apart neighboring rays' origins are.
+ */
+void
+WavefrontRenderer::measure_coherence(unsigned int m,
+                                     int when)
+{
+    unsigned int run_octant = 0;
+    bool run_coherent = true;
+    for (unsigned int j = 0; j < m; j++) {
+        const unsigned int k = order[j];
+        const unsigned int octant = get_octant(k);
+        if (j % RayPacket::MaxSize == 0) {
+            run_octant = octant;
+            run_coherent = true;
+        }
+        run_coherent = run_coherent && octant == run_octant;
+        if (j % RayPacket::MaxSize == RayPacket::MaxSize - 1 || j == m - 1) {
+            sort_stats.npackets[when]++;
+            sort_stats.ncoherent_packets[when] += run_coherent;
+        }
+
+        if (j > 0) {
+            const unsigned int prev = order[j - 1];
+            sort_stats.noctant_changes[when] += (octant != get_octant(prev));
+            Vector3 step(next.ox[k] - next.ox[prev], next.oy[k] - next.oy[prev], next.oz[k] - next.oz[prev]);
+            sort_stats.origin_steps[when] += step.length();
+        }
+    }
+}
+
+
+/*
+ * WavefrontRenderer::print_sort_stats --
+ *
+ * Print how much more coherent sorting made the reflection rays.
+ */
+void
+WavefrontRenderer::print_sort_stats()
+    const
+{
+    const SortStats &st = sort_stats;
+    if (st.nrays == 0) {
+        printf("Ray sorting: no reflection rays were sorted.\n");
+        return;
+    }
+    printf("Ray sorting: %lu reflection rays sorted.\n", st.nrays);
+    printf("  Octant changes between neighbors: %lu before, %lu after.\n",
+           st.noctant_changes[0], st.noctant_changes[1]);
+    printf("  Packets with one octant: %.1f%% before, %.1f%% after.\n",
+           100.0 * st.ncoherent_packets[0] / st.npackets[0], 100.0 * st.ncoherent_packets[1] / st.npackets[1]);
+    printf("  Mean distance between neighbors' origins: %g before, %g after.\n",
+           st.origin_steps[0] / st.nrays, st.origin_steps[1] / st.nrays);
+}
+
+
+/*
+ * WavefrontRenderer::run_stage --
+ *
+ * Run a stage over n items of work, split into contiguous ranges of at least grain items across the render threads.
+ * stage is called as
+ *
+ *     void stage(unsigned int first, unsigned int last, Scene::RenderStats &stats)
+ *
+ * once per thread, with the range of items it should do and the stats it should count into.
+ */
+template<typename Stage>
+void
+WavefrontRenderer::run_stage(unsigned int n,
+                             unsigned int grain,
+                             Stage stage)
+{
+    unsigned int nthreads = std::min(nworkers, (n + grain - 1) / grain);
+    if (nthreads <= 1) {
+        stage(0, n, stats[0]);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    const unsigned int per_thread = (n + nthreads - 1) / nthreads;
+    for (unsigned int t = 1; t < nthreads; t++) {
+        unsigned int first = std::min(n, t * per_thread);
+        unsigned int last = std::min(n, first + per_thread);
+        threads.push_back(std::thread([&stage, this, first, last, t]() { stage(first, last, stats[t]); }));
+    }
+    stage(0, std::min(n, per_thread), stats[0]);
+    for (std::thread &t : threads) {
+        t.join();
+    }
+}
+
+#pragma mark - Sort Stats
+
+/*
+ * WavefrontRenderer::SortStats::SortStats --
+ *
+ * Default constructor. Create a zeroed set of stats.
+ */
+WavefrontRenderer::SortStats::SortStats()
+    : nrays(0)
+{
+    for (int when = 0; when < 2; when++) {
+        noctant_changes[when] = 0;
+        npackets[when] = 0;
+        ncoherent_packets[when] = 0;
+        origin_steps[when] = 0.0;
+    }
+}
+
+#pragma mark - Ray Buffers
+
+/*
+ * WavefrontRenderer::RayBuffer::resize --
+ *
+ * Make room for n rays.
+ */
+void
+WavefrontRenderer::RayBuffer::resize(unsigned int n)
+{
+    ox.resize(n);
+    oy.resize(n);
+    oz.resize(n);
+    dx.resize(n);
+    dy.resize(n);
+    dz.resize(n);
+    throughput.resize(n);
+    weight.resize(n);
+    depth.resize(n);
+    pixel.resize(n);
+}
+
+
+/*
+ * WavefrontRenderer::RayBuffer::set --
+ * WavefrontRenderer::RayBuffer::copy --
+ *
+ * Store a ray and its path in slot i, either given or copied from slot j of another buffer.
+ */
+void
+WavefrontRenderer::RayBuffer::set(unsigned int i,
+                                  const Ray &ray,
+                                  const Color &t,
+                                  float w,
+                                  int d,
+                                  unsigned int p)
+{
+    ox[i] = ray.origin.x;
+    oy[i] = ray.origin.y;
+    oz[i] = ray.origin.z;
+    dx[i] = ray.direction.x;
+    dy[i] = ray.direction.y;
+    dz[i] = ray.direction.z;
+    throughput[i] = t;
+    weight[i] = w;
+    depth[i] = d;
+    pixel[i] = p;
+}
+
+void
+WavefrontRenderer::RayBuffer::copy(unsigned int i,
+                                   const RayBuffer &from,
+                                   unsigned int j)
+{
+    ox[i] = from.ox[j];
+    oy[i] = from.oy[j];
+    oz[i] = from.oz[j];
+    dx[i] = from.dx[j];
+    dy[i] = from.dy[j];
+    dz[i] = from.dz[j];
+    throughput[i] = from.throughput[j];
+    weight[i] = from.weight[j];
+    depth[i] = from.depth[j];
+    pixel[i] = from.pixel[j];
+}
+
+
+/*
+ * WavefrontRenderer::RayBuffer::get_ray --
+ *
+ * Return the ray in slot i.
+ */
+Ray
+WavefrontRenderer::RayBuffer::get_ray(unsigned int i)
+    const
+{
+    return Ray(Vector3(ox[i], oy[i], oz[i]), Vector3(dx[i], dy[i], dz[i]));
+}
@@ -0,0 +1,148 @@
+/* wavefront.h
+ *
+ * Declaration of the wavefront renderer, the Scene's alternative to depth-first rendering. Instead of following one
+ * pixel's path to the end before starting on the next, it takes a wave of many pixels a bounce at a time. Each bounce
+ * runs in stages over the whole wave:
+ *
+ *   - extend: find the nearest hit of every ray, primary rays in packets,
+ *   - compact: drop the rays that hit nothing,
+ *   - shade: work out where each hit is, its normal, and the shadow rays toward each light,
+ *   - shadow: trace all the shadow rays,
+ *   - accumulate: add each hit's direct light to its pixel, and generate the reflection rays for the next bounce,
+ *   - sort: bin the reflection rays by direction and origin, so that rays traced together take similar paths through
+ *     the scene.
+ *
+ * Each stage is one tight loop, split across the render threads, running the same code over and over against data
+ * laid out in flat arrays. This renderer is experimental. So far that hasn't made up for writing every ray out and
+ * reading it back, and it has been slower than depth-first on every scene measured, even with the reflection rays
+ * sorted. It's kept as the base for work on the stages, and charles leaves it out of its help.
+ *
+ * The arithmetic for each path is exactly the depth-first renderer's, in the same order, so the image is the same.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __WAVEFRONT_H__
+#define __WAVEFRONT_H__
+
+#include <vector>
+
+#include "basics.h"
+#include "object.h"
+#include "radix_sort.h"
+#include "scene.h"
+
+
+class Material;
+class PointLight;
+class Writer;
+
+
+class WavefrontRenderer
+{
+public:
+    WavefrontRenderer(Scene &scene, unsigned int nworkers);
+    ~WavefrontRenderer();
+
+    void render(Scene::RenderStats &stats, Writer *stream = NULL);
+
+    // Number of pixels in a wave. Memory use is proportional.
+    static const unsigned int WaveSize = 1 << 18;
+
+private:
+    /*
+     * A buffer of rays, in structure of arrays form, with the state of the path each one is on: how much of the light
+     * it finds reaches the eye (see Scene::shade), its weight and depth, and the pixel it's for.
+     */
+    struct RayBuffer
+    {
+        void resize(unsigned int n);
+        void set(unsigned int i, const Ray &ray, const Color &throughput, float weight, int depth, unsigned int pixel);
+        void copy(unsigned int i, const RayBuffer &from, unsigned int j);
+        Ray get_ray(unsigned int i) const;
+
+        std::vector<float> ox, oy, oz;
+        std::vector<float> dx, dy, dz;
+        std::vector<Color> throughput;
+        std::vector<float> weight;
+        std::vector<int> depth;
+        std::vector<unsigned int> pixel;
+    };
+
+    /*
+     * How coherent the reflection rays were before (index 0) and after (index 1) sorting, over the whole render.
+     * Only kept if the Scene asks for it. See measure_coherence.
+     */
+    struct SortStats
+    {
+        SortStats();
+
+        unsigned long nrays;
+        unsigned long noctant_changes[2];
+        unsigned long npackets[2];
+        unsigned long ncoherent_packets[2];
+        double origin_steps[2];
+    };
+
+    unsigned int generate(int y0, int y1, int packet_size);
+    void extend(unsigned int n, bool primary);
+    unsigned int compact(unsigned int n);
+    void shade(unsigned int n);
+    void trace_shadows(unsigned int n);
+    unsigned int accumulate(unsigned int n);
+    void sort(unsigned int m);
+    unsigned int get_octant(unsigned int k) const;
+    void measure_coherence(unsigned int m, int when);
+    void print_sort_stats() const;
+
+    template<typename Stage>
+    void run_stage(unsigned int n, unsigned int grain, Stage stage);
+
+    Scene &scene;
+    unsigned int nworkers;
+    std::vector<Scene::RenderStats> stats;
+    std::vector<const PointLight *> lights;
+
+    /*
+     * The pixels of the wave being rendered, which ray pixel indexes count from: the wave's rows of the Scene's
+     * framebuffer, if it holds Colors in row order, or else wave_pixels, which is stored into the framebuffer or handed
+     * to the Writer as each wave is finished.
+     */
+    Color *wave;
+    std::vector<Color> wave_pixels;
+
+    // Rays to extend, and the reflection rays spawned from them, by index in the sorted order.
+    RayBuffer rays, next;
+    std::vector<unsigned char> spawned;
+
+    // The nearest hit of each ray, by ray index, and whether there was one.
+    std::vector<Intersection> hits;
+    std::vector<unsigned char> found;
+
+    /*
+     * Indexes of the rays that hit something, in the order they're shaded. After shading, the slots in next of the
+     * reflection rays, in the order they'll be traced.
+     */
+    std::vector<unsigned int> order;
+
+    // Sort keys for the reflection rays, and the stats, if kept.
+    std::vector<SortItem> sort_items, sort_scratch;
+    SortStats sort_stats;
+
+    // Where each of those hits is, the normal there, and its material, in shading order.
+    std::vector<float> px, py, pz;
+    std::vector<float> nx, ny, nz;
+    std::vector<const Material *> materials;
+
+    /*
+     * Shadow rays, one slot per hit per light, at slot hit * lights.size() + light. pending says whether the ray needs
+     * tracing at all. shadowed is whether the light turned out to be blocked. It's a plain array of bools so that it
+     * can be handed straight to Scene::shade_direct.
+     */
+    std::vector<float> sdx, sdy, sdz, sdistance;
+    std::vector<unsigned char> pending;
+    bool *shadowed;
+    unsigned int nshadowed;
+};
+
+#endif
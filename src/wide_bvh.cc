@@ -0,0 +1,248 @@
+/* wide_bvh.cc
+ *
+ * Definition of the wide BVH. Wide trees are made by collapsing a binary tree from the top down: each wide node starts
+ * with the two children of a binary node, then repeatedly replaces the interior child with the biggest surface area
+ * with its own two children, until it has Width of them or all of them are leaves.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "basics.h"
+#include "bvh.h"
+#include "wide_bvh.h"
+
+
+static_assert(sizeof(WideBVH::Node) % 64 == 0, "wide BVH nodes must fill whole cache lines");
+static_assert(WideBVH::Width % 4 == 0, "wide BVH nodes must fill whole SSE vectors");
+
+// Defined here too, since std::vector::assign takes it by reference.
+const unsigned int WideBVH::NoSlot;
+
+
+/*
+ * WideBVH::WideBVH --
+ *
+ * Default constructor. Create an empty tree.
+ */
+WideBVH::WideBVH()
+    : storage(NULL),
+      nodes(NULL),
+      nnodes(0),
+      index_data(NULL)
+{ }
+
+
+/*
+ * WideBVH::~WideBVH --
+ *
+ * Destructor.
+ */
+WideBVH::~WideBVH()
+{
+    clear();
+}
+
+
+/*
+ * WideBVH::build --
+ *
+ * Build the tree by collapsing the given binary tree. Any existing tree is thrown away. The wide tree refers to the
+ * binary tree's primitive indices, so the binary tree has to outlive it, or at least last until the next call to
+ * build() or clear().
+ */
+void
+WideBVH::build(const BVH &bvh)
+{
+    clear();
+    if (bvh.is_empty()) {
+        return;
+    }
+
+    /*
+     * Every wide node swallows at least one binary interior node, so there are no more of them than that, or one if
+     * the binary root is a leaf. Build into room for that many, then move the nodes into an allocation just big enough.
+     */
+    unsigned int capacity = std::max(1u, (bvh.get_nnodes() - 1) / 2);
+    unsigned char *build_storage;
+    Node *built = allocate(capacity, build_storage);
+    slots.assign(bvh.get_nnodes(), NoSlot);
+    collapse(bvh.get_nodes(), 0, built);
+
+    nodes = allocate(nnodes, storage);
+    memcpy(nodes, built, nnodes * sizeof(Node));
+    delete[] build_storage;
+
+    index_data = bvh.get_indices();
+}
+
+
+/*
+ * WideBVH::refit --
+ *
+ * Catch up with the binary tree this tree was built from after it was refit. changed is the list of binary nodes
+ * whose boxes changed, from BVH::refit(). Refitting may have moved the binary tree's indices, so they're picked up
+ * again too.
+ */
+void
+WideBVH::refit(const BVH &bvh,
+               const std::vector<unsigned int> &changed)
+{
+    const BVH::Node *binary = bvh.get_nodes();
+    for (unsigned int index : changed) {
+        unsigned int slot = slots[index];
+        if (slot != NoSlot) {
+            set_slot(nodes[slot / Width], slot % Width, binary[index].bounds);
+        }
+    }
+    index_data = bvh.get_indices();
+}
+
+
+/*
+ * WideBVH::clear --
+ *
+ * Throw away the tree.
+ */
+void
+WideBVH::clear()
+{
+    delete[] storage;
+    storage = NULL;
+    nodes = NULL;
+    nnodes = 0;
+    index_data = NULL;
+    slots.clear();
+}
+
+
+/*
+ * WideBVH::is_empty --
+ * WideBVH::get_nodes --
+ * WideBVH::get_nnodes --
+ *
+ * Accessors for the tree.
+ */
+bool
+WideBVH::is_empty()
+    const
+{
+    return nnodes == 0;
+}
+
+const WideBVH::Node *
+WideBVH::get_nodes()
+    const
+{
+    return nodes;
+}
+
+unsigned int
+WideBVH::get_nnodes()
+    const
+{
+    return nnodes;
+}
+
+
+/*
+ * WideBVH::allocate --
+ *
+ * Allocate room for n nodes on a cache line boundary, which new doesn't promise. Return the nodes; the allocation to
+ * free later is stored in allocation.
+ */
+WideBVH::Node *
+WideBVH::allocate(unsigned int n,
+                  unsigned char *&allocation)
+{
+    allocation = new unsigned char[n * sizeof(Node) + 63];
+    return (Node *)(((uintptr_t)allocation + 63) & ~(uintptr_t)63);
+}
+
+
+/*
+ * WideBVH::collapse --
+ *
+ * Make the wide node for the subtree of the binary tree rooted at binary[index], and all the wide nodes under it,
+ * starting at out[nnodes]. Return the index of the node. A binary leaf at the root becomes a wide node with one child.
+ */
+unsigned int
+WideBVH::collapse(const BVH::Node *binary,
+                  unsigned int index,
+                  Node *out)
+{
+    unsigned int children[Width];
+    unsigned int nchildren = 0;
+    if (binary[index].nprims > 0) {
+        children[nchildren++] = index;
+    }
+    else {
+        children[nchildren++] = index + 1;
+        children[nchildren++] = binary[index].offset;
+    }
+
+    while (nchildren < Width) {
+        int widest = -1;
+        float widest_area = -1.0f;
+        for (unsigned int i = 0; i < nchildren; i++) {
+            const BVH::Node &child = binary[children[i]];
+            if (child.nprims == 0 && child.bounds.surface_area() > widest_area) {
+                widest = i;
+                widest_area = child.bounds.surface_area();
+            }
+        }
+        if (widest < 0) {
+            break;
+        }
+        unsigned int opened = children[widest];
+        children[widest] = opened + 1;
+        children[nchildren++] = binary[opened].offset;
+    }
+
+    Node &node = out[nnodes];
+    unsigned int node_index = nnodes++;
+    for (unsigned int i = 0; i < Width; i++) {
+        set_slot(node, i, (i < nchildren) ? binary[children[i]].bounds : AABB());
+        node.child[i] = 0;
+        node.nprims[i] = 0;
+        if (i < nchildren) {
+            slots[children[i]] = node_index * Width + i;
+        }
+    }
+
+    for (unsigned int i = 0; i < nchildren; i++) {
+        const BVH::Node &child = binary[children[i]];
+        if (child.nprims > 0) {
+            node.child[i] = child.offset;
+            node.nprims[i] = child.nprims;
+        }
+        else {
+            node.child[i] = collapse(binary, children[i], out);
+        }
+    }
+
+    return node_index;
+}
+
+
+/*
+ * WideBVH::set_slot --
+ *
+ * Store the box of the child in slot of node.
+ */
+void
+WideBVH::set_slot(Node &node,
+                  unsigned int slot,
+                  const AABB &bounds)
+{
+    node.min_x[slot] = bounds.min.x;
+    node.min_y[slot] = bounds.min.y;
+    node.min_z[slot] = bounds.min.z;
+    node.max_x[slot] = bounds.max.x;
+    node.max_y[slot] = bounds.max.y;
+    node.max_z[slot] = bounds.max.z;
+}
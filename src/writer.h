@@ -2,6 +2,11 @@
  *
  * Writers handle the interface between (mostly) C libraries to write various image formats and the rest of Charles.
  *
+ * Every Writer can write a whole rendered Scene. Writers that can also stream take the image a tile at a time while
+ * it's still rendering, so the Scene never holds the whole image, and the file starts filling in as soon as the first
+ * tiles are done. A stream is opened with begin_image, fed finished tiles in any order with write_tile, from any
+ * number of threads at once, and closed with end_image.
+ *
  * Eryn Wells <eryn@erynwells.me>
  */
 
@@ -11,6 +16,7 @@
 #include <string>
 
 
+struct Color;
 class Scene;
 
 
@@ -22,6 +28,36 @@ public:
     { }
 
     virtual int write_scene(const Scene &scene, const std::string &filename) = 0;
+
+    virtual bool
+    can_stream()
+        const
+    {
+        return false;
+    }
+
+    virtual bool
+    begin_image(const std::string &filename,
+                int width,
+                int height)
+    {
+        return false;
+    }
+
+    // pixels holds the tile's rows one after another, width pixels each.
+    virtual void
+    write_tile(int x,
+               int y,
+               int width,
+               int height,
+               const Color *pixels)
+    { }
+
+    virtual int
+    end_image()
+    {
+        return -1;
+    }
 };
 
 #endif
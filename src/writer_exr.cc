@@ -0,0 +1,609 @@
+/* writer_exr.cc
+ *
+ * Definition of the OpenEXR writer.
+ *
+ * A file is a magic number and version, a header of attributes, a table of where each block of scan lines starts, and
+ * the blocks, each a line number, a size, and the block's samples. Within a block, each line stores all of its blue
+ * samples, then green, then red, since channels go in alphabetical order. Everything is little endian.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+#include "scene.h"
+#include "writer_exr.h"
+
+extern "C" {
+#include <zlib.h>
+}
+
+
+namespace {
+
+const uint32_t Magic = 20000630;
+
+// Version 2, with no flags set: a single part of scan lines, with short names.
+const uint32_t Version = 2;
+
+const int NumChannels = 3;
+
+const int32_t PixelTypeFloat = 2;
+
+const unsigned char LineOrderIncreasingY = 0;
+
+
+inline void
+put_uint32(std::vector<unsigned char> &out,
+           uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        out.push_back(value >> (8 * i));
+    }
+}
+
+
+inline void
+put_float(std::vector<unsigned char> &out,
+          float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_uint32(out, bits);
+}
+
+
+/*
+ * put_attribute --
+ *
+ * Start a header attribute: its name, its type, and the size of its value, which the caller puts next.
+ */
+void
+put_attribute(std::vector<unsigned char> &out,
+              const char *name,
+              const char *type,
+              uint32_t size)
+{
+    out.insert(out.end(), name, name + strlen(name) + 1);
+    out.insert(out.end(), type, type + strlen(type) + 1);
+    put_uint32(out, size);
+}
+
+
+/*
+ * make_header --
+ *
+ * Build everything in the file before the offset table.
+ */
+std::vector<unsigned char>
+make_header(int width,
+            int height,
+            EXRWriter::Compression compression)
+{
+    std::vector<unsigned char> out;
+    put_uint32(out, Magic);
+    put_uint32(out, Version);
+
+    // Each channel is its name, pixel type, linearity, three reserved bytes, and x and y sampling.
+    put_attribute(out, "channels", "chlist", NumChannels * 18 + 1);
+    for (const char *name = "BGR"; *name; name++) {
+        out.push_back(*name);
+        out.push_back('\0');
+        put_uint32(out, PixelTypeFloat);
+        out.insert(out.end(), 4, 0);
+        put_uint32(out, 1);
+        put_uint32(out, 1);
+    }
+    out.push_back('\0');
+
+    put_attribute(out, "compression", "compression", 1);
+    out.push_back(compression);
+    put_attribute(out, "dataWindow", "box2i", 16);
+    put_uint32(out, 0);
+    put_uint32(out, 0);
+    put_uint32(out, width - 1);
+    put_uint32(out, height - 1);
+    put_attribute(out, "displayWindow", "box2i", 16);
+    put_uint32(out, 0);
+    put_uint32(out, 0);
+    put_uint32(out, width - 1);
+    put_uint32(out, height - 1);
+    put_attribute(out, "lineOrder", "lineOrder", 1);
+    out.push_back(LineOrderIncreasingY);
+    put_attribute(out, "pixelAspectRatio", "float", 4);
+    put_float(out, 1.0);
+    put_attribute(out, "screenWindowCenter", "v2f", 8);
+    put_float(out, 0.0);
+    put_float(out, 0.0);
+    put_attribute(out, "screenWindowWidth", "float", 4);
+    put_float(out, 1.0);
+    out.push_back('\0');
+    return out;
+}
+
+
+inline int
+get_lines_per_block(EXRWriter::Compression compression)
+{
+    return (compression == EXRWriter::CompressionZIP) ? 16 : 1;
+}
+
+
+/*
+ * predict --
+ *
+ * Get a block ready for RLE or ZIP compression, as OpenEXR does. Its bytes are split in two, the even ones and then the
+ * odd ones, which puts the low bytes of the floats apart from their sign and exponent bytes. Then every byte is
+ * replaced by its difference from the byte before, so smooth runs of samples come out as runs of nearly equal bytes.
+ */
+void
+predict(const unsigned char *in,
+        size_t size,
+        unsigned char *out)
+{
+    unsigned char *evens = out, *odds = out + (size + 1) / 2;
+    for (size_t i = 0; i < size; i++) {
+        if (i % 2 == 0) {
+            *evens++ = in[i];
+        }
+        else {
+            *odds++ = in[i];
+        }
+    }
+
+    int prev = out[0];
+    for (size_t i = 1; i < size; i++) {
+        const int d = int(out[i]) - prev + (128 + 256);
+        prev = out[i];
+        out[i] = d;
+    }
+}
+
+
+/*
+ * rle_compress --
+ *
+ * Run length encode size bytes into out, which must have room for size + size / 64 + 2 bytes. A run of three or more
+ * equal bytes is stored as its length less one and the byte; anything else goes out as a negative count and the bytes
+ * themselves. Runs are at most 127 long either way. Return the encoded size.
+ */
+size_t
+rle_compress(const unsigned char *in,
+             size_t size,
+             unsigned char *out)
+{
+    const int MinRun = 3, MaxRun = 127;
+    const unsigned char *end = in + size;
+    const unsigned char *run_start = in, *run_end = in + 1;
+    unsigned char *o = out;
+
+    while (run_start < end) {
+        while (run_end < end && *run_start == *run_end && run_end - run_start - 1 < MaxRun) {
+            run_end++;
+        }
+        if (run_end - run_start >= MinRun) {
+            *o++ = (run_end - run_start) - 1;
+            *o++ = *run_start;
+            run_start = run_end;
+        }
+        else {
+            // Take bytes up to the start of the next run worth encoding.
+            while (run_end < end
+                   && ((run_end + 1 >= end || *run_end != *(run_end + 1))
+                       || (run_end + 2 >= end || *(run_end + 1) != *(run_end + 2)))
+                   && run_end - run_start < MaxRun) {
+                run_end++;
+            }
+            *o++ = (unsigned char)(signed char)(run_start - run_end);
+            while (run_start < run_end) {
+                *o++ = *run_start++;
+            }
+        }
+        run_end++;
+    }
+    return o - out;
+}
+
+
+/*
+ * make_chunk --
+ *
+ * Compress a block of samples, whose first line is y, into a chunk of the file. A block that doesn't get any smaller
+ * is stored as it is, which readers tell apart by its size.
+ */
+void
+make_chunk(int y,
+           const std::vector<float> &samples,
+           EXRWriter::Compression compression,
+           std::vector<unsigned char> &chunk)
+{
+    const unsigned char *raw = (const unsigned char *)samples.data();
+    const size_t raw_size = samples.size() * sizeof(float);
+
+    std::vector<unsigned char> compressed;
+    if (compression != EXRWriter::CompressionNone) {
+        std::vector<unsigned char> predicted(raw_size);
+        predict(raw, raw_size, predicted.data());
+        if (compression == EXRWriter::CompressionRLE) {
+            compressed.resize(raw_size + raw_size / 64 + 2);
+            compressed.resize(rle_compress(predicted.data(), raw_size, compressed.data()));
+        }
+        else {
+            uLongf size = compressBound(raw_size);
+            compressed.resize(size);
+            if (compress2(compressed.data(), &size, predicted.data(), raw_size, Z_DEFAULT_COMPRESSION) != Z_OK) {
+                size = raw_size;
+            }
+            compressed.resize(size);
+        }
+    }
+    if (compression == EXRWriter::CompressionNone || compressed.size() >= raw_size) {
+        compressed.assign(raw, raw + raw_size);
+    }
+
+    chunk.clear();
+    chunk.reserve(8 + compressed.size());
+    put_uint32(chunk, y);
+    put_uint32(chunk, compressed.size());
+    chunk.insert(chunk.end(), compressed.begin(), compressed.end());
+}
+
+
+/*
+ * little_endian --
+ *
+ * Put a sample in the file's byte order.
+ */
+inline float
+little_endian(float value)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits = __builtin_bswap32(bits);
+    memcpy(&value, &bits, sizeof(bits));
+#endif
+    return value;
+}
+
+} /* anonymous namespace */
+
+#pragma mark - Streams
+
+/*
+ * The state of an image being written. Lines wait in their blocks until the whole block has arrived; the thread that
+ * finishes a block compresses it, outside the lock. Compressed blocks are written in order as soon as the ones before
+ * them have been, and where each one went is filled into the offset table at the end.
+ */
+struct EXRWriter::Stream
+{
+    // A block waiting for the rest of its samples.
+    struct PendingBlock
+    {
+        std::vector<float> samples;
+        size_t npixels;
+    };
+
+    Stream();
+
+    int get_nlines(unsigned int block) const;
+
+    std::mutex mutex;
+    FILE *file;
+    std::string filename;
+    int width, height;
+    int lines_per_block;
+    unsigned int nblocks;
+    bool ok;
+
+    std::map<unsigned int, PendingBlock> blocks;
+
+    // Chunks compressed but waiting for the ones before them to be written, by block.
+    std::map<unsigned int, std::vector<unsigned char>> chunks;
+    unsigned int nwritten;
+
+    // Where the offset table is, where each block went, and the size of the file so far.
+    size_t table_offset;
+    std::vector<uint64_t> offsets;
+    size_t nbytes;
+};
+
+
+EXRWriter::Stream::Stream()
+    : file(NULL),
+      width(0),
+      height(0),
+      lines_per_block(1),
+      nblocks(0),
+      ok(true),
+      nwritten(0),
+      table_offset(0),
+      nbytes(0)
+{ }
+
+
+/*
+ * EXRWriter::Stream::get_nlines --
+ *
+ * Get the number of lines in the given block. Only the last can be short.
+ */
+int
+EXRWriter::Stream::get_nlines(unsigned int block)
+    const
+{
+    return std::min(lines_per_block, height - (int)block * lines_per_block);
+}
+
+#pragma mark - EXR Writer
+
+/*
+ * EXRWriter::EXRWriter --
+ *
+ * Default constructor. Write with ZIP compression, on one thread per hardware thread.
+ */
+EXRWriter::EXRWriter()
+    : compression(CompressionZIP),
+      nthreads(0),
+      stream(NULL)
+{ }
+
+
+/*
+ * EXRWriter::~EXRWriter --
+ *
+ * Destructor. Abandon any unfinished stream.
+ */
+EXRWriter::~EXRWriter()
+{
+    if (stream != NULL) {
+        fclose(stream->file);
+        delete stream;
+    }
+}
+
+
+/*
+ * EXRWriter::get_compression --
+ * EXRWriter::set_compression --
+ * EXRWriter::get_nthreads --
+ * EXRWriter::set_nthreads --
+ *
+ * Get and set the compression method, and the number of threads write_scene compresses with, where 0 means one per
+ * hardware thread.
+ */
+EXRWriter::Compression
+EXRWriter::get_compression()
+    const
+{
+    return compression;
+}
+
+void
+EXRWriter::set_compression(Compression c)
+{
+    compression = c;
+}
+
+unsigned int
+EXRWriter::get_nthreads()
+    const
+{
+    return nthreads;
+}
+
+void
+EXRWriter::set_nthreads(unsigned int n)
+{
+    nthreads = n;
+}
+
+
+/*
+ * EXRWriter::write_scene --
+ *
+ * Write the given scene to a file in OpenEXR format. The image is streamed a block at a time by a pool of threads,
+ * which take turns picking up the next block. Return the size of the file, or -1 if it couldn't be written.
+ */
+int
+EXRWriter::write_scene(const Scene &scene, const std::string &filename)
+{
+    if (!scene.is_rendered() || !begin_image(filename, scene.get_width(), scene.get_height())) {
+        return -1;
+    }
+
+    const Framebuffer &framebuffer = scene.get_framebuffer();
+    const int width = stream->width, lines_per_block = stream->lines_per_block;
+    const unsigned int nblocks = stream->nblocks;
+    unsigned int nworkers = (nthreads > 0) ? nthreads : std::thread::hardware_concurrency();
+    nworkers = std::max(1u, std::min(nworkers, nblocks));
+
+    std::atomic<unsigned int> next_block(0);
+    run_workers(nworkers, [&](unsigned int) {
+        std::vector<Color> buffer;
+        for (unsigned int b = next_block++; b < nblocks; b = next_block++) {
+            const int y = b * lines_per_block, nlines = stream->get_nlines(b);
+            write_tile(0, y, width, nlines, framebuffer.load_rows(y, nlines, buffer));
+        }
+    });
+    return end_image();
+}
+
+
+/*
+ * EXRWriter::can_stream --
+ * EXRWriter::begin_image --
+ *
+ * EXR files can be streamed. Start streaming a width x height image into the named file, and write its header and
+ * room for the offset table. Return false if the file couldn't be written.
+ */
+bool
+EXRWriter::can_stream()
+    const
+{
+    return true;
+}
+
+bool
+EXRWriter::begin_image(const std::string &filename,
+                       int width,
+                       int height)
+{
+    if (stream != NULL) {
+        fclose(stream->file);
+        delete stream;
+        stream = NULL;
+    }
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "%s: %s\n", filename.c_str(), strerror(errno));
+        return false;
+    }
+
+    const int lines_per_block = get_lines_per_block(compression);
+    const unsigned int nblocks = (height + lines_per_block - 1) / lines_per_block;
+    const std::vector<unsigned char> header = make_header(width, height, compression);
+    const std::vector<unsigned char> table(nblocks * sizeof(uint64_t), 0);
+    if (fwrite(header.data(), 1, header.size(), file) != header.size()
+        || fwrite(table.data(), 1, table.size(), file) != table.size()) {
+        fprintf(stderr, "%s: %s\n", filename.c_str(), strerror(errno));
+        fclose(file);
+        return false;
+    }
+
+    stream = new Stream();
+    stream->file = file;
+    stream->filename = filename;
+    stream->width = width;
+    stream->height = height;
+    stream->lines_per_block = lines_per_block;
+    stream->nblocks = nblocks;
+    stream->table_offset = header.size();
+    stream->offsets.resize(nblocks);
+    stream->nbytes = header.size() + table.size();
+    return true;
+}
+
+
+/*
+ * EXRWriter::write_tile --
+ *
+ * Take a finished tile of the image being streamed. Safe to call from many threads at once. The tile is split into
+ * channels before taking the stream's lock, and the blocks it finishes are compressed after letting it go, so threads
+ * only wait on each other to copy lines into their blocks and write out chunks.
+ */
+void
+EXRWriter::write_tile(int x,
+                      int y,
+                      int width,
+                      int height,
+                      const Color *pixels)
+{
+    Stream &s = *stream;
+
+    // Each line of the tile, as blue, then green, then red.
+    std::vector<float> channels(height * NumChannels * width);
+    for (int r = 0; r < height; r++) {
+        const Color *row = pixels + r * width;
+        float *blue = channels.data() + r * NumChannels * width, *green = blue + width, *red = green + width;
+        for (int i = 0; i < width; i++) {
+            blue[i] = little_endian(row[i].blue);
+            green[i] = little_endian(row[i].green);
+            red[i] = little_endian(row[i].red);
+        }
+    }
+
+    std::vector<std::pair<unsigned int, std::vector<float>>> finished;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (int r = 0; r < height; r++) {
+            const unsigned int b = (y + r) / s.lines_per_block;
+            Stream::PendingBlock &block = s.blocks[b];
+            if (block.samples.empty()) {
+                block.samples.resize(s.get_nlines(b) * NumChannels * s.width);
+                block.npixels = 0;
+            }
+            const int line = (y + r) % s.lines_per_block;
+            for (int c = 0; c < NumChannels; c++) {
+                memcpy(block.samples.data() + (line * NumChannels + c) * s.width + x,
+                       channels.data() + (r * NumChannels + c) * width, width * sizeof(float));
+            }
+            block.npixels += width;
+            if (block.npixels == (size_t)s.get_nlines(b) * s.width) {
+                finished.push_back(std::make_pair(b, std::vector<float>()));
+                finished.back().second.swap(block.samples);
+                s.blocks.erase(b);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < finished.size(); i++) {
+        const unsigned int b = finished[i].first;
+        std::vector<unsigned char> chunk;
+        make_chunk(b * s.lines_per_block, finished[i].second, compression, chunk);
+        finished[i].second.clear();
+        finished[i].second.shrink_to_fit();
+
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.chunks[b].swap(chunk);
+        std::map<unsigned int, std::vector<unsigned char>>::iterator it;
+        while ((it = s.chunks.find(s.nwritten)) != s.chunks.end()) {
+            s.offsets[s.nwritten] = s.nbytes;
+            if (s.ok && fwrite(it->second.data(), 1, it->second.size(), s.file) != it->second.size()) {
+                s.ok = false;
+            }
+            s.nbytes += it->second.size();
+            s.chunks.erase(it);
+            s.nwritten++;
+        }
+    }
+}
+
+
+/*
+ * EXRWriter::end_image --
+ *
+ * Finish the image being streamed by filling in the offset table. Every pixel must have been written. Return the size
+ * of the file, or -1 if it couldn't be written.
+ */
+int
+EXRWriter::end_image()
+{
+    if (stream == NULL) {
+        return -1;
+    }
+    Stream &s = *stream;
+    bool ok = s.ok && s.nwritten == s.nblocks;
+    if (ok) {
+        std::vector<unsigned char> table;
+        for (uint64_t offset : s.offsets) {
+            put_uint32(table, offset);
+            put_uint32(table, offset >> 32);
+        }
+        ok = fseek(s.file, s.table_offset, SEEK_SET) == 0
+          && fwrite(table.data(), 1, table.size(), s.file) == table.size();
+    }
+    ok = (fclose(s.file) == 0) && ok;
+
+    int nbytes = ok ? (int)s.nbytes : -1;
+    if (!ok) {
+        fprintf(stderr, "%s: couldn't write image\n", s.filename.c_str());
+    }
+    delete stream;
+    stream = NULL;
+    return nbytes;
+}
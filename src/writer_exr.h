@@ -0,0 +1,62 @@
+/* writer_exr.h
+ *
+ * Declaration of the OpenEXR writer.
+ *
+ * This writes the plainest kind of EXR file: one part of scan lines, with red, green, and blue channels of 32 bit
+ * floats, and only the header attributes every file must have. The floats are stored as they are, so the file holds
+ * exactly what the renderer produced. Scan lines are grouped into blocks, one line each for RLE and ZIPS and sixteen
+ * for ZIP, and each block is compressed on its own, so blocks compress in parallel: write_scene hands them out to a
+ * pool of threads, and streamed blocks are compressed by the render thread that finished them.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __WRITER_EXR_H__
+#define __WRITER_EXR_H__
+
+#include "writer.h"
+
+
+class EXRWriter
+    : public Writer
+{
+public:
+    // Compression methods, numbered as the file format numbers them.
+    enum Compression {
+        CompressionNone = 0,
+        CompressionRLE = 1,
+        CompressionZIPS = 2,
+        CompressionZIP = 3,
+    };
+
+    EXRWriter();
+    ~EXRWriter();
+
+    Compression get_compression() const;
+    void set_compression(Compression c);
+    unsigned int get_nthreads() const;
+    void set_nthreads(unsigned int n);
+
+    int write_scene(const Scene &scene, const std::string &filename);
+
+    bool can_stream() const;
+    bool begin_image(const std::string &filename, int width, int height);
+    void write_tile(int x, int y, int width, int height, const Color *pixels);
+    int end_image();
+
+private:
+    struct Stream;
+
+    EXRWriter(const EXRWriter &other);
+    EXRWriter &operator=(const EXRWriter &other);
+
+    Compression compression;
+
+    // Threads write_scene compresses with, or 0 for one per hardware thread.
+    unsigned int nthreads;
+
+    // The image being written, if there is one.
+    Stream *stream;
+};
+
+#endif
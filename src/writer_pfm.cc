@@ -0,0 +1,184 @@
+/* writer_pfm.cc
+ *
+ * Definition of the PFM writer.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "scene.h"
+#include "writer_pfm.h"
+
+
+namespace {
+
+// Bytes per pixel: three 32 bit floats.
+const size_t PixelSize = 3 * sizeof(float);
+
+} /* anonymous namespace */
+
+
+/*
+ * PFMWriter::PFMWriter --
+ *
+ * Default constructor.
+ */
+PFMWriter::PFMWriter()
+    : fd(-1),
+      image_width(0),
+      image_height(0),
+      header_size(0),
+      npixels(0),
+      ok(false)
+{ }
+
+
+/*
+ * PFMWriter::~PFMWriter --
+ *
+ * Destructor. Abandon any unfinished stream.
+ */
+PFMWriter::~PFMWriter()
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+
+/*
+ * PFMWriter::write_scene --
+ *
+ * Write the given scene to a file in PFM format, by streaming it a row at a time. Return the size of the file, or -1
+ * if it couldn't be written.
+ */
+int
+PFMWriter::write_scene(const Scene &scene, const std::string &filename)
+{
+    if (!scene.is_rendered() || !begin_image(filename, scene.get_width(), scene.get_height())) {
+        return -1;
+    }
+    const Framebuffer &framebuffer = scene.get_framebuffer();
+    std::vector<Color> buffer;
+    for (int y = 0; y < image_height; y++) {
+        write_tile(0, y, image_width, 1, framebuffer.load_rows(y, 1, buffer));
+    }
+    return end_image();
+}
+
+
+/*
+ * PFMWriter::can_stream --
+ * PFMWriter::begin_image --
+ *
+ * PFM files can be streamed. Start streaming a width x height image into the named file, and write its header. A
+ * negative scale in the header means the floats are little endian. Return false if the file couldn't be written.
+ */
+bool
+PFMWriter::can_stream()
+    const
+{
+    return true;
+}
+
+bool
+PFMWriter::begin_image(const std::string &name,
+                       int width,
+                       int height)
+{
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+
+    fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", name.c_str(), strerror(errno));
+        return false;
+    }
+
+    const uint16_t one = 1;
+    const bool little_endian = *(const unsigned char *)&one == 1;
+    char header[64];
+    header_size = snprintf(header, sizeof(header), "PF\n%d %d\n%s\n", width, height, little_endian ? "-1.0" : "1.0");
+    if (write(fd, header, header_size) != (ssize_t)header_size) {
+        fprintf(stderr, "%s: %s\n", name.c_str(), strerror(errno));
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    filename = name;
+    image_width = width;
+    image_height = height;
+    npixels = 0;
+    ok = true;
+    return true;
+}
+
+
+/*
+ * PFMWriter::write_tile --
+ *
+ * Take a finished tile of the image being streamed, and write each of its rows into place. Safe to call from many
+ * threads at once.
+ */
+void
+PFMWriter::write_tile(int x,
+                      int y,
+                      int width,
+                      int height,
+                      const Color *pixels)
+{
+    std::vector<float> rgb(width * 3);
+    for (int r = 0; r < height; r++) {
+        const Color *row = pixels + r * width;
+        for (int i = 0; i < width; i++) {
+            rgb[i * 3 + 0] = row[i].red;
+            rgb[i * 3 + 1] = row[i].green;
+            rgb[i * 3 + 2] = row[i].blue;
+        }
+
+        // Rows are stored bottom to top.
+        const off_t offset = header_size + ((off_t)(image_height - 1 - (y + r)) * image_width + x) * PixelSize;
+        const size_t size = width * PixelSize;
+        if (pwrite(fd, rgb.data(), size, offset) != (ssize_t)size) {
+            ok = false;
+        }
+    }
+    npixels += width * height;
+}
+
+
+/*
+ * PFMWriter::end_image --
+ *
+ * Finish the image being streamed. Every pixel must have been written. Return the size of the file, or -1 if it
+ * couldn't be written.
+ */
+int
+PFMWriter::end_image()
+{
+    if (fd < 0) {
+        return -1;
+    }
+    bool finished = ok && npixels == (size_t)image_width * image_height;
+    finished = (close(fd) == 0) && finished;
+    fd = -1;
+    if (!finished) {
+        fprintf(stderr, "%s: couldn't write image\n", filename.c_str());
+        return -1;
+    }
+    return header_size + (size_t)image_width * image_height * PixelSize;
+}
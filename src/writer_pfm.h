@@ -0,0 +1,54 @@
+/* writer_pfm.h
+ *
+ * Declaration of the PFM writer.
+ *
+ * PFM is the floating point cousin of PPM: a short text header, then red, green, and blue as 32 bit floats, a row at a
+ * time from the bottom of the image up. Nothing is clamped or quantized, so everything the renderer produced is kept.
+ * The header records the byte order, so the floats go out exactly as they are in memory, less their alpha channel.
+ *
+ * Every pixel has a fixed place in the file, so streamed tiles are written straight to it, from whichever thread
+ * finished them, with no reordering.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __WRITER_PFM_H__
+#define __WRITER_PFM_H__
+
+#include <atomic>
+#include <cstddef>
+
+#include "writer.h"
+
+
+class PFMWriter
+    : public Writer
+{
+public:
+    PFMWriter();
+    ~PFMWriter();
+
+    int write_scene(const Scene &scene, const std::string &filename);
+
+    bool can_stream() const;
+    bool begin_image(const std::string &filename, int width, int height);
+    void write_tile(int x, int y, int width, int height, const Color *pixels);
+    int end_image();
+
+private:
+    PFMWriter(const PFMWriter &other);
+    PFMWriter &operator=(const PFMWriter &other);
+
+    // The file being streamed into, or -1.
+    int fd;
+    std::string filename;
+    int image_width, image_height;
+
+    // Where the pixels start, after the header.
+    size_t header_size;
+
+    std::atomic<size_t> npixels;
+    std::atomic<bool> ok;
+};
+
+#endif
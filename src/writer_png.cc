@@ -1,132 +1,770 @@
-/* writer_png.c
+/* writer_png.cc
  *
  * Definition of the PNG writer.
  *
+ * The file is put together here rather than by libpng, which can only deflate on one thread: a signature, an IHDR
+ * chunk, one IDAT chunk per compressed strip, and an IEND chunk. The zlib header goes at the front of the first IDAT,
+ * and the Adler-32 checksum of the whole image, combined from the strips' checksums, at the end of the last.
+ *
  * Eryn Wells <eryn@erynwells.me>
  */
 
-#include <csetjmp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "basics.h"
+#include "parallel.h"
 #include "scene.h"
 #include "writer_png.h"
 
 extern "C" {
-#include <png.h>
+#include <zlib.h>
+}
+
+
+namespace {
+
+/*
+ * Strip sizing. Every strip costs about 30 bytes more than one long run of deflate would: its IDAT chunk header, the
+ * empty block the sync flush ends it with, and its own Huffman tables. That's nothing next to a noisy image, but a
+ * render with big flat areas can compress 500:1, and at pigz's 128 KB strips a 4K frame came out 17% bigger than
+ * libpng's. So images are cut into about TargetStrips strips, which is plenty to keep the threads busy, but no
+ * smaller than MinStripSize uncompressed bytes each. That leaves the same frame about 2% bigger.
+ */
+const size_t TargetStrips = 32;
+const size_t MinStripSize = 256 * 1024;
+
+// How far back deflate can refer, and so how much of the previous strip each strip is primed with.
+const size_t WindowSize = 32 * 1024;
+
+// Bytes per pixel: 8 bit RGB.
+const size_t PixelSize = 3;
+
+const unsigned char Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+
+/*
+ * get_strip_size --
+ *
+ * Uncompressed bytes per strip for an image with nbytes of filtered rows. It depends only on the image, so the file
+ * comes out the same however many threads write it.
+ */
+inline size_t
+get_strip_size(size_t nbytes)
+{
+    return std::max(MinStripSize, nbytes / TargetStrips);
+}
+
+
+inline void
+put_uint32(unsigned char *p,
+           uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+
+/*
+ * write_chunk --
+ *
+ * Write a PNG chunk: its length, type, data, and the CRC of its type and data. Return false if writing fails.
+ */
+bool
+write_chunk(FILE *file,
+            const char *type,
+            const unsigned char *data,
+            size_t size)
+{
+    unsigned char header[8], crc_bytes[4];
+    put_uint32(header, size);
+    memcpy(header + 4, type, 4);
+    uLong crc = crc32(0, header + 4, 4);
+    if (size > 0) {
+        crc = crc32(crc, data, size);
+    }
+    put_uint32(crc_bytes, crc);
+    return fwrite(header, 1, 8, file) == 8
+        && fwrite(data, 1, size, file) == size
+        && fwrite(crc_bytes, 1, 4, file) == 4;
+}
+
+
+/*
+ * convert_row --
+ *
+ * Convert a row of pixels to 8 bit RGB, clamping each channel to [0, 1] and rounding it to the nearest level. NaNs
+ * come out black. Both versions do the same arithmetic, with SSE's max returning its second operand for a NaN.
+ */
+void
+convert_row(const Color *pixels,
+            int width,
+            unsigned char *row)
+{
+#if defined(CHARLES_SIMD_SSE)
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 levels = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+    for (int x = 0; x < width; x++) {
+        const __m128 c = _mm_min_ps(_mm_max_ps(pixels[x].to_m128(), zero), one);
+        const __m128i i = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c, levels), half));
+        const uint32_t rgba = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packus_epi32(i, i), _mm_setzero_si128()));
+        row[x * 3 + 0] = rgba;
+        row[x * 3 + 1] = rgba >> 8;
+        row[x * 3 + 2] = rgba >> 16;
+    }
+#else
+    for (int x = 0; x < width; x++) {
+        const float c[3] = { pixels[x].red, pixels[x].green, pixels[x].blue };
+        for (int i = 0; i < 3; i++) {
+            float v = (c[i] > 0.0f) ? c[i] : 0.0f;
+            v = (v < 1.0f) ? v : 1.0f;
+            row[x * 3 + i] = (unsigned char)(v * 255.0f + 0.5f);
+        }
+    }
+#endif
+}
+
+
+inline unsigned char
+paeth(unsigned char a,
+      unsigned char b,
+      unsigned char c)
+{
+    const int p = a + b - c;
+    const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return a;
+    }
+    return (pb <= pc) ? b : c;
+}
+
+
+/*
+ * filter_row --
+ *
+ * Filter a row of n bytes with the given filter, which mustn't be Adaptive, into out. prev is the row above, or NULL
+ * for the first row, which has zeros above it. out[0] is the filter type, and the filtered bytes follow.
+ */
+void
+filter_row(PNGWriter::Filter filter,
+           const unsigned char *row,
+           const unsigned char *prev,
+           size_t n,
+           unsigned char *out)
+{
+    out[0] = filter;
+    out++;
+    if (prev == NULL && (filter == PNGWriter::FilterUp || filter == PNGWriter::FilterAverage
+                         || filter == PNGWriter::FilterPaeth)) {
+        // With nothing above, Up is None, Average halves the left byte, and Paeth is Sub.
+        for (size_t i = 0; i < n; i++) {
+            const unsigned char left = (i >= PixelSize) ? row[i - PixelSize] : 0;
+            switch (filter) {
+                case PNGWriter::FilterUp: out[i] = row[i]; break;
+                case PNGWriter::FilterAverage: out[i] = row[i] - (left >> 1); break;
+                default: out[i] = row[i] - left; break;
+            }
+        }
+        return;
+    }
+
+    switch (filter) {
+        case PNGWriter::FilterSub:
+            memcpy(out, row, PixelSize);
+            for (size_t i = PixelSize; i < n; i++) {
+                out[i] = row[i] - row[i - PixelSize];
+            }
+            break;
+        case PNGWriter::FilterUp:
+            for (size_t i = 0; i < n; i++) {
+                out[i] = row[i] - prev[i];
+            }
+            break;
+        case PNGWriter::FilterAverage:
+            for (size_t i = 0; i < PixelSize; i++) {
+                out[i] = row[i] - (prev[i] >> 1);
+            }
+            for (size_t i = PixelSize; i < n; i++) {
+                out[i] = row[i] - ((row[i - PixelSize] + prev[i]) >> 1);
+            }
+            break;
+        case PNGWriter::FilterPaeth:
+            for (size_t i = 0; i < PixelSize; i++) {
+                out[i] = row[i] - prev[i];
+            }
+            for (size_t i = PixelSize; i < n; i++) {
+                out[i] = row[i] - paeth(row[i - PixelSize], prev[i], prev[i - PixelSize]);
+            }
+            break;
+        default:
+            memcpy(out, row, n);
+            break;
+    }
+}
+
+
+/*
+ * filter_row_adaptively --
+ *
+ * Filter a row with whichever filter leaves the smallest sum of differences, counting each byte as signed, which is
+ * libpng's heuristic. scratch holds a filtered row.
+ */
+void
+filter_row_adaptively(const unsigned char *row,
+                      const unsigned char *prev,
+                      size_t n,
+                      unsigned char *out,
+                      unsigned char *scratch)
+{
+    unsigned long best_sum = ~0ul;
+    for (int f = PNGWriter::FilterNone; f <= PNGWriter::FilterPaeth; f++) {
+        filter_row((PNGWriter::Filter)f, row, prev, n, scratch);
+        unsigned long sum = 0;
+        for (size_t i = 1; i <= n && sum < best_sum; i++) {
+            sum += (scratch[i] < 128) ? scratch[i] : 256 - scratch[i];
+        }
+        if (sum < best_sum) {
+            best_sum = sum;
+            memcpy(out, scratch, n + 1);
+        }
+    }
+}
+
+
+
+/*
+ * filter_any_row --
+ *
+ * Filter a row with the given filter, or the best one for the row if it's Adaptive. scratch holds a filtered row.
+ */
+inline void
+filter_any_row(PNGWriter::Filter filter,
+               const unsigned char *row,
+               const unsigned char *prev,
+               size_t n,
+               unsigned char *out,
+               unsigned char *scratch)
+{
+    if (filter == PNGWriter::FilterAdaptive) {
+        filter_row_adaptively(row, prev, n, out, scratch);
+    }
+    else {
+        filter_row(filter, row, prev, n, out);
+    }
+}
+
+
+/*
+ * A strip of filtered rows, and what it compresses to. The size bytes at begin are the strip's own, and the dictionary
+ * bytes before them are the end of the strip before. Streamed strips keep their bytes in input; others point into the
+ * whole filtered image.
+ */
+struct Strip
+{
+    Strip()
+        : begin(NULL), size(0), dictionary(0), last(false), adler(0), ok(false)
+    { }
+
+    std::vector<unsigned char> input;
+    const unsigned char *begin;
+    size_t size, dictionary;
+    bool last;
+
+    std::vector<unsigned char> data;
+    uLong adler;
+    bool ok;
+};
+
+
+/*
+ * compress_strip --
+ *
+ * Deflate a strip into raw deflate data. The strip is primed with the end of the one before it, and every strip but
+ * the last is finished with a sync flush, which ends it on a byte boundary without ending the deflate stream.
+ */
+void
+compress_strip(Strip &strip,
+               int level,
+               int strategy)
+{
+    strip.ok = false;
+    strip.adler = adler32(adler32(0, NULL, 0), strip.begin, strip.size);
+
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, strategy) != Z_OK) {
+        return;
+    }
+    if (strip.dictionary > 0) {
+        deflateSetDictionary(&z, strip.begin - strip.dictionary, strip.dictionary);
+    }
+
+    // A sync flush adds an empty stored block, five bytes, past what deflateBound allows for.
+    strip.data.resize(deflateBound(&z, strip.size) + 16);
+    z.next_in = (Bytef *)strip.begin;
+    z.avail_in = strip.size;
+    z.next_out = strip.data.data();
+    z.avail_out = strip.data.size();
+    int status = deflate(&z, strip.last ? Z_FINISH : Z_SYNC_FLUSH);
+    strip.ok = strip.last ? (status == Z_STREAM_END) : (status == Z_OK && z.avail_in == 0 && z.avail_out > 0);
+    strip.data.resize(z.total_out);
+    deflateEnd(&z);
 }
 
 
-static void png_user_error(png_structp png, png_const_charp msg);
-static void png_user_warning(png_structp png, png_const_charp msg);
+/*
+ * write_header --
+ *
+ * Write the PNG signature and IHDR chunk: 8 bit RGB, deflate compression, adaptive filtering (which allows any filter
+ * on any row), and no interlacing. Return false if writing fails.
+ */
+bool
+write_header(FILE *file,
+             int width,
+             int height)
+{
+    unsigned char ihdr[13];
+    put_uint32(ihdr, width);
+    put_uint32(ihdr + 4, height);
+    ihdr[8] = 8;
+    ihdr[9] = 2;
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    return fwrite(Signature, 1, sizeof(Signature), file) == sizeof(Signature)
+        && write_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+}
+
+
+/*
+ * write_strip --
+ *
+ * Write a compressed strip as an IDAT chunk, in order after the ones before it, and add its size to nbytes. The first
+ * strip gets the zlib header on its front, and the last the checksum of the whole image, which adler accumulates as
+ * the strips go by. Return false if the strip couldn't be compressed or written.
+ */
+bool
+write_strip(FILE *file,
+            Strip &strip,
+            bool first,
+            int level,
+            uLong &adler,
+            size_t &nbytes)
+{
+    if (!strip.ok) {
+        return false;
+    }
+    if (first) {
+        const unsigned int level_flags = (level < 2) ? 0 : (level < 6) ? 1 : (level == 6) ? 2 : 3;
+        unsigned char zlib_header[2] = { 0x78, (unsigned char)(level_flags << 6) };
+        zlib_header[1] += (31 - (zlib_header[0] * 256 + zlib_header[1]) % 31) % 31;
+        strip.data.insert(strip.data.begin(), zlib_header, zlib_header + 2);
+        adler = adler32(0, NULL, 0);
+    }
+    adler = adler32_combine(adler, strip.adler, strip.size);
+    if (strip.last) {
+        unsigned char adler_bytes[4];
+        put_uint32(adler_bytes, adler);
+        strip.data.insert(strip.data.end(), adler_bytes, adler_bytes + 4);
+    }
+    nbytes += 12 + strip.data.size();
+    return write_chunk(file, "IDAT", strip.data.data(), strip.data.size());
+}
+
+
+inline int
+get_strategy(PNGWriter::Filter filter)
+{
+    return (filter == PNGWriter::FilterNone) ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+}
+
+} /* anonymous namespace */
+
+#pragma mark - Streams
+
+/*
+ * The state of an image being streamed. Tiles arrive in any order, so rows wait in a reorder buffer until everything
+ * above them has been filtered; writer_png.h says how big that can get. Filtered rows pile up until there's a strip's
+ * worth, which the thread that finished it compresses, outside the lock; strips are written in order as soon as the
+ * ones before them have been.
+ */
+struct PNGWriter::Stream
+{
+    // A row waiting for the rest of its pixels.
+    struct PendingRow
+    {
+        std::vector<unsigned char> rgb;
+        int npixels;
+    };
+
+    Stream();
+
+    std::mutex mutex;
+    FILE *file;
+    std::string filename;
+    int width, height;
+    bool ok;
+    size_t nbytes;
+
+    std::map<int, PendingRow> rows;
+    int next_row;
+    std::vector<unsigned char> prev, scratch;
+
+    // Filtered rows not yet cut into a strip, after the dictionary bytes that end the strip before.
+    std::vector<unsigned char> strip;
+    size_t dictionary, strip_size;
+
+    // Strips compressed but waiting for the ones before them to be written, by number.
+    std::map<unsigned int, Strip> compressed;
+    unsigned int nstrips, nwritten;
+    uLong adler;
+};
+
+
+PNGWriter::Stream::Stream()
+    : file(NULL),
+      width(0),
+      height(0),
+      ok(true),
+      nbytes(0),
+      next_row(0),
+      dictionary(0),
+      strip_size(0),
+      nstrips(0),
+      nwritten(0),
+      adler(0)
+{ }
+
+#pragma mark - PNG Writer
+
+/*
+ * PNGWriter::PNGWriter --
+ *
+ * Default constructor. Write with zlib's default level and adaptive filtering, on one thread per hardware thread.
+ */
+PNGWriter::PNGWriter()
+    : level(6),
+      filter(FilterAdaptive),
+      nthreads(0),
+      stream(NULL)
+{ }
+
+
+/*
+ * PNGWriter::~PNGWriter --
+ *
+ * Destructor. Abandon any unfinished stream.
+ */
+PNGWriter::~PNGWriter()
+{
+    if (stream != NULL) {
+        fclose(stream->file);
+        delete stream;
+    }
+}
+
+
+/*
+ * PNGWriter::get_level --
+ * PNGWriter::set_level --
+ * PNGWriter::get_filter --
+ * PNGWriter::set_filter --
+ * PNGWriter::get_nthreads --
+ * PNGWriter::set_nthreads --
+ *
+ * Get and set the compression level, from 0 to 9, the filter, and the number of threads write_scene encodes with,
+ * where 0 means one per hardware thread. Levels out of range are clamped. Streamed images are encoded by the threads
+ * that hand in their tiles.
+ */
+int
+PNGWriter::get_level()
+    const
+{
+    return level;
+}
+
+void
+PNGWriter::set_level(int l)
+{
+    level = std::max(0, std::min(l, 9));
+}
+
+PNGWriter::Filter
+PNGWriter::get_filter()
+    const
+{
+    return filter;
+}
+
+void
+PNGWriter::set_filter(Filter f)
+{
+    filter = f;
+}
+
+unsigned int
+PNGWriter::get_nthreads()
+    const
+{
+    return nthreads;
+}
+
+void
+PNGWriter::set_nthreads(unsigned int n)
+{
+    nthreads = n;
+}
 
 
 /*
  * PNGWriter::write_scene --
  *
- * Write the given scene to a file in PNG format.
+ * Write the given scene to a file in PNG format. First the rows are converted and filtered, a share of them per
+ * thread, into one buffer; each thread converts the row before its share too, since filters look at the row above.
+ * Then the buffer is cut into strips, which the threads take turns compressing. Return the size of the file, or -1 if
+ * it couldn't be written.
  */
 int
 PNGWriter::write_scene(const Scene &scene, const std::string &filename)
 {
-    if (!scene.is_rendered()) {
+    if (!scene.is_rendered() || scene.get_width() <= 0 || scene.get_height() <= 0) {
         return -1;
     }
 
-    FILE *file = fopen(filename.c_str(), "wb");
-    if (!file) {
-        return -1;
-    }
+    const int width = scene.get_width(), height = scene.get_height();
+    const size_t row_size = width * PixelSize;
+    const size_t filtered_size = row_size + 1;
+    unsigned int nworkers = (nthreads > 0) ? nthreads : std::thread::hardware_concurrency();
+    nworkers = std::max(1u, std::min(nworkers, (unsigned int)height));
 
-    // Set up the PNG data structures. libpng requires two: a PNG object and an info object.
-    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, png_user_error, png_user_warning);
-    if (!png) {
-        return -3;
-    }
-    png_infop png_info = png_create_info_struct(png);
-    if (!png_info) {
-        return -4;
-    }
-
-    // Set up libpng error handling. If an error occurs, libpng will longjmp back here... (Wat.)
-    if (setjmp(png_jmpbuf(png))) {
-        png_destroy_write_struct(&png, &png_info);
-        return -5;
-    }
-
-    /*
-     * Tell libpng about basic parameters for the image:
-     *   - 8 bit depth
-     *   - RGB (no alpha)
-     *   - No interlacing
-     *   - No compression
-     */
-    png_set_IHDR(png, png_info,
-                 scene.get_width(), scene.get_height(),
-                 8, PNG_COLOR_TYPE_RGB,
-                 PNG_INTERLACE_NONE,
-                 PNG_COMPRESSION_TYPE_DEFAULT,
-                 PNG_FILTER_TYPE_DEFAULT);
-
-    // Set up output.
-    png_init_io(png, file);
-
-    // Write header information.
-    png_write_info(png, png_info);
-
-    // Write it!
-    const Color *pixels = scene.get_pixels();
-    png_byte *row = NULL;
-    int nbytes = 0;
-    for (int y = 0; y < scene.get_height(); y++) {
-        row = new png_byte[scene.get_width() * 3];
-        if (row == NULL) {
-            // TODO: DANGER! WILL ROBINSON!
+    std::vector<unsigned char> image(filtered_size * height);
+    const Framebuffer &framebuffer = scene.get_framebuffer();
+    run_workers(nworkers, [&](unsigned int w) {
+        unsigned int begin, end;
+        split_range(height, w, nworkers, begin, end);
+        std::vector<unsigned char> rows(2 * row_size), scratch(filtered_size);
+        std::vector<Color> buffer;
+        unsigned char *row = rows.data(), *prev = rows.data() + row_size;
+        if (begin > 0) {
+            convert_row(framebuffer.load_rows(begin - 1, 1, buffer), width, prev);
         }
-        for (int x = 0; x < scene.get_width(); x++) {
-            Color c = pixels[y * scene.get_width() + x];
-            row[x*3+0] = 0xff * c.red;
-            row[x*3+1] = 0xff * c.green;
-            row[x*3+2] = 0xff * c.blue;
-            nbytes += 3;
-
+        for (unsigned int y = begin; y < end; y++) {
+            convert_row(framebuffer.load_rows(y, 1, buffer), width, row);
+            filter_any_row(filter, row, (y > 0) ? prev : NULL, row_size, image.data() + y * filtered_size,
+                           scratch.data());
+            std::swap(row, prev);
         }
-        png_write_row(png, row);
-        delete[] row;
+    });
+
+    // Cut the image into strips of whole rows.
+    const size_t rows_per_strip = std::max((size_t)1, get_strip_size(image.size()) / filtered_size);
+    std::vector<Strip> strips((height + rows_per_strip - 1) / rows_per_strip);
+    for (size_t i = 0; i < strips.size(); i++) {
+        const size_t begin = i * rows_per_strip * filtered_size;
+        strips[i].begin = image.data() + begin;
+        strips[i].size = std::min(image.size(), begin + rows_per_strip * filtered_size) - begin;
+        strips[i].dictionary = std::min(begin, WindowSize);
+        strips[i].last = (i + 1 == strips.size());
     }
+    std::atomic<size_t> next_strip(0);
+    run_workers(std::min(nworkers, (unsigned int)strips.size()), [&](unsigned int) {
+        for (size_t i = next_strip++; i < strips.size(); i = next_strip++) {
+            compress_strip(strips[i], level, get_strategy(filter));
+        }
+    });
 
-    // Clean up!
-    png_write_end(png, png_info);
-    png_destroy_write_struct(&png, &png_info);
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "%s: %s\n", filename.c_str(), strerror(errno));
+        return -1;
+    }
+    size_t nbytes = sizeof(Signature) + (12 + 13) + 12;
+    uLong adler = 0;
+    bool ok = write_header(file, width, height);
+    for (size_t i = 0; ok && i < strips.size(); i++) {
+        ok = write_strip(file, strips[i], i == 0, level, adler, nbytes);
+    }
+    ok = ok && write_chunk(file, "IEND", NULL, 0);
 
-    // Return number of bytes written.
+    if (fclose(file) != 0 || !ok) {
+        fprintf(stderr, "%s: couldn't write image\n", filename.c_str());
+        return -1;
+    }
     return nbytes;
 }
 
 
 /*
- * png_user_error --
+ * PNGWriter::can_stream --
+ * PNGWriter::begin_image --
  *
- * Called by libpng when it encounters an error.
+ * PNG files can be streamed. Start streaming a width x height image into the named file, and write its header. Return
+ * false if the file couldn't be written.
  */
+bool
+PNGWriter::can_stream()
+    const
+{
+    return true;
+}
 
-/* static */ void
-png_user_error(png_structp png,
-               png_const_charp msg)
+bool
+PNGWriter::begin_image(const std::string &filename,
+                       int width,
+                       int height)
 {
+    if (stream != NULL) {
+        fclose(stream->file);
+        delete stream;
+        stream = NULL;
+    }
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
 
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "%s: %s\n", filename.c_str(), strerror(errno));
+        return false;
+    }
+    if (!write_header(file, width, height)) {
+        fprintf(stderr, "%s: %s\n", filename.c_str(), strerror(errno));
+        fclose(file);
+        return false;
+    }
+
+    stream = new Stream();
+    stream->file = file;
+    stream->filename = filename;
+    stream->width = width;
+    stream->height = height;
+    stream->nbytes = sizeof(Signature) + (12 + 13);
+    stream->strip_size = get_strip_size((width * PixelSize + 1) * (size_t)height);
+    stream->prev.resize(width * PixelSize);
+    stream->scratch.resize(width * PixelSize + 1);
+    return true;
 }
 
 
 /*
- * png_user_warning --
+ * PNGWriter::write_tile --
  *
- * Called by libpng when it encounters an warning.
+ * Take a finished tile of the image being streamed. Safe to call from many threads at once. Its pixels are converted
+ * before taking the stream's lock, and its strip, if it finishes one, compressed after letting it go, so threads only
+ * wait on each other to copy rows, filter them, and write out strips.
  */
+void
+PNGWriter::write_tile(int x,
+                      int y,
+                      int width,
+                      int height,
+                      const Color *pixels)
+{
+    Stream &s = *stream;
+    const size_t row_size = s.width * PixelSize;
+    const size_t filtered_size = row_size + 1;
+
+    std::vector<unsigned char> rgb(width * height * PixelSize);
+    for (int r = 0; r < height; r++) {
+        convert_row(pixels + r * width, width, rgb.data() + r * width * PixelSize);
+    }
+
+    std::vector<Strip> cut;
+    unsigned int first_strip;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (int r = 0; r < height; r++) {
+            Stream::PendingRow &row = s.rows[y + r];
+            if (row.rgb.empty()) {
+                row.rgb.resize(row_size);
+                row.npixels = 0;
+            }
+            memcpy(row.rgb.data() + x * PixelSize, rgb.data() + r * width * PixelSize, width * PixelSize);
+            row.npixels += width;
+        }
+
+        std::map<int, Stream::PendingRow>::iterator it;
+        while ((it = s.rows.find(s.next_row)) != s.rows.end() && it->second.npixels == s.width) {
+            const size_t end = s.strip.size();
+            s.strip.resize(end + filtered_size);
+            filter_any_row(filter, it->second.rgb.data(), (s.next_row > 0) ? s.prev.data() : NULL, row_size,
+                           s.strip.data() + end, s.scratch.data());
+            s.prev.swap(it->second.rgb);
+            s.rows.erase(it);
+            s.next_row++;
 
-/* static */ void
-png_user_warning(png_structp png,
-                 png_const_charp msg)
+            const bool last = (s.next_row == s.height);
+            if (s.strip.size() - s.dictionary >= s.strip_size || last) {
+                Strip strip;
+                strip.input.swap(s.strip);
+                strip.dictionary = s.dictionary;
+                strip.size = strip.input.size() - s.dictionary;
+                strip.last = last;
+                s.dictionary = std::min(strip.size, WindowSize);
+                s.strip.assign(strip.input.end() - s.dictionary, strip.input.end());
+                cut.push_back(std::move(strip));
+            }
+        }
+        first_strip = s.nstrips;
+        s.nstrips += cut.size();
+    }
+
+    for (size_t i = 0; i < cut.size(); i++) {
+        Strip &strip = cut[i];
+        strip.begin = strip.input.data() + strip.dictionary;
+        compress_strip(strip, level, get_strategy(filter));
+        strip.input.clear();
+        strip.input.shrink_to_fit();
+
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.compressed[first_strip + i] = std::move(strip);
+        std::map<unsigned int, Strip>::iterator it;
+        while ((it = s.compressed.find(s.nwritten)) != s.compressed.end()) {
+            if (s.ok && !write_strip(s.file, it->second, s.nwritten == 0, level, s.adler, s.nbytes)) {
+                s.ok = false;
+            }
+            s.compressed.erase(it);
+            s.nwritten++;
+        }
+    }
+}
+
+
+/*
+ * PNGWriter::end_image --
+ *
+ * Finish the image being streamed. Every pixel must have been written. Return the size of the file, or -1 if it
+ * couldn't be written.
+ */
+int
+PNGWriter::end_image()
 {
+    if (stream == NULL) {
+        return -1;
+    }
+    Stream &s = *stream;
+    bool ok = s.ok && s.next_row == s.height && s.nwritten == s.nstrips;
+    if (ok) {
+        ok = write_chunk(s.file, "IEND", NULL, 0);
+        s.nbytes += 12;
+    }
+    ok = (fclose(s.file) == 0) && ok;
 
+    int nbytes = ok ? (int)s.nbytes : -1;
+    if (!ok) {
+        fprintf(stderr, "%s: couldn't write image\n", s.filename.c_str());
+    }
+    delete stream;
+    stream = NULL;
+    return nbytes;
 }
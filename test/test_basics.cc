@@ -157,3 +157,100 @@ TEST_F(Vector3Test, DotProduct)
 {
     EXPECT_EQ(131.0, v1.dot(v2));
 }
+
+
+TEST_F(Vector3Test, CrossProduct)
+{
+    EXPECT_EQ(Vector3::Z, Vector3::X.cross(Vector3::Y));
+    EXPECT_EQ(Vector3::X, Vector3::Y.cross(Vector3::Z));
+    EXPECT_EQ(Vector3(-14, 18, -8), v1.cross(v2));
+}
+
+
+#if !defined(CHARLES_SIMD_SSE)
+TEST_F(Vector3Test, Constexpr)
+{
+    constexpr Vector3 a(1, 3, 5);
+    constexpr Vector3 b(7, 13, 17);
+    static_assert((a + b) == Vector3(8, 16, 22), "constexpr addition");
+    static_assert(a.dot(b) == 131.0, "constexpr dot product");
+    static_assert(a[2] == 5.0, "constexpr component access");
+}
+#endif
+
+
+class ColorTest
+    : public ::testing::Test
+{
+public:
+    virtual void SetUp();
+
+protected:
+    Color c1, c2;
+};
+
+
+void
+ColorTest::SetUp()
+{
+    c1 = Color(0.25, 0.5, 0.75, 0.5);
+    c2 = Color(0.5, 0.25, 0.125, 1.0);
+}
+
+
+TEST_F(ColorTest, ScalarMulLeavesAlpha)
+{
+    Color out = c1 * 2;
+    EXPECT_EQ(0.5, out.red);
+    EXPECT_EQ(1.0, out.green);
+    EXPECT_EQ(1.5, out.blue);
+    EXPECT_EQ(0.5, out.alpha);
+
+    out = 2 * c1;
+    EXPECT_EQ(0.5, out.red);
+    EXPECT_EQ(0.5, out.alpha);
+
+    out = c1 / 2;
+    EXPECT_EQ(0.125, out.red);
+    EXPECT_EQ(0.25, out.green);
+    EXPECT_EQ(0.375, out.blue);
+    EXPECT_EQ(0.5, out.alpha);
+}
+
+
+TEST_F(ColorTest, ScalarAddIncludesAlpha)
+{
+    Color out = c1 + 0.25;
+    EXPECT_EQ(0.5, out.red);
+    EXPECT_EQ(0.75, out.green);
+    EXPECT_EQ(1.0, out.blue);
+    EXPECT_EQ(0.75, out.alpha);
+
+    out -= 0.25;
+    EXPECT_EQ(c1.red, out.red);
+    EXPECT_EQ(c1.alpha, out.alpha);
+}
+
+
+TEST_F(ColorTest, Blend)
+{
+    Color out = c1 * c2;
+    EXPECT_EQ(0.125, out.red);
+    EXPECT_EQ(0.125, out.green);
+    EXPECT_EQ(0.09375, out.blue);
+    EXPECT_EQ(0.5, out.alpha);
+
+    out = c1 / c2;
+    EXPECT_EQ(0.5, out.red);
+    EXPECT_EQ(2.0, out.green);
+    EXPECT_EQ(6.0, out.blue);
+    EXPECT_EQ(0.5, out.alpha);
+
+    out = c1 + c2;
+    EXPECT_EQ(0.75, out.red);
+    EXPECT_EQ(1.5, out.alpha);
+
+    out = c1 - c2;
+    EXPECT_EQ(-0.25, out.red);
+    EXPECT_EQ(-0.5, out.alpha);
+}
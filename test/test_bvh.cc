@@ -0,0 +1,348 @@
+/* test_bvh.cc
+ *
+ * Unit tests for the bvh module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "bvh.h"
+#include "object_sphere.h"
+#include "test_helpers.h"
+
+
+class BVHTest
+    : public ::testing::Test
+{
+public:
+    virtual void SetUp();
+    virtual void TearDown();
+
+protected:
+    float nearest_hit(const Sphere *s, const Ray &ray);
+
+    std::vector<Sphere *> spheres;
+    BVH bvh;
+};
+
+
+void
+BVHTest::SetUp()
+{
+    spheres = random_spheres(1000, 100, 0.5, 5);
+    bvh.build(sphere_bounds(spheres));
+}
+
+
+void
+BVHTest::TearDown()
+{
+    for (Sphere *s : spheres) {
+        delete s;
+    }
+}
+
+
+float
+BVHTest::nearest_hit(const Sphere *s, const Ray &ray)
+{
+    Intersection hit;
+    return s->intersect(ray, 0.0, INFINITY, hit) ? hit.t : INFINITY;
+}
+
+
+TEST_F(BVHTest, BoundsContainAllPrimitives)
+{
+    const BVH::Node &root = bvh.get_nodes()[0];
+    AABB b;
+    for (Sphere *s : spheres) {
+        s->compute_bounds(b);
+        EXPECT_LE(root.bounds.min.x, b.min.x);
+        EXPECT_LE(root.bounds.min.y, b.min.y);
+        EXPECT_LE(root.bounds.min.z, b.min.z);
+        EXPECT_GE(root.bounds.max.x, b.max.x);
+        EXPECT_GE(root.bounds.max.y, b.max.y);
+        EXPECT_GE(root.bounds.max.z, b.max.z);
+    }
+    EXPECT_EQ(spheres.size(), bvh.get_nindices());
+}
+
+
+TEST_F(BVHTest, NearestHitMatchesBruteForce)
+{
+    for (int i = 0; i < 1000; i++) {
+        Vector3 o(random_float(-150, 150), random_float(-150, 150), random_float(-150, 150));
+        Vector3 target(random_float(-100, 100), random_float(-100, 100), random_float(-100, 100));
+        Ray ray(o, (target - o).normalize());
+
+        float expected = INFINITY;
+        for (Sphere *s : spheres) {
+            expected = fminf(expected, nearest_hit(s, ray));
+        }
+
+        float tmax = INFINITY;
+        bvh.intersect(ray, 0.0, tmax, [&](unsigned int index, float tmin, float &tmax) {
+            float t = nearest_hit(spheres[index], ray);
+            if (t < tmax) {
+                tmax = t;
+                return true;
+            }
+            return false;
+        });
+
+        EXPECT_EQ(expected, tmax);
+    }
+}
+
+
+TEST_F(BVHTest, AdoptedTreeMatchesBuiltTree)
+{
+    std::vector<BVH::Node> nodes(bvh.get_nodes(), bvh.get_nodes() + bvh.get_nnodes());
+    std::vector<unsigned int> indices(bvh.get_indices(), bvh.get_indices() + bvh.get_nindices());
+
+    BVH adopted;
+    ASSERT_TRUE(adopted.adopt(nodes.data(), nodes.size(), indices.data(), indices.size()));
+
+    for (int i = 0; i < 100; i++) {
+        Ray ray(Vector3(random_float(-150, 150), random_float(-150, 150), -200), Vector3::Z);
+        auto intersect = [&](unsigned int index, float tmin, float &tmax) {
+            float t = nearest_hit(spheres[index], ray);
+            if (t < tmax) {
+                tmax = t;
+                return true;
+            }
+            return false;
+        };
+        float t1 = INFINITY, t2 = INFINITY;
+        bvh.intersect(ray, 0.0, t1, intersect);
+        adopted.intersect(ray, 0.0, t2, intersect);
+        EXPECT_EQ(t1, t2);
+    }
+
+    // Children pointing backwards, or primitives out of range, are rejected.
+    nodes[0].offset = 0;
+    EXPECT_FALSE(adopted.adopt(nodes.data(), nodes.size(), indices.data(), indices.size()));
+    EXPECT_TRUE(adopted.is_empty());
+}
+
+
+TEST_F(BVHTest, LinearTreeMatchesBruteForce)
+{
+    std::vector<AABB> bounds;
+    AABB b;
+    for (Sphere *s : spheres) {
+        s->compute_bounds(b);
+        bounds.push_back(b);
+    }
+    BVH linear;
+    linear.build_linear(bounds, 4);
+
+    for (int i = 0; i < 1000; i++) {
+        Vector3 o(random_float(-150, 150), random_float(-150, 150), random_float(-150, 150));
+        Vector3 target(random_float(-100, 100), random_float(-100, 100), random_float(-100, 100));
+        Ray ray(o, (target - o).normalize());
+
+        float expected = INFINITY;
+        for (Sphere *s : spheres) {
+            expected = fminf(expected, nearest_hit(s, ray));
+        }
+
+        float tmax = INFINITY;
+        linear.intersect(ray, 0.0, tmax, [&](unsigned int index, float tmin, float &tmax) {
+            float t = nearest_hit(spheres[index], ray);
+            if (t < tmax) {
+                tmax = t;
+                return true;
+            }
+            return false;
+        });
+
+        EXPECT_EQ(expected, tmax);
+    }
+}
+
+
+TEST_F(BVHTest, ParallelLinearTreeIsConsistent)
+{
+    // Enough boxes, some of them duplicates, that the build is split across workers.
+    std::vector<AABB> bounds;
+    for (int i = 0; i < 40000; i++) {
+        Vector3 c(random_float(-100, 100), random_float(-100, 100), random_float(-100, 100));
+        if (i % 10 == 0) {
+            c = Vector3(1, 2, 3);
+        }
+        bounds.push_back(AABB(c - Vector3(0.5, 0.5, 0.5), c + Vector3(0.5, 0.5, 0.5)));
+    }
+
+    BVH serial, parallel;
+    serial.build_linear(bounds, 1, 1);
+    parallel.build_linear(bounds, 1, 4);
+
+    // The workers make exactly the tree one would.
+    ASSERT_EQ(serial.get_nnodes(), parallel.get_nnodes());
+    ASSERT_EQ(serial.get_nindices(), parallel.get_nindices());
+    for (unsigned int i = 0; i < serial.get_nnodes(); i++) {
+        const BVH::Node &a = serial.get_nodes()[i], &b = parallel.get_nodes()[i];
+        EXPECT_EQ(a.offset, b.offset);
+        EXPECT_EQ(a.nprims, b.nprims);
+        EXPECT_EQ(a.axis, b.axis);
+    }
+    for (unsigned int i = 0; i < serial.get_nindices(); i++) {
+        EXPECT_EQ(serial.get_indices()[i], parallel.get_indices()[i]);
+    }
+
+    // It's well formed, every primitive is in exactly one leaf, and every box holds everything under it.
+    const BVH::Node *nodes = parallel.get_nodes();
+    BVH adopted;
+    EXPECT_TRUE(adopted.adopt(nodes, parallel.get_nnodes(), parallel.get_indices(), parallel.get_nindices()));
+
+    auto contains = [](const AABB &outer, const AABB &inner) {
+        return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z
+            && outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+    };
+    std::vector<int> seen(bounds.size(), 0);
+    for (unsigned int i = 0; i < parallel.get_nnodes(); i++) {
+        const BVH::Node &node = nodes[i];
+        if (node.nprims > 0) {
+            EXPECT_LE(node.nprims, (unsigned int)BVH::MaxLeafSize);
+            for (unsigned int j = node.offset; j < node.offset + node.nprims; j++) {
+                unsigned int prim = parallel.get_indices()[j];
+                seen[prim]++;
+                EXPECT_TRUE(contains(node.bounds, bounds[prim]));
+            }
+        }
+        else {
+            EXPECT_TRUE(contains(node.bounds, nodes[i + 1].bounds));
+            EXPECT_TRUE(contains(node.bounds, nodes[node.offset].bounds));
+        }
+    }
+    for (unsigned int i = 0; i < bounds.size(); i++) {
+        EXPECT_EQ(1, seen[i]);
+    }
+}
+
+
+TEST_F(BVHTest, PacketHitsMatchSingleRays)
+{
+    auto nearest = [&](const Ray &ray, const unsigned int *prims, unsigned int n, float &tmax) {
+        bool hit = false;
+        for (unsigned int i = 0; i < n; i++) {
+            float t = nearest_hit(spheres[prims[i]], ray);
+            if (t < tmax) {
+                tmax = t;
+                hit = true;
+            }
+        }
+        return hit;
+    };
+
+    for (int i = 0; i < 200; i++) {
+        // Alternate between parallel rays through a block of pixels and rays fanning out from a point.
+        RayPacket packet;
+        Vector3 corner(random_float(-120, 120), random_float(-120, 120), -200);
+        Vector3 eye(random_float(-50, 50), random_float(-50, 50), -300);
+        for (int y = 0; y < 8; y++) {
+            for (int x = 0; x < 8; x++) {
+                Vector3 p = corner + Vector3(x, y, 0);
+                packet.add((i % 2 == 0) ? Ray(p, Vector3::Z) : Ray(eye, (p - eye).normalize()));
+            }
+        }
+        // Packets that straddle the eye have rays going both ways, and can't be traced as one.
+        if (!packet.prepare()) {
+            continue;
+        }
+
+        float tmax[RayPacket::MaxSize];
+        for (unsigned int r = 0; r < packet.size; r++) {
+            tmax[r] = INFINITY;
+        }
+        bvh.intersect_packet(packet, 0.0, tmax,
+                             [&](unsigned int r, const unsigned int *prims, unsigned int n, float tmin, float &tmax) {
+            return nearest(packet.rays[r], prims, n, tmax);
+        });
+
+        for (unsigned int r = 0; r < packet.size; r++) {
+            float expected = INFINITY;
+            bvh.intersect_leaves(packet.rays[r], 0.0, expected,
+                                 [&](const unsigned int *prims, unsigned int n, float tmin, float &tmax) {
+                return nearest(packet.rays[r], prims, n, tmax);
+            });
+            EXPECT_EQ(expected, tmax[r]);
+        }
+    }
+}
+
+
+TEST_F(BVHTest, RefitTreeMatchesBruteForce)
+{
+    std::vector<AABB> bounds;
+    AABB b;
+    for (Sphere *s : spheres) {
+        s->compute_bounds(b);
+        bounds.push_back(b);
+    }
+
+    // Nudging a few spheres only touches the nodes above them.
+    std::vector<unsigned int> moved, changed;
+    for (unsigned int i = 0; i < spheres.size(); i += 100) {
+        spheres[i]->set_origin(spheres[i]->get_origin() + Vector3(random_float(-5, 5), random_float(-5, 5), 0));
+        spheres[i]->compute_bounds(bounds[i]);
+        moved.push_back(i);
+    }
+    bvh.refit(bounds, moved, changed);
+    EXPECT_LT(changed.size(), bvh.get_nnodes() / 4);
+    EXPECT_LT(bvh.get_degradation(), 1.1f);
+
+    for (int i = 0; i < 1000; i++) {
+        Vector3 o(random_float(-150, 150), random_float(-150, 150), random_float(-150, 150));
+        Vector3 target(random_float(-100, 100), random_float(-100, 100), random_float(-100, 100));
+        Ray ray(o, (target - o).normalize());
+
+        float expected = INFINITY;
+        for (Sphere *s : spheres) {
+            expected = fminf(expected, nearest_hit(s, ray));
+        }
+
+        float tmax = INFINITY;
+        bvh.intersect(ray, 0.0, tmax, [&](unsigned int index, float tmin, float &tmax) {
+            float t = nearest_hit(spheres[index], ray);
+            if (t < tmax) {
+                tmax = t;
+                return true;
+            }
+            return false;
+        });
+
+        EXPECT_EQ(expected, tmax);
+    }
+
+    // Scattering every sphere somewhere else entirely leaves boxes that overlap everything.
+    moved.clear();
+    for (unsigned int i = 0; i < spheres.size(); i++) {
+        spheres[i]->set_origin(Vector3(random_float(-100, 100), random_float(-100, 100), random_float(-100, 100)));
+        spheres[i]->compute_bounds(bounds[i]);
+        moved.push_back(i);
+    }
+    bvh.refit(bounds, moved, changed);
+    EXPECT_GT(bvh.get_degradation(), 2.0f);
+    bvh.build(bounds);
+    EXPECT_EQ(1.0f, bvh.get_degradation());
+}
+
+
+TEST(BVHEmptyTest, NeverHits)
+{
+    BVH bvh;
+    bvh.build(std::vector<AABB>());
+    EXPECT_TRUE(bvh.is_empty());
+
+    float tmax = INFINITY;
+    EXPECT_FALSE(bvh.intersect(Ray(Vector3::Zero, Vector3::Z), 0.0, tmax,
+                               [](unsigned int index, float tmin, float &tmax) { return true; }));
+}
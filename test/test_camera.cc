@@ -0,0 +1,80 @@
+/* test_camera.cc
+ *
+ * Unit tests for the camera module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "camera.h"
+
+
+static void
+expect_vector(const Vector3 &expected,
+              const Vector3 &actual)
+{
+    EXPECT_NEAR(expected.x, actual.x, 1e-5);
+    EXPECT_NEAR(expected.y, actual.y, 1e-5);
+    EXPECT_NEAR(expected.z, actual.z, 1e-5);
+}
+
+
+TEST(CameraTest, OrthographicRaysStepAcrossThePlane)
+{
+    OrthographicCamera camera;
+    camera.set_origin(Vector3(-2, -1, -10));
+    camera.set_width(Vector3(8, 0, 0));
+    camera.set_height(Vector3(0, 4, 0));
+    camera.set_pixel_width(16);
+    camera.set_pixel_height(8);
+    camera.prepare();
+
+    Ray ray = camera.compute_primary_ray(0, 0);
+    expect_vector(Vector3(-2, -1, -10), ray.origin);
+    expect_vector(Vector3::Z, ray.direction);
+
+    ray = camera.compute_primary_ray(6, 3);
+    expect_vector(Vector3(1, 0.5, -10), ray.origin);
+    expect_vector(Vector3::Z, ray.direction);
+}
+
+
+TEST(CameraTest, PerspectiveRaysSpanTheAngleOfView)
+{
+    PerspectiveCamera camera;
+    camera.set_origin(Vector3(1, 2, 3));
+    camera.set_direction(Vector3::X);
+    camera.set_width(-Vector3::Z);
+    camera.set_height(Vector3::Y);
+    camera.set_angle(90.0);
+    camera.set_pixel_width(101);
+    camera.set_pixel_height(51);
+    camera.prepare();
+
+    // The middle pixel looks straight ahead.
+    Ray ray = camera.compute_primary_ray(50, 25);
+    expect_vector(Vector3(1, 2, 3), ray.origin);
+    expect_vector(Vector3::X, ray.direction);
+
+    // The edges of the image are 45 degrees off to either side, less half a pixel.
+    const float edge = 1.0 - 1.0 / 101.0;
+    ray = camera.compute_primary_ray(0, 25);
+    expect_vector(Vector3(1, 0, edge).normalize(), ray.direction);
+    ray = camera.compute_primary_ray(100, 25);
+    expect_vector(Vector3(1, 0, -edge).normalize(), ray.direction);
+
+    // Pixels are square, so the image is half as tall as it is wide.
+    ray = camera.compute_primary_ray(50, 50);
+    expect_vector(Vector3(1, 50.0 / 101.0, 0).normalize(), ray.direction);
+    EXPECT_FLOAT_EQ(1.0, ray.direction.length());
+
+    // The direction needn't be a unit vector; only which way it points matters.
+    camera.set_direction(Vector3(5, 0, 0));
+    camera.prepare();
+    ray = camera.compute_primary_ray(0, 25);
+    expect_vector(Vector3(1, 0, edge).normalize(), ray.direction);
+}
@@ -0,0 +1,266 @@
+/* test_framebuffer.cc
+ *
+ * Unit tests for the framebuffer module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "framebuffer.h"
+#include "light.h"
+#include "material.h"
+#include "object_plane.h"
+#include "object_sphere.h"
+#include "scene.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRAMEBUFFER_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+const Framebuffer::Format Formats[] = {
+    Framebuffer::FormatRGBA32F,
+    Framebuffer::FormatRGB32F,
+    Framebuffer::FormatRGBA16F,
+    Framebuffer::FormatRGB16F,
+};
+
+const Framebuffer::Order Orders[] = {
+    Framebuffer::OrderLinear,
+    Framebuffer::OrderTiled,
+    Framebuffer::OrderMorton,
+};
+
+
+float
+as_float(uint32_t bits)
+{
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+
+/*
+ * What a color should come back as after being stored in the given format.
+ */
+Color
+round_trip(const Color &c,
+           Framebuffer::Format format)
+{
+    switch (format) {
+        case Framebuffer::FormatRGBA32F:
+            return c;
+        case Framebuffer::FormatRGB32F:
+            return Color(c.red, c.green, c.blue);
+        case Framebuffer::FormatRGBA16F:
+            return Color(half_to_float(float_to_half(c.red)), half_to_float(float_to_half(c.green)),
+                         half_to_float(float_to_half(c.blue)), half_to_float(float_to_half(c.alpha)));
+        case Framebuffer::FormatRGB16F:
+            return Color(half_to_float(float_to_half(c.red)), half_to_float(float_to_half(c.green)),
+                         half_to_float(float_to_half(c.blue)));
+    }
+    return c;
+}
+
+
+bool
+same_color(const Color &a,
+           const Color &b)
+{
+    return memcmp(&a, &b, sizeof(Color)) == 0;
+}
+
+
+#if FRAMEBUFFER_X86
+__attribute__((target("f16c")))
+uint16_t
+f16c_float_to_half(float f)
+{
+    return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+}
+
+__attribute__((target("f16c")))
+float
+f16c_half_to_float(uint16_t h)
+{
+    return _cvtsh_ss(h);
+}
+#endif
+
+} /* anonymous namespace */
+
+
+TEST(FramebufferTest, HalfConversions)
+{
+    EXPECT_EQ(0x0000, float_to_half(0.0));
+    EXPECT_EQ(0x8000, float_to_half(-0.0));
+    EXPECT_EQ(0x3c00, float_to_half(1.0));
+    EXPECT_EQ(0xc000, float_to_half(-2.0));
+    EXPECT_EQ(0x3555, float_to_half(1.0 / 3.0));
+    EXPECT_EQ(0x7bff, float_to_half(65504.0));
+    EXPECT_EQ(0x7bff, float_to_half(65519.0));
+    EXPECT_EQ(0x7c00, float_to_half(65520.0));
+    EXPECT_EQ(0x7c00, float_to_half(INFINITY));
+    EXPECT_EQ(0x0001, float_to_half(ldexpf(1.0, -24)));
+    EXPECT_EQ(0x0000, float_to_half(ldexpf(1.0, -25)));
+    EXPECT_EQ(0x0001, float_to_half(ldexpf(1.5, -25)));
+    EXPECT_EQ(0x0400, float_to_half(ldexpf(1.0, -14)));
+
+    // Ties go to even: 1 + 2^-11 is halfway between 1 and the next half up.
+    EXPECT_EQ(0x3c00, float_to_half(1.0 + ldexpf(1.0, -11)));
+    EXPECT_EQ(0x3c02, float_to_half(1.0 + 3 * ldexpf(1.0, -11)));
+
+    EXPECT_TRUE(std::isnan(half_to_float(float_to_half(NAN))));
+
+    // Every half that isn't a NaN survives the trip to float and back.
+    for (uint32_t h = 0; h < 0x10000; h++) {
+        if ((h & 0x7c00) == 0x7c00 && (h & 0x3ff) != 0) {
+            continue;
+        }
+        ASSERT_EQ(h, float_to_half(half_to_float(h))) << std::hex << h;
+    }
+}
+
+
+#if FRAMEBUFFER_X86
+TEST(FramebufferTest, HalfConversionsMatchF16C)
+{
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("f16c")) {
+        return;
+    }
+    for (uint32_t h = 0; h < 0x10000; h++) {
+        const float expected = f16c_half_to_float(h), actual = half_to_float(h);
+        ASSERT_EQ(0, memcmp(&expected, &actual, sizeof(float))) << std::hex << h;
+    }
+    for (uint64_t bits = 0; bits <= 0xffffffffu; bits += 997) {
+        const float f = as_float(bits);
+        ASSERT_EQ(f16c_float_to_half(f), float_to_half(f)) << std::hex << bits;
+    }
+}
+#endif
+
+
+TEST(FramebufferTest, SizesAndIndexes)
+{
+    Framebuffer framebuffer;
+    const size_t sizes[] = { 16, 12, 8, 6 };
+    for (int i = 0; i < 4; i++) {
+        framebuffer.set_format(Formats[i]);
+        framebuffer.allocate(8, 8, 4);
+        EXPECT_EQ(sizes[i], framebuffer.get_pixel_size());
+        EXPECT_EQ(64 * sizes[i], framebuffer.get_nbytes());
+        EXPECT_EQ(i == 0, framebuffer.get_pixels() != NULL);
+    }
+
+    // Tiles are padded out to whole tiles, and laid out a row of tiles at a time.
+    framebuffer.set_format(Framebuffer::FormatRGB16F);
+    framebuffer.set_order(Framebuffer::OrderTiled);
+    framebuffer.allocate(10, 5, 4);
+    EXPECT_EQ(3 * 2 * 16 * 6u, framebuffer.get_nbytes());
+    EXPECT_EQ(1u, framebuffer.get_index(1, 0));
+    EXPECT_EQ(4u, framebuffer.get_index(0, 1));
+    EXPECT_EQ(16u, framebuffer.get_index(4, 0));
+    EXPECT_EQ(48u + 5u, framebuffer.get_index(1, 5));
+
+    // Morton tiles are rounded up to a power of two.
+    framebuffer.set_order(Framebuffer::OrderMorton);
+    framebuffer.allocate(10, 5, 3);
+    EXPECT_EQ(4, framebuffer.get_tile_size());
+    EXPECT_EQ(1u, framebuffer.get_index(1, 0));
+    EXPECT_EQ(2u, framebuffer.get_index(0, 1));
+    EXPECT_EQ(3u, framebuffer.get_index(1, 1));
+    EXPECT_EQ(4u, framebuffer.get_index(2, 0));
+    EXPECT_EQ(15u, framebuffer.get_index(3, 3));
+    EXPECT_EQ(16u, framebuffer.get_index(4, 0));
+}
+
+
+TEST(FramebufferTest, EveryLayoutReadsBackInRows)
+{
+    const int width = 37, height = 23;
+    std::vector<Color> image(width * height);
+    for (int i = 0; i < width * height; i++) {
+        image[i] = Color(i * 0.001f, 1.0f / (i + 1), i % 7 * 300.5f, (i % 3) * 0.25f);
+    }
+
+    for (Framebuffer::Format format : Formats) {
+        for (Framebuffer::Order order : Orders) {
+            Framebuffer framebuffer;
+            framebuffer.set_format(format);
+            framebuffer.set_order(order);
+            framebuffer.allocate(width, height, 6);
+
+            // Store in uneven rectangles, from the bottom up.
+            for (int y = 20; y > -7; y -= 7) {
+                for (int x = 0; x < width; x += 5) {
+                    const int y0 = std::max(0, y), w = std::min(5, width - x), h = std::min(height, y + 7) - y0;
+                    framebuffer.store(x, y0, w, h, image.data() + y0 * width + x, width);
+                }
+            }
+
+            std::vector<Color> buffer;
+            const Color *rows = framebuffer.load_rows(3, 10, buffer);
+            for (int i = 0; i < 10 * width; i++) {
+                const Color expected = round_trip(image[3 * width + i], format);
+                ASSERT_TRUE(same_color(expected, rows[i])) << "format " << format << ", order " << order << ", "
+                                                           << i;
+            }
+        }
+    }
+}
+
+
+TEST(FramebufferTest, ScenesRenderIntoEveryLayout)
+{
+    Scene scene;
+    scene.set_width(50);
+    scene.set_height(40);
+    scene.set_tile_size(12);
+    scene.set_nthreads(3);
+    Material *red = new Material();
+    red->set_diffuse_color(Color(1.0, 0.2, 0.1));
+    scene.add_material(red);
+    Sphere *s = new Sphere(Vector3(25, 20, 0), 12);
+    s->set_material(red);
+    scene.add_shape(s);
+    Plane *floor = new Plane(Vector3(0, 35, 0), Vector3(0, -1, 0.2).normalize());
+    floor->set_material(red);
+    scene.add_shape(floor);
+    scene.add_light(new PointLight(Vector3(25, -50, -100)));
+    scene.render();
+    const std::vector<Color> expected(scene.get_pixels(), scene.get_pixels() + 50 * 40);
+
+    const Scene::RenderMode modes[] = { Scene::RenderModeDepthFirst, Scene::RenderModeWavefront };
+    for (Scene::RenderMode mode : modes) {
+        for (Framebuffer::Format format : Formats) {
+            for (Framebuffer::Order order : Orders) {
+                scene.set_render_mode(mode);
+                scene.get_framebuffer().set_format(format);
+                scene.get_framebuffer().set_order(order);
+                scene.render();
+                EXPECT_TRUE(scene.is_rendered());
+
+                std::vector<Color> buffer;
+                const Color *actual = scene.get_framebuffer().load_rows(0, 40, buffer);
+                int differences = 0;
+                for (int i = 0; i < 50 * 40; i++) {
+                    differences += !same_color(round_trip(expected[i], format), actual[i]);
+                }
+                EXPECT_EQ(0, differences) << "mode " << mode << ", format " << format << ", order " << order;
+            }
+        }
+    }
+}
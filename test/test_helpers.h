@@ -0,0 +1,94 @@
+/* test_helpers.h
+ *
+ * Helpers shared by the unit tests: random numbers and vectors, and scenes of randomly placed spheres. Everything
+ * random comes from rand(), so a test that seeds it sees the same values on every run.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#ifndef __TEST_HELPERS_H__
+#define __TEST_HELPERS_H__
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "basics.h"
+#include "object_sphere.h"
+
+
+/*
+ * random_float --
+ *
+ * Return a random number in [lo, hi].
+ */
+inline float
+random_float(float lo,
+             float hi)
+{
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+
+/*
+ * random_vector --
+ *
+ * Return a vector with each coordinate a random number in [lo, hi], drawn x first.
+ */
+inline Vector3
+random_vector(float lo,
+              float hi)
+{
+    const float x = random_float(lo, hi);
+    const float y = random_float(lo, hi);
+    const float z = random_float(lo, hi);
+    return Vector3(x, y, z);
+}
+
+
+/*
+ * random_spheres --
+ *
+ * Seed rand() with 42 and make n spheres with centers in the cube [-extent, extent] on each axis and radii in
+ * [min_radius, max_radius]. If whole is true, centers and radii are rounded to whole numbers, which lines lots of box
+ * faces up exactly with axis-parallel rays. The caller owns the spheres.
+ */
+inline std::vector<Sphere *>
+random_spheres(unsigned int n,
+               float extent,
+               float min_radius,
+               float max_radius,
+               bool whole = false)
+{
+    srand(42);
+    std::vector<Sphere *> spheres;
+    spheres.reserve(n);
+    for (unsigned int i = 0; i < n; i++) {
+        Vector3 center = random_vector(-extent, extent);
+        float radius = random_float(min_radius, max_radius);
+        if (whole) {
+            center = Vector3(roundf(center.x), roundf(center.y), roundf(center.z));
+            radius = roundf(radius);
+        }
+        spheres.push_back(new Sphere(center, radius));
+    }
+    return spheres;
+}
+
+
+/*
+ * sphere_bounds --
+ *
+ * Return the bounds of each of the given spheres, in order, ready to build a BVH over.
+ */
+inline std::vector<AABB>
+sphere_bounds(const std::vector<Sphere *> &spheres)
+{
+    std::vector<AABB> bounds(spheres.size());
+    for (size_t i = 0; i < spheres.size(); i++) {
+        spheres[i]->compute_bounds(bounds[i]);
+    }
+    return bounds;
+}
+
+#endif
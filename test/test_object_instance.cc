@@ -0,0 +1,181 @@
+/* test_object_instance.cc
+ *
+ * Unit tests for the object_instance module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "object_instance.h"
+#include "object_plane.h"
+#include "object_sphere.h"
+#include "test_helpers.h"
+#include "transform.h"
+
+
+class InstanceTest
+    : public ::testing::Test
+{
+public:
+    virtual void SetUp();
+    virtual void TearDown();
+
+protected:
+    InstanceGroup group;
+    std::vector<Sphere *> group_spheres;
+};
+
+
+void
+InstanceTest::SetUp()
+{
+    group_spheres = random_spheres(50, 5, 0.2, 1);
+    for (Sphere *s : group_spheres) {
+        ASSERT_TRUE(group.add_shape(s));
+    }
+    group.build();
+}
+
+
+void
+InstanceTest::TearDown()
+{ }
+
+
+/*
+ * Scaling a group evenly and moving it is the same as scaling and moving each sphere in it, so an Instance that does
+ * that should see the same hits and normals as the spheres placed by hand.
+ */
+TEST_F(InstanceTest, MatchesPlacedSpheres)
+{
+    const float scale = 3.0f;
+    const Vector3 offset(20, -10, 40);
+    Transform transform = Transform::translate(offset) * Transform::rotate(Vector3(1, 2, 3), 0.5) *
+                          Transform::scale(scale);
+    Instance instance(&group, transform);
+
+    std::vector<Sphere *> placed;
+    for (Sphere *s : group_spheres) {
+        placed.push_back(new Sphere(transform.transform_point(s->get_origin()), s->get_radius() * scale));
+    }
+
+    AABB bounds;
+    ASSERT_TRUE(instance.compute_bounds(bounds));
+
+    int nhits = 0;
+    for (int i = 0; i < 2000; i++) {
+        Vector3 o(random_float(-50, 50), random_float(-50, 50), random_float(-50, 50));
+        Vector3 target = offset + Vector3(random_float(-15, 15), random_float(-15, 15), random_float(-15, 15));
+        Ray ray(o, (target - o).normalize());
+
+        float expected = INFINITY;
+        unsigned int expected_index = 0;
+        for (unsigned int j = 0; j < placed.size(); j++) {
+            Intersection hit;
+            if (placed[j]->intersect(ray, 0.0, expected, hit)) {
+                expected = hit.t;
+                expected_index = j;
+            }
+        }
+
+        Intersection hit;
+        bool found = instance.intersect(ray, 0.0, INFINITY, hit);
+        EXPECT_EQ(std::isfinite(expected), found);
+        EXPECT_EQ(found, instance.occluded(ray, 0.0, INFINITY));
+        if (!found || !std::isfinite(expected)) {
+            continue;
+        }
+        nhits++;
+
+        EXPECT_NEAR(expected, hit.t, 1e-2);
+        EXPECT_EQ(group_spheres[expected_index], hit.shape);
+
+        Vector3 p = ray.parameterize(hit.t);
+        Vector3 expected_normal = placed[expected_index]->compute_normal(p);
+        Vector3 normal = instance.compute_hit_normal(hit, p);
+        EXPECT_NEAR(expected_normal.x, normal.x, 1e-2);
+        EXPECT_NEAR(expected_normal.y, normal.y, 1e-2);
+        EXPECT_NEAR(expected_normal.z, normal.z, 1e-2);
+
+        // Hits are inside the bounds.
+        EXPECT_LE(bounds.min.x - 1e-3, p.x);
+        EXPECT_GE(bounds.max.x + 1e-3, p.x);
+    }
+    EXPECT_GT(nhits, 100);
+
+    for (Sphere *s : placed) {
+        delete s;
+    }
+}
+
+
+TEST(InstanceGroupTest, NormalsStayPerpendicularUnderUnevenScaling)
+{
+    InstanceGroup group;
+    group.add_shape(new Sphere(Vector3(1, 0, 0), 1));
+    group.build();
+    Instance instance(&group, Transform::scale(Vector3(1, 4, 1)));
+
+    // The stretched sphere is an ellipsoid 8 tall. Its top still faces straight up; a point on its side faces mostly
+    // sideways, though less so than a sphere's would.
+    Intersection hit;
+    Ray down(Vector3(1, 10, 0), -Vector3::Y);
+    ASSERT_TRUE(instance.intersect(down, 0.0, INFINITY, hit));
+    EXPECT_NEAR(6, hit.t, 1e-4);
+    Vector3 normal = instance.compute_hit_normal(hit, down.parameterize(hit.t));
+    EXPECT_NEAR(0, normal.x, 1e-4);
+    EXPECT_NEAR(1, normal.y, 1e-4);
+    EXPECT_NEAR(0, normal.z, 1e-4);
+
+    // The point on the ellipsoid at (1 + cos 45, 4 sin 45, 0) has normal (cos 45, sin 45 / 4, 0), normalized.
+    Ray across(Vector3(10, 4 * sqrtf(0.5), 0), -Vector3::X);
+    ASSERT_TRUE(instance.intersect(across, 0.0, INFINITY, hit));
+    normal = instance.compute_hit_normal(hit, across.parameterize(hit.t));
+    Vector3 expected = Vector3(sqrtf(0.5), sqrtf(0.5) / 4, 0).normalize();
+    EXPECT_NEAR(expected.x, normal.x, 1e-3);
+    EXPECT_NEAR(expected.y, normal.y, 1e-3);
+    EXPECT_NEAR(0, normal.z, 1e-3);
+}
+
+
+TEST_F(InstanceTest, MovesWithItsOrigin)
+{
+    Instance instance(&group);
+    AABB before, after;
+    ASSERT_TRUE(instance.compute_bounds(before));
+    instance.set_origin(Vector3(100, 0, 0));
+    ASSERT_TRUE(instance.compute_bounds(after));
+    EXPECT_FLOAT_EQ(before.min.x + 100, after.min.x);
+    EXPECT_FLOAT_EQ(before.max.y, after.max.y);
+    EXPECT_FLOAT_EQ(100, instance.get_transform().get_translation().x);
+
+    // Transforms with no inverse are refused.
+    EXPECT_FALSE(instance.set_transform(Transform::scale(0)));
+    EXPECT_FLOAT_EQ(100, instance.get_origin().x);
+}
+
+
+TEST(InstanceGroupTest, RefusesUnboundedShapesAndInstances)
+{
+    InstanceGroup group;
+    Plane plane;
+    EXPECT_FALSE(group.add_shape(&plane));
+
+    InstanceGroup other;
+    Instance instance(&other);
+    EXPECT_FALSE(group.add_shape(&instance));
+    EXPECT_EQ(0u, group.size());
+
+    // Instances of empty groups have no bounds, and nothing to hit.
+    AABB bounds;
+    EXPECT_FALSE(instance.compute_bounds(bounds));
+    other.build();
+    Intersection hit;
+    EXPECT_FALSE(instance.intersect(Ray(Vector3::Zero, Vector3::Z), 0.0, INFINITY, hit));
+}
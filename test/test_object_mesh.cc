@@ -0,0 +1,157 @@
+/* test_object_mesh.cc
+ *
+ * Unit tests for the object_mesh module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "object_mesh.h"
+
+
+/*
+ * Make a mesh of the square [0, n] x [0, n] at z = 0, split into n x n cells of two triangles each. The cells share
+ * every edge and vertex with their neighbors.
+ */
+static void
+make_grid(TriangleMesh &mesh,
+          unsigned int n)
+{
+    std::vector<Vector3> vertices;
+    std::vector<unsigned int> indices;
+    for (unsigned int y = 0; y <= n; y++) {
+        for (unsigned int x = 0; x <= n; x++) {
+            vertices.push_back(Vector3(x, y, 0));
+        }
+    }
+    for (unsigned int y = 0; y < n; y++) {
+        for (unsigned int x = 0; x < n; x++) {
+            unsigned int i = y * (n + 1) + x;
+            unsigned int quad[] = { i, i + 1, i + n + 2, i, i + n + 2, i + n + 1 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+    ASSERT_TRUE(mesh.set_geometry(vertices, indices));
+    EXPECT_TRUE(vertices.empty());
+    EXPECT_TRUE(indices.empty());
+}
+
+
+TEST(TriangleMeshTest, SingleTriangle)
+{
+    std::vector<Vector3> vertices = { Vector3(0, 0, 5), Vector3(2, 0, 5), Vector3(0, 2, 5) };
+    std::vector<unsigned int> indices = { 0, 1, 2 };
+    TriangleMesh mesh;
+    ASSERT_TRUE(mesh.set_geometry(vertices, indices));
+    EXPECT_EQ(1u, mesh.get_ntriangles());
+
+    Intersection hit;
+    EXPECT_TRUE(mesh.intersect(Ray(Vector3(0.5, 0.5, 0), Vector3::Z), 0, INFINITY, hit));
+    EXPECT_FLOAT_EQ(5, hit.t);
+    EXPECT_EQ(&mesh, hit.shape);
+    EXPECT_EQ(0u, hit.primitive_id);
+
+    // Triangles are two-sided, and their normals face the side their vertices run counterclockwise around.
+    EXPECT_TRUE(mesh.intersect(Ray(Vector3(0.5, 0.5, 10), -Vector3::Z), 0, INFINITY, hit));
+    EXPECT_FLOAT_EQ(5, hit.t);
+    Vector3 normal = mesh.compute_hit_normal(hit, Vector3(0.5, 0.5, 5));
+    EXPECT_FLOAT_EQ(1, normal.z);
+    EXPECT_TRUE(mesh.point_is_on_surface(Vector3(0.5, 0.5, 5)));
+    EXPECT_FALSE(mesh.point_is_on_surface(Vector3(1.5, 1.5, 5)));
+
+    EXPECT_FALSE(mesh.intersect(Ray(Vector3(1.5, 1.5, 0), Vector3::Z), 0, INFINITY, hit));
+    EXPECT_FALSE(mesh.intersect(Ray(Vector3(0.5, 0.5, 0), Vector3::Z), 0, 4, hit));
+    EXPECT_TRUE(mesh.occluded(Ray(Vector3(0.5, 0.5, 0), Vector3::Z), 0, 6));
+    EXPECT_FALSE(mesh.occluded(Ray(Vector3(0.5, 0.5, 0), Vector3::Z), 0, 4));
+
+    // Moving the mesh's origin moves its triangles.
+    mesh.set_origin(Vector3(10, 0, 0));
+    EXPECT_FALSE(mesh.intersect(Ray(Vector3(0.5, 0.5, 0), Vector3::Z), 0, INFINITY, hit));
+    EXPECT_TRUE(mesh.intersect(Ray(Vector3(10.5, 0.5, 0), Vector3::Z), 0, INFINITY, hit));
+    AABB bounds;
+    EXPECT_TRUE(mesh.compute_bounds(bounds));
+    EXPECT_FLOAT_EQ(10, bounds.min.x);
+    EXPECT_FLOAT_EQ(12, bounds.max.x);
+}
+
+
+TEST(TriangleMeshTest, BadGeometryIsRefused)
+{
+    TriangleMesh mesh;
+    std::vector<Vector3> vertices = { Vector3(0, 0, 0), Vector3(1, 0, 0), Vector3(0, 1, 0) };
+    std::vector<unsigned int> indices = { 0, 1, 3 };
+    EXPECT_FALSE(mesh.set_geometry(vertices, indices));
+    indices = { 0, 1 };
+    EXPECT_FALSE(mesh.set_geometry(vertices, indices));
+    EXPECT_EQ(3u, vertices.size());
+    EXPECT_EQ(0u, mesh.get_ntriangles());
+
+    AABB bounds;
+    EXPECT_FALSE(mesh.compute_bounds(bounds));
+    Intersection hit;
+    EXPECT_FALSE(mesh.intersect(Ray(Vector3::Zero, Vector3::Z), 0, INFINITY, hit));
+}
+
+
+/*
+ * Rays aimed straight at the grid's shared edges and vertices, where rounding could let a less careful test slip
+ * between neighboring triangles, always hit something.
+ */
+TEST(TriangleMeshTest, NoRaysLeakThroughSeams)
+{
+    const unsigned int n = 16;
+    TriangleMesh mesh;
+    make_grid(mesh, n);
+    EXPECT_EQ(2 * n * n, mesh.get_ntriangles());
+
+    srand(42);
+    for (int i = 0; i < 4000; i++) {
+        // A target on a grid line, a diagonal, or a vertex, inside the square.
+        float x = rand() % n + 0.5f, y = rand() % n + 0.5f;
+        switch (i % 3) {
+            case 0: x = floorf(x); break;
+            case 1: y = x - floorf(x) + floorf(y); break;
+            case 2: x = floorf(x); y = floorf(y); break;
+        }
+        if (x <= 0 || y <= 0 || x >= n || y >= n) {
+            continue;
+        }
+        Vector3 target(x, y, 0);
+        Vector3 origin(rand() % 200 - 100.0f + 0.37f, rand() % 200 - 100.0f + 0.11f, 50.0f + rand() % 50);
+        Ray ray(origin, (target - origin).normalize());
+
+        Intersection hit;
+        ASSERT_TRUE(mesh.intersect(ray, 0, INFINITY, hit)) << "leaked at (" << x << ", " << y << ")";
+        EXPECT_NEAR((target - origin).length(), hit.t, 1e-3);
+        EXPECT_TRUE(mesh.occluded(ray, 0, INFINITY));
+    }
+}
+
+
+TEST(TriangleMeshTest, NormalsAreInterpolated)
+{
+    TriangleMesh mesh;
+    make_grid(mesh, 1);
+
+    // Tilt the normals at x = 1 toward +x.
+    std::vector<Vector3> normals = { Vector3::Z, Vector3(1, 0, 1).normalize(), Vector3::Z,
+                                     Vector3(1, 0, 1).normalize() };
+    ASSERT_TRUE(mesh.set_normals(normals));
+
+    Intersection hit;
+    ASSERT_TRUE(mesh.intersect(Ray(Vector3(0.5, 0.25, 1), -Vector3::Z), 0, INFINITY, hit));
+    Vector3 normal = mesh.compute_hit_normal(hit, Vector3(0.5, 0.25, 0));
+    EXPECT_GT(normal.x, 0.1);
+    EXPECT_LT(normal.x, normal.z);
+    EXPECT_NEAR(0, normal.y, 1e-5);
+    EXPECT_NEAR(1, normal.length(), 1e-5);
+
+    std::vector<Vector3> too_few = { Vector3::Z };
+    EXPECT_FALSE(mesh.set_normals(too_few));
+}
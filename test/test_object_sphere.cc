@@ -0,0 +1,86 @@
+/* test_object_sphere.cc
+ *
+ * Unit tests for the object_sphere module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+#include <cstdlib>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "object_sphere.h"
+
+
+class SphereTest
+    : public ::testing::Test
+{
+public:
+    SphereTest();
+
+protected:
+    Sphere sphere;
+};
+
+
+SphereTest::SphereTest()
+    : sphere(Vector3(0, 0, 10), 2)
+{ }
+
+
+TEST_F(SphereTest, IntersectNearestInInterval)
+{
+    Ray ray(Vector3::Zero, Vector3::Z);
+    Intersection hit;
+
+    EXPECT_TRUE(sphere.intersect(ray, 0, INFINITY, hit));
+    EXPECT_FLOAT_EQ(8, hit.t);
+    EXPECT_EQ(&sphere, hit.shape);
+
+    // With the near side excluded, the far side is the nearest hit.
+    EXPECT_TRUE(sphere.intersect(ray, 9, INFINITY, hit));
+    EXPECT_FLOAT_EQ(12, hit.t);
+
+    // Both hits are outside these intervals. hit is left alone.
+    EXPECT_FALSE(sphere.intersect(ray, 0, 7, hit));
+    EXPECT_FALSE(sphere.intersect(ray, 13, INFINITY, hit));
+    EXPECT_FLOAT_EQ(12, hit.t);
+}
+
+
+TEST_F(SphereTest, Occluded)
+{
+    Ray ray(Vector3::Zero, Vector3::Z);
+
+    EXPECT_TRUE(sphere.occluded(ray, 0, INFINITY));
+    EXPECT_TRUE(sphere.occluded(ray, 0, 9));
+    EXPECT_TRUE(sphere.occluded(ray, 9, INFINITY));
+    EXPECT_FALSE(sphere.occluded(ray, 0, 7));
+    EXPECT_FALSE(sphere.occluded(ray, 8.5, 11.5));
+    EXPECT_FALSE(sphere.occluded(ray, 13, INFINITY));
+
+    // Pointing away.
+    EXPECT_FALSE(sphere.occluded(Ray(Vector3::Zero, -Vector3::Z), 0, INFINITY));
+}
+
+
+TEST_F(SphereTest, OccludedAgreesWithIntersect)
+{
+    srand(7);
+    for (int i = 0; i < 10000; i++) {
+        Vector3 o(rand() % 21 - 10, rand() % 21 - 10, rand() % 21);
+        Vector3 d(rand() % 21 - 10, rand() % 21 - 10, rand() % 21 - 10);
+        if (d == Vector3::Zero) {
+            continue;
+        }
+        Ray ray(o, d.normalize());
+        float tmin = (rand() % 100) / 10.0;
+        float tmax = tmin + (rand() % 100) / 10.0;
+
+        Intersection hit;
+        EXPECT_EQ(sphere.intersect(ray, tmin, tmax, hit), sphere.occluded(ray, tmin, tmax))
+            << ray << " [" << tmin << ", " << tmax << "]";
+    }
+}
@@ -0,0 +1,90 @@
+/* test_radix_sort.cc
+ *
+ * Unit tests for the radix_sort and morton modules.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "morton.h"
+#include "radix_sort.h"
+
+
+static bool
+key_less(const SortItem &a,
+         const SortItem &b)
+{
+    return a.key < b.key;
+}
+
+
+TEST(RadixSortTest, MatchesStableSort)
+{
+    srand(42);
+
+    const unsigned int key_bits[] = { 1, 8, 13, 33, 64 };
+    for (unsigned int b = 0; b < sizeof(key_bits) / sizeof(key_bits[0]); b++) {
+        const uint64_t mask = (key_bits[b] == 64) ? ~(uint64_t)0 : (((uint64_t)1 << key_bits[b]) - 1);
+        std::vector<SortItem> items(5000), scratch(5000);
+        for (unsigned int i = 0; i < items.size(); i++) {
+            uint64_t key = ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand();
+            items[i].key = key & mask;
+            items[i].value = i;
+        }
+
+        std::vector<SortItem> expected = items;
+        std::stable_sort(expected.begin(), expected.end(), key_less);
+        radix_sort(items.data(), scratch.data(), items.size(), key_bits[b]);
+
+        for (unsigned int i = 0; i < items.size(); i++) {
+            EXPECT_EQ(expected[i].key, items[i].key);
+            EXPECT_EQ(expected[i].value, items[i].value);
+        }
+    }
+}
+
+
+TEST(RadixSortTest, EqualKeysKeepTheirOrder)
+{
+    std::vector<SortItem> items(300), scratch(300);
+    for (unsigned int i = 0; i < items.size(); i++) {
+        items[i].key = 7;
+        items[i].value = i;
+    }
+    radix_sort(items.data(), scratch.data(), items.size(), 32);
+    for (unsigned int i = 0; i < items.size(); i++) {
+        EXPECT_EQ(i, items[i].value);
+    }
+
+    // Nothing to sort is fine too.
+    radix_sort(items.data(), scratch.data(), 0, 32);
+}
+
+
+TEST(MortonTest, InterleavesBits)
+{
+    EXPECT_EQ(0u, morton_expand(0));
+    EXPECT_EQ(1u, morton_expand(1));
+    EXPECT_EQ(0x8u, morton_expand(2));
+    EXPECT_EQ(0x09249249u, morton_expand(0x3FF));
+
+    AABB box(Vector3(0, 0, 0), Vector3(1023, 1023, 1023));
+    EXPECT_EQ(1u, morton_code(Vector3(1, 0, 0), box));
+    EXPECT_EQ(2u, morton_code(Vector3(0, 1, 0), box));
+    EXPECT_EQ(4u, morton_code(Vector3(0, 0, 1), box));
+    EXPECT_EQ(0x3FFFFFFFu, morton_code(Vector3(1023, 1023, 1023), box));
+
+    // Points outside the box clamp to it.
+    EXPECT_EQ(0u, morton_code(Vector3(-5, -5, -5), box));
+    EXPECT_EQ(0x3FFFFFFFu, morton_code(Vector3(2000, 2000, 2000), box));
+
+    // A flat box puts everything at zero along its flat axis.
+    AABB flat(Vector3(0, 0, 0), Vector3(1023, 0, 1023));
+    EXPECT_EQ(4u, morton_code(Vector3(0, 5, 1), flat));
+}
@@ -0,0 +1,76 @@
+/* test_ray_packet.cc
+ *
+ * Unit tests for the ray_packet module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+#include <cstdlib>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "ray_packet.h"
+#include "test_helpers.h"
+
+
+TEST(RayPacketTest, FrustumIsConservative)
+{
+    srand(42);
+
+    for (int i = 0; i < 500; i++) {
+        RayPacket packet;
+        Vector3 eye(random_float(-10, 10), random_float(-10, 10), -50);
+        Vector3 corner(random_float(-20, 20), random_float(-20, 20), 0);
+        for (int y = 0; y < 4; y++) {
+            for (int x = 0; x < 4; x++) {
+                Vector3 p = corner + Vector3(x, y, 0);
+                packet.add((i % 2 == 0) ? Ray(p - Vector3(0, 0, 50), Vector3::Z) : Ray(eye, (p - eye).normalize()));
+            }
+        }
+        // Packets that straddle the eye have rays going both ways, and can't be traced as one.
+        if (!packet.prepare()) {
+            continue;
+        }
+
+        Vector3 c(random_float(-30, 30), random_float(-30, 30), random_float(-10, 40));
+        Vector3 e(random_float(0.1, 5), random_float(0.1, 5), random_float(0.1, 5));
+        AABB box(c - e, c + e);
+
+        bool any = false;
+        float tnear;
+        for (unsigned int r = 0; r < packet.size; r++) {
+            any = any || box.intersect(packet.rays[r], packet.inv_directions[r], 0.0, INFINITY, tnear);
+        }
+        if (any) {
+            EXPECT_TRUE(packet.intersect_frustum(box, 0.0, INFINITY));
+        }
+    }
+}
+
+
+TEST(RayPacketTest, FrustumCullsBoxesOffToTheSide)
+{
+    RayPacket packet;
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            packet.add(Ray(Vector3(x, y, -10), Vector3::Z));
+        }
+    }
+    ASSERT_TRUE(packet.prepare());
+
+    EXPECT_TRUE(packet.intersect_frustum(AABB(Vector3(6, 6, 0), Vector3(9, 9, 1)), 0.0, INFINITY));
+    EXPECT_FALSE(packet.intersect_frustum(AABB(Vector3(8.5, 0, 0), Vector3(9, 9, 1)), 0.0, INFINITY));
+    EXPECT_FALSE(packet.intersect_frustum(AABB(Vector3(0, 0, -20), Vector3(9, 9, -15)), 0.0, INFINITY));
+    EXPECT_FALSE(packet.intersect_frustum(AABB(Vector3(0, 0, 5), Vector3(9, 9, 6)), 0.0, 10.0));
+}
+
+
+TEST(RayPacketTest, MixedDirectionsCantBePrepared)
+{
+    RayPacket packet;
+    packet.add(Ray(Vector3::Zero, Vector3::Z));
+    packet.add(Ray(Vector3::Zero, -Vector3::Z));
+    EXPECT_FALSE(packet.prepare());
+}
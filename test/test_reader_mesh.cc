@@ -0,0 +1,251 @@
+/* test_reader_mesh.cc
+ *
+ * Unit tests for the reader_mesh module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "object_mesh.h"
+#include "reader_mesh.h"
+
+
+class MeshReaderTest
+    : public ::testing::Test
+{
+public:
+    virtual void TearDown();
+
+protected:
+    int read(TriangleMesh &mesh, const std::string &contents, unsigned int nthreads = 1);
+
+    std::string filename;
+};
+
+
+void
+MeshReaderTest::TearDown()
+{
+    if (!filename.empty()) {
+        unlink(filename.c_str());
+        filename.clear();
+    }
+}
+
+
+/*
+ * Write contents to a temporary file and read it into mesh with nthreads threads.
+ */
+int
+MeshReaderTest::read(TriangleMesh &mesh,
+                     const std::string &contents,
+                     unsigned int nthreads)
+{
+    TearDown();
+
+    char name[] = "/tmp/charles_test_XXXXXX";
+    int fd = mkstemp(name);
+    EXPECT_NE(-1, fd);
+    filename = name;
+    EXPECT_EQ((ssize_t)contents.size(), write(fd, contents.data(), contents.size()));
+    close(fd);
+
+    MeshReader reader;
+    reader.set_nthreads(nthreads);
+    return reader.read_mesh(mesh, filename);
+}
+
+
+/*
+ * Append value to bytes, most significant byte first if big_endian is set.
+ */
+template<typename T>
+static void
+append(std::string &bytes,
+       T value,
+       bool big_endian)
+{
+    unsigned char raw[sizeof(T)];
+    memcpy(raw, &value, sizeof(T));
+    const uint16_t one = 1;
+    if ((*(const unsigned char *)&one == 1) == big_endian) {
+        for (size_t i = 0; i < sizeof(T) / 2; i++) {
+            std::swap(raw[i], raw[sizeof(T) - 1 - i]);
+        }
+    }
+    bytes.append((const char *)raw, sizeof(T));
+}
+
+
+static void
+expect_vertex(const Vector3 &expected,
+              const Vector3 &actual)
+{
+    EXPECT_FLOAT_EQ(expected.x, actual.x);
+    EXPECT_FLOAT_EQ(expected.y, actual.y);
+    EXPECT_FLOAT_EQ(expected.z, actual.z);
+}
+
+
+TEST_F(MeshReaderTest, ObjTrianglesAndFans)
+{
+    TriangleMesh mesh;
+    int n = read(mesh, "# A square and a triangle.\n"
+                       "v 0 0 0\n"
+                       "vt 0.5 0.5\n"
+                       "v 1.5 0 -2e-1\n"
+                       "v  1 1 0\r\n"
+                       "vn 0 0 1\n"
+                       "v 0 1 0\n"
+                       "f 1/1/1 2/1/1 3/1/1 4/1/1\n"
+                       "usemtl red\n"
+                       "v -1 -1 .25\n"
+                       "f -1 1//1 -4\n");
+    ASSERT_EQ(3, n);
+    ASSERT_EQ(5u, mesh.get_nvertices());
+    expect_vertex(Vector3(1.5, 0, -0.2), mesh.get_vertices()[1]);
+    expect_vertex(Vector3(-1, -1, 0.25), mesh.get_vertices()[4]);
+
+    const unsigned int expected[] = { 0, 1, 2, 0, 2, 3, 4, 0, 1 };
+    for (unsigned int i = 0; i < 9; i++) {
+        EXPECT_EQ(expected[i], mesh.get_indices()[i]);
+    }
+}
+
+
+TEST_F(MeshReaderTest, ParallelObjMatchesSerial)
+{
+    // A strip of quads, long enough that every thread gets some of it.
+    std::string contents;
+    char line[128];
+    const unsigned int nquads = 500;
+    for (unsigned int i = 0; i <= nquads; i++) {
+        snprintf(line, sizeof(line), "v %u.%u 0 -%u.5e-2\nv %u 1 %u\n", i, i % 10, i, i, i % 7);
+        contents += line;
+        if (i > 0) {
+            // Alternate between absolute and relative indices.
+            if (i % 2) {
+                snprintf(line, sizeof(line), "f %u %u %u %u\n", 2 * i - 1, 2 * i + 1, 2 * i + 2, 2 * i);
+            }
+            else {
+                snprintf(line, sizeof(line), "f -4 -2 -1 -3\n");
+            }
+            contents += line;
+        }
+    }
+
+    TriangleMesh serial, parallel;
+    ASSERT_EQ(2 * (int)nquads, read(serial, contents, 1));
+    ASSERT_EQ(2 * (int)nquads, read(parallel, contents, 7));
+    ASSERT_EQ(serial.get_nvertices(), parallel.get_nvertices());
+    for (unsigned int i = 0; i < serial.get_nvertices(); i++) {
+        expect_vertex(serial.get_vertices()[i], parallel.get_vertices()[i]);
+    }
+    for (unsigned int i = 0; i < 3 * serial.get_ntriangles(); i++) {
+        EXPECT_EQ(serial.get_indices()[i], parallel.get_indices()[i]);
+    }
+    expect_vertex(Vector3(250.0, 0, -2.505), serial.get_vertices()[500]);
+}
+
+
+TEST_F(MeshReaderTest, ObjErrors)
+{
+    TriangleMesh mesh;
+    EXPECT_EQ(-1, read(mesh, "v 0 0\n"));
+    EXPECT_EQ(-1, read(mesh, "v 0 0 0\nv 1 0 0\nf 1 2\n"));
+    EXPECT_EQ(-1, read(mesh, "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 0 1 2\n"));
+    EXPECT_EQ(-1, read(mesh, "v 0 0 0\nv 1 0 0\nv 0 1 0\nf -4 1 2\n"));
+    EXPECT_EQ(-1, read(mesh, "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n"));
+
+    MeshReader reader;
+    EXPECT_EQ(-1, reader.read_mesh(mesh, "/nonexistent/mesh.obj"));
+}
+
+
+TEST_F(MeshReaderTest, BinaryPly)
+{
+    for (int big_endian = 0; big_endian < 2; big_endian++) {
+        std::string contents = "ply\n";
+        contents += big_endian ? "format binary_big_endian 1.0\n" : "format binary_little_endian 1.0\n";
+        contents += "comment Four vertices, with normals, and a quad.\n"
+                    "element vertex 4\n"
+                    "property float x\n"
+                    "property float y\n"
+                    "property double z\n"
+                    "property uchar flags\n"
+                    "property float nx\n"
+                    "property float ny\n"
+                    "property float nz\n"
+                    "element face 2\n"
+                    "property list uchar int vertex_indices\n"
+                    "property short extra\n"
+                    "element edge 1\n"
+                    "property list uint16 uint8 ends\n"
+                    "end_header\n";
+        for (int i = 0; i < 4; i++) {
+            append<float>(contents, i & 1, big_endian);
+            append<float>(contents, i >> 1, big_endian);
+            append<double>(contents, 0.5 * i, big_endian);
+            append<uint8_t>(contents, 0xff, big_endian);
+            append<float>(contents, 0, big_endian);
+            append<float>(contents, 0.6, big_endian);
+            append<float>(contents, 0.8, big_endian);
+        }
+        append<uint8_t>(contents, 4, big_endian);
+        append<int32_t>(contents, 0, big_endian);
+        append<int32_t>(contents, 1, big_endian);
+        append<int32_t>(contents, 3, big_endian);
+        append<int32_t>(contents, 2, big_endian);
+        append<int16_t>(contents, -1, big_endian);
+        append<uint8_t>(contents, 3, big_endian);
+        append<int32_t>(contents, 3, big_endian);
+        append<int32_t>(contents, 1, big_endian);
+        append<int32_t>(contents, 0, big_endian);
+        append<int16_t>(contents, -1, big_endian);
+        append<uint16_t>(contents, 2, big_endian);
+        append<uint8_t>(contents, 0, big_endian);
+        append<uint8_t>(contents, 1, big_endian);
+
+        TriangleMesh mesh;
+        ASSERT_EQ(3, read(mesh, contents, 2 + big_endian));
+        ASSERT_EQ(4u, mesh.get_nvertices());
+        expect_vertex(Vector3(1, 1, 1.5), mesh.get_vertices()[3]);
+
+        const unsigned int expected[] = { 0, 1, 3, 0, 3, 2, 3, 1, 0 };
+        for (unsigned int i = 0; i < 9; i++) {
+            EXPECT_EQ(expected[i], mesh.get_indices()[i]);
+        }
+
+        // The normals are interpolated, so they're the same everywhere.
+        Intersection hit;
+        ASSERT_TRUE(mesh.intersect(Ray(Vector3(0.5, 0.25, 10), Vector3(0, 0, -1)), 0.0, 100.0, hit));
+        expect_vertex(Vector3(0, 0.6, 0.8), mesh.compute_hit_normal(hit, Vector3(0.5, 0.25, 0.5)));
+
+        // Chopping off the edge and the last byte of the faces leaves the last face incomplete.
+        EXPECT_EQ(-1, read(mesh, contents.substr(0, contents.size() - 4 - 1)));
+    }
+}
+
+
+TEST_F(MeshReaderTest, PlyErrors)
+{
+    TriangleMesh mesh;
+    EXPECT_EQ(-1, read(mesh, "ply\nformat ascii 1.0\nelement vertex 0\nproperty float x\nend_header\n"));
+    EXPECT_EQ(-1, read(mesh, "ply\nformat binary_little_endian 1.0\nelement vertex 1\nproperty vec3 x\n"
+                             "end_header\n"));
+    EXPECT_EQ(-1, read(mesh, "ply\nformat binary_little_endian 1.0\nelement vertex 1\nproperty float x\n"
+                             "end_header\n0000"));
+    EXPECT_EQ(-1, read(mesh, "ply\nformat binary_little_endian 1.0\nelement vertex 2\nproperty float x\n"
+                             "property float y\nproperty float z\nend_header\n"));
+    EXPECT_EQ(-1, read(mesh, "ply\nformat binary_little_endian 1.0\nelement vertex 0\n"));
+}
@@ -0,0 +1,132 @@
+/* test_reader_text.cc
+ *
+ * Unit tests for the reader_text module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "light.h"
+#include "reader_text.h"
+#include "scene.h"
+
+
+class TextReaderTest
+    : public ::testing::Test
+{
+public:
+    virtual void TearDown();
+
+protected:
+    int read(const std::string &contents);
+
+    std::string filename;
+    Scene scene;
+};
+
+
+void
+TextReaderTest::TearDown()
+{
+    if (!filename.empty()) {
+        unlink(filename.c_str());
+    }
+}
+
+
+/*
+ * Write contents to a temporary file and read it into scene.
+ */
+int
+TextReaderTest::read(const std::string &contents)
+{
+    TearDown();
+
+    char name[] = "/tmp/charles_test_XXXXXX";
+    int fd = mkstemp(name);
+    EXPECT_NE(-1, fd);
+    filename = name;
+    EXPECT_EQ((ssize_t)contents.size(), write(fd, contents.data(), contents.size()));
+    close(fd);
+
+    TextReader reader;
+    return reader.read_scene(scene, filename);
+}
+
+
+TEST_F(TextReaderTest, ReadsStatements)
+{
+    int n = read("# A comment.\n"
+                 "render width 320 height 200 max-depth 3\n"
+                 "\n"
+                 "ambient intensity 0.5\n"
+                 "material red diffuse-color 1 0 0   # trailing comment\n"
+                 "sphere center 0 0 0 radius 2 material red\n"
+                 "  plane normal 0 1 0\n"
+                 "light origin 0 10 0\n"
+                 "camera orthographic origin 0 0 -10\n");
+    EXPECT_EQ(7, n);
+    EXPECT_EQ(320, scene.get_width());
+    EXPECT_EQ(200, scene.get_height());
+    EXPECT_EQ(3, scene.get_max_depth());
+    EXPECT_FLOAT_EQ(0.5, scene.get_ambient().get_intensity());
+    EXPECT_NE((Camera *)NULL, scene.get_camera());
+}
+
+
+TEST_F(TextReaderTest, EmptyFile)
+{
+    EXPECT_EQ(0, read(""));
+    EXPECT_EQ(0, read("# Nothing here.\n\n   \n"));
+}
+
+
+TEST_F(TextReaderTest, NoTrailingNewline)
+{
+    EXPECT_EQ(1, read("render width 10"));
+    EXPECT_EQ(10, scene.get_width());
+}
+
+
+TEST_F(TextReaderTest, RenderSettings)
+{
+    EXPECT_EQ(1, read("render threads 0 tile-size 16\n"));
+    EXPECT_EQ(0u, scene.get_nthreads());
+    EXPECT_EQ(16, scene.get_tile_size());
+    EXPECT_EQ(1, read("render threads 3\n"));
+    EXPECT_EQ(3u, scene.get_nthreads());
+}
+
+
+TEST_F(TextReaderTest, Errors)
+{
+    EXPECT_EQ(-1, read("teapot\n"));
+    EXPECT_EQ(-1, read("sphere radius\n"));
+    EXPECT_EQ(-1, read("sphere radius big\n"));
+    EXPECT_EQ(-1, read("sphere radius 1 color 1 0 0\n"));
+    EXPECT_EQ(-1, read("sphere material undefined\n"));
+    EXPECT_EQ(-1, read("sphere radius -1\n"));
+    EXPECT_EQ(-1, read("material a\nmaterial a\n"));
+    EXPECT_EQ(-1, read("render width " + std::string(1000, '1') + "\n"));
+    EXPECT_EQ(-1, read("camera fisheye\n"));
+    EXPECT_EQ(-1, read("render threads -1\n"));
+    EXPECT_EQ(-1, read("render threads 4294967297\n"));
+    EXPECT_EQ(-1, read("render threads 100000\n"));
+    EXPECT_EQ(-1, read("render width 99999999999999999999\n"));
+    EXPECT_EQ(-1, read("render tile-size 0\n"));
+    EXPECT_EQ(-1, read("render tile-size -16\n"));
+}
+
+
+TEST(TextReaderMissingFileTest, Fails)
+{
+    Scene scene;
+    TextReader reader;
+    EXPECT_GT(0, reader.read_scene(scene, "/nonexistent/scene"));
+}
@@ -0,0 +1,271 @@
+/* test_scene.cc
+ *
+ * Unit tests for the scene module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "camera.h"
+#include "light.h"
+#include "material.h"
+#include "object_instance.h"
+#include "object_plane.h"
+#include "object_sphere.h"
+#include "scene.h"
+#include "transform.h"
+
+
+/*
+ * Render a tiny image from inside a mirrored sphere. Every ray bounces around the inside until it runs out of depth,
+ * picking up a little ambient light at each bounce.
+ */
+static Color
+render_mirror_ball(int max_depth)
+{
+    Scene scene;
+    scene.set_width(4);
+    scene.set_height(4);
+    scene.set_nthreads(1);
+    scene.set_max_depth(max_depth);
+    scene.get_ambient().set_intensity(1.0);
+
+    Material *mirror = new Material();
+    mirror->set_diffuse_color(Color(0.01, 0.01, 0.01));
+    mirror->set_diffuse_level(0.0);
+    mirror->set_specular_level(1.0);
+    scene.add_material(mirror);
+
+    Sphere *ball = new Sphere(Vector3(2, 2, -995), 10);
+    ball->set_material(mirror);
+    scene.add_shape(ball);
+    // Ambient light only counts once per light.
+    scene.add_light(new PointLight(Vector3(2, 2, -1000)));
+
+    scene.render();
+    return scene.get_pixels()[5];
+}
+
+
+TEST(SceneTest, DeepReflections)
+{
+    Color shallow = render_mirror_ball(1);
+    Color deep = render_mirror_ball(100);
+    Color deeper = render_mirror_ball(10000);
+
+    EXPECT_LT(shallow.red, deep.red);
+    EXPECT_LT(deep.red, deeper.red);
+    EXPECT_TRUE(std::isfinite(deeper.red));
+}
+
+
+/*
+ * Build a scene with a bit of everything: spheres, overlapping and not, a plane, reflections, and two lights, one of
+ * which some surfaces face away from. The spheres are stored in spheres, if it's given.
+ */
+static void
+build_test_scene(Scene &scene,
+                 std::vector<Sphere *> *spheres = NULL)
+{
+    scene.set_width(160);
+    scene.set_height(120);
+    scene.get_ambient().set_intensity(0.2);
+
+    Material *shiny = new Material();
+    shiny->set_diffuse_color(Color(1.0, 0.5, 0.25));
+    shiny->set_specular_level(0.7);
+    scene.add_material(shiny);
+    Material *dull = new Material();
+    dull->set_diffuse_color(Color(0.25, 0.5, 1.0));
+    dull->set_specular_level(0.1);
+    scene.add_material(dull);
+
+    for (int i = 0; i < 12; i++) {
+        Sphere *s = new Sphere(Vector3(15 + 12 * i, 40 + 5 * (i % 4), 10 * (i % 3)), 8 + i % 5);
+        s->set_material((i % 2) ? shiny : dull);
+        scene.add_shape(s);
+        if (spheres != NULL) {
+            spheres->push_back(s);
+        }
+    }
+    Plane *floor = new Plane(Vector3(0, 100, 0), Vector3(0, -1, 0.1).normalize());
+    floor->set_material(shiny);
+    scene.add_shape(floor);
+
+    scene.add_light(new PointLight(Vector3(80, -50, -100)));
+    scene.add_light(new PointLight(Vector3(0, 60, 50), Color::White, 0.5));
+}
+
+
+TEST(SceneTest, WavefrontMatchesDepthFirst)
+{
+    Scene depth_first;
+    build_test_scene(depth_first);
+    depth_first.set_nthreads(1);
+    depth_first.render();
+
+    // With and without sorting the reflection rays.
+    for (int sort = 0; sort < 2; sort++) {
+        Scene wavefront;
+        build_test_scene(wavefront);
+        wavefront.set_render_mode(Scene::RenderModeWavefront);
+        wavefront.set_ray_sorting(sort);
+        wavefront.set_nthreads(3);
+        wavefront.render();
+
+        const Color *expected = depth_first.get_pixels();
+        const Color *actual = wavefront.get_pixels();
+        for (int i = 0; i < 160 * 120; i++) {
+            EXPECT_EQ(expected[i].red, actual[i].red);
+            EXPECT_EQ(expected[i].green, actual[i].green);
+            EXPECT_EQ(expected[i].blue, actual[i].blue);
+        }
+    }
+}
+
+
+TEST(SceneTest, PerspectiveCameraRendersTheSameBothWays)
+{
+    Scene orthographic;
+    build_test_scene(orthographic);
+    orthographic.set_nthreads(1);
+    orthographic.render();
+
+    Scene scenes[2];
+    for (int i = 0; i < 2; i++) {
+        build_test_scene(scenes[i]);
+        PerspectiveCamera *camera = new PerspectiveCamera();
+        camera->set_origin(Vector3(80, 60, -150));
+        camera->set_width(Vector3::X);
+        camera->set_height(Vector3::Y);
+        camera->set_angle(50.0);
+        scenes[i].set_camera(camera);
+        scenes[i].set_render_mode(i ? Scene::RenderModeWavefront : Scene::RenderModeDepthFirst);
+        scenes[i].set_nthreads(2);
+        scenes[i].render();
+    }
+
+    int differences = 0;
+    for (int i = 0; i < 160 * 120; i++) {
+        const Color &expected = scenes[0].get_pixels()[i];
+        const Color &actual = scenes[1].get_pixels()[i];
+        EXPECT_EQ(expected.red, actual.red);
+        EXPECT_EQ(expected.green, actual.green);
+        EXPECT_EQ(expected.blue, actual.blue);
+        differences += (expected.red != orthographic.get_pixels()[i].red);
+    }
+    // The camera is used: the perspective view isn't the default orthographic one.
+    EXPECT_GT(differences, 160 * 120 / 10);
+}
+
+
+/*
+ * Move some of the spheres of the test scene, and grow one.
+ */
+static void
+move_test_spheres(std::vector<Sphere *> &spheres)
+{
+    spheres[0]->set_origin(Vector3(60, 20, 5));
+    spheres[5]->set_origin(spheres[5]->get_origin() + Vector3(-30, 10, 0));
+    spheres[9]->set_radius(15);
+}
+
+
+TEST(SceneTest, MovedShapesRenderLikeANewScene)
+{
+    Scene expected;
+    std::vector<Sphere *> expected_spheres;
+    build_test_scene(expected, &expected_spheres);
+    move_test_spheres(expected_spheres);
+    expected.set_nthreads(1);
+    expected.render();
+
+    // Refit, and rebuilt because refitting made the tree worse.
+    const float limits[] = { 100.0f, 1.0f };
+    for (float limit : limits) {
+        Scene moved;
+        std::vector<Sphere *> moved_spheres;
+        build_test_scene(moved, &moved_spheres);
+        moved.set_refit_limit(limit);
+        moved.set_nthreads(1);
+        moved.render();
+        move_test_spheres(moved_spheres);
+        moved.render();
+
+        for (int i = 0; i < 160 * 120; i++) {
+            EXPECT_EQ(expected.get_pixels()[i].red, moved.get_pixels()[i].red);
+            EXPECT_EQ(expected.get_pixels()[i].green, moved.get_pixels()[i].green);
+            EXPECT_EQ(expected.get_pixels()[i].blue, moved.get_pixels()[i].blue);
+        }
+    }
+}
+
+
+/*
+ * Render a grid of copies of a small cluster of spheres, either as instances of one group or as separate spheres.
+ */
+static void
+render_clusters(Scene &scene,
+                bool instanced)
+{
+    scene.set_width(160);
+    scene.set_height(120);
+    scene.set_nthreads(1);
+    scene.get_ambient().set_intensity(0.2);
+    scene.add_light(new PointLight(Vector3(80, -50, -100)));
+
+    Material *material = new Material();
+    material->set_diffuse_color(Color(1.0, 0.5, 0.25));
+    material->set_specular_level(0.5);
+    scene.add_material(material);
+
+    const Vector3 cluster[] = { Vector3(0, 0, 0), Vector3(6, 0, 2), Vector3(3, 5, -1) };
+    InstanceGroup *group = new InstanceGroup();
+    for (const Vector3 &c : cluster) {
+        Sphere *s = new Sphere(c, 3);
+        s->set_material(material);
+        group->add_shape(s);
+    }
+    scene.add_group(group);
+
+    for (int i = 0; i < 6; i++) {
+        for (int j = 0; j < 4; j++) {
+            Vector3 offset(15 + 25 * i, 15 + 28 * j, 3 * (i + j));
+            if (instanced) {
+                scene.add_shape(new Instance(group, Transform::translate(offset)));
+                continue;
+            }
+            for (const Vector3 &c : cluster) {
+                Sphere *s = new Sphere(c + offset, 3);
+                s->set_material(material);
+                scene.add_shape(s);
+            }
+        }
+    }
+    scene.render();
+}
+
+
+TEST(SceneTest, InstancesRenderLikeCopies)
+{
+    Scene copies, instances;
+    render_clusters(copies, false);
+    render_clusters(instances, true);
+
+    // Instances work in their group's space, so rounding can move the odd edge pixel.
+    int differences = 0;
+    for (int i = 0; i < 160 * 120; i++) {
+        const Color &expected = copies.get_pixels()[i];
+        const Color &actual = instances.get_pixels()[i];
+        if (fabsf(expected.red - actual.red) > 1e-3 || fabsf(expected.green - actual.green) > 1e-3 ||
+            fabsf(expected.blue - actual.blue) > 1e-3) {
+            differences++;
+        }
+    }
+    EXPECT_LT(differences, 160 * 120 / 200);
+}
@@ -0,0 +1,214 @@
+/* test_scene_cache.cc
+ *
+ * Unit tests for the scene_cache module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bvh.h"
+#include "camera.h"
+#include "light.h"
+#include "scene.h"
+#include "scene_cache.h"
+
+
+class SceneCacheTest
+    : public ::testing::Test
+{
+public:
+    virtual void SetUp();
+    virtual void TearDown();
+
+protected:
+    void write_file(const std::string &contents);
+
+    std::string filename;
+};
+
+
+void
+SceneCacheTest::SetUp()
+{
+    char name[] = "/tmp/charles_test_XXXXXX";
+    int fd = mkstemp(name);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    filename = name;
+
+    write_file("render width 64 height 48 max-depth 3 tile-size 8\n"
+               "ambient intensity 0.5\n"
+               "camera orthographic origin 0 0 -10 width 64 0 0 height 0 48 0\n"
+               "material red diffuse-color 1 0 0\n"
+               "sphere center 10 10 0 radius 5 material red\n"
+               "sphere center 30 20 0 radius 8\n"
+               "plane origin 0 40 0 normal 0 1 0 material red\n"
+               "light origin 0 20 -20\n");
+}
+
+
+void
+SceneCacheTest::TearDown()
+{
+    unlink(filename.c_str());
+    unlink(SceneCache::get_cache_filename(filename).c_str());
+}
+
+
+void
+SceneCacheTest::write_file(const std::string &contents)
+{
+    FILE *f = fopen(filename.c_str(), "w");
+    ASSERT_NE((FILE *)NULL, f);
+    fputs(contents.c_str(), f);
+    fclose(f);
+}
+
+
+TEST_F(SceneCacheTest, NoCache)
+{
+    Scene scene;
+    SceneCache cache;
+    EXPECT_GT(0, cache.read_scene(scene, filename));
+}
+
+
+TEST_F(SceneCacheTest, RendersLikeTheTextFile)
+{
+    Scene text_scene;
+    ASSERT_LE(0, text_scene.read(filename));
+    text_scene.set_nthreads(1);
+    text_scene.render();
+
+    Scene baked_scene;
+    ASSERT_EQ(0, baked_scene.bake(filename));
+
+    Scene cached_scene;
+    SceneCache cache;
+    // Two materials, counting the default one, two spheres, a plane, and a light.
+    EXPECT_EQ(6, cache.read_scene(cached_scene, filename));
+    EXPECT_EQ(64, cached_scene.get_width());
+    EXPECT_EQ(48, cached_scene.get_height());
+    EXPECT_EQ(3, cached_scene.get_max_depth());
+    EXPECT_EQ(8, cached_scene.get_tile_size());
+    EXPECT_FLOAT_EQ(0.5, cached_scene.get_ambient().get_intensity());
+    EXPECT_NE((Camera *)NULL, cached_scene.get_camera());
+
+    cached_scene.set_nthreads(1);
+    cached_scene.render();
+    const Color *expected = text_scene.get_pixels();
+    const Color *actual = cached_scene.get_pixels();
+    for (int i = 0; i < 64 * 48; i++) {
+        EXPECT_EQ(expected[i].red, actual[i].red);
+        EXPECT_EQ(expected[i].green, actual[i].green);
+        EXPECT_EQ(expected[i].blue, actual[i].blue);
+    }
+}
+
+
+TEST_F(SceneCacheTest, StaleCacheIsIgnored)
+{
+    Scene baked_scene;
+    ASSERT_EQ(0, baked_scene.bake(filename));
+
+    write_file("render width 32 height 16\n");
+
+    Scene cached_scene;
+    SceneCache cache;
+    EXPECT_GT(0, cache.read_scene(cached_scene, filename));
+    EXPECT_EQ(640, cached_scene.get_width());
+
+    // Scene::read falls back to the text file.
+    EXPECT_EQ(1, cached_scene.read(filename));
+    EXPECT_EQ(32, cached_scene.get_width());
+}
+
+
+TEST_F(SceneCacheTest, DamagedCacheIsIgnored)
+{
+    Scene baked_scene;
+    ASSERT_EQ(0, baked_scene.bake(filename));
+
+    // Cut the cache off partway through the BVH.
+    std::string cache_filename = SceneCache::get_cache_filename(filename);
+    FILE *f = fopen(cache_filename.c_str(), "r");
+    ASSERT_NE((FILE *)NULL, f);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    ASSERT_EQ(0, truncate(cache_filename.c_str(), size - 4));
+
+    Scene cached_scene;
+    SceneCache cache;
+    EXPECT_GT(0, cache.read_scene(cached_scene, filename));
+}
+
+
+TEST_F(SceneCacheTest, TooDeepBVHIsRejected)
+{
+    /*
+     * A spine of interior nodes, each with a leaf for its right child, is consistent in every other way but far deeper
+     * than traversal can follow. A cache holding one has to be turned away before it's traced.
+     */
+    const unsigned int depth = 200;
+    std::vector<BVH::Node> nodes(2 * depth + 1);
+    for (unsigned int i = 0; i < depth; i++) {
+        nodes[i].offset = depth + 1 + i;
+        nodes[i].nprims = 0;
+        nodes[i].axis = 0;
+    }
+    for (unsigned int i = depth; i < nodes.size(); i++) {
+        nodes[i].offset = 0;
+        nodes[i].nprims = 1;
+        nodes[i].axis = 0;
+    }
+    unsigned int index = 0;
+
+    BVH bvh;
+    EXPECT_FALSE(bvh.adopt(nodes.data(), nodes.size(), &index, 1));
+    EXPECT_TRUE(bvh.is_empty());
+
+    // Cut down to what the stack can hold, the same spine is fine.
+    const unsigned int short_depth = BVH::StackSize - 1;
+    nodes.resize(2 * short_depth + 1);
+    for (unsigned int i = 0; i < short_depth; i++) {
+        nodes[i].offset = short_depth + 1 + i;
+        nodes[i].nprims = 0;
+    }
+    for (unsigned int i = short_depth; i < nodes.size(); i++) {
+        nodes[i].offset = 0;
+        nodes[i].nprims = 1;
+    }
+    EXPECT_TRUE(bvh.adopt(nodes.data(), nodes.size(), &index, 1));
+}
+
+
+TEST_F(SceneCacheTest, RepeatedBVHIndexIsRejected)
+{
+    Scene baked_scene;
+    ASSERT_EQ(0, baked_scene.bake(filename));
+
+    // The indices come last. Make the last sphere index repeat the one before it.
+    std::string cache_filename = SceneCache::get_cache_filename(filename);
+    FILE *f = fopen(cache_filename.c_str(), "r+b");
+    ASSERT_NE((FILE *)NULL, f);
+    unsigned int indices[2];
+    ASSERT_EQ(0, fseek(f, -(long)sizeof(indices), SEEK_END));
+    ASSERT_EQ(2u, fread(indices, sizeof(unsigned int), 2, f));
+    ASSERT_NE(indices[0], indices[1]);
+    indices[1] = indices[0];
+    ASSERT_EQ(0, fseek(f, -(long)sizeof(indices), SEEK_END));
+    ASSERT_EQ(2u, fwrite(indices, sizeof(unsigned int), 2, f));
+    fclose(f);
+
+    Scene cached_scene;
+    SceneCache cache;
+    EXPECT_GT(0, cache.read_scene(cached_scene, filename));
+}
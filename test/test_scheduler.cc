@@ -0,0 +1,104 @@
+/* test_scheduler.cc
+ *
+ * Unit tests for the scheduler module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "scheduler.h"
+
+
+/*
+ * Pull every tile out of the scheduler from nworkers threads at once and count how many times each pixel is covered.
+ */
+static std::vector<int>
+drain(TileScheduler &scheduler, int width, int height)
+{
+    std::vector<std::vector<Tile> > taken(scheduler.get_nworkers());
+    std::vector<std::thread> threads;
+    for (unsigned int w = 0; w < scheduler.get_nworkers(); w++) {
+        threads.push_back(std::thread([&scheduler, &taken, w]() {
+            Tile t;
+            while (scheduler.next_tile(w, t)) {
+                taken[w].push_back(t);
+            }
+        }));
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    std::vector<int> coverage(width * height, 0);
+    for (const std::vector<Tile> &tiles : taken) {
+        for (const Tile &t : tiles) {
+            for (int y = t.y; y < t.y + t.height; y++) {
+                for (int x = t.x; x < t.x + t.width; x++) {
+                    coverage[y * width + x]++;
+                }
+            }
+        }
+    }
+    return coverage;
+}
+
+
+TEST(TileSchedulerTest, CoversImageExactlyOnce)
+{
+    TileScheduler scheduler(100, 70, 16, 4);
+    EXPECT_EQ(7u * 5u, scheduler.get_ntiles());
+
+    std::vector<int> coverage = drain(scheduler, 100, 70);
+    for (int c : coverage) {
+        EXPECT_EQ(1, c);
+    }
+}
+
+
+TEST(TileSchedulerTest, IdleWorkersSteal)
+{
+    // Worker 0 never asks for tiles, so worker 1 has to steal all of worker 0's.
+    TileScheduler scheduler(64, 64, 8, 2);
+    Tile t;
+    unsigned int n = 0;
+    while (scheduler.next_tile(1, t)) {
+        n++;
+    }
+    EXPECT_EQ(scheduler.get_ntiles(), n);
+    EXPECT_FALSE(scheduler.next_tile(0, t));
+}
+
+
+TEST(TileSchedulerTest, MoreWorkersThanTiles)
+{
+    TileScheduler scheduler(10, 10, 32, 8);
+    EXPECT_EQ(1u, scheduler.get_ntiles());
+
+    std::vector<int> coverage = drain(scheduler, 10, 10);
+    for (int c : coverage) {
+        EXPECT_EQ(1, c);
+    }
+}
+
+
+TEST(TileSchedulerTest, InterleavedWorkersMoveDownTogether)
+{
+    TileScheduler scheduler(100, 70, 16, 3, true);
+    std::vector<int> coverage = drain(scheduler, 100, 70);
+    for (int c : coverage) {
+        EXPECT_EQ(1, c);
+    }
+
+    // Each worker's first tiles are dealt from the top row of tiles.
+    TileScheduler again(100, 70, 16, 3, true);
+    Tile t;
+    for (unsigned int w = 0; w < 3; w++) {
+        ASSERT_TRUE(again.next_tile(w, t));
+        EXPECT_EQ(0, t.y);
+        EXPECT_EQ((int)w * 16, t.x);
+    }
+}
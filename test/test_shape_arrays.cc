@@ -0,0 +1,105 @@
+/* test_shape_arrays.cc
+ *
+ * Unit tests for the shape_arrays module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "object_plane.h"
+#include "object_sphere.h"
+#include "shape_arrays.h"
+#include "test_helpers.h"
+
+
+TEST(SphereArrayTest, MatchesSphere)
+{
+    std::vector<Sphere *> spheres = random_spheres(50, 20, 0.5, 5);
+    SphereArray array;
+    for (Sphere *s : spheres) {
+        array.add(*s);
+    }
+    ASSERT_EQ(spheres.size(), array.size());
+
+    for (int i = 0; i < 200; i++) {
+        Vector3 o = random_vector(-30, 30);
+        Ray ray(o, (random_vector(-20, 20) - o).normalize());
+        float tmin = random_float(0, 5);
+        float tmax = random_float(5, 60);
+
+        for (unsigned int s = 0; s < spheres.size(); s++) {
+            Intersection hit;
+            float t = -1;
+            bool expected = spheres[s]->intersect(ray, tmin, tmax, hit);
+            EXPECT_EQ(expected, array.intersect(s, ray, tmin, tmax, t));
+            if (expected) {
+                EXPECT_EQ(hit.t, t);
+                EXPECT_EQ(spheres[s]->compute_normal(ray.parameterize(t)),
+                          array.compute_normal(s, ray.parameterize(t)));
+            }
+            EXPECT_EQ(spheres[s]->occluded(ray, tmin, tmax), array.occluded(s, ray, tmin, tmax));
+        }
+    }
+
+    AABB expected, actual = array.compute_bounds(3);
+    spheres[3]->compute_bounds(expected);
+    EXPECT_EQ(expected.min, actual.min);
+    EXPECT_EQ(expected.max, actual.max);
+    EXPECT_EQ(spheres[3], array.get_shape(3));
+
+    for (Sphere *s : spheres) {
+        delete s;
+    }
+}
+
+
+TEST(PlaneArrayTest, FindsNearestPlane)
+{
+    srand(42);
+
+    std::vector<Plane *> planes;
+    PlaneArray array;
+    for (int i = 0; i < 10; i++) {
+        planes.push_back(new Plane(random_vector(-20, 20), random_vector(-1, 1)));
+        array.add(*planes.back());
+    }
+    // One that all the rays below run parallel to.
+    planes.push_back(new Plane(Vector3(0, 0, 0), Vector3(0, 0, 1)));
+    array.add(*planes.back());
+
+    for (int i = 0; i < 200; i++) {
+        Vector3 d = random_vector(-1, 1);
+        d.z = 0;
+        Ray ray(random_vector(-30, 30), d.normalize());
+
+        float expected_t = INFINITY;
+        const Shape *expected_shape = NULL;
+        for (Plane *p : planes) {
+            Intersection hit;
+            if (p->intersect(ray, 0.0, expected_t, hit)) {
+                expected_t = hit.t;
+                expected_shape = p;
+            }
+        }
+
+        float t = INFINITY;
+        unsigned int index;
+        bool found = array.intersect(ray, 0.0, t, index);
+        EXPECT_EQ(expected_shape != NULL, found);
+        EXPECT_EQ(expected_t, t);
+        if (found) {
+            EXPECT_EQ(expected_shape, array.get_shape(index));
+        }
+        EXPECT_EQ(found, array.occluded(ray, 0.0, INFINITY));
+    }
+
+    for (Plane *p : planes) {
+        delete p;
+    }
+}
@@ -0,0 +1,106 @@
+/* test_sphere_kernels.cc
+ *
+ * Unit tests for the sphere_kernels module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "sphere_kernels.h"
+#include "test_helpers.h"
+
+
+class SphereKernelTest
+    : public ::testing::Test
+{
+public:
+    virtual void SetUp();
+
+protected:
+    std::vector<float> cx, cy, cz, radius;
+    SphereData data;
+};
+
+
+void
+SphereKernelTest::SetUp()
+{
+    srand(42);
+    for (int i = 0; i < 64; i++) {
+        Vector3 c = random_vector(-20, 20);
+        cx.push_back(c.x);
+        cy.push_back(c.y);
+        cz.push_back(c.z);
+        radius.push_back(random_float(0.5, 5));
+    }
+    // Two copies of the same sphere, to check which one a tie goes to.
+    cx.push_back(cx[0]);
+    cy.push_back(cy[0]);
+    cz.push_back(cz[0]);
+    radius.push_back(radius[0]);
+
+    SphereData d = { cx.data(), cy.data(), cz.data(), radius.data() };
+    data = d;
+}
+
+
+TEST_F(SphereKernelTest, BestKernelIsListed)
+{
+    std::vector<const SphereKernel *> kernels = get_sphere_kernels();
+    ASSERT_LT(0U, kernels.size());
+    EXPECT_EQ(1U, kernels.front()->width);
+    EXPECT_EQ(kernels.back(), &get_best_sphere_kernel());
+}
+
+
+TEST_F(SphereKernelTest, KernelsMatchScalarCode)
+{
+    std::vector<const SphereKernel *> kernels = get_sphere_kernels();
+
+    for (int i = 0; i < 500; i++) {
+        // Batches of every size up to a little more than the widest kernel, so the partial batches get tested too.
+        unsigned int n = 1 + i % 20;
+        std::vector<unsigned int> prims;
+        for (unsigned int j = 0; j < n; j++) {
+            prims.push_back(rand() % cx.size());
+        }
+        if (i % 5 == 0) {
+            prims[0] = 0;
+            prims[n - 1] = cx.size() - 1;
+        }
+
+        Vector3 o = random_vector(-30, 30);
+        Ray ray(o, (random_vector(-20, 20) - o).normalize());
+        float tmin = random_float(0, 5);
+        float tmax = random_float(5, 60);
+
+        // Test them one at a time, the way the SphereKernel interface says it should behave.
+        float expected_t = tmax;
+        unsigned int expected_index = ~0U;
+        bool expected_occluded = false;
+        for (unsigned int p : prims) {
+            float t;
+            if (intersect_sphere(data, p, ray, tmin, expected_t, t)) {
+                expected_t = t;
+                expected_index = p;
+            }
+            expected_occluded = expected_occluded || occluded_sphere(data, p, ray, tmin, tmax);
+        }
+
+        for (const SphereKernel *k : kernels) {
+            SCOPED_TRACE(k->name);
+            float t = tmax;
+            unsigned int index = ~0U;
+            EXPECT_EQ(expected_index != ~0U, k->intersect(data, prims.data(), n, ray, tmin, t, index));
+            EXPECT_EQ(expected_t, t);
+            EXPECT_EQ(expected_index, index);
+            EXPECT_EQ(expected_occluded, k->occluded(data, prims.data(), n, ray, tmin, tmax));
+        }
+    }
+}
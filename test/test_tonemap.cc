@@ -0,0 +1,300 @@
+/* test_tonemap.cc
+ *
+ * Unit tests for the tonemap module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "light.h"
+#include "material.h"
+#include "object_sphere.h"
+#include "scene.h"
+#include "test_helpers.h"
+#include "tonemap.h"
+#include "writer.h"
+
+
+namespace {
+
+/*
+ * A Writer that keeps the image it's streamed, and checks that every pixel arrives exactly once.
+ */
+class RecordingWriter
+    : public Writer
+{
+public:
+    int
+    write_scene(const Scene &scene, const std::string &filename)
+    {
+        return -1;
+    }
+
+    bool
+    can_stream()
+        const
+    {
+        return true;
+    }
+
+    bool
+    begin_image(const std::string &filename,
+                int w,
+                int h)
+    {
+        width = w;
+        pixels.assign(w * h, Color(-1, -1, -1));
+        nwrites.assign(w * h, 0);
+        return true;
+    }
+
+    void
+    write_tile(int x,
+               int y,
+               int w,
+               int h,
+               const Color *tile)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int r = 0; r < h; r++) {
+            for (int i = 0; i < w; i++) {
+                pixels[(y + r) * width + x + i] = tile[r * w + i];
+                nwrites[(y + r) * width + x + i]++;
+            }
+        }
+    }
+
+    int
+    end_image()
+    {
+        for (int n : nwrites) {
+            EXPECT_EQ(1, n);
+        }
+        return 1;
+    }
+
+    std::mutex mutex;
+    int width;
+    std::vector<Color> pixels;
+    std::vector<int> nwrites;
+};
+
+
+float
+map_one(const ToneMapper &mapper,
+        float value)
+{
+    Color c(value, value, value);
+    mapper.map_row(0, 0, 1, &c, &c);
+    EXPECT_EQ(c.red, c.green);
+    EXPECT_EQ(c.red, c.blue);
+    return c.red;
+}
+
+} /* anonymous namespace */
+
+
+TEST(ToneMapperTest, ClampsWithoutEncoding)
+{
+    RecordingWriter writer;
+    ToneMapper mapper(writer);
+    mapper.set_srgb(false);
+    mapper.set_dither(false);
+
+    EXPECT_EQ(0.0f, map_one(mapper, 0.0));
+    EXPECT_EQ(0.25f, map_one(mapper, 0.25));
+    EXPECT_EQ(1.0f, map_one(mapper, 1.0));
+    EXPECT_EQ(1.0f, map_one(mapper, 7.5));
+    EXPECT_EQ(0.0f, map_one(mapper, -2.0));
+    EXPECT_EQ(0.0f, map_one(mapper, NAN));
+    EXPECT_EQ(1.0f, map_one(mapper, INFINITY));
+
+    Color c(0.1, 0.2, 0.3, 0.75);
+    mapper.map_row(0, 0, 1, &c, &c);
+    EXPECT_EQ(0.75f, c.alpha);
+
+    mapper.set_exposure(1.0);
+    EXPECT_EQ(0.5f, map_one(mapper, 0.25));
+    mapper.set_exposure(-2.0);
+    EXPECT_EQ(0.25f, map_one(mapper, 1.0));
+}
+
+
+TEST(ToneMapperTest, Operators)
+{
+    RecordingWriter writer;
+    ToneMapper mapper(writer);
+    mapper.set_srgb(false);
+    mapper.set_dither(false);
+
+    mapper.set_operator(ToneMapper::OperatorReinhard);
+    EXPECT_FLOAT_EQ(0.5, map_one(mapper, 1.0));
+    EXPECT_FLOAT_EQ(0.75, map_one(mapper, 3.0));
+    EXPECT_GT(1.0, map_one(mapper, 1000.0));
+
+    mapper.set_operator(ToneMapper::OperatorACES);
+    EXPECT_FLOAT_EQ(2.54 / 3.16, map_one(mapper, 1.0));
+    EXPECT_EQ(1.0f, map_one(mapper, 100.0));
+    float prev = -1.0;
+    for (float v = 0.0; v < 20.0; v += 0.01) {
+        const float mapped = map_one(mapper, v);
+        EXPECT_LE(prev, mapped) << v;
+        prev = mapped;
+    }
+}
+
+
+TEST(ToneMapperTest, SRGBMatchesTheFormula)
+{
+    RecordingWriter writer;
+    ToneMapper mapper(writer);
+    mapper.set_dither(false);
+
+    for (int i = 0; i <= 10000; i++) {
+        const double v = i / 10000.0;
+        const double expected = (v <= 0.0031308) ? 12.92 * v : 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+        EXPECT_NEAR(expected, map_one(mapper, v), 2e-5) << v;
+    }
+}
+
+
+TEST(ToneMapperTest, DitheringAveragesOut)
+{
+    RecordingWriter writer;
+    ToneMapper mapper(writer);
+    mapper.set_srgb(false);
+
+    for (float v = 0.0; v <= 1.0; v += 0.0123) {
+        std::vector<Color> block(64, Color(v, v, v));
+        float sum = 0.0;
+        for (int y = 0; y < 8; y++) {
+            mapper.map_row(0, y, 8, block.data() + y * 8, block.data() + y * 8);
+            for (int x = 0; x < 8; x++) {
+                const float level = block[y * 8 + x].red * 255;
+                EXPECT_EQ(level, roundf(level)) << "not a whole level";
+                EXPECT_LE(floorf(v * 255), roundf(level));
+                EXPECT_GE(ceilf(v * 255), roundf(level));
+                sum += roundf(level);
+            }
+        }
+        EXPECT_NEAR(v * 255, sum / 64, 1.0 / 64 + 1e-4) << v;
+    }
+}
+
+
+TEST(ToneMapperTest, BestKernelIsListed)
+{
+    std::vector<const ToneMapKernel *> kernels = get_tone_map_kernels();
+    ASSERT_LT(0U, kernels.size());
+    EXPECT_EQ(1U, kernels.front()->width);
+    EXPECT_EQ(kernels.back(), &get_best_tone_map_kernel());
+
+    RecordingWriter writer;
+    ToneMapper mapper(writer);
+    EXPECT_EQ(&get_best_tone_map_kernel(), &mapper.get_kernel());
+}
+
+
+TEST(ToneMapperTest, KernelsMatchScalarCode)
+{
+    std::vector<const ToneMapKernel *> kernels = get_tone_map_kernels();
+
+    // Colors from well below black to well above white, and some that aren't numbers at all.
+    srand(42);
+    std::vector<Color> in(101);
+    for (Color &c : in) {
+        c = Color(random_float(-1, 4), random_float(-1, 4), random_float(0, 1), random_float(0, 1));
+    }
+    in[3].red = NAN;
+    in[10].green = INFINITY;
+    in[17].blue = -INFINITY;
+    in[30] = Color(1e30, 0, -0.0);
+    in[41] = Color(1, 1, 1);
+
+    const ToneMapper::Operator ops[] = {
+        ToneMapper::OperatorClamp, ToneMapper::OperatorReinhard, ToneMapper::OperatorACES
+    };
+    RecordingWriter writer;
+    ToneMapper mapper(writer);
+    for (ToneMapper::Operator op : ops) {
+        for (int settings = 0; settings < 4; settings++) {
+            mapper.set_operator(op);
+            mapper.set_srgb(settings & 1);
+            mapper.set_dither(settings & 2);
+            mapper.set_exposure(settings - 1.5);
+
+            // Rows starting at different columns and of every width up to a little more than the widest kernel, so
+            // the leftover pixels and the dither pattern's offsets get tested too.
+            for (int x = 0; x < 8; x++) {
+                for (int width = 0; width <= 20; width++) {
+                    std::vector<Color> expected(width), actual(width);
+                    mapper.set_kernel(*kernels.front());
+                    mapper.map_row(x, x + 3, width, in.data() + x * 10, expected.data());
+                    for (const ToneMapKernel *kernel : kernels) {
+                        mapper.set_kernel(*kernel);
+                        mapper.map_row(x, x + 3, width, in.data() + x * 10, actual.data());
+                        EXPECT_EQ(0, memcmp(expected.data(), actual.data(), width * sizeof(Color)))
+                            << kernel->name << " op " << op << " settings " << settings << " at " << x << " width "
+                            << width;
+                    }
+                }
+            }
+
+            // And a whole row, mapped in place.
+            std::vector<Color> expected(in.size()), actual = in;
+            mapper.set_kernel(*kernels.front());
+            mapper.map_row(5, 1, in.size(), in.data(), expected.data());
+            mapper.set_kernel(*kernels.back());
+            mapper.map_row(5, 1, in.size(), actual.data(), actual.data());
+            EXPECT_EQ(0, memcmp(expected.data(), actual.data(), in.size() * sizeof(Color))) << kernels.back()->name;
+        }
+    }
+}
+
+
+TEST(ToneMapperTest, FeedsAnyWriter)
+{
+    Scene scene;
+    scene.set_width(60);
+    scene.set_height(45);
+    scene.set_tile_size(16);
+    scene.get_ambient().set_intensity(1.0);
+    Material *white = new Material();
+    scene.add_material(white);
+    Sphere *s = new Sphere(Vector3(30, 20, 0), 15);
+    s->set_material(white);
+    scene.add_shape(s);
+    scene.add_light(new PointLight(Vector3(30, -50, -100)));
+    scene.set_nthreads(1);
+    scene.render();
+
+    RecordingWriter writer;
+    ToneMapper mapper(writer);
+    mapper.set_operator(ToneMapper::OperatorACES);
+    mapper.set_exposure(0.5);
+    std::vector<Color> expected(60 * 45);
+    for (int y = 0; y < 45; y++) {
+        mapper.map_row(0, y, 60, scene.get_pixels() + y * 60, expected.data() + y * 60);
+    }
+
+    // Whole scenes go through in bands, and streamed renders a tile or wave at a time, all landing in the same place.
+    mapper.set_nthreads(3);
+    EXPECT_EQ(1, mapper.write_scene(scene, "unused"));
+    EXPECT_EQ(0, memcmp(expected.data(), writer.pixels.data(), expected.size() * sizeof(Color)));
+
+    const Scene::RenderMode modes[] = { Scene::RenderModeDepthFirst, Scene::RenderModeWavefront };
+    for (Scene::RenderMode mode : modes) {
+        scene.set_render_mode(mode);
+        scene.set_nthreads(3);
+        EXPECT_EQ(1, scene.render(mapper, "unused"));
+        EXPECT_EQ(0, memcmp(expected.data(), writer.pixels.data(), expected.size() * sizeof(Color))) << mode;
+    }
+}
@@ -0,0 +1,73 @@
+/* test_transform.cc
+ *
+ * Unit tests for the transform module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "transform.h"
+
+
+static void
+expect_near(const Vector3 &expected,
+            const Vector3 &actual)
+{
+    EXPECT_NEAR(expected.x, actual.x, 1e-4);
+    EXPECT_NEAR(expected.y, actual.y, 1e-4);
+    EXPECT_NEAR(expected.z, actual.z, 1e-4);
+}
+
+
+TEST(TransformTest, ComposesRightToLeft)
+{
+    Transform t = Transform::translate(Vector3(1, 2, 3)) * Transform::rotate(Vector3::Z, M_PI / 2) *
+                  Transform::scale(2);
+    expect_near(Vector3(1, 4, 3), t.transform_point(Vector3(1, 0, 0)));
+    expect_near(Vector3(0, 2, 0), t.transform_vector(Vector3(1, 0, 0)));
+    expect_near(Vector3(1, 2, 3), t.get_translation());
+}
+
+
+TEST(TransformTest, InverseUndoesTransform)
+{
+    Transform t = Transform::translate(Vector3(-4, 0.5, 7)) * Transform::rotate(Vector3(1, 1, 0), 0.7) *
+                  Transform::scale(Vector3(1, 3, 0.25));
+    Transform inverse;
+    ASSERT_TRUE(t.invert(inverse));
+
+    const Vector3 p(2, -3, 5);
+    expect_near(p, inverse.transform_point(t.transform_point(p)));
+    expect_near(p, (t * inverse).transform_point(p));
+
+    // Flattening space can't be undone. inverse is left alone.
+    EXPECT_FALSE(Transform::scale(Vector3(1, 0, 1)).invert(inverse));
+    expect_near(p, inverse.transform_point(t.transform_point(p)));
+}
+
+
+TEST(TransformTest, BoundsHoldEveryCorner)
+{
+    Transform t = Transform::translate(Vector3(10, 0, 0)) * Transform::rotate(Vector3(0, 1, 1), 1.1) *
+                  Transform::scale(Vector3(2, 1, 0.5));
+    AABB box(Vector3(-1, -2, -3), Vector3(1, 2, 3));
+    AABB bounds = t.transform_bounds(box);
+
+    for (int i = 0; i < 8; i++) {
+        Vector3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y,
+                       (i & 4) ? box.max.z : box.min.z);
+        Vector3 p = t.transform_point(corner);
+        EXPECT_LE(bounds.min.x - 1e-4, p.x);
+        EXPECT_LE(bounds.min.y - 1e-4, p.y);
+        EXPECT_LE(bounds.min.z - 1e-4, p.z);
+        EXPECT_GE(bounds.max.x + 1e-4, p.x);
+        EXPECT_GE(bounds.max.y + 1e-4, p.y);
+        EXPECT_GE(bounds.max.z + 1e-4, p.z);
+    }
+
+    EXPECT_TRUE(t.transform_bounds(AABB()).is_empty());
+}
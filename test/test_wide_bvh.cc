@@ -0,0 +1,220 @@
+/* test_wide_bvh.cc
+ *
+ * Unit tests for the wide_bvh module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "bvh.h"
+#include "object_sphere.h"
+#include "test_helpers.h"
+#include "wide_bvh.h"
+
+
+class WideBVHTest
+    : public ::testing::Test
+{
+public:
+    virtual void SetUp();
+    virtual void TearDown();
+
+protected:
+    bool nearest(const Ray &ray, const unsigned int *prims, unsigned int n, float &tmax);
+    bool any(const Ray &ray, const unsigned int *prims, unsigned int n, float tmin, float tmax);
+    void check_ray(const Ray &ray);
+
+    std::vector<Sphere *> spheres;
+    BVH bvh;
+    WideBVH wide;
+};
+
+
+void
+WideBVHTest::SetUp()
+{
+    // Whole-number centers and radii put lots of box faces exactly in line with the axis-parallel rays below.
+    spheres = random_spheres(2000, 100, 1, 5, true);
+    bvh.build(sphere_bounds(spheres), 4);
+    wide.build(bvh);
+}
+
+
+void
+WideBVHTest::TearDown()
+{
+    for (Sphere *s : spheres) {
+        delete s;
+    }
+}
+
+
+bool
+WideBVHTest::nearest(const Ray &ray,
+                     const unsigned int *prims,
+                     unsigned int n,
+                     float &tmax)
+{
+    bool found = false;
+    for (unsigned int i = 0; i < n; i++) {
+        Intersection hit;
+        if (spheres[prims[i]]->intersect(ray, 0.0, tmax, hit)) {
+            tmax = hit.t;
+            found = true;
+        }
+    }
+    return found;
+}
+
+
+bool
+WideBVHTest::any(const Ray &ray,
+                 const unsigned int *prims,
+                 unsigned int n,
+                 float tmin,
+                 float tmax)
+{
+    for (unsigned int i = 0; i < n; i++) {
+        if (spheres[prims[i]]->occluded(ray, tmin, tmax)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*
+ * Trace ray through both trees, and check that they agree on the nearest hit, and on whether anything is hit before
+ * it or before a bit after it.
+ */
+void
+WideBVHTest::check_ray(const Ray &ray)
+{
+    float expected = INFINITY, actual = INFINITY;
+    bool expected_found = bvh.intersect_leaves(ray, 0.0, expected,
+                                               [&](const unsigned int *prims, unsigned int n, float, float &tmax) {
+        return nearest(ray, prims, n, tmax);
+    });
+    bool actual_found = wide.intersect_leaves(ray, 0.0, actual,
+                                              [&](const unsigned int *prims, unsigned int n, float, float &tmax) {
+        return nearest(ray, prims, n, tmax);
+    });
+    EXPECT_EQ(expected_found, actual_found);
+    EXPECT_EQ(expected, actual);
+
+    auto occluded_leaf = [&](const unsigned int *prims, unsigned int n, float tmin, float tmax) {
+        return any(ray, prims, n, tmin, tmax);
+    };
+    const float limits[] = { expected * 0.5f, expected + 1.0f, INFINITY };
+    for (float limit : limits) {
+        EXPECT_EQ(bvh.occluded_leaves(ray, 0.0, limit, occluded_leaf),
+                  wide.occluded_leaves(ray, 0.0, limit, occluded_leaf));
+    }
+}
+
+
+TEST_F(WideBVHTest, NodesAreCacheLineAligned)
+{
+    ASSERT_FALSE(wide.is_empty());
+    EXPECT_EQ(0u, (uintptr_t)wide.get_nodes() % 64);
+    EXPECT_EQ(0u, sizeof(WideBVH::Node) % 64);
+    EXPECT_LT(wide.get_nnodes(), bvh.get_nnodes());
+}
+
+
+TEST_F(WideBVHTest, EveryLeafIsReachedOnce)
+{
+    std::vector<int> seen(spheres.size(), 0);
+    const WideBVH::Node *nodes = wide.get_nodes();
+    for (unsigned int i = 0; i < wide.get_nnodes(); i++) {
+        for (unsigned int c = 0; c < WideBVH::Width; c++) {
+            for (unsigned int j = 0; j < nodes[i].nprims[c]; j++) {
+                seen[bvh.get_indices()[nodes[i].child[c] + j]]++;
+            }
+        }
+    }
+    for (unsigned int i = 0; i < spheres.size(); i++) {
+        EXPECT_EQ(1, seen[i]);
+    }
+}
+
+
+TEST_F(WideBVHTest, HitsMatchBinaryTree)
+{
+    for (int i = 0; i < 2000; i++) {
+        Vector3 o(random_float(-150, 150), random_float(-150, 150), random_float(-150, 150));
+        Vector3 target(random_float(-100, 100), random_float(-100, 100), random_float(-100, 100));
+        check_ray(Ray(o, (target - o).normalize()));
+    }
+}
+
+
+TEST_F(WideBVHTest, AxisParallelHitsMatchBinaryTree)
+{
+    // Rays parallel to two axes, some lying exactly in the faces of boxes, including negative zero directions.
+    const Vector3 directions[] = { Vector3::X, Vector3::Y, Vector3::Z, -Vector3::X, -Vector3::Y, -Vector3::Z };
+    for (int i = 0; i < 600; i++) {
+        Vector3 o(rand() % 300 - 150, rand() % 300 - 150, rand() % 300 - 150);
+        check_ray(Ray(o, directions[i % 6]));
+    }
+}
+
+
+TEST_F(WideBVHTest, RefitHitsMatchBinaryTree)
+{
+    std::vector<AABB> bounds(spheres.size());
+    std::vector<unsigned int> moved, changed;
+    for (unsigned int i = 0; i < spheres.size(); i++) {
+        if (i % 7 == 0) {
+            spheres[i]->set_origin(spheres[i]->get_origin() + Vector3(rand() % 21 - 10, rand() % 21 - 10, 0));
+            moved.push_back(i);
+        }
+        spheres[i]->compute_bounds(bounds[i]);
+    }
+    bvh.refit(bounds, moved, changed);
+    ASSERT_FALSE(changed.empty());
+    wide.refit(bvh, changed);
+
+    for (int i = 0; i < 2000; i++) {
+        Vector3 o(random_float(-150, 150), random_float(-150, 150), random_float(-150, 150));
+        Vector3 target(random_float(-100, 100), random_float(-100, 100), random_float(-100, 100));
+        check_ray(Ray(o, (target - o).normalize()));
+    }
+}
+
+
+TEST(WideBVHSmallTest, SingleLeaf)
+{
+    std::vector<AABB> bounds;
+    bounds.push_back(AABB(Vector3(-1, -1, -1), Vector3(1, 1, 1)));
+    BVH bvh;
+    bvh.build(bounds);
+    WideBVH wide;
+    wide.build(bvh);
+    EXPECT_EQ(1u, wide.get_nnodes());
+
+    float tmax = INFINITY;
+    bool found = wide.intersect_leaves(Ray(Vector3(0, 0, -5), Vector3::Z), 0.0, tmax,
+                                       [](const unsigned int *prims, unsigned int n, float tmin, float &tmax) {
+        tmax = 4.0;
+        return true;
+    });
+    EXPECT_TRUE(found);
+    EXPECT_EQ(4.0, tmax);
+
+    // Empty slots are never hit, whichever way the ray goes.
+    tmax = INFINITY;
+    EXPECT_FALSE(wide.intersect_leaves(Ray(Vector3(5, 5, 5), -Vector3::Z), 0.0, tmax,
+                                       [](const unsigned int *, unsigned int, float, float &) { return true; }));
+
+    bvh.clear();
+    wide.build(bvh);
+    EXPECT_TRUE(wide.is_empty());
+}
@@ -0,0 +1,323 @@
+/* test_writer_exr.cc
+ *
+ * Unit tests for the writer_exr module. Files are read back by a small decoder here, written from the OpenEXR file
+ * layout rather than from the writer.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+extern "C" {
+#include <zlib.h>
+}
+
+#include "basics.h"
+#include "light.h"
+#include "material.h"
+#include "object_plane.h"
+#include "object_sphere.h"
+#include "scene.h"
+#include "writer_exr.h"
+
+
+class EXRWriterTest
+    : public ::testing::Test
+{
+public:
+    virtual void SetUp();
+    virtual void TearDown();
+
+protected:
+    bool read_back(std::vector<float> &rgb, int &compression);
+    std::string read_file();
+
+    std::string filename;
+    Scene scene;
+    std::vector<float> expected;
+};
+
+
+/*
+ * Render a scene with smooth shading, hard edges, and pixels brighter than 1. It's a few lines over a multiple of 16,
+ * so ZIP's last block is short.
+ */
+void
+EXRWriterTest::SetUp()
+{
+    char name[] = "/tmp/charles_test_XXXXXX";
+    int fd = mkstemp(name);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    filename = name;
+
+    scene.set_width(120);
+    scene.set_height(85);
+    scene.set_nthreads(1);
+    scene.get_ambient().set_intensity(0.5);
+    Material *red = new Material();
+    red->set_diffuse_color(Color(1.0, 0.2, 0.1));
+    scene.add_material(red);
+    Sphere *s = new Sphere(Vector3(60, 40, 0), 30);
+    s->set_material(red);
+    scene.add_shape(s);
+    Plane *floor = new Plane(Vector3(0, 70, 0), Vector3(0, -1, 0.2).normalize());
+    floor->set_material(red);
+    scene.add_shape(floor);
+    scene.add_light(new PointLight(Vector3(60, -50, -100)));
+    scene.add_light(new PointLight(Vector3(0, 0, -100)));
+    scene.render();
+
+    const Color *pixels = scene.get_pixels();
+    for (int i = 0; i < 120 * 85; i++) {
+        expected.push_back(pixels[i].red);
+        expected.push_back(pixels[i].green);
+        expected.push_back(pixels[i].blue);
+    }
+}
+
+
+void
+EXRWriterTest::TearDown()
+{
+    unlink(filename.c_str());
+}
+
+
+std::string
+EXRWriterTest::read_file()
+{
+    std::string contents;
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file) {
+        char buffer[4096];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            contents.append(buffer, n);
+        }
+        fclose(file);
+    }
+    return contents;
+}
+
+
+namespace {
+
+uint32_t
+get_uint32(const std::string &data,
+           size_t offset)
+{
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | (unsigned char)data[offset + i];
+    }
+    return value;
+}
+
+
+/*
+ * Undo run length encoding.
+ */
+std::string
+rle_decode(const std::string &in)
+{
+    std::string out;
+    for (size_t i = 0; i < in.size();) {
+        const int count = (signed char)in[i++];
+        if (count < 0) {
+            out.append(in, i, -count);
+            i += -count;
+        }
+        else {
+            out.append(count + 1, in[i++]);
+        }
+    }
+    return out;
+}
+
+
+/*
+ * Undo the byte differences, then put the two halves of the bytes back together.
+ */
+std::string
+unpredict(std::string in)
+{
+    for (size_t i = 1; i < in.size(); i++) {
+        in[i] = (unsigned char)in[i - 1] + (unsigned char)in[i] - 128;
+    }
+    std::string out(in.size(), '\0');
+    const size_t half = (in.size() + 1) / 2;
+    for (size_t i = 0; i < in.size(); i++) {
+        out[i] = (i % 2 == 0) ? in[i / 2] : in[half + i / 2];
+    }
+    return out;
+}
+
+} /* anonymous namespace */
+
+
+/*
+ * Read the file back as RGB floats, checking its structure along the way.
+ */
+bool
+EXRWriterTest::read_back(std::vector<float> &rgb,
+                         int &compression)
+{
+    const std::string data = read_file();
+    if (data.size() < 8 || get_uint32(data, 0) != 20000630 || get_uint32(data, 4) != 2) {
+        ADD_FAILURE() << "not a single part scan line file";
+        return false;
+    }
+
+    // Walk the header, checking the attributes that matter.
+    int width = 0, height = 0;
+    compression = -1;
+    size_t p = 8;
+    std::string channels;
+    while (p < data.size() && data[p] != '\0') {
+        const std::string name = data.c_str() + p;
+        p += name.size() + 1;
+        const std::string type = data.c_str() + p;
+        p += type.size() + 1;
+        const uint32_t size = get_uint32(data, p);
+        p += 4;
+        if (name == "channels") {
+            EXPECT_EQ("chlist", type);
+            for (size_t c = p; data[c] != '\0'; c += 18) {
+                channels += data.substr(c, 1);
+                EXPECT_EQ('\0', data[c + 1]);
+                EXPECT_EQ(2u, get_uint32(data, c + 2)) << "channels should be floats";
+            }
+        }
+        else if (name == "compression") {
+            compression = data[p];
+        }
+        else if (name == "dataWindow") {
+            EXPECT_EQ(0u, get_uint32(data, p));
+            EXPECT_EQ(0u, get_uint32(data, p + 4));
+            width = get_uint32(data, p + 8) + 1;
+            height = get_uint32(data, p + 12) + 1;
+        }
+        else if (name == "lineOrder") {
+            EXPECT_EQ(0, data[p]);
+        }
+        p += size;
+    }
+    p++;
+    EXPECT_EQ("BGR", channels);
+    EXPECT_EQ(120, width);
+    EXPECT_EQ(85, height);
+
+    const int lines_per_block = (compression == EXRWriter::CompressionZIP) ? 16 : 1;
+    const int nblocks = (height + lines_per_block - 1) / lines_per_block;
+    rgb.assign(width * height * 3, 0.0);
+    size_t end = p + nblocks * 8;
+    for (int b = 0; b < nblocks; b++) {
+        const size_t offset = get_uint32(data, p + b * 8) | ((uint64_t)get_uint32(data, p + b * 8 + 4) << 32);
+        if (offset != end || offset + 8 > data.size()) {
+            ADD_FAILURE() << "block " << b << " is at " << offset << ", expected " << end;
+            return false;
+        }
+        const int y = get_uint32(data, offset);
+        const size_t size = get_uint32(data, offset + 4);
+        EXPECT_EQ(b * lines_per_block, y);
+        end = offset + 8 + size;
+
+        const int nlines = std::min(lines_per_block, height - y);
+        const size_t raw_size = nlines * width * 3 * sizeof(float);
+        std::string block = data.substr(offset + 8, size);
+        if (size < raw_size) {
+            if (compression == EXRWriter::CompressionRLE) {
+                block = unpredict(rle_decode(block));
+            }
+            else {
+                std::string out(raw_size, '\0');
+                uLongf out_size = raw_size;
+                EXPECT_EQ(Z_OK, uncompress((Bytef *)&out[0], &out_size, (const Bytef *)block.data(), block.size()));
+                block = unpredict(out);
+            }
+        }
+        if (block.size() != raw_size) {
+            ADD_FAILURE() << "block " << b << " is " << block.size() << " bytes, expected " << raw_size;
+            return false;
+        }
+
+        // Each line is blue, then green, then red.
+        const float *samples = (const float *)block.data();
+        for (int l = 0; l < nlines; l++) {
+            for (int c = 0; c < 3; c++) {
+                for (int x = 0; x < width; x++) {
+                    rgb[((y + l) * width + x) * 3 + (2 - c)] = samples[(l * 3 + c) * width + x];
+                }
+            }
+        }
+    }
+    EXPECT_EQ(data.size(), end);
+    return true;
+}
+
+
+TEST_F(EXRWriterTest, EveryCompressionReadsBack)
+{
+    int uncompressed = 0;
+    for (int c = EXRWriter::CompressionNone; c <= EXRWriter::CompressionZIP; c++) {
+        EXRWriter writer;
+        writer.set_compression((EXRWriter::Compression)c);
+        writer.set_nthreads(1 + c % 3);
+        const int nbytes = writer.write_scene(scene, filename);
+        EXPECT_EQ((int)read_file().size(), nbytes);
+        if (c == EXRWriter::CompressionNone) {
+            uncompressed = nbytes;
+        }
+        else {
+            EXPECT_GT(uncompressed, nbytes) << "compression " << c;
+        }
+
+        std::vector<float> actual;
+        int compression;
+        ASSERT_TRUE(read_back(actual, compression));
+        EXPECT_EQ(c, compression);
+        EXPECT_TRUE(actual == expected) << "compression " << c;
+    }
+}
+
+
+TEST_F(EXRWriterTest, StreamedRendersMatchWholeImages)
+{
+    EXRWriter writer;
+    ASSERT_LT(0, writer.write_scene(scene, filename));
+    const std::string whole = read_file();
+
+    scene.set_tile_size(16);
+    const Scene::RenderMode modes[] = { Scene::RenderModeDepthFirst, Scene::RenderModeWavefront };
+    for (Scene::RenderMode mode : modes) {
+        scene.set_render_mode(mode);
+        scene.set_nthreads(3);
+        ASSERT_LT(0, scene.render(writer, filename));
+        EXPECT_TRUE(read_file() == whole) << "mode " << mode;
+    }
+}
+
+
+TEST_F(EXRWriterTest, Errors)
+{
+    EXRWriter writer;
+    EXPECT_EQ(-1, writer.write_scene(scene, "/nonexistent/image.exr"));
+    EXPECT_EQ(-1, writer.end_image());
+
+    Scene unrendered;
+    EXPECT_EQ(-1, writer.write_scene(unrendered, filename));
+
+    ASSERT_TRUE(writer.begin_image(filename, 4, 4));
+    std::vector<Color> tile(4 * 2);
+    writer.write_tile(0, 0, 4, 2, tile.data());
+    EXPECT_EQ(-1, writer.end_image());
+}
@@ -0,0 +1,164 @@
+/* test_writer_pfm.cc
+ *
+ * Unit tests for the writer_pfm module.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "basics.h"
+#include "light.h"
+#include "material.h"
+#include "object_sphere.h"
+#include "scene.h"
+#include "writer_pfm.h"
+
+
+class PFMWriterTest
+    : public ::testing::Test
+{
+public:
+    virtual void SetUp();
+    virtual void TearDown();
+
+protected:
+    bool read_back(std::vector<float> &rgb);
+
+    std::string filename;
+    Scene scene;
+};
+
+
+/*
+ * Render a scene lit by enough lights that some pixels are well over 1.
+ */
+void
+PFMWriterTest::SetUp()
+{
+    char name[] = "/tmp/charles_test_XXXXXX";
+    int fd = mkstemp(name);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    filename = name;
+
+    scene.set_width(70);
+    scene.set_height(50);
+    scene.set_nthreads(1);
+    Material *white = new Material();
+    white->set_diffuse_color(Color::White);
+    scene.add_material(white);
+    Sphere *s = new Sphere(Vector3(35, 25, 0), 20);
+    s->set_material(white);
+    scene.add_shape(s);
+    scene.get_ambient().set_intensity(1.0);
+    scene.add_light(new PointLight(Vector3(35, -50, -100)));
+    scene.add_light(new PointLight(Vector3(0, 0, -100)));
+    scene.render();
+}
+
+
+void
+PFMWriterTest::TearDown()
+{
+    unlink(filename.c_str());
+}
+
+
+/*
+ * Read the file back, turning its rows right side up.
+ */
+bool
+PFMWriterTest::read_back(std::vector<float> &rgb)
+{
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (!file) {
+        ADD_FAILURE() << "couldn't open " << filename;
+        return false;
+    }
+    char type[3];
+    int width, height;
+    float scale;
+    bool ok = fscanf(file, "%2s %d %d %f", type, &width, &height, &scale) == 4 && fgetc(file) == '\n';
+    EXPECT_TRUE(ok);
+    EXPECT_STREQ("PF", type);
+    EXPECT_EQ(70, width);
+    EXPECT_EQ(50, height);
+    EXPECT_EQ(-1.0, scale);
+
+    rgb.resize(70 * 50 * 3);
+    for (int y = 49; ok && y >= 0; y--) {
+        ok = fread(rgb.data() + y * 70 * 3, sizeof(float), 70 * 3, file) == 70 * 3;
+    }
+    ok = ok && fgetc(file) == EOF;
+    fclose(file);
+    EXPECT_TRUE(ok);
+    return ok;
+}
+
+
+TEST_F(PFMWriterTest, KeepsEveryValue)
+{
+    PFMWriter writer;
+    EXPECT_EQ((int)strlen("PF\n70 50\n-1.0\n") + 70 * 50 * 12, writer.write_scene(scene, filename));
+
+    std::vector<float> rgb;
+    ASSERT_TRUE(read_back(rgb));
+    const Color *pixels = scene.get_pixels();
+    float brightest = 0.0;
+    for (int i = 0; i < 70 * 50; i++) {
+        EXPECT_EQ(pixels[i].red, rgb[i * 3 + 0]);
+        EXPECT_EQ(pixels[i].green, rgb[i * 3 + 1]);
+        EXPECT_EQ(pixels[i].blue, rgb[i * 3 + 2]);
+        brightest = std::max(brightest, rgb[i * 3]);
+    }
+    EXPECT_LT(1.5, brightest);
+}
+
+
+TEST_F(PFMWriterTest, StreamedRendersMatchWholeImages)
+{
+    std::vector<float> expected(70 * 50 * 3);
+    const Color *pixels = scene.get_pixels();
+    for (int i = 0; i < 70 * 50; i++) {
+        expected[i * 3 + 0] = pixels[i].red;
+        expected[i * 3 + 1] = pixels[i].green;
+        expected[i * 3 + 2] = pixels[i].blue;
+    }
+
+    PFMWriter writer;
+    scene.set_tile_size(16);
+    const Scene::RenderMode modes[] = { Scene::RenderModeDepthFirst, Scene::RenderModeWavefront };
+    for (Scene::RenderMode mode : modes) {
+        scene.set_render_mode(mode);
+        scene.set_nthreads(3);
+        ASSERT_LT(0, scene.render(writer, filename));
+
+        std::vector<float> actual;
+        ASSERT_TRUE(read_back(actual));
+        EXPECT_TRUE(actual == expected) << "mode " << mode;
+    }
+}
+
+
+TEST_F(PFMWriterTest, Errors)
+{
+    PFMWriter writer;
+    EXPECT_EQ(-1, writer.write_scene(scene, "/nonexistent/image.pfm"));
+    EXPECT_EQ(-1, writer.end_image());
+
+    Scene unrendered;
+    EXPECT_EQ(-1, writer.write_scene(unrendered, filename));
+
+    ASSERT_TRUE(writer.begin_image(filename, 4, 4));
+    std::vector<Color> tile(4 * 2);
+    writer.write_tile(0, 0, 4, 2, tile.data());
+    EXPECT_EQ(-1, writer.end_image());
+}
@@ -0,0 +1,229 @@
+/* test_writer_png.cc
+ *
+ * Unit tests for the writer_png module. Images are read back with libpng, so they're checked by a decoder that's
+ * independent of the writer.
+ *
+ * Eryn Wells <eryn@erynwells.me>
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+extern "C" {
+#include <png.h>
+}
+
+#include "basics.h"
+#include "light.h"
+#include "material.h"
+#include "object_plane.h"
+#include "object_sphere.h"
+#include "scene.h"
+#include "writer_png.h"
+
+
+class PNGWriterTest
+    : public ::testing::Test
+{
+public:
+    virtual void SetUp();
+    virtual void TearDown();
+
+protected:
+    bool read_back(std::vector<unsigned char> &rgb, unsigned int width = 400, unsigned int height = 300);
+
+    std::string filename;
+    Scene scene;
+};
+
+
+/*
+ * Render a scene big enough to need several strips, with smooth shading and hard edges for the filters to work on.
+ */
+void
+PNGWriterTest::SetUp()
+{
+    char name[] = "/tmp/charles_test_XXXXXX";
+    int fd = mkstemp(name);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    filename = name;
+
+    scene.set_width(400);
+    scene.set_height(300);
+    scene.set_nthreads(1);
+    scene.get_ambient().set_intensity(0.2);
+    Material *red = new Material();
+    red->set_diffuse_color(Color(1.0, 0.2, 0.1));
+    scene.add_material(red);
+    for (int i = 0; i < 5; i++) {
+        Sphere *s = new Sphere(Vector3(50 + 75 * i, 120 + 20 * (i % 2), 0), 30 + 5 * i);
+        s->set_material(red);
+        scene.add_shape(s);
+    }
+    Plane *floor = new Plane(Vector3(0, 250, 0), Vector3(0, -1, 0.2).normalize());
+    floor->set_material(red);
+    scene.add_shape(floor);
+    scene.add_light(new PointLight(Vector3(200, -100, -200)));
+    scene.render();
+}
+
+
+void
+PNGWriterTest::TearDown()
+{
+    unlink(filename.c_str());
+}
+
+
+/*
+ * Read the file back as 8 bit RGB.
+ */
+bool
+PNGWriterTest::read_back(std::vector<unsigned char> &rgb,
+                         unsigned int width,
+                         unsigned int height)
+{
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&image, filename.c_str())) {
+        ADD_FAILURE() << image.message;
+        return false;
+    }
+    EXPECT_EQ(width, image.width);
+    EXPECT_EQ(height, image.height);
+    image.format = PNG_FORMAT_RGB;
+    rgb.resize(PNG_IMAGE_SIZE(image));
+    if (!png_image_finish_read(&image, NULL, rgb.data(), 0, NULL)) {
+        ADD_FAILURE() << image.message;
+        return false;
+    }
+    return true;
+}
+
+
+TEST_F(PNGWriterTest, EveryFilterAndLevelReadsBack)
+{
+    std::vector<unsigned char> expected(400 * 300 * 3);
+    const Color *pixels = scene.get_pixels();
+    for (int i = 0; i < 400 * 300; i++) {
+        expected[i * 3 + 0] = std::min(pixels[i].red, 1.0f) * 255.0f + 0.5f;
+        expected[i * 3 + 1] = std::min(pixels[i].green, 1.0f) * 255.0f + 0.5f;
+        expected[i * 3 + 2] = std::min(pixels[i].blue, 1.0f) * 255.0f + 0.5f;
+    }
+
+    for (int filter = PNGWriter::FilterNone; filter <= PNGWriter::FilterAdaptive; filter++) {
+        for (int level = 0; level <= 9; level += 3) {
+            PNGWriter writer;
+            writer.set_filter((PNGWriter::Filter)filter);
+            writer.set_level(level);
+            writer.set_nthreads(1 + filter % 3);
+            int nbytes = writer.write_scene(scene, filename);
+            ASSERT_LT(0, nbytes);
+
+            std::vector<unsigned char> actual;
+            ASSERT_TRUE(read_back(actual));
+            EXPECT_TRUE(actual == expected) << "filter " << filter << ", level " << level;
+        }
+    }
+}
+
+
+TEST_F(PNGWriterTest, ThreadsDontChangeTheFile)
+{
+    std::vector<std::string> files;
+    for (unsigned int nthreads = 1; nthreads <= 4; nthreads++) {
+        PNGWriter writer;
+        writer.set_nthreads(nthreads);
+        int nbytes = writer.write_scene(scene, filename);
+        ASSERT_LT(0, nbytes);
+
+        FILE *file = fopen(filename.c_str(), "rb");
+        ASSERT_NE((FILE *)NULL, file);
+        std::string contents(nbytes, '\0');
+        EXPECT_EQ((size_t)nbytes, fread(&contents[0], 1, nbytes, file));
+        EXPECT_EQ(EOF, fgetc(file));
+        fclose(file);
+        files.push_back(contents);
+    }
+    for (size_t i = 1; i < files.size(); i++) {
+        EXPECT_TRUE(files[i] == files[0]);
+    }
+}
+
+
+TEST_F(PNGWriterTest, StreamedRendersMatchWholeImages)
+{
+    PNGWriter writer;
+    ASSERT_LT(0, writer.write_scene(scene, filename));
+    std::vector<unsigned char> expected;
+    ASSERT_TRUE(read_back(expected));
+
+    const Scene::RenderMode modes[] = { Scene::RenderModeDepthFirst, Scene::RenderModeWavefront };
+    for (Scene::RenderMode mode : modes) {
+        for (int nthreads = 1; nthreads <= 3; nthreads += 2) {
+            scene.set_render_mode(mode);
+            scene.set_nthreads(nthreads);
+            ASSERT_LT(0, scene.render(writer, filename));
+            EXPECT_FALSE(scene.is_rendered());
+
+            std::vector<unsigned char> actual;
+            ASSERT_TRUE(read_back(actual));
+            EXPECT_TRUE(actual == expected) << "mode " << mode << ", " << nthreads << " threads";
+        }
+    }
+}
+
+
+TEST_F(PNGWriterTest, ClampsAndRounds)
+{
+    const Color pixels[] = {
+        Color(0.0, 0.5, 1.0),
+        Color(1.5, 100.0, -0.25),
+        Color(0.2 / 255, 0.6 / 255, 254.4 / 255),
+        Color(NAN, -NAN, INFINITY),
+    };
+    const unsigned char expected[] = {
+        0, 128, 255,
+        255, 255, 0,
+        0, 1, 254,
+        0, 0, 255,
+    };
+
+    PNGWriter writer;
+    ASSERT_TRUE(writer.begin_image(filename, 4, 1));
+    writer.write_tile(0, 0, 4, 1, pixels);
+    ASSERT_LT(0, writer.end_image());
+
+    std::vector<unsigned char> actual;
+    ASSERT_TRUE(read_back(actual, 4, 1));
+    EXPECT_TRUE(actual == std::vector<unsigned char>(expected, expected + 12));
+}
+
+
+TEST_F(PNGWriterTest, Errors)
+{
+    PNGWriter writer;
+    EXPECT_EQ(-1, writer.write_scene(scene, "/nonexistent/image.png"));
+
+    Scene unrendered;
+    EXPECT_EQ(-1, writer.write_scene(unrendered, filename));
+
+    EXPECT_EQ(-1, scene.render(writer, "/nonexistent/image.png"));
+    EXPECT_EQ(-1, writer.end_image());
+
+    // A stream missing some of its rows can't be finished.
+    ASSERT_TRUE(writer.begin_image(filename, 4, 4));
+    std::vector<Color> tile(4 * 2);
+    writer.write_tile(0, 0, 4, 2, tile.data());
+    EXPECT_EQ(-1, writer.end_image());
+}